@@ -60,6 +60,8 @@ static void size_count(mpz_t out, const mpz_t n, int size, int perm)
     }
 }
 
+#ifndef RXE_CURSOR_WALK
+
 void rxe_comb_nitems(mpz_t out, const mpz_t n, int lo, int hi, int perm)
 {
     mpz_set_ui(out,0);
@@ -73,6 +75,8 @@ void rxe_comb_nitems(mpz_t out, const mpz_t n, int lo, int hi, int perm)
     mpz_clear(c);
 }
 
+#endif
+
 /* --------------------------- Decoding ----------------------------------- */
 
 // Decode index j into an unordered choice of 'size' members, ascending, using
@@ -154,6 +158,7 @@ static void decode_perm(mpz_t *digit, const mpz_t n, int size, mpz_t j)
 // when pos is past the end.
 static int comb_decode(struct rxe_node *node, const mpz_t pos)
 {
+    struct rxe_node_state *ns = NS(node);
     if (mpz_sgn(pos) < 0 || mpz_cmp(pos,node->nitems) >= 0) return 1;
     const mpz_t *n = (const mpz_t *)&node->rxe->nitems;
     mpz_t j,c;
@@ -165,11 +170,11 @@ static int comb_decode(struct rxe_node *node, const mpz_t pos)
         if (mpz_cmp(j,c) < 0) break;
         mpz_sub(j,j,c);
     }
-    node->rep_count = size;
+    ns->rep_count = size;
     if (size > 0) {
         if (rxe_repeat_reserve(node,size)) { mpz_clear(j); mpz_clear(c); return 1; }
-        if (node->comb_perm) decode_perm(node->rep_digit,*n,size,j);
-        else                 decode_comb(node->rep_digit,*n,size,j);
+        if (node->comb_perm) decode_perm(ns->rep_digit,*n,size,j);
+        else                 decode_comb(ns->rep_digit,*n,size,j);
     }
     mpz_clear(j);
     mpz_clear(c);
@@ -178,18 +183,22 @@ static int comb_decode(struct rxe_node *node, const mpz_t pos)
 
 /* --------------------------- Public API --------------------------------- */
 
+#ifndef RXE_CURSOR_WALK
+
 void rxe_comb_make(struct rxe_node *node, int lo, int hi, int perm)
 {
     node->is_comb   = 1;
     node->comb_perm = perm;
     node->rep_min   = lo;          // the size range lives in the repeat fields
     node->rep_max   = hi;
-    node->rep_count = 0;
-    node->rep_digit = NULL;
-    node->rep_len   = NULL;
-    node->rep_alloc = 0;
+    node->walk.rep_count = 0;
+    node->walk.rep_digit = NULL;
+    node->walk.rep_word  = NULL;
+    node->walk.rep_len   = NULL;
+    node->walk.rep_at    = NULL;
+    node->walk.rep_alloc = 0;
     node->is_inf    = 0;           // a choice over a finite set is finite
-    mpz_set_ui(node->comb_index,0);
+    mpz_set_ui(node->walk.comb_index,0);
     rxe_comb_nitems(node->nitems,node->rxe->nitems,lo,hi,perm);
     if (mpz_sgn(node->nitems) > 0) {
         mpz_t z;
@@ -199,22 +208,25 @@ void rxe_comb_make(struct rxe_node *node, int lo, int hi, int perm)
     }
 }
 
+#endif
+
 int rxe_comb_seek(struct rxe_node *node, const mpz_t pos)
 {
     if (comb_decode(node,pos)) return 1;
-    mpz_set(node->comb_index,pos);
+    mpz_set(NS(node)->comb_index,pos);
     return 0;
 }
 
 int rxe_comb_iterate(struct rxe_node *node)
 {
+    struct rxe_node_state *ns = NS(node);
     mpz_t next;
     int carry = 0;
     mpz_init(next);
-    mpz_add_ui(next,node->comb_index,1);
+    mpz_add_ui(next,ns->comb_index,1);
     if (mpz_cmp(next,node->nitems) >= 0) { mpz_set_ui(next,0); carry = 1; }
     comb_decode(node,next);
-    mpz_set(node->comb_index,next);
+    mpz_set(ns->comb_index,next);
     mpz_clear(next);
     return carry;
 }
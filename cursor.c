@@ -0,0 +1,172 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * cursor -- a walker that owns its position, so one parse serves many.
+ *
+ * rxe_seek and rxe_iterate keep where they are in the tree itself: the
+ * alternation, every node's iterator, every repetition's digits. That is what
+ * made them simple, and it is why a thread that wants its own walk has had to
+ * rxe_deep_clone the whole tree first -- on a pattern with tens of thousands of
+ * nodes, once per thread, bignums and all.
+ *
+ * A cursor is the position without the tree. When the expression has a plan,
+ * the position is the plan's digits and nothing else, and every cursor reads
+ * the one tree and the one plan, which stay hot in a shared cache instead of
+ * being copied per thread. Without a plan the tree walk runs as it always has,
+ * over the one shared tree, but with every field it writes -- the alternation
+ * and node chosen, the repetitions' digits, the scratch -- looked up in the
+ * cursor's own walk (struct rxe_walk) rather than in the tree. That lookup is
+ * a second build of the walk code, kept apart in walk.c.
+ *
+ * A cursor is also the context its own failures are reported in. The library's
+ * other reasons are per thread, which is enough for them; a cursor's is per
+ * cursor, so a walker can hand one to another thread and still ask it why.
+ */
+
+#include "rxe.h"
+#include "plan.h"
+
+struct rxe_cursor {
+    struct rxe *rxe;              // the shared expression, never written
+    struct rxe_walk *walk;        // where it stands in the tree, when there is
+                                  // no plan
+    struct rxe_plan *plan;        // the shared plan, when there is one
+    struct rxe_plan_state *st;    // ...and this cursor's digits in it
+    const char *reason;           // why the last call failed, or NULL
+};
+
+struct rxe_cursor *rxe_cursor_new(struct rxe *rxe)
+{
+    if (!rxe || rxe->status) return NULL;
+    struct rxe_cursor *cur = NEW(1,struct rxe_cursor);
+    if (!cur) return NULL;
+    cur->rxe = rxe;
+    cur->walk = NULL;
+    cur->plan = NULL;
+    cur->st = NULL;
+    cur->reason = NULL;
+    if (rxe->plan && rxe_plan_usable(rxe->plan)) {
+        cur->plan = rxe_plan_ref(rxe->plan);
+        cur->st = rxe_plan_state_new(cur->plan);
+    } else {
+        cur->walk = rxe_walk_new(rxe);
+    }
+    return cur;
+}
+
+void rxe_cursor_free(struct rxe_cursor *cur)
+{
+    if (!cur) return;
+    rxe_walk_free(cur->walk);
+    rxe_plan_state_free(cur->st);
+    rxe_plan_unref(cur->plan);
+    rxe_mem_free(cur);
+}
+
+int rxe_cursor_seek(struct rxe_cursor *cur, const mpz_t pos)
+{
+    int rc;
+    cur->reason = NULL;
+    if (mpz_sgn(pos) < 0) {
+        cur->reason = "negative index";
+        return 1;
+    }
+    if (cur->plan) {
+        rc = rxe_plan_seek(cur->plan,cur->st,pos);
+    } else {
+        // rxe_seek wants a mutable index, though it never changes it.
+        mpz_t p;
+        int was = rxe_check_overflow();
+        mpz_init_set(p,pos);
+        rc = rxe_walk_seek(cur->walk,cur->rxe,p);
+        mpz_clear(p);
+        if (rc && rxe_member_overflow) {
+            cur->reason = rxe_status_message(RXE_TOO_BIG);
+            rxe_member_overflow |= was;
+            return rc;
+        }
+        rxe_member_overflow |= was;
+    }
+    if (rc) cur->reason = "index past the end of the set";
+    return rc;
+}
+
+int rxe_cursor_iterate(struct rxe_cursor *cur)
+{
+    cur->reason = NULL;
+    if (cur->plan) return rxe_plan_iterate(cur->plan,cur->st);
+    return rxe_walk_iterate(cur->walk,cur->rxe);
+}
+
+// As rxe_advance. The plan keeps no index, so a sum that leaves the branch is
+// placed by reading the digits back and seeking.
+int rxe_cursor_advance(struct rxe_cursor *cur, long delta)
+{
+    cur->reason = NULL;
+    if (!cur->plan) {
+        if (!rxe_walk_advance(cur->walk,cur->rxe,delta)) return 0;
+    } else {
+        if (!rxe_plan_advance(cur->plan,cur->st,delta)) return 0;
+        mpz_t pos;
+        mpz_init(pos);
+        rxe_plan_index(cur->plan,cur->st,pos);
+        if (delta >= 0) mpz_add_ui(pos,pos,(unsigned long)delta);
+        else mpz_sub_ui(pos,pos,0UL - (unsigned long)delta);
+        int rc = mpz_sgn(pos) < 0 || rxe_plan_seek(cur->plan,cur->st,pos);
+        mpz_clear(pos);
+        if (!rc) return 0;
+    }
+    cur->reason = delta < 0 ? "index before the start of the set"
+                            : "index past the end of the set";
+    return 1;
+}
+
+char *rxe_cursor_current(char *str, int maxlen, struct rxe_cursor *cur)
+{
+    cur->reason = NULL;
+    if (cur->plan) {
+        if (maxlen <= 0) return str;
+        return rxe_plan_render(cur->plan,cur->st,str,maxlen);
+    }
+    // The thread's latch is read and then left as the caller had it, plus
+    // whatever this render raised, so a caller reading either one is right.
+    int was = rxe_check_overflow();
+    char *end = rxe_walk_current(cur->walk,str,maxlen,cur->rxe);
+    if (rxe_member_overflow) cur->reason = rxe_status_message(RXE_TOO_BIG);
+    rxe_member_overflow |= was;
+    return end;
+}
+
+// As rxe_current_delta, over the cursor's own last render.
+char *rxe_cursor_current_delta(char *str, int maxlen, struct rxe_cursor *cur)
+{
+    cur->reason = NULL;
+    if (cur->plan) {
+        if (maxlen <= 0) return str;
+        return rxe_plan_render_delta(cur->plan,cur->st,str,maxlen);
+    }
+    int was = rxe_check_overflow();
+    char *end = rxe_walk_current_delta(cur->walk,str,maxlen,cur->rxe);
+    if (rxe_member_overflow) cur->reason = rxe_status_message(RXE_TOO_BIG);
+    rxe_member_overflow |= was;
+    return end;
+}
+
+const char *rxe_cursor_reason(struct rxe_cursor *cur)
+{
+    return cur && cur->reason ? cur->reason : "";
+}
@@ -0,0 +1,917 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * dfa -- a parse tree as a deterministic automaton.
+ *
+ * Everything else in the library reads a pattern as a set of members laid out
+ * by the tree: a numeral per alternation, a digit per node. That is what makes
+ * a seek a few divisions, but it is also why the tree cannot answer the
+ * questions an automaton answers in passing -- whether a string is in the
+ * language at all, whatever path spelt it, or what can still follow a prefix.
+ * This builds the automaton, for the parts of the library that need those.
+ *
+ * It is the textbook construction, in three steps. The tree becomes a
+ * Thompson NFA: a class is a move on its bytes, a dictionary a chain per word,
+ * a group its alternations side by side, and a repetition as many copies of
+ * its body as its bounds call for, the optional ones each with a way out and
+ * an unbounded one a loop. What is not regular is refused rather than
+ * approximated: a backreference, and the choices and policies, whose members
+ * depend on one another in ways an automaton does not remember.
+ *
+ * The NFA is then determinised by subsets. The only wrinkle is the alphabet:
+ * rather than take all 256 bytes at every state, the bytes are first split
+ * into columns, two bytes sharing one when no class in the pattern has one
+ * without the other. '[a-z]{8}' has two columns, not 256, and each subset is
+ * moved once per column. Last, the result is minimised by refining the
+ * accepting/rejecting split until it stops splitting (Moore's algorithm),
+ * which is slower in theory than Hopcroft's and plenty at these sizes.
+ *
+ * Both steps can blow up -- '(a|b)*a(a|b){20}' needs 2^20 states however it is
+ * built -- so both are capped, and a pattern past the cap is refused with
+ * RXE_AUTOMATON_TOO_BIG instead of eating the host.
+ *
+ * rxe_dfa_build_spelt determinises by vectors rather than sets, keeping count
+ * of how many ways the pattern spells each string as well as whether it does;
+ * see "Counting the spellings" below.
+ */
+
+#include <string.h>
+#include "rxe.h"
+#include "dfa.h"
+
+#define NFA_MAX_STATES   (1<<18)    // Thompson states, before determinising
+#define DFA_MAX_POOL     (1<<24)    // NFA states listed over all the subsets
+
+/* ------------------------------ The NFA --------------------------------- */
+
+struct nstate {
+    int eps;                      // first of its empty moves, -1 if none
+    int to;                       // where its one byte move goes, -1 if none
+    int set;                      // ...and on which bytes
+};
+
+struct nedge { int to, next; };
+
+struct nfa {
+    struct nstate *st;
+    int n, nalloc;
+    struct nedge *e;
+    int ne, ealloc;
+    unsigned char (*set)[32];     // byte sets, a bit per byte
+    int nset, salloc;
+    int status;                   // why a build stopped, RXE_OK if it did not
+};
+
+struct frag { int s, e; };        // a piece of the NFA: where in, where out
+
+static void *grow(void *p, int *alloc, int want, size_t size)
+{
+    if (want <= *alloc) return p;
+    int n = *alloc ? *alloc : 64;
+    while (n < want) n *= 2;
+    void *q = kmalloc((size_t)n*size,__FILE__,__LINE__);
+    if (p) {
+        memcpy(q,p,(size_t)*alloc*size);
+        rxe_mem_free(p);
+    }
+    *alloc = n;
+    return q;
+}
+
+static int new_state(struct nfa *a)
+{
+    if (a->n >= NFA_MAX_STATES) {
+        a->status = RXE_AUTOMATON_TOO_BIG;
+        return -1;
+    }
+    a->st = grow(a->st,&a->nalloc,a->n+1,sizeof *a->st);
+    a->st[a->n].eps = -1;
+    a->st[a->n].to  = -1;
+    a->st[a->n].set = -1;
+    return a->n++;
+}
+
+static void add_eps(struct nfa *a, int from, int to)
+{
+    a->e = grow(a->e,&a->ealloc,a->ne+1,sizeof *a->e);
+    a->e[a->ne].to = to;
+    a->e[a->ne].next = a->st[from].eps;
+    a->st[from].eps = a->ne++;
+}
+
+// A state has at most one byte move, which every caller gives to a state it
+// has just made.
+
+static void add_bytes(struct nfa *a, int from, int to, const unsigned char *set)
+{
+    a->set = grow(a->set,&a->salloc,a->nset+1,sizeof *a->set);
+    memcpy(a->set[a->nset],set,32);
+    a->st[from].to = to;
+    a->st[from].set = a->nset++;
+}
+
+static int frag_pair(struct nfa *a, struct frag *f)
+{
+    return (f->s = new_state(a)) < 0 || (f->e = new_state(a)) < 0;
+}
+
+static int frag_rxe(struct nfa *a, struct rxe *rxe, struct frag *f);
+
+// The body once for each run it must make, then once more for each it may:
+// 'x{2,4}' is x x (x (x)?)?, and 'x{2,}' is x x x*.
+
+static int frag_repeat(struct nfa *a, struct rxe_node *node, struct frag *f)
+{
+    struct frag g;
+    int i, at;
+    if (frag_pair(a,f)) return 1;
+    at = f->s;
+    for (i=0;i<node->rep_min;i++) {
+        if (frag_rxe(a,node->rxe,&g)) return 1;
+        add_eps(a,at,g.s);
+        at = g.e;
+    }
+    if (node->rep_max == RXE_REP_UNBOUNDED) {
+        if (frag_rxe(a,node->rxe,&g)) return 1;
+        add_eps(a,at,g.s);
+        add_eps(a,g.e,at);
+    } else {
+        for ( ; i < node->rep_max ; i++) {
+            add_eps(a,at,f->e);
+            if (frag_rxe(a,node->rxe,&g)) return 1;
+            add_eps(a,at,g.s);
+            at = g.e;
+        }
+    }
+    add_eps(a,at,f->e);
+    return 0;
+}
+
+static int frag_node(struct nfa *a, struct rxe_node *node, struct frag *f)
+{
+    unsigned char set[32];
+    int i;
+    if (node->is_backref || node->is_comb || node->is_policy) {
+        a->status = RXE_NOT_REGULAR;
+        return 1;
+    }
+    if (node->is_repeat) return frag_repeat(a,node,f);
+    // A shuffled group reorders its members but has the same ones, so to an
+    // automaton it is a group like any other.
+    if (node->rxe) return frag_rxe(a,node->rxe,f);
+    if (frag_pair(a,f)) return 1;
+    if (node->is_dict) {
+        for (i=0;i<node->nwords;i++) {
+            const unsigned char *w = (const unsigned char *)node->words[i];
+            int at = new_state(a);
+            if (at < 0) return 1;
+            add_eps(a,f->s,at);
+            if (!*w) add_eps(a,at,f->e);
+            for ( ; *w ; w++) {
+                int to = w[1] ? new_state(a) : f->e;
+                if (to < 0) return 1;
+                memset(set,0,sizeof set);
+                set[*w>>3] |= 1 << (*w&7);
+                add_bytes(a,at,to,set);
+                at = to;
+            }
+        }
+    } else if (node->len) {
+        // A node with no characters matches nothing, and is left with no way
+        // from its start to its end.
+        memset(set,0,sizeof set);
+        for (i=0;i<node->len;i++) {
+            unsigned char c = (unsigned char)node->str[i];
+            set[c>>3] |= 1 << (c&7);
+        }
+        add_bytes(a,f->s,f->e,set);
+    }
+    return 0;
+}
+
+static int frag_rxe(struct nfa *a, struct rxe *rxe, struct frag *f)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    struct frag g;
+    if (frag_pair(a,f)) return 1;
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        int at = new_state(a);
+        if (at < 0) return 1;
+        add_eps(a,f->s,at);
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (frag_node(a,node,&g)) return 1;
+            add_eps(a,at,g.s);
+            at = g.e;
+        }
+        add_eps(a,at,f->e);
+    }
+    return 0;
+}
+
+static void nfa_free(struct nfa *a)
+{
+    if (a->st) rxe_mem_free(a->st);
+    if (a->e) rxe_mem_free(a->e);
+    if (a->set) rxe_mem_free(a->set);
+}
+
+/* --------------------------- Determinising ------------------------------ */
+
+// The columns: bytes split by every set in the NFA, each split keeping the
+// ones on the same side of it together. Returns how many there are.
+
+static int columns(const struct nfa *a, int *cls)
+{
+    int map[512];
+    int ncls = 1, i, b;
+    memset(cls,0,256*sizeof *cls);
+    for (i=0;i<a->nset;i++) {
+        const unsigned char *s = a->set[i];
+        int n = 0;
+        for (b=0;b<2*ncls;b++) map[b] = -1;
+        for (b=0;b<256;b++) {
+            int key = cls[b]*2 + ((s[b>>3] >> (b&7)) & 1);
+            if (map[key] < 0) map[key] = n++;
+            cls[b] = map[key];
+        }
+        ncls = n;
+    }
+    return ncls;
+}
+
+struct subsets {
+    const struct nfa *a;
+    int *mark, stamp;             // which NFA states the closure has reached
+    int *stack;
+    int *pool, npool, apool;      // every subset's states, end to end
+    int *off, aoff;               // ...where each begins
+    int *len, alen;               // ...and how many states it has
+    int *tab, mask;               // subsets by hash, -1 for an empty slot
+    int n, max;                   // subsets so far, and how many may be
+};
+
+static int cmp_int(const void *x, const void *y)
+{
+    int a = *(const int *)x, b = *(const int *)y;
+    return a < b ? -1 : a > b;
+}
+
+static unsigned hash_ints(const int *v, int n)
+{
+    unsigned h = 2166136261u;
+    int i;
+    for (i=0;i<n;i++) h = (h ^ (unsigned)v[i]) * 16777619u;
+    return h;
+}
+
+// Close the 'n' states at the end of the pool under empty moves, in place,
+// and return the subset's number -- an old one if the pool's tail repeats
+// one, else a new one, or -1 past a cap.
+
+static int close_subset(struct subsets *s, int n)
+{
+    const struct nfa *a = s->a;
+    int base = s->npool, sp = 0, i, k;
+    s->stamp++;
+    for (i=0;i<n;i++) {
+        int x = s->pool[base+i];
+        if (s->mark[x] == s->stamp) continue;
+        s->mark[x] = s->stamp;
+        s->stack[sp++] = x;
+    }
+    n = 0;
+    while (sp) {
+        int x = s->stack[--sp];
+        if (s->npool + n >= DFA_MAX_POOL) return -1;
+        s->pool = grow(s->pool,&s->apool,s->npool+n+1,sizeof *s->pool);
+        s->pool[base + n++] = x;
+        for (k = a->st[x].eps ; k >= 0 ; k = a->e[k].next) {
+            int y = a->e[k].to;
+            if (s->mark[y] == s->stamp) continue;
+            s->mark[y] = s->stamp;
+            s->stack[sp++] = y;
+        }
+    }
+    qsort(s->pool + base,(size_t)n,sizeof *s->pool,cmp_int);
+    unsigned h = hash_ints(s->pool + base,n) & (unsigned)s->mask;
+    while ((k = s->tab[h]) >= 0) {
+        if (s->len[k] == n && !memcmp(s->pool + s->off[k],s->pool + base,
+                                      (size_t)n*sizeof *s->pool))
+            return k;
+        h = (h+1) & (unsigned)s->mask;
+    }
+    if (s->n >= s->max) return -1;
+    s->off = grow(s->off,&s->aoff,s->n+1,sizeof *s->off);
+    s->len = grow(s->len,&s->alen,s->n+1,sizeof *s->len);
+    s->off[s->n] = base;
+    s->len[s->n] = n;
+    s->npool += n;
+    s->tab[h] = s->n;
+    return s->n++;
+}
+
+struct by_weight { mpz_srcptr w; int q; };
+
+static int cmp_weight(const void *x, const void *y)
+{
+    return mpz_cmp(((const struct by_weight *)x)->w,
+                   ((const struct by_weight *)y)->w);
+}
+
+// The first blocks of a weighted automaton: states that spell what ends in
+// them the same number of ways together, which for a plain one is accepting
+// or not.
+
+static void weight_blocks(const struct rxe_dfa *d, int *blk)
+{
+    int n = d->nstates, i, b = 0;
+    struct by_weight *v = NEW(n > 0 ? n : 1,struct by_weight);
+    for (i=0;i<n;i++) {
+        v[i].w = d->weight[i];
+        v[i].q = i;
+    }
+    qsort(v,(size_t)n,sizeof *v,cmp_weight);
+    for (i=0;i<n;i++) {
+        if (i && mpz_cmp(v[i].w,v[i-1].w)) b++;
+        blk[v[i].q] = b;
+    }
+    rxe_mem_free(v);
+}
+
+// Moore's refinement: states alike so far stay alike only while every column
+// takes them to states alike so far too. Each round splits blocks or changes
+// nothing; at nothing, the blocks are the minimal automaton's states.
+
+static void minimise(struct rxe_dfa *d)
+{
+    int n = d->nstates, k = d->ncls, w = k + 1, i, j, nb = -1;
+    int *blk = NEW(n,int), *nblk = NEW(n,int), *sig = NEW(n*w,int);
+    int size = 1;
+    while (size < 2*n) size *= 2;
+    int *tab = NEW(size,int);
+    if (d->weight) weight_blocks(d,blk);
+    else for (i=0;i<n;i++) blk[i] = d->accept[i];
+    for (;;) {
+        int cnt = 0;
+        for (i=0;i<n;i++) {
+            int *s = sig + i*w;
+            s[0] = blk[i];
+            for (j=0;j<k;j++) s[j+1] = blk[d->next[i*k+j]];
+        }
+        for (i=0;i<size;i++) tab[i] = -1;
+        for (i=0;i<n;i++) {
+            const int *s = sig + i*w;
+            unsigned h = hash_ints(s,w) & (unsigned)(size-1);
+            while (tab[h] >= 0 && memcmp(sig + tab[h]*w,s,(size_t)w*sizeof *s))
+                h = (h+1) & (unsigned)(size-1);
+            if (tab[h] < 0) {
+                tab[h] = i;
+                nblk[i] = cnt++;
+            } else {
+                nblk[i] = nblk[tab[h]];
+            }
+        }
+        int *t = blk; blk = nblk; nblk = t;
+        if (cnt == nb) break;
+        nb = cnt;
+    }
+    if (nb < n) {
+        int *next = NEW(nb*k,int);
+        unsigned char *accept = NEW(nb,unsigned char);
+        // A block's first state stands for it; its moves land in blocks.
+        for (i=n-1;i>=0;i--) {
+            for (j=0;j<k;j++) next[blk[i]*k+j] = blk[d->next[i*k+j]];
+            accept[blk[i]] = d->accept[i];
+        }
+        if (d->weight) {
+            mpz_t *weight = NEW(nb,mpz_t);
+            for (i=0;i<nb;i++) mpz_init(weight[i]);
+            for (i=0;i<n;i++) mpz_set(weight[blk[i]],d->weight[i]);
+            for (i=0;i<n;i++) mpz_clear(d->weight[i]);
+            rxe_mem_free(d->weight);
+            d->weight = weight;
+        }
+        rxe_mem_free(d->next);
+        rxe_mem_free(d->accept);
+        d->next = next;
+        d->accept = accept;
+        d->start = blk[d->start];
+        d->nstates = nb;
+    }
+    rxe_mem_free(blk);
+    rxe_mem_free(nblk);
+    rxe_mem_free(sig);
+    rxe_mem_free(tab);
+}
+
+static int determinise(const struct nfa *a, int start, int final,
+                       int max_states, struct rxe_dfa **out)
+{
+    struct rxe_dfa *d = NEW(1,struct rxe_dfa);
+    struct subsets s;
+    int rep[256], q, i, c, status = RXE_OK, anext = 0;
+    memset(&s,0,sizeof s);
+    d->ncls = columns(a,d->cls);
+    for (c=255;c>=0;c--) rep[d->cls[c]] = c;
+    d->next = NULL;
+    d->accept = NULL;
+    d->weight = NULL;
+    s.a = a;
+    s.max = max_states;
+    s.mark = NEW(a->n,int);
+    memset(s.mark,0,(size_t)a->n*sizeof *s.mark);
+    s.stack = NEW(a->n,int);
+    for (i=1;i<2*max_states;i*=2) ;
+    s.tab = NEW(i,int);
+    s.mask = i-1;
+    for (i=0;i<=s.mask;i++) s.tab[i] = -1;
+    s.pool = grow(NULL,&s.apool,1,sizeof *s.pool);
+    s.pool[0] = start;
+    close_subset(&s,1);
+    // Subsets are numbered as they are found, so walking the numbers in order
+    // is a breadth-first walk that ends when nothing new turns up.
+    for (q=0;q<s.n;q++) {
+        d->next = grow(d->next,&anext,(q+1)*d->ncls,sizeof *d->next);
+        for (c=0;c<d->ncls;c++) {
+            int n = 0, b = rep[c];
+            for (i=0;i<s.len[q];i++) {
+                const struct nstate *x = &a->st[s.pool[s.off[q]+i]];
+                if (x->to < 0 || !((a->set[x->set][b>>3] >> (b&7)) & 1))
+                    continue;
+                s.pool = grow(s.pool,&s.apool,s.npool+n+1,sizeof *s.pool);
+                s.pool[s.npool + n++] = x->to;
+            }
+            int to = close_subset(&s,n);
+            if (to < 0) { status = RXE_AUTOMATON_TOO_BIG; goto done; }
+            d->next[q*d->ncls+c] = to;
+        }
+    }
+    d->nstates = s.n;
+    d->start = 0;
+    d->accept = NEW(s.n,unsigned char);
+    for (q=0;q<s.n;q++) {
+        d->accept[q] = 0;
+        for (i=0;i<s.len[q];i++)
+            if (s.pool[s.off[q]+i] == final) d->accept[q] = 1;
+    }
+    minimise(d);
+done:
+    rxe_mem_free(s.mark);
+    rxe_mem_free(s.stack);
+    rxe_mem_free(s.tab);
+    rxe_mem_free(s.pool);
+    if (s.off) rxe_mem_free(s.off);
+    if (s.len) rxe_mem_free(s.len);
+    if (status) {
+        rxe_dfa_free(d);
+        d = NULL;
+    }
+    *out = d;
+    return status;
+}
+
+/* ------------------------ Counting the spellings ------------------------ */
+
+// The tree counts a string once for every way the pattern spells it, and
+// Thompson's construction spells each of those along a path of its own: an
+// alternation's branches, a dictionary's words and a repetition's run counts
+// each leave by a move of their own, so the paths that read a string to the
+// final state are its spellings. Determinising by vectors instead of sets --
+// for each NFA state, how many paths on the string read so far end there --
+// keeps that count. Two strings that reach the same vector go on alike, spelt
+// alike, so the vectors are the states of a deterministic automaton, and the
+// final state's entry is each one's weight.
+//
+// Unlike the subsets there may be endlessly many vectors: '(a|a)*' reaches
+// a new one with every byte. So this is for finite sets, and capped whatever
+// it is given. A vector keeps only the states that matter -- those with a
+// byte move, and the final one -- and of those only the ones that can still
+// reach the final state; a state with nothing but empty moves has passed its
+// paths on by the time the closure is done.
+
+struct spelt {
+    const struct nfa *a;
+    int final;
+    unsigned char *live;          // NFA states that can still reach 'final'
+    int *mark, stamp;             // which states the closure has reached,
+    mpz_t *paths;                 // ...how many paths reach each,
+    int *reach, nreach;           // ...in the order found,
+    int *indeg, *queue;           // ...and the empty moves still coming in
+    int *pool, npool, apool;      // every vector's states, end to end
+    mpz_t *count;                 // ...and their paths, alongside
+    int acount;
+    int *off, aoff;               // where each vector begins
+    int *len, alen;               // ...and how many states it has
+    int *tab, mask;               // vectors by hash, -1 for an empty slot
+    int n, max;                   // vectors so far, and how many may be
+};
+
+// The states from which the final one can still be reached, found backwards
+// over every move reversed.
+
+static unsigned char *coreach(const struct nfa *a, int final)
+{
+    int n = a->n, m = 0, x, k, sp = 0;
+    int *deg = NEW(n + 1,int), *pos = NEW(n + 1,int), *todo = NEW(n,int);
+    unsigned char *live = NEW(n,unsigned char);
+    memset(deg,0,(size_t)(n + 1)*sizeof *deg);
+    memset(live,0,(size_t)n);
+    for (x=0;x<n;x++) {
+        if (a->st[x].to >= 0) { deg[a->st[x].to + 1]++; m++; }
+        for (k=a->st[x].eps;k>=0;k=a->e[k].next) { deg[a->e[k].to + 1]++; m++; }
+    }
+    for (x=0;x<n;x++) deg[x+1] += deg[x];
+    memcpy(pos,deg,(size_t)(n + 1)*sizeof *pos);
+    int *from = NEW(m > 0 ? m : 1,int);
+    for (x=0;x<n;x++) {
+        if (a->st[x].to >= 0) from[pos[a->st[x].to]++] = x;
+        for (k=a->st[x].eps;k>=0;k=a->e[k].next) from[pos[a->e[k].to]++] = x;
+    }
+    live[final] = 1;
+    todo[sp++] = final;
+    while (sp) {
+        int t = todo[--sp];
+        for (k=deg[t];k<deg[t+1];k++)
+            if (!live[from[k]]) {
+                live[from[k]] = 1;
+                todo[sp++] = from[k];
+            }
+    }
+    rxe_mem_free(deg);
+    rxe_mem_free(pos);
+    rxe_mem_free(todo);
+    rxe_mem_free(from);
+    return live;
+}
+
+// Start a closure: every state it reaches is marked with this stamp.
+
+static void spelt_begin(struct spelt *s)
+{
+    s->stamp++;
+    s->nreach = 0;
+}
+
+// 'n' more paths into state x.
+
+static void spelt_seed(struct spelt *s, int x, mpz_srcptr n)
+{
+    if (s->mark[x] != s->stamp) {
+        s->mark[x] = s->stamp;
+        s->reach[s->nreach++] = x;
+        mpz_set(s->paths[x],n);
+    } else {
+        mpz_add(s->paths[x],s->paths[x],n);
+    }
+}
+
+// Close the seeded states under empty moves, passing each one's paths on to
+// the states its moves lead to once every path into it has arrived -- the
+// empty moves in topological order, which is why a cycle of them, endlessly
+// many paths, is refused. Returns the vector's number, an old one if it was
+// seen before; -1 past a cap, -2 on a cycle.
+
+static int spelt_close(struct spelt *s)
+{
+    const struct nfa *a = s->a;
+    int i, k, head = 0, tail = 0, done = 0;
+    for (i=0;i<s->nreach;i++) {
+        int x = s->reach[i];
+        for (k=a->st[x].eps;k>=0;k=a->e[k].next) {
+            int y = a->e[k].to;
+            if (s->mark[y] != s->stamp) {
+                s->mark[y] = s->stamp;
+                s->reach[s->nreach++] = y;
+                mpz_set_ui(s->paths[y],0);
+            }
+        }
+    }
+    for (i=0;i<s->nreach;i++) s->indeg[s->reach[i]] = 0;
+    for (i=0;i<s->nreach;i++)
+        for (k=a->st[s->reach[i]].eps;k>=0;k=a->e[k].next)
+            s->indeg[a->e[k].to]++;
+    for (i=0;i<s->nreach;i++)
+        if (!s->indeg[s->reach[i]]) s->queue[tail++] = s->reach[i];
+    while (head < tail) {
+        int x = s->queue[head++];
+        done++;
+        for (k=a->st[x].eps;k>=0;k=a->e[k].next) {
+            int y = a->e[k].to;
+            mpz_add(s->paths[y],s->paths[y],s->paths[x]);
+            if (!--s->indeg[y]) s->queue[tail++] = y;
+        }
+    }
+    if (done < s->nreach) return -2;
+
+    // The states that matter, in order, at the end of the pool.
+    int base = s->npool, n = 0;
+    for (i=0;i<s->nreach;i++) {
+        int x = s->reach[i];
+        if (s->live[x] && (a->st[x].to >= 0 || x == s->final))
+            s->queue[n++] = x;
+    }
+    if (base + n >= DFA_MAX_POOL) return -1;
+    qsort(s->queue,(size_t)n,sizeof *s->queue,cmp_int);
+    s->pool = grow(s->pool,&s->apool,base+n+1,sizeof *s->pool);
+    if (base + n + 1 > s->acount) {
+        int was = s->acount;
+        s->count = grow(s->count,&s->acount,base+n+1,sizeof *s->count);
+        for (i=was;i<s->acount;i++) mpz_init(s->count[i]);
+    }
+    unsigned h = 2166136261u;
+    for (i=0;i<n;i++) {
+        s->pool[base+i] = s->queue[i];
+        mpz_set(s->count[base+i],s->paths[s->queue[i]]);
+        h = (h ^ (unsigned)s->queue[i]) * 16777619u;
+        h = (h ^ (unsigned)mpz_get_ui(s->count[base+i])) * 16777619u;
+    }
+    h &= (unsigned)s->mask;
+    while ((k = s->tab[h]) >= 0) {
+        if (s->len[k] == n && !memcmp(s->pool + s->off[k],s->pool + base,
+                                      (size_t)n*sizeof *s->pool)) {
+            for (i=0;i<n;i++)
+                if (mpz_cmp(s->count[s->off[k]+i],s->count[base+i])) break;
+            if (i == n) return k;
+        }
+        h = (h+1) & (unsigned)s->mask;
+    }
+    if (s->n >= s->max) return -1;
+    s->off = grow(s->off,&s->aoff,s->n+1,sizeof *s->off);
+    s->len = grow(s->len,&s->alen,s->n+1,sizeof *s->len);
+    s->off[s->n] = base;
+    s->len[s->n] = n;
+    s->npool += n;
+    s->tab[h] = s->n;
+    return s->n++;
+}
+
+static int determinise_spelt(const struct nfa *a, int start, int final,
+                             int max_states, struct rxe_dfa **out)
+{
+    struct rxe_dfa *d = NEW(1,struct rxe_dfa);
+    struct spelt s;
+    int rep[256], q, i, c, status = RXE_OK, anext = 0;
+    mpz_t one;
+    memset(&s,0,sizeof s);
+    mpz_init_set_ui(one,1);
+    d->ncls = columns(a,d->cls);
+    for (c=255;c>=0;c--) rep[d->cls[c]] = c;
+    d->next = NULL;
+    d->accept = NULL;
+    d->weight = NULL;
+    d->nstates = 0;
+    s.a = a;
+    s.final = final;
+    s.max = max_states;
+    s.live = coreach(a,final);
+    s.mark = NEW(a->n,int);
+    memset(s.mark,0,(size_t)a->n*sizeof *s.mark);
+    s.paths = NEW(a->n,mpz_t);
+    for (i=0;i<a->n;i++) mpz_init(s.paths[i]);
+    s.reach = NEW(a->n,int);
+    s.indeg = NEW(a->n,int);
+    s.queue = NEW(a->n,int);
+    for (i=1;i<2*max_states;i*=2) ;
+    s.tab = NEW(i,int);
+    s.mask = i-1;
+    for (i=0;i<=s.mask;i++) s.tab[i] = -1;
+    spelt_begin(&s);
+    spelt_seed(&s,start,one);
+    if ((i = spelt_close(&s)) < 0) {
+        status = i == -2 ? RXE_INFINITE : RXE_AUTOMATON_TOO_BIG;
+        goto done;
+    }
+    for (q=0;q<s.n;q++) {
+        d->next = grow(d->next,&anext,(q+1)*d->ncls,sizeof *d->next);
+        for (c=0;c<d->ncls;c++) {
+            int b = rep[c];
+            spelt_begin(&s);
+            for (i=0;i<s.len[q];i++) {
+                const struct nstate *x = &a->st[s.pool[s.off[q]+i]];
+                if (x->to < 0 || !((a->set[x->set][b>>3] >> (b&7)) & 1))
+                    continue;
+                spelt_seed(&s,x->to,s.count[s.off[q]+i]);
+            }
+            int to = spelt_close(&s);
+            if (to < 0) {
+                status = to == -2 ? RXE_INFINITE : RXE_AUTOMATON_TOO_BIG;
+                goto done;
+            }
+            d->next[q*d->ncls+c] = to;
+        }
+    }
+    d->nstates = s.n;
+    d->start = 0;
+    d->accept = NEW(s.n,unsigned char);
+    d->weight = NEW(s.n,mpz_t);
+    for (q=0;q<s.n;q++) {
+        mpz_init(d->weight[q]);
+        for (i=0;i<s.len[q];i++)
+            if (s.pool[s.off[q]+i] == final)
+                mpz_set(d->weight[q],s.count[s.off[q]+i]);
+        d->accept[q] = mpz_sgn(d->weight[q]) != 0;
+    }
+    minimise(d);
+done:
+    mpz_clear(one);
+    rxe_mem_free(s.live);
+    rxe_mem_free(s.mark);
+    for (i=0;i<a->n;i++) mpz_clear(s.paths[i]);
+    rxe_mem_free(s.paths);
+    rxe_mem_free(s.reach);
+    rxe_mem_free(s.indeg);
+    rxe_mem_free(s.queue);
+    rxe_mem_free(s.tab);
+    if (s.pool) rxe_mem_free(s.pool);
+    for (i=0;i<s.acount;i++) mpz_clear(s.count[i]);
+    if (s.count) rxe_mem_free(s.count);
+    if (s.off) rxe_mem_free(s.off);
+    if (s.len) rxe_mem_free(s.len);
+    if (status) {
+        rxe_dfa_free(d);
+        d = NULL;
+    }
+    *out = d;
+    return status;
+}
+
+/* ------------------------------------------------------------------------ */
+
+// The automaton of what 'rxe' matches, whole or, under the RXE_DFA_FLOAT_*
+// bits, anywhere within a string: a floating start is a loop on every byte
+// before the pattern, a floating end one after it. Returns RXE_OK and sets
+// *out, or the status that stopped it with *out NULL.
+
+int rxe_dfa_build(struct rxe *rxe, int anchor, int max_states,
+                  struct rxe_dfa **out)
+{
+    struct nfa a;
+    struct frag f;
+    unsigned char every[32];
+    int start, final;
+    memset(&a,0,sizeof a);
+    memset(every,0xff,sizeof every);
+    *out = NULL;
+    if (frag_rxe(&a,rxe,&f)) goto fail;
+    start = f.s;
+    final = f.e;
+    if (anchor & RXE_DFA_FLOAT_START) {
+        if ((start = new_state(&a)) < 0) goto fail;
+        add_bytes(&a,start,start,every);
+        add_eps(&a,start,f.s);
+    }
+    if (anchor & RXE_DFA_FLOAT_END) {
+        if ((final = new_state(&a)) < 0) goto fail;
+        add_bytes(&a,final,final,every);
+        add_eps(&a,f.e,final);
+    }
+    a.status = determinise(&a,start,final,max_states,out);
+fail:
+    nfa_free(&a);
+    return a.status;
+}
+
+// The automaton of what 'rxe' matches, whole, weighted by how many ways the
+// pattern spells each string it accepts -- for a finite set; see "Counting the
+// spellings". Returns as rxe_dfa_build does, and RXE_INFINITE if it comes on
+// endlessly many spellings after all.
+
+int rxe_dfa_build_spelt(struct rxe *rxe, int max_states, struct rxe_dfa **out)
+{
+    struct nfa a;
+    struct frag f;
+    memset(&a,0,sizeof a);
+    *out = NULL;
+    if (!frag_rxe(&a,rxe,&f))
+        a.status = determinise_spelt(&a,f.s,f.e,max_states,out);
+    nfa_free(&a);
+    return a.status;
+}
+
+// The pairs of states an intersection has found, numbered as found; pair k
+// is at[2k], at[2k+1].
+
+struct pairs {
+    int *at, aat, n, max;
+    int *tab;
+    unsigned mask;
+};
+
+// The number of pair (x, y), new if it has not been seen, or -1 past a cap.
+
+static int pair_state(struct pairs *p, int x, int y)
+{
+    int key[2] = { x, y }, k;
+    unsigned h = hash_ints(key,2) & p->mask;
+    while ((k = p->tab[h]) >= 0) {
+        if (p->at[2*k] == x && p->at[2*k+1] == y) return k;
+        h = (h+1) & p->mask;
+    }
+    if (p->n >= p->max) return -1;
+    p->at = grow(p->at,&p->aat,2*(p->n+1),sizeof *p->at);
+    p->at[2*p->n] = x;
+    p->at[2*p->n+1] = y;
+    p->tab[h] = p->n;
+    return p->n++;
+}
+
+// The automaton of what both 'a' and 'b' accept: pairs of their states, found
+// from the pair of starts as subsets are found from the start set. A byte's
+// column is the pair of its columns in the two. Returns RXE_OK and sets *out,
+// or RXE_AUTOMATON_TOO_BIG past the cap with *out NULL.
+
+int rxe_dfa_intersect(const struct rxe_dfa *a, const struct rxe_dfa *b,
+                      int max_states, struct rxe_dfa **out)
+{
+    struct rxe_dfa *d = NEW(1,struct rxe_dfa);
+    struct pairs p;
+    int ca[256], cb[256], c, k, q, i, anext = 0, status = RXE_OK;
+    d->ncls = 0;
+    for (c=0;c<256;c++) {
+        for (k=0;k<d->ncls;k++)
+            if (ca[k] == a->cls[c] && cb[k] == b->cls[c]) break;
+        if (k == d->ncls) {
+            ca[k] = a->cls[c];
+            cb[k] = b->cls[c];
+            d->ncls++;
+        }
+        d->cls[c] = k;
+    }
+    d->next = NULL;
+    d->accept = NULL;
+    d->weight = NULL;
+    memset(&p,0,sizeof p);
+    p.max = max_states;
+    for (i=1;i<2*max_states;i*=2) ;
+    p.tab = NEW(i,int);
+    p.mask = (unsigned)i - 1;
+    for (k=0;k<i;k++) p.tab[k] = -1;
+    pair_state(&p,a->start,b->start);
+    for (q=0;q<p.n;q++) {
+        d->next = grow(d->next,&anext,(q+1)*d->ncls,sizeof *d->next);
+        for (c=0;c<d->ncls;c++) {
+            int to = pair_state(&p,a->next[p.at[2*q]*a->ncls + ca[c]],
+                                b->next[p.at[2*q+1]*b->ncls + cb[c]]);
+            if (to < 0) { status = RXE_AUTOMATON_TOO_BIG; goto done; }
+            d->next[q*d->ncls + c] = to;
+        }
+    }
+    d->nstates = p.n;
+    d->start = 0;
+    d->accept = NEW(p.n,unsigned char);
+    for (q=0;q<p.n;q++)
+        d->accept[q] = a->accept[p.at[2*q]] && b->accept[p.at[2*q+1]];
+    minimise(d);
+done:
+    rxe_mem_free(p.tab);
+    if (p.at) rxe_mem_free(p.at);
+    if (status) {
+        rxe_dfa_free(d);
+        d = NULL;
+    }
+    *out = d;
+    return status;
+}
+
+int rxe_dfa_run(const struct rxe_dfa *dfa, int q, const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    while (p < end) q = dfa->next[q*dfa->ncls + dfa->cls[*p++]];
+    return q;
+}
+
+// What the automaton rejects instead. Every state has every move, so this is
+// only the accepting states traded for the rest.
+
+void rxe_dfa_complement(struct rxe_dfa *dfa)
+{
+    int q;
+    for (q=0;q<dfa->nstates;q++) dfa->accept[q] = !dfa->accept[q];
+}
+
+void rxe_dfa_free(struct rxe_dfa *dfa)
+{
+    if (!dfa) return;
+    if (dfa->next) rxe_mem_free(dfa->next);
+    if (dfa->accept) rxe_mem_free(dfa->accept);
+    if (dfa->weight) {
+        for (int q=0;q<dfa->nstates;q++) mpz_clear(dfa->weight[q]);
+        rxe_mem_free(dfa->weight);
+    }
+    rxe_mem_free(dfa);
+}
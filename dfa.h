@@ -0,0 +1,53 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+#ifndef __RXE_DFA_H__
+#define __RXE_DFA_H__
+
+// A deterministic automaton over bytes, built from a parse tree; see dfa.c.
+// Bytes no class in the pattern tells apart share a column: cls[c] is byte
+// c's column, and next[q*ncls + cls[c]] the state q goes to on c. Every state
+// has every column, so a state no string can leave to acceptance is a state
+// like any other rather than a missing entry.
+
+struct rxe_dfa {
+    int  nstates;
+    int  start;
+    int  ncls;                    // columns
+    int  cls[256];                // the column of each byte
+    int *next;                    // nstates rows of ncls columns
+    unsigned char *accept;        // one per state
+    mpz_t *weight;                // of rxe_dfa_build_spelt, how many ways the
+                                  // pattern spells the string ending in each
+                                  // state, 0 where it rejects; else NULL
+};
+
+// Anchoring for rxe_dfa_build: whether the pattern may begin after the start
+// of the string, and end before its end, as a search for it would.
+#define RXE_DFA_FLOAT_START          0x0001
+#define RXE_DFA_FLOAT_END            0x0002
+
+int  rxe_dfa_build(struct rxe *rxe, int anchor, int max_states,
+                   struct rxe_dfa **out);
+int  rxe_dfa_build_spelt(struct rxe *rxe, int max_states,
+                         struct rxe_dfa **out);
+int  rxe_dfa_intersect(const struct rxe_dfa *a, const struct rxe_dfa *b,
+                       int max_states, struct rxe_dfa **out);
+int  rxe_dfa_run(const struct rxe_dfa *dfa, int q, const char *s, size_t len);
+void rxe_dfa_complement(struct rxe_dfa *dfa);
+void rxe_dfa_free(struct rxe_dfa *dfa);
+
+#endif // __RXE_DFA_H__
@@ -30,6 +30,8 @@
 // an unknown name is parsed. rxenum's resolver reads name.dict off disk; the
 // browser build registers its built-ins and whatever the user has uploaded.
 
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
 #include "rxe.h"
 #include "dict.h"
@@ -69,9 +71,53 @@ const char *rxe_posix_class(const char *name, int len)
 
 /* ------------------------ The word dictionaries ------------------------- */
 
+// A word list, counted. The registry holds one reference to each list it
+// knows, and every node parsed from it holds another, so a list replaced or
+// dropped from the registry lives on for as long as a parse still reads it.
+// Callers see only the array of words; the count sits in front of it.
+struct wordlist {
+    int   refs;
+    int   nwords;
+    int   owns;                 // the words are the list's own, to free with it
+    char *word[];
+};
+
+static struct wordlist *wordlist_of(char **words)
+{
+    return (struct wordlist *)((char *)words - offsetof(struct wordlist,word));
+}
+
+char **rxe_words_new(int nwords, int owns)
+{
+    struct wordlist *wl = (struct wordlist *)
+        NEW(sizeof(struct wordlist) + (size_t)nwords*sizeof(char *),char);
+    wl->refs = 1;
+    wl->nwords = nwords;
+    wl->owns = owns;
+    memset(wl->word,0,(size_t)nwords*sizeof(char *));
+    return wl->word;
+}
+
+char **rxe_words_ref(char **words)
+{
+    if (words) __atomic_add_fetch(&wordlist_of(words)->refs,1,__ATOMIC_RELAXED);
+    return words;
+}
+
+void rxe_words_unref(char **words)
+{
+    if (!words) return;
+    struct wordlist *wl = wordlist_of(words);
+    if (__atomic_sub_fetch(&wl->refs,1,__ATOMIC_ACQ_REL)) return;
+    int i;
+    if (wl->owns)
+        for (i=0;i<wl->nwords;i++) rxe_mem_free(wl->word[i]);
+    rxe_mem_free(wl);
+}
+
 struct dict {
     char        *name;
-    char       **words;
+    char       **words;             // a counted list; see above
     int          nwords;
     struct dict *next;
 };
@@ -79,6 +125,13 @@ struct dict {
 static struct dict *dicts;                 // the registry, a plain list
 static int (*resolver)(const char *name);  // asked on a miss, may register
 
+// The registry is one list for the whole process, and threads that each parse
+// their own pattern all read it, and may register into it through the resolver.
+// The lock keeps the list whole. It is held for a lookup or an insertion, never
+// across the resolver, which may itself register (and so take the lock) and
+// may take as long as reading a file does.
+static pthread_mutex_t registry = PTHREAD_MUTEX_INITIALIZER;
+
 static struct dict *find(const char *name, int len)
 {
     struct dict *d;
@@ -90,11 +143,19 @@ static struct dict *find(const char *name, int len)
 int rxe_register_dict(const char *name, const char **words, int nwords)
 {
     int i;
+    // The copy is made before the lock is taken; only the swap is under it.
+    char **copy = rxe_words_new(nwords,1), **old = NULL;
+    for (i=0;i<nwords;i++) {
+        int wl = (int)strlen(words[i]);
+        copy[i] = NEW(wl+1,char);
+        memcpy(copy[i],words[i],wl+1);
+    }
+    pthread_mutex_lock(&registry);
     struct dict *d = find(name,(int)strlen(name));
     if (d) {
-        // Re-registering a name replaces it. Release the old contents first.
-        for (i=0;i<d->nwords;i++) rxe_mem_free(d->words[i]);
-        if (d->words) rxe_mem_free(d->words);
+        // Re-registering a name replaces it. The registry lets go of the old
+        // list; a parse still reading it holds its own reference.
+        old = d->words;
     } else {
         d = NEW(1,struct dict);
         d->name = NEW((int)strlen(name)+1,char);
@@ -103,12 +164,9 @@ int rxe_register_dict(const char *name, const char **words, int nwords)
         dicts = d;
     }
     d->nwords = nwords;
-    d->words = nwords ? NEW(nwords,char *) : NULL;
-    for (i=0;i<nwords;i++) {
-        int wl = (int)strlen(words[i]);
-        d->words[i] = NEW(wl+1,char);
-        memcpy(d->words[i],words[i],wl+1);
-    }
+    d->words = copy;
+    pthread_mutex_unlock(&registry);
+    rxe_words_unref(old);
     return 0;
 }
 
@@ -117,35 +175,114 @@ void rxe_set_dict_resolver(int (*fn)(const char *name))
     resolver = fn;
 }
 
-int rxe_lookup_dict(const char *name, int len, char ***words, int *nwords)
+static _Thread_local const struct rxe_baked *baked_in_use;
+
+// The registered list under 'name', with a reference taken before the lock is
+// let go, so a registration racing in behind cannot free it under the caller.
+static int lookup(const char *name, int len, char ***words, int *nwords)
 {
+    pthread_mutex_lock(&registry);
     struct dict *d = find(name,len);
-    if (!d && resolver) {
-        // The resolver is handed a NUL-terminated name, which the parser's
-        // pointer into the pattern is not, so make a temporary copy of it.
-        char stackbuf[64], *heap = NULL, *nul = stackbuf;
-        if (len >= (int)sizeof(stackbuf)) nul = heap = NEW(len+1,char);
-        memcpy(nul,name,len);
-        nul[len] = 0;
-        if (resolver(nul)) d = find(name,len);
-        if (heap) rxe_mem_free(heap);
+    if (d) {
+        *words = rxe_words_ref(d->words);
+        *nwords = d->nwords;
     }
-    if (!d) return 0;
-    *words = d->words;
-    *nwords = d->nwords;
-    return 1;
+    pthread_mutex_unlock(&registry);
+    return d != NULL;
+}
+
+int rxe_lookup_dict(const char *name, int len, char ***words, int *nwords)
+{
+    if (baked_in_use) {
+        int i;
+        for (i=0;i<baked_in_use->ndicts;i++) {
+            const struct rxe_baked_dict *b = &baked_in_use->dict[i];
+            if ((int)strlen(b->name)==len && !memcmp(b->name,name,len)) {
+                *words = rxe_words_ref(b->words);
+                *nwords = b->nwords;
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (lookup(name,len,words,nwords)) return 1;
+    if (!resolver) return 0;
+    // The resolver is handed a NUL-terminated name, which the parser's pointer
+    // into the pattern is not, so make a temporary copy of it.
+    char stackbuf[64], *heap = NULL, *nul = stackbuf;
+    int found = 0;
+    if (len >= (int)sizeof(stackbuf)) nul = heap = NEW(len+1,char);
+    memcpy(nul,name,len);
+    nul[len] = 0;
+    if (resolver(nul)) found = lookup(name,len,words,nwords);
+    if (heap) rxe_mem_free(heap);
+    return found;
+}
+
+// A copy, taken under the lock: the registry's own name is freed by whichever
+// thread next replaces or drops the entry, which may be before the caller is
+// done with it.
+char *rxe_dict_name(char **words)
+{
+    struct dict *d;
+    char *name = NULL;
+    pthread_mutex_lock(&registry);
+    for ( d = dicts ; d ; d = d->next )
+        if (d->words == words) break;
+    if (d) {
+        size_t n = strlen(d->name) + 1;
+        name = NEW(n,char);
+        if (name) memcpy(name,d->name,n);
+    }
+    pthread_mutex_unlock(&registry);
+    return name;
 }
 
 void rxe_free_dicts(void)
 {
     struct dict *d, *next;
-    int i;
+    pthread_mutex_lock(&registry);
     for ( d = dicts ; d ; d = next ) {
         next = d->next;
-        for (i=0;i<d->nwords;i++) rxe_mem_free(d->words[i]);
-        if (d->words) rxe_mem_free(d->words);
+        rxe_words_unref(d->words);
         rxe_mem_free(d->name);
         rxe_mem_free(d);
     }
     dicts = NULL;
+    pthread_mutex_unlock(&registry);
+}
+
+/* ---------------------- Dictionaries from an image ---------------------- */
+
+struct rxe_baked *rxe_baked_new(int ndicts)
+{
+    struct rxe_baked *baked = NEW(1,struct rxe_baked);
+    baked->refs = 1;
+    baked->ndicts = ndicts;
+    baked->dict = ndicts ? NEW(ndicts,struct rxe_baked_dict) : NULL;
+    int i;
+    for (i=0;i<ndicts;i++) baked->dict[i].words = NULL;
+    return baked;
+}
+
+struct rxe_baked *rxe_baked_ref(struct rxe_baked *baked)
+{
+    if (baked) __atomic_add_fetch(&baked->refs,1,__ATOMIC_RELAXED);
+    return baked;
+}
+
+void rxe_baked_unref(struct rxe_baked *baked)
+{
+    if (!baked || __atomic_sub_fetch(&baked->refs,1,__ATOMIC_ACQ_REL)) return;
+    int i;
+    for (i=0;i<baked->ndicts;i++) rxe_words_unref(baked->dict[i].words);
+    if (baked->dict) rxe_mem_free(baked->dict);
+    rxe_mem_free(baked);
+}
+
+const struct rxe_baked *rxe_baked_use(const struct rxe_baked *baked)
+{
+    const struct rxe_baked *was = baked_in_use;
+    baked_in_use = baked;
+    return was;
 }
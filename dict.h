@@ -23,9 +23,47 @@
 // dictionaries need the node kind below.
 const char *rxe_posix_class(const char *name, int len);
 
+// A counted list of words: made with one reference, taken and dropped with
+// the other two, and freed with the last -- the words too, if 'owns'.
+char **rxe_words_new(int nwords, int owns);
+char **rxe_words_ref(char **words);
+void   rxe_words_unref(char **words);
+
 // Look a word dictionary up by name, resolving it if it has not been seen. On
-// success returns 1 and points *words/*nwords at the registry's own copy,
-// which the caller must not free. On a miss returns 0.
+// success returns 1 and points *words/*nwords at the list, with a reference
+// taken for the caller, who drops it with rxe_words_unref; re-registering the
+// name meanwhile leaves it intact. On a miss returns 0.
 int rxe_lookup_dict(const char *name, int len, char ***words, int *nwords);
 
+// The name a dictionary node's words were registered under, or NULL if the
+// registry no longer holds them. The name is a copy, the caller's to free with
+// rxe_mem_free; the registry's own may go at any time to another thread.
+char *rxe_dict_name(char **words);
+
+// Dictionaries an expression brought with it from an image (see image.c), not
+// found in the registry. The words point into the image; only the counted
+// lists of pointers to them are the set's own. The expression and every clone of it
+// borrow from the one set, so it is counted, and freed with the last of them.
+struct rxe_baked_dict {
+    const char *name;
+    char      **words;
+    int         nwords;
+};
+
+struct rxe_baked {
+    int refs;
+    int ndicts;
+    struct rxe_baked_dict *dict;
+};
+
+struct rxe_baked *rxe_baked_new(int ndicts);
+struct rxe_baked *rxe_baked_ref(struct rxe_baked *baked);
+void rxe_baked_unref(struct rxe_baked *baked);
+
+// While a set is in use on this thread, a [:name:] is looked up in it alone:
+// the registry and the resolver are not consulted, so a name an image did not
+// bring is unknown rather than quietly taken from whatever is registered now.
+// Returns the set it replaces; NULL is the registry.
+const struct rxe_baked *rxe_baked_use(const struct rxe_baked *baked);
+
 #endif // __RXE_DICT_H__
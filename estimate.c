@@ -0,0 +1,243 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * estimate -- how many duplicates a set holds, from a sample of its indices.
+ *
+ * rxedup answers exactly by looking at every member, and rxe_count_distinct
+ * exactly by building an automaton; the first costs the size of the set and
+ * the second is refused by a backreference or a blown state cap. Rank offers a
+ * third way that costs neither. A string spelt m ways sits at m indices, so an
+ * index drawn uniformly lands on it with probability m/N, and
+ *
+ *     E[1/m] = sum over strings s of (m(s)/N) * (1/m(s)) = D/N
+ *
+ * where D is the number of distinct strings. Draw K indices, render each, ask
+ * rxe_rank_count for its m, and the mean of 1/m estimates the share of the
+ * index range that is distinct, with the usual standard error -- whatever N
+ * is, since a draw costs one seek and one rank and neither grows with the set.
+ *
+ * The interval is the normal one, mean plus or minus 1.96 standard errors,
+ * which is sound once the sample holds some variety. It is not when every draw
+ * came back spelt the same number of ways, c -- most often once: the sample
+ * variance is then zero and the interval a point, which claims far more than
+ * K draws can show. Those draws say only that the indices on strings spelt
+ * otherwise are rare -- under 3/K of them, by the rule of three, at 95% -- so
+ * the share is then somewhere from (1 - 3/K)/c, were those few all spelt
+ * without end, to that plus 3/K, were they all unique: for c = 1, at least
+ * 1 - 3/K.
+ *
+ * The indices are drawn up front, on the calling thread, from the caller's
+ * generator, and each draw's 1/m is kept in its own slot and summed in draw
+ * order afterwards, so a seed gives the same answer however many threads
+ * ranked it.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "rxe.h"
+
+struct est_run {
+    struct rxe *rxe;
+    mpz_t *at;                  // the drawn indices
+    double *inv;                // 1/m for each, once ranked
+    unsigned long samples;
+    unsigned long next;         // the next draw to rank, taken atomically
+    int maxlen;
+    int fail;                   // the first failure's status, or RXE_OK
+};
+
+// The strings a thread has lately ranked, by hash, one to a slot. A set worth
+// estimating is often one spelling few strings many ways, and there the draws
+// land on the same strings over and over -- every draw from (a|a){22} on the
+// one string, whose rank is the costly part of a draw. A later string that
+// hashes to a slot simply takes it over.
+#define EST_MEMO 256
+
+struct est_memo {
+    char  *str;                 // NULL in an empty slot
+    size_t len;
+    double inv;
+};
+
+struct est_worker {
+    struct est_run *run;
+    struct rxe_cursor *cur;
+    struct est_memo memo[EST_MEMO];
+};
+
+static unsigned est_hash(const char *s, size_t n)
+{
+    uint64_t h = 1469598103934665603ULL;    // FNV-1a, as rxedup hashes
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return (unsigned)(h % EST_MEMO);
+}
+
+static void est_fail(struct est_run *run, int status)
+{
+    int none = RXE_OK;
+    __atomic_compare_exchange_n(&run->fail, &none, status, 0,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// The status behind a cursor's last failure, from the reason it gave.
+
+static int cursor_status(struct rxe_cursor *cur)
+{
+    const char *why = rxe_cursor_reason(cur);
+    return !strcmp(why, rxe_status_message(RXE_TOO_BIG)) ? RXE_TOO_BIG
+                                                         : RXE_UNIMPLEMENTED;
+}
+
+static void *est_walk(void *arg)
+{
+    struct est_worker *w = arg;
+    struct est_run *run = w->run;
+    char *str = malloc((size_t)run->maxlen + 2);
+    if (!str || !w->cur) { est_fail(run, RXE_NO_MEMORY); free(str); return NULL; }
+    mpz_t m;
+    mpz_init(m);
+    for (;;) {
+        if (__atomic_load_n(&run->fail, __ATOMIC_RELAXED)) break;
+        unsigned long i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (i >= run->samples) break;
+        // A drawn index is inside the set, so a seek fails on a member past
+        // the cap and on nothing else a caller could mend.
+        if (rxe_cursor_seek(w->cur, run->at[i])) {
+            est_fail(run, cursor_status(w->cur));
+            break;
+        }
+        char *end = rxe_cursor_current(str, run->maxlen + 1, w->cur);
+        size_t len = (size_t)(end - str);
+        if (*rxe_cursor_reason(w->cur) || len > (size_t)run->maxlen) {
+            est_fail(run, RXE_TOO_BIG);
+            break;
+        }
+        // Rank reads its string up to a NUL, so a member holding one would be
+        // ranked as a shorter string it is not; such a draw cannot be counted.
+        str[len] = 0;
+        struct est_memo *e = &w->memo[est_hash(str, len)];
+        if (e->str && e->len == len && !memcmp(e->str, str, len)) {
+            run->inv[i] = e->inv;
+            continue;
+        }
+        if (memchr(str, 0, len) || rxe_rank_count(run->rxe, str, m) ||
+            !mpz_sgn(m)) {
+            est_fail(run, RXE_UNIMPLEMENTED);
+            break;
+        }
+        run->inv[i] = 1.0 / mpz_get_d(m);
+        char *copy = realloc(e->str, len + 1);
+        if (copy) {
+            memcpy(copy, str, len + 1);
+            e->str = copy;
+            e->len = len;
+            e->inv = run->inv[i];
+        }
+    }
+    for (int k = 0; k < EST_MEMO; k++) free(w->memo[k].str);
+    mpz_clear(m);
+    free(str);
+    return NULL;
+}
+
+int rxe_estimate_distinct(struct rxe *rxe, unsigned long samples,
+                          gmp_randstate_t rs, int maxlen, int nthreads,
+                          struct rxe_estimate *out)
+{
+    if (!rxe) return RXE_UNIMPLEMENTED;
+    if (rxe->status) return rxe->status;
+    if (rxe_is_infinite(rxe)) return RXE_INFINITE;
+    if (maxlen < 1) return RXE_TOO_BIG;
+    memset(out, 0, sizeof *out);
+    out->share = out->share_lo = out->share_hi = 1;
+    // Rank needs the exact counts; make them once here rather than have every
+    // thread's first rank race to.
+    rxe_force_size(rxe);
+    if (!samples || !mpz_sgn(rxe->nitems)) return RXE_OK;
+
+    struct est_run run;
+    run.rxe = rxe;
+    run.samples = samples;
+    run.next = 0;
+    run.maxlen = maxlen;
+    run.fail = RXE_OK;
+    run.at = NEW(samples, mpz_t);
+    run.inv = NEW(samples, double);
+    for (unsigned long i = 0; i < samples; i++) {
+        mpz_init(run.at[i]);
+        mpz_urandomm(run.at[i], rs, rxe->nitems);
+    }
+
+    if (nthreads < 1) nthreads = 1;
+    if ((unsigned long)nthreads > samples) nthreads = (int)samples;
+    struct est_worker *w = NEW(nthreads, struct est_worker);
+    for (int t = 0; t < nthreads; t++) {
+        w[t].run = &run;
+        w[t].cur = rxe_cursor_new(rxe);
+        memset(w[t].memo, 0, sizeof w[t].memo);
+    }
+    // Thread 0 is this one, as in rxe_foreach_parallel; a thread that will not
+    // spawn leaves its share of the draws to the others.
+    pthread_t *tid = NEW(nthreads, pthread_t);
+    char *spun = NEW(nthreads, char);
+    for (int t = 1; t < nthreads; t++)
+        spun[t] = pthread_create(&tid[t], NULL, est_walk, &w[t]) == 0;
+    est_walk(&w[0]);
+    for (int t = 1; t < nthreads; t++)
+        if (spun[t]) pthread_join(tid[t], NULL);
+
+    int rc = run.fail;
+    if (rc == RXE_OK) {
+        double sum = 0, sq = 0;
+        unsigned long repeated = 0;
+        for (unsigned long i = 0; i < samples; i++) {
+            sum += run.inv[i];
+            repeated += run.inv[i] < 1;
+        }
+        double mean = sum / samples;
+        for (unsigned long i = 0; i < samples; i++)
+            sq += (run.inv[i] - mean) * (run.inv[i] - mean);
+        out->samples = samples;
+        out->repeated = repeated;
+        out->share = mean;
+        if (sq == 0 && samples > 3) {
+            out->share_lo = mean * (1 - 3.0 / samples);
+            out->share_hi = fmin(out->share_lo + 3.0 / samples, 1);
+        } else if (samples < 4) {
+            out->share_lo = 0;
+            out->share_hi = 1;
+        } else {
+            double se = sqrt(sq / (samples - 1) / samples);
+            out->share_lo = fmax(mean - 1.96 * se, 0);
+            out->share_hi = fmin(mean + 1.96 * se, 1);
+        }
+    }
+
+    for (int t = 0; t < nthreads; t++) rxe_cursor_free(w[t].cur);
+    for (unsigned long i = 0; i < samples; i++) mpz_clear(run.at[i]);
+    rxe_mem_free(run.at);
+    rxe_mem_free(run.inv);
+    rxe_mem_free(tid);
+    rxe_mem_free(spun);
+    rxe_mem_free(w);
+    return rc;
+}
@@ -0,0 +1,573 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * filter -- the members of one pattern that a second one matches.
+ *
+ * rxe_parse_filtered(A, B) is the set A, less every member B does not match:
+ * counted exactly, and numbered 0, 1, 2, ... in A's own order, so that seek,
+ * iterate and rank work on it as on any other set. The obvious way to get it
+ * -- walk A, test each member, keep the ones that pass -- costs the whole of
+ * A however few pass, and cannot seek at all. This does neither.
+ *
+ * B becomes a DFA (dfa.c) with S states, and the question every count asks is
+ * then how many members of some part of A take the automaton from each state
+ * to each other. For a class that is a count per column; for a sequence, the
+ * product of its parts' matrices; for an alternation, the sum. Only a vector's
+ * worth of that is ever needed: a pass from the right end of the tree to the
+ * left, carrying w[q] -- how many ways from state q through what lies to the
+ * right to acceptance -- gives at the root how many members are accepted from
+ * the start, which is the size of the filtered set. Nothing is rendered.
+ *
+ * A seek is a pass that stops. Descending the tree the way rxe_alt_seek does,
+ * most significant position first, each position is given two vectors: u, how
+ * many ways to reach each state through the positions already fixed on one
+ * side, and w, how many ways from each state to acceptance through the ones
+ * still open on the other. A candidate x for the position weighs the sum over
+ * q of u[q]*w[x(q)], the filtered members that fix the position to x; walking
+ * the candidates in A's order and subtracting the weights until the index
+ * falls inside one picks the digit, and the candidate's state map moves the
+ * fixed side on before the next position. Which side is fixed depends on the
+ * direction: by default the head is the most significant position, the fixed
+ * side is the left and the open one a pass from the right; under (?L) it is
+ * the other way round, with a pass from the left. The digits so found are an
+ * index into A, and A's own seek renders it.
+ *
+ * A repetition is a sequence of one body, as long as its block: the blocks
+ * are weighed by passing the body over the open side once per run length,
+ * and within the block the positions go as an alternation's would.
+ *
+ * Stepping is the other half. A seek costs a pass over the tree, where A's own
+ * step costs a digit, so rxe_iterate tries the next few members of A first
+ * and tests them against the DFA -- most of the time, for a filter that keeps
+ * much, one of them passes -- and seeks only when they all fail, which skips
+ * the rest of the run B rejects without touching it.
+ *
+ * A must be finite, and numbered by place value: an endless set has no count
+ * to take the filtered one from, and a backreference, a choice, a policy or a
+ * shuffle numbers its members in ways a digit at a time cannot follow. B must
+ * be regular, which rules out the first three of those in it too. B is matched
+ * as a search would match it, anywhere in the member, unless a leading '^' or
+ * a trailing '$' pins it to an end. RXE_FILTER_EXCLUDE keeps the members B
+ * does not match instead, which is the complemented automaton and costs the
+ * same.
+ */
+
+#include <string.h>
+#include "rxe.h"
+#include "rxe_alt.h"
+#include "repeat.h"
+#include "dfa.h"
+#include "filter.h"
+
+struct rxe_filter {
+    int refs;
+    struct rxe_dfa *dfa;          // B, or what B rejects under the exclude flag
+};
+
+enum { BACK, FWD };               // which way a pass runs: see pass_node
+
+/* ------------------------------- Vectors -------------------------------- */
+
+static mpz_t *vec_new(int n)
+{
+    mpz_t *v = NEW(n,mpz_t);
+    int i;
+    for (i=0;i<n;i++) mpz_init(v[i]);
+    return v;
+}
+
+static void vec_free(mpz_t *v, int n)
+{
+    int i;
+    for (i=0;i<n;i++) mpz_clear(v[i]);
+    rxe_mem_free(v);
+}
+
+static void vec_copy(mpz_t *dst, mpz_t *src, int n)
+{
+    int i;
+    for (i=0;i<n;i++) mpz_set(dst[i],src[i]);
+}
+
+static int vec_is_zero(mpz_t *v, int n)
+{
+    int i;
+    for (i=0;i<n;i++) if (mpz_sgn(v[i])) return 0;
+    return 1;
+}
+
+static void dot(mpz_t out, mpz_t *u, mpz_t *w, int n)
+{
+    int i;
+    mpz_set_ui(out,0);
+    for (i=0;i<n;i++) if (mpz_sgn(u[i])) mpz_addmul(out,u[i],w[i]);
+}
+
+/* -------------------------------- Passes -------------------------------- */
+
+// A pass carries a vector across part of the tree. BACK takes one indexed by
+// the state after the part to one indexed by the state before it, out[q] the
+// sum of in[x(q)] over the part's members x; FWD takes one the other way, each
+// in[q] added into out[x(q)]. out is overwritten, and must not be in.
+
+static void pass_rxe(const struct rxe_dfa *d, struct rxe *rxe, int dir,
+                     mpz_t *in, mpz_t *out);
+
+static void pass_class(const struct rxe_dfa *d, struct rxe_node *node,
+                       int dir, mpz_t *in, mpz_t *out)
+{
+    unsigned long cnt[256];
+    int S = d->nstates, k = d->ncls, q, c;
+    // Characters sharing a column go to the same state from every state, so
+    // they are counted, not visited.
+    memset(cnt,0,sizeof cnt);
+    for (c=0;c<node->len;c++) cnt[d->cls[(unsigned char)node->str[c]]]++;
+    for (q=0;q<S;q++) {
+        if (dir == FWD && !mpz_sgn(in[q])) continue;
+        for (c=0;c<k;c++) {
+            if (!cnt[c]) continue;
+            int t = d->next[q*k+c];
+            if (dir == BACK) mpz_addmul_ui(out[q],in[t],cnt[c]);
+            else             mpz_addmul_ui(out[t],in[q],cnt[c]);
+        }
+    }
+}
+
+static void pass_dict(const struct rxe_dfa *d, struct rxe_node *node,
+                      int dir, mpz_t *in, mpz_t *out)
+{
+    int S = d->nstates, q, i;
+    for (q=0;q<S;q++) {
+        if (dir == FWD && !mpz_sgn(in[q])) continue;
+        for (i=0;i<node->nwords;i++) {
+            const char *w = node->words[i];
+            int t = rxe_dfa_run(d,q,w,strlen(w));
+            if (dir == BACK) mpz_add(out[q],out[q],in[t]);
+            else             mpz_add(out[t],out[t],in[q]);
+        }
+    }
+}
+
+// The sum over the run lengths, each run the body passed over once more than
+// the last. A run that leaves nothing leaves nothing for any longer one either.
+
+static void pass_repeat(const struct rxe_dfa *d, struct rxe_node *node,
+                        int dir, mpz_t *in, mpz_t *out)
+{
+    int S = d->nstates, n, q;
+    mpz_t *v = vec_new(S), *t = vec_new(S);
+    vec_copy(v,in,S);
+    for (n=0;;n++) {
+        if (n >= node->rep_min)
+            for (q=0;q<S;q++) mpz_add(out[q],out[q],v[q]);
+        if (n == node->rep_max) break;
+        pass_rxe(d,node->rxe,dir,v,t);
+        mpz_t *s = v; v = t; t = s;
+        if (vec_is_zero(v,S)) break;
+    }
+    vec_free(v,S);
+    vec_free(t,S);
+}
+
+static void pass_node(const struct rxe_dfa *d, struct rxe_node *node, int dir,
+                      mpz_t *in, mpz_t *out)
+{
+    int q;
+    for (q=0;q<d->nstates;q++) mpz_set_ui(out[q],0);
+    if (node->is_repeat)    pass_repeat(d,node,dir,in,out);
+    else if (node->rxe)     pass_rxe(d,node->rxe,dir,in,out);
+    else if (node->is_dict) pass_dict(d,node,dir,in,out);
+    else                    pass_class(d,node,dir,in,out);
+}
+
+static void pass_alt(const struct rxe_dfa *d, struct rxe_alt *alt, int dir,
+                     mpz_t *in, mpz_t *out)
+{
+    int S = d->nstates;
+    struct rxe_node *node;
+    mpz_t *a = vec_new(S), *b = vec_new(S);
+    vec_copy(a,in,S);
+    for ( node = dir == BACK ? alt->tail : alt->head ; node ;
+          node = dir == BACK ? node->prev : node->next ) {
+        pass_node(d,node,dir,a,b);
+        mpz_t *s = a; a = b; b = s;
+    }
+    vec_copy(out,a,S);
+    vec_free(a,S);
+    vec_free(b,S);
+}
+
+static void pass_rxe(const struct rxe_dfa *d, struct rxe *rxe, int dir,
+                     mpz_t *in, mpz_t *out)
+{
+    int S = d->nstates, q;
+    struct rxe_alt *alt;
+    mpz_t *t = vec_new(S);
+    for (q=0;q<S;q++) mpz_set_ui(out[q],0);
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        if (!mpz_sgn(alt->nitems)) continue;
+        pass_alt(d,alt,dir,in,t);
+        for (q=0;q<S;q++) mpz_add(out[q],out[q],t[q]);
+    }
+    vec_free(t,S);
+}
+
+/* -------------------------------- Seeking ------------------------------- */
+
+// Each seek below finds the member of its part that the filtered index 'i'
+// lands in, weighing candidates by u and w as the comment at the top says. It
+// leaves in 'idx' the member's index in the part's own numbering and in 'map'
+// the state it takes each state to, takes from 'i' the weight of everything
+// it passed over, and returns 1 if 'i' was past the lot.
+
+static int seek_rxe(const struct rxe_dfa *d, struct rxe *rxe, mpz_t *u,
+                    mpz_t *w, mpz_t i, mpz_t idx, int *map);
+
+// Moving the fixed side over a position just chosen, and the chosen part's map
+// into the map of everything fixed so far: on the left, states are pushed
+// forward through it and it applies after what came before; on the right,
+// they are pulled back and it applies first.
+
+static void fix_side(const struct rxe_dfa *d, int l2r, mpz_t *fix, mpz_t *tmp,
+                     const int *g, int *map, int *scratch)
+{
+    int S = d->nstates, q;
+    if (!l2r) {
+        for (q=0;q<S;q++) mpz_set_ui(tmp[q],0);
+        for (q=0;q<S;q++)
+            if (mpz_sgn(fix[q])) mpz_add(tmp[g[q]],tmp[g[q]],fix[q]);
+        for (q=0;q<S;q++) map[q] = g[map[q]];
+    } else {
+        for (q=0;q<S;q++) mpz_set(tmp[q],fix[g[q]]);
+        for (q=0;q<S;q++) scratch[q] = map[g[q]];
+        memcpy(map,scratch,(size_t)S*sizeof *map);
+    }
+    vec_copy(fix,tmp,S);
+}
+
+static int seek_repeat(const struct rxe_dfa *d, struct rxe_node *node, int l2r,
+                       mpz_t *u, mpz_t *w, mpz_t i, mpz_t idx, int *map)
+{
+    struct rxe *body = node->rxe;
+    int S = d->nstates, n, s, q, rc = 0, cap = 16;
+    // open[t]: the open side across t positions of the body, from the right
+    // by default, from the left under (?L).
+    mpz_t **open = NEW(cap,mpz_t *);
+    mpz_t *other = l2r ? w : u, wt, dg;
+    mpz_init(wt);
+    mpz_init(dg);
+    open[0] = vec_new(S);
+    vec_copy(open[0],l2r ? u : w,S);
+    for (n=0;;n++) {
+        if (n >= node->rep_min) {
+            dot(wt,other,open[n],S);
+            if (mpz_cmp(i,wt) < 0) break;
+            mpz_sub(i,i,wt);
+        }
+        if (n == node->rep_max) { rc = 1; break; }
+        if (n+1 == cap) {
+            mpz_t **o = NEW(2*cap,mpz_t *);
+            memcpy(o,open,(size_t)cap*sizeof *o);
+            rxe_mem_free(open);
+            open = o;
+            cap *= 2;
+        }
+        open[n+1] = vec_new(S);
+        pass_rxe(d,body,l2r ? FWD : BACK,open[n],open[n+1]);
+        if (vec_is_zero(open[n+1],S)) { n++; rc = 1; break; }
+    }
+    if (!rc) {
+        mpz_t *fix = vec_new(S), *tmp = vec_new(S);
+        int *g = NEW(S,int), *scratch = NEW(S,int);
+        vec_copy(fix,l2r ? w : u,S);
+        for (q=0;q<S;q++) map[q] = q;
+        // The shorter blocks come first; within this one the positions are a
+        // numeral in the body's count, most significant first.
+        mpz_set_ui(idx,0);
+        for (s=0;s<n && !rc;s++) {
+            mpz_t *o = open[n-1-s];
+            rc = l2r ? seek_rxe(d,body,o,fix,i,dg,g)
+                     : seek_rxe(d,body,fix,o,i,dg,g);
+            if (rc) break;
+            mpz_mul(idx,idx,body->nitems);
+            mpz_add(idx,idx,dg);
+            fix_side(d,l2r,fix,tmp,g,map,scratch);
+        }
+        if (n > node->rep_min) {
+            rxe_repeat_nitems(wt,body->nitems,node->rep_min,n-1);
+            mpz_add(idx,idx,wt);
+        }
+        vec_free(fix,S);
+        vec_free(tmp,S);
+        rxe_mem_free(g);
+        rxe_mem_free(scratch);
+    }
+    for (s=0;s<=n && s<cap;s++) vec_free(open[s],S);
+    rxe_mem_free(open);
+    mpz_clear(wt);
+    mpz_clear(dg);
+    return rc;
+}
+
+static int seek_node(const struct rxe_dfa *d, struct rxe_node *node, int l2r,
+                     mpz_t *u, mpz_t *w, mpz_t i, mpz_t idx, int *map)
+{
+    if (node->is_repeat) return seek_repeat(d,node,l2r,u,w,i,idx,map);
+    if (node->rxe) return seek_rxe(d,node->rxe,u,w,i,idx,map);
+    int S = d->nstates, k = d->ncls, n = node->is_dict ? node->nwords : node->len;
+    int p, q, rc = 1;
+    mpz_t wt;
+    mpz_init(wt);
+    for (p=0;p<n;p++) {
+        mpz_set_ui(wt,0);
+        for (q=0;q<S;q++) {
+            if (node->is_dict) {
+                const char *s = node->words[p];
+                map[q] = rxe_dfa_run(d,q,s,strlen(s));
+            } else {
+                map[q] = d->next[q*k + d->cls[(unsigned char)node->str[p]]];
+            }
+            if (mpz_sgn(u[q])) mpz_addmul(wt,u[q],w[map[q]]);
+        }
+        if (mpz_cmp(i,wt) < 0) { rc = 0; break; }
+        mpz_sub(i,i,wt);
+    }
+    mpz_set_ui(idx,p);
+    mpz_clear(wt);
+    return rc;
+}
+
+static int seek_alt(const struct rxe_dfa *d, struct rxe_alt *alt, int l2r,
+                    mpz_t *u, mpz_t *w, mpz_t i, mpz_t idx, int *map)
+{
+    int S = d->nstates, k = 0, j, s, q, rc = 0;
+    struct rxe_node *node, **nd = NEW(alt->nnodes + 1,struct rxe_node *);
+    for ( node = alt->head ; node ; node = node->next ) nd[k++] = node;
+    // open[j]: the open side of position j, across every position on it.
+    mpz_t **open = NEW(k + 1,mpz_t *);
+    for (j=0;j<k;j++) open[j] = vec_new(S);
+    if (l2r) {
+        if (k) vec_copy(open[0],u,S);
+        for (j=1;j<k;j++) pass_node(d,nd[j-1],FWD,open[j-1],open[j]);
+    } else {
+        if (k) vec_copy(open[k-1],w,S);
+        for (j=k-2;j>=0;j--) pass_node(d,nd[j+1],BACK,open[j+1],open[j]);
+    }
+    mpz_t *fix = vec_new(S), *tmp = vec_new(S), dg;
+    int *g = NEW(S,int), *scratch = NEW(S,int);
+    mpz_init(dg);
+    vec_copy(fix,l2r ? w : u,S);
+    for (q=0;q<S;q++) map[q] = q;
+    mpz_set_ui(idx,0);
+    for (s=0;s<k;s++) {
+        j = l2r ? k-1-s : s;
+        rc = l2r ? seek_node(d,nd[j],l2r,open[j],fix,i,dg,g)
+                 : seek_node(d,nd[j],l2r,fix,open[j],i,dg,g);
+        if (rc) break;
+        mpz_mul(idx,idx,rxe_node_radix(nd[j]));
+        mpz_add(idx,idx,dg);
+        fix_side(d,l2r,fix,tmp,g,map,scratch);
+    }
+    // No positions at all: the one member is the empty string, and it weighs
+    // whatever passes straight from u to w.
+    if (!k) {
+        dot(dg,u,w,S);
+        rc = mpz_cmp(i,dg) >= 0;
+    }
+    for (j=0;j<k;j++) vec_free(open[j],S);
+    rxe_mem_free(open);
+    rxe_mem_free(nd);
+    vec_free(fix,S);
+    vec_free(tmp,S);
+    rxe_mem_free(g);
+    rxe_mem_free(scratch);
+    mpz_clear(dg);
+    return rc;
+}
+
+static int seek_rxe(const struct rxe_dfa *d, struct rxe *rxe, mpz_t *u,
+                    mpz_t *w, mpz_t i, mpz_t idx, int *map)
+{
+    int S = d->nstates, rc = 1;
+    int l2r = rxe->flags & RXE_FLAG_LEFT_TO_RIGHT;
+    struct rxe_alt *alt;
+    mpz_t *t = vec_new(S), wt;
+    mpz_init(wt);
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        if (!mpz_sgn(alt->nitems)) continue;
+        pass_alt(d,alt,BACK,w,t);
+        dot(wt,u,t,S);
+        if (mpz_cmp(i,wt) < 0) {
+            rc = seek_alt(d,alt,l2r,u,w,i,idx,map);
+            if (!rc) mpz_add(idx,idx,alt->start);
+            break;
+        }
+        mpz_sub(i,i,wt);
+    }
+    vec_free(t,S);
+    mpz_clear(wt);
+    return rc;
+}
+
+/* ------------------------------------------------------------------------ */
+
+// The start state's row and the accepting column, which every count and seek
+// from the root is between.
+
+static void ends(const struct rxe_dfa *d, mpz_t *u, mpz_t *w)
+{
+    int q;
+    for (q=0;q<d->nstates;q++) mpz_set_ui(w[q],d->accept[q]);
+    if (u) mpz_set_ui(u[d->start],1);
+}
+
+// The index in A of the filtered set's member 'pos'. Returns 1 past the end.
+
+int rxe_filter_locate(struct rxe *rxe, const mpz_t pos, mpz_t at)
+{
+    const struct rxe_dfa *d = rxe->filter->dfa;
+    int S = d->nstates, rc;
+    if (mpz_sgn(pos) < 0 || mpz_cmp(pos,rxe->nitems) >= 0) return 1;
+    mpz_t *u = vec_new(S), *w = vec_new(S), i;
+    int *map = NEW(S,int);
+    ends(d,u,w);
+    mpz_init_set(i,pos);
+    rc = seek_rxe(d,rxe,u,w,i,at,map);
+    mpz_clear(i);
+    vec_free(u,S);
+    vec_free(w,S);
+    rxe_mem_free(map);
+    return rc;
+}
+
+// The other way: how many filtered members come before index 'at' of A. The
+// filtered members are in A's order, so this is the first one at or past it,
+// found by halving; a rank costs a few dozen seeks, not a walk.
+
+void rxe_filter_position(struct rxe *rxe, const mpz_t at, mpz_t pos)
+{
+    mpz_t lo, hi, a;
+    mpz_init_set_ui(lo,0);
+    mpz_init_set(hi,rxe->nitems);
+    mpz_init(a);
+    while (mpz_cmp(lo,hi) < 0) {
+        mpz_add(pos,lo,hi);
+        mpz_fdiv_q_2exp(pos,pos,1);
+        if (rxe_filter_locate(rxe,pos,a) || mpz_cmp(a,at) >= 0)
+            mpz_set(hi,pos);
+        else
+            mpz_add_ui(lo,pos,1);
+    }
+    mpz_set(pos,lo);
+    mpz_clear(lo);
+    mpz_clear(hi);
+    mpz_clear(a);
+}
+
+int rxe_filter_accepts(const struct rxe_filter *filter, const char *s,
+                       size_t len)
+{
+    const struct rxe_dfa *d = filter->dfa;
+    return d->accept[rxe_dfa_run(d,d->start,s,len)];
+}
+
+const struct rxe_dfa *rxe_filter_dfa(const struct rxe_filter *filter)
+{
+    return filter->dfa;
+}
+
+struct rxe_filter *rxe_filter_ref(struct rxe_filter *filter)
+{
+    if (filter) __atomic_add_fetch(&filter->refs,1,__ATOMIC_RELAXED);
+    return filter;
+}
+
+void rxe_filter_unref(struct rxe_filter *filter)
+{
+    if (filter && !__atomic_sub_fetch(&filter->refs,1,__ATOMIC_ACQ_REL)) {
+        rxe_dfa_free(filter->dfa);
+        rxe_mem_free(filter);
+    }
+}
+
+// Whether a set is numbered in a way a filter can follow: place value all the
+// way down, which a backreference, a choice, a policy or a shuffle is not.
+
+static int filterable(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    for ( alt = rxe->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (node->is_backref || node->is_comb || node->is_policy
+                    || node->is_shuffle) return 0;
+            if (node->rxe && !filterable(node->rxe)) return 0;
+        }
+    return 1;
+}
+
+struct rxe *rxe_parse_filtered(const char *str, const char *filter, int flags)
+{
+    struct rxe *rxe = rxe_parse(str,flags);
+    struct rxe_dfa *dfa = NULL;
+    int status, anchor = 0;
+    size_t n = strlen(filter);
+    if (rxe->status) return rxe;
+    if (rxe_is_infinite(rxe) || !filterable(rxe) || rxe->lex) {
+        rxe->status = RXE_FILTER_SET;
+        return rxe;
+    }
+    // The parse drops a leading '^' and a trailing '$' as the no-ops they are
+    // in a pattern that is always matched whole; here they are what says the
+    // filter is not to float, so they are looked for first.
+    if (filter[0] != '^') anchor |= RXE_DFA_FLOAT_START;
+    if (!n || filter[n-1] != '$' || (n > 1 && filter[n-2] == '\\'))
+        anchor |= RXE_DFA_FLOAT_END;
+    struct rxe *b = rxe_parse(filter,flags & (RXE_CASELESS|RXE_DOTALL));
+    status = b->status ? RXE_BAD_FILTER
+                       : rxe_dfa_build(b,anchor,RXE_FILTER_MAX_STATES,&dfa);
+    rxe_free(b);
+    if (status) {
+        rxe->status = status;
+        return rxe;
+    }
+    if (flags & RXE_FILTER_EXCLUDE) rxe_dfa_complement(dfa);
+    // The plan walks A without asking the filter, so it goes; and the counts
+    // a pass reads are every one of A's, put off or not.
+    rxe_uncompile(rxe);
+    rxe_force_size(rxe);
+    rxe->filter = NEW(1,struct rxe_filter);
+    rxe->filter->refs = 1;
+    rxe->filter->dfa = dfa;
+    int S = dfa->nstates;
+    mpz_t *w = vec_new(S), *t = vec_new(S);
+    ends(dfa,NULL,w);
+    pass_rxe(dfa,rxe,BACK,w,t);
+    mpz_set(rxe->nitems,t[dfa->start]);
+    vec_free(w,S);
+    vec_free(t,S);
+    // Start on the first member that passes, as a parse starts on its first.
+    if (mpz_sgn(rxe->nitems)) {
+        mpz_t z;
+        mpz_init(z);
+        rxe_seek(rxe,z);
+        mpz_clear(z);
+    } else {
+        rxe->walk.curr = NULL;
+    }
+    return rxe;
+}
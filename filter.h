@@ -0,0 +1,32 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+#ifndef __RXE_FILTER_H__
+#define __RXE_FILTER_H__
+
+// The filter of rxe_parse_filtered: the second pattern's automaton, immutable
+// once built and shared by every clone of the expression it filters, as the
+// plan is. See filter.c.
+
+struct rxe_filter *rxe_filter_ref(struct rxe_filter *filter);
+void rxe_filter_unref(struct rxe_filter *filter);
+int  rxe_filter_accepts(const struct rxe_filter *filter, const char *s,
+                        size_t len);
+const struct rxe_dfa *rxe_filter_dfa(const struct rxe_filter *filter);
+int  rxe_filter_locate(struct rxe *rxe, const mpz_t pos, mpz_t at);
+void rxe_filter_position(struct rxe *rxe, const mpz_t at, mpz_t pos);
+
+#endif // __RXE_FILTER_H__
@@ -29,12 +29,16 @@
  * positions scatter across the set, so each is a fresh seek -- and is left to
  * rxenum's own loop; foreach is the unshuffled fast path on purpose.
  *
- * It touches neither rxe_current nor rxe_iterate: it only drives them. That
+ * It touches neither the render nor rxe_iterate: it only drives them. That
  * keeps the primitive orthogonal to the engine it stands on, which is the whole
  * point of carving it out.
  */
 
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
 #include "rxe.h"
+#include "plan.h"
 
 int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
                 int maxlen, rxe_sink emit, void *ctx)
@@ -52,9 +56,16 @@ int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
     // odometer; left is the countdown for 'count', held apart so a zero count
     // (no limit) never decrements and so never reaches the stop. Both are
     // copies: the arguments are const, and rxe_seek wants a mutable index.
-    mpz_t idx, left;
+    // left is only ever compared and decremented, so it is an rxe_int, which
+    // a fixed-width build keeps in a register; a count past the word pins at
+    // its top, further than any walk gets.
+    mpz_t idx;
+    rxe_int left;
     mpz_init_set(idx, from);
-    mpz_init_set(left, count);
+    ri_init(left);
+    ri_set_mpz(left, count);
+    rxe_int one;
+    ri_init_set_ui(one, 1);
 
     int rc;
 
@@ -70,7 +81,9 @@ int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
     }
 
     for (;;) {
-        char *end = rxe_current(str, maxlen + 1, rxe);
+        // Each member after the first is mostly the one before it, and the
+        // buffer is private, so only the part the step moved is rendered.
+        char *end = rxe_current_delta(str, maxlen + 1, rxe);
         size_t len = (size_t)(end - str);
         // Two ways a member cannot be delivered whole: the render path raised
         // the overflow latch on a closed-form repeat too big to build, or the
@@ -84,9 +97,9 @@ int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
         }
         // Meet the count before stepping, so exactly 'count' members are seen
         // and the odometer is not advanced past the last wanted one.
-        if (mpz_sgn(left)) {
-            mpz_sub_ui(left, left, 1);
-            if (!mpz_sgn(left)) { rc = RXE_FOREACH_END; break; }
+        if (ri_sgn(left)) {
+            ri_sub(left, left, one);
+            if (!ri_sgn(left)) { rc = RXE_FOREACH_END; break; }
         }
         mpz_add_ui(idx, idx, 1);
         // A finite set wraps here -- rxe_iterate carries out and resets to the
@@ -97,7 +110,460 @@ int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
 
 done:
     mpz_clear(idx);
+    ri_clear(left);
+    ri_clear(one);
+    free(str);
+    return rc;
+}
+
+/*
+ * rxe_seek_many -- a list of indices rather than a range: resumed shards, a
+ * sampled audit set, hits to render again. Seeking each one divides it
+ * through every node, though neighbours in a sorted list mostly agree on all
+ * but their low digits. So only the first is seeked; each after it is reached
+ * by rxe_advance from the one before, which carries the difference through the
+ * low digits and leaves the high ones standing, and then delta-rendered, which
+ * leaves the prefix they spell standing too. A gap too wide for a long is
+ * seeked as before. The list need not be sorted -- an advance goes either way
+ * -- but the closer neighbours sit, the nearer this comes to a plain walk.
+ */
+
+int rxe_seek_many(struct rxe *rxe, const mpz_t *idx, size_t n, int maxlen,
+                  rxe_sink emit, void *ctx)
+{
+    if (!rxe || maxlen < 1) return RXE_FOREACH_RANGE;
+    // One byte over the width, as in rxe_foreach, to tell a member that fills
+    // it from one that does not fit.
+    char *str = malloc((size_t)maxlen + 2);
+    if (!str) return RXE_FOREACH_TOOBIG;
+    mpz_t gap;
+    mpz_init(gap);
+    int rc = RXE_FOREACH_END;
+    size_t j;
+    rxe_check_overflow();
+    for ( j = 0 ; j < n ; j++ ) {
+        int moved;
+        if (j) mpz_sub(gap, idx[j], idx[j-1]);
+        if (j && mpz_fits_slong_p(gap)) {
+            moved = rxe_advance(rxe, mpz_get_si(gap));
+        } else {
+            // rxe_seek wants a mutable index, though it never changes it.
+            mpz_set(gap, idx[j]);
+            moved = rxe_seek(rxe, gap);
+        }
+        if (moved) {
+            rc = rxe_member_overflow ? RXE_FOREACH_TOOBIG : RXE_FOREACH_RANGE;
+            rxe_member_overflow = 0;
+            break;
+        }
+        char *end = rxe_current_delta(str, maxlen + 1, rxe);
+        size_t len = (size_t)(end - str);
+        if (rxe_member_overflow) { rxe_member_overflow = 0; rc = RXE_FOREACH_TOOBIG; break; }
+        if (len > (size_t)maxlen)                { rc = RXE_FOREACH_TOOBIG; break; }
+        if (emit && emit(str, len, idx[j], ctx)) {
+            rc = RXE_FOREACH_STOP;
+            break;
+        }
+    }
+    mpz_clear(gap);
+    free(str);
+    return rc;
+}
+
+/*
+ * rxe_render_batch -- the same walk with the sink turned inside out: the caller
+ * asks for the next n members and gets them back to back in one buffer, with
+ * an offsets table to find them by, as a columnar store lays out a string
+ * column. A consumer that hashes or filters thousands at a time then pays
+ * neither an indirect call nor a terminated copy per member.
+ *
+ * Members land end to end, so the one before is always sitting just behind
+ * where the next goes. Each is laid by copying the prefix the step left alone
+ * -- rxe_touched says how much -- and delta-rendering the rest after it, which
+ * is exactly what rxe_current_delta does in place; only the place moves.
+ */
+
+int rxe_render_batch(struct rxe *rxe, size_t n, char *buf, size_t bufsize,
+                     size_t *offsets, size_t *produced)
+{
+    size_t k = 0, off = 0;
+    int rc = RXE_FOREACH_STOP;
+    *produced = 0;
+    if (!rxe || !buf) return RXE_FOREACH_RANGE;
+    if (n && bufsize < 2) return RXE_FOREACH_TOOBIG;
+    if (RS(rxe)->plan_live)
+        return rxe_plan_render_batch(rxe->plan,RS(rxe)->plan_state,n,buf,bufsize,
+                                     offsets,produced);
+    offsets[0] = 0;
+    // Stale overflow would read as this batch's; see rxe_foreach.
+    rxe_check_overflow();
+    while (k < n) {
+        // The render writes a NUL after the member, and a member that fills
+        // its width cannot be told from one cut short at it, so a member is
+        // taken only with a byte to spare past its terminator.
+        size_t room = bufsize - off;
+        if (room < 2) break;
+        int maxlen = room - 1 > INT_MAX ? INT_MAX : (int)(room - 1);
+        char *at = buf + off, *end;
+        if (k) {
+            size_t prev = off - offsets[k-1], keep = rxe_touched(rxe);
+            if (keep > prev) keep = prev;
+            if (keep > (size_t)maxlen) keep = maxlen;
+            memcpy(at, buf + offsets[k-1], keep);
+            end = rxe_current_delta(at, maxlen, rxe);
+        } else {
+            end = rxe_current(at, maxlen, rxe);
+        }
+        // Too long for what is left. The member stays current, for the next
+        // batch to start on; only if the whole buffer cannot hold it is that
+        // an error rather than a full buffer.
+        if (rxe_member_overflow || end - at >= maxlen) {
+            rxe_member_overflow = 0;
+            if (!k) rc = RXE_FOREACH_TOOBIG;
+            break;
+        }
+        off = (size_t)(end - buf);
+        offsets[++k] = off;
+        // A finite set wraps to its first member after the last; the caller
+        // sees the end, and the expression is back at the start.
+        if (!rxe_next(rxe)) { rc = RXE_FOREACH_END; break; }
+    }
+    // The caller's own buffer does not hold the last member laid here, so the
+    // next rxe_current_delta must not take it to.
+    RS(rxe)->moved_all = 1;
+    *produced = k;
+    return rc;
+}
+
+/*
+ * rxe_foreach_parallel -- the same walk, over every core, without each tool
+ * cutting the range up by hand.
+ *
+ * The static split -- T equal slices, one per thread -- is only fair when every
+ * member costs the same. It doesn't: members differ in length, a backreference
+ * renders twice, a closed-form repeat can be long, and the thread dealt the
+ * expensive slice finishes long after the rest sat idle. So the range is still
+ * dealt out in T slices, but a thread eats its own in chunks from the front,
+ * and one whose slice has run dry takes the back half of another's. The
+ * victim's slice shrinks under its lock, the thief's grows, and no member is
+ * ever in two slices at once. A chunk is what a thread walks without asking
+ * again: one seek and a run of steps, the shape rxe_foreach is built for.
+ *
+ * An infinite set with no count has no range to split. There every thread
+ * takes its chunks from one shared frontier that only moves forward, until a
+ * sink says stop.
+ *
+ * Each thread walks through its own rxe_cursor, so the caller's rxe is read and
+ * never moved. Cursors are made, and freed, on the calling thread, so any
+ * count the parse deferred is settled before a walker starts.
+ */
+
+#define PAR_CHUNK 1024          // most members a thread walks per grab
+
+struct par_slice {
+    pthread_mutex_t mu;
+    mpz_t lo, hi;               // what is left of this thread's slice
+};
+
+struct par_run {
+    int nthreads;
+    int maxlen;
+    rxe_sink emit;
+    void *const *ctx;
+    struct par_slice *slice;
+    int bounded;                // 0: infinite and uncounted, use 'next'
+    pthread_mutex_t mu;         // guards 'next', 'stop' and 'stop_at'
+    mpz_t next;
+    unsigned long chunk;
+    int stop;                   // the verdict of the lowest stop, 0 while none
+    mpz_t stop_at;              // the index it came at
+    int stopped;                // read unlocked: has anything stopped yet
+};
+
+struct par_worker {
+    struct par_run *run;
+    int t;
+    struct rxe_cursor *cur;
+};
+
+// Record a verdict at index 'at'. The walk's answer is the serial one -- the
+// verdict at the lowest index that stopped -- and not whichever thread got
+// there first: a thread running ahead can hit a member too big to render while
+// a slice below it has yet to reach the member its sink stops on. So a stop
+// keeps only the lowest index, and the members below it are still walked,
+// since any of them may stop lower yet.
+static void par_cancel(struct par_run *run, int rc, const mpz_t at)
+{
+    pthread_mutex_lock(&run->mu);
+    if (!run->stop || mpz_cmp(at, run->stop_at) < 0) {
+        run->stop = rc;
+        mpz_set(run->stop_at, at);
+        __atomic_store_n(&run->stopped, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&run->mu);
+}
+
+// Whether index 'at' is at or past the lowest stop, and so not to be walked.
+static int par_past(struct par_run *run, const mpz_t at)
+{
+    if (!__atomic_load_n(&run->stopped, __ATOMIC_RELAXED)) return 0;
+    pthread_mutex_lock(&run->mu);
+    int past = mpz_cmp(at, run->stop_at) >= 0;
+    pthread_mutex_unlock(&run->mu);
+    return past;
+}
+
+// Cut slice 's' off at the lowest stop, so nothing past it is handed out. The
+// caller holds s->mu; the run's lock is only ever taken inside a slice's.
+static void par_clip(struct par_run *run, struct par_slice *s)
+{
+    if (!__atomic_load_n(&run->stopped, __ATOMIC_RELAXED)) return;
+    pthread_mutex_lock(&run->mu);
+    if (mpz_cmp(s->hi, run->stop_at) > 0)
+        mpz_set(s->hi, mpz_cmp(s->lo, run->stop_at) > 0 ? s->lo : run->stop_at);
+    pthread_mutex_unlock(&run->mu);
+}
+
+// Take up to 'chunk' members from the front of slice 's' into [lo, lo+n).
+// The caller holds s->mu.
+static int par_take_front(struct par_run *run, struct par_slice *s,
+                          mpz_t lo, unsigned long *n)
+{
+    par_clip(run, s);
+    if (mpz_cmp(s->lo, s->hi) >= 0) return 0;
+    mpz_t left;
+    mpz_init(left);
+    mpz_sub(left, s->hi, s->lo);
+    *n = mpz_cmp_ui(left, run->chunk) < 0 ? mpz_get_ui(left) : run->chunk;
+    mpz_set(lo, s->lo);
+    mpz_add_ui(s->lo, s->lo, *n);
     mpz_clear(left);
+    return 1;
+}
+
+// The next chunk for thread t: from its own slice while it lasts, else from
+// the back half of the first other slice with anything left in it, else
+// nothing -- every member is either walked or in a chunk another thread holds.
+static int par_grab(struct par_run *run, int t, mpz_t lo, unsigned long *n)
+{
+    if (!run->bounded) {
+        pthread_mutex_lock(&run->mu);
+        int got = !run->stop || mpz_cmp(run->next, run->stop_at) < 0;
+        mpz_set(lo, run->next);
+        mpz_add_ui(run->next, run->next, run->chunk);
+        pthread_mutex_unlock(&run->mu);
+        *n = run->chunk;
+        return got;
+    }
+
+    struct par_slice *own = &run->slice[t];
+    pthread_mutex_lock(&own->mu);
+    int got = par_take_front(run, own, lo, n);
+    pthread_mutex_unlock(&own->mu);
+    if (got) return 1;
+
+    mpz_t mid, hi;
+    mpz_init(mid);
+    mpz_init(hi);
+    for (int k = 1; k < run->nthreads && !got; k++) {
+        struct par_slice *v = &run->slice[(t + k) % run->nthreads];
+        pthread_mutex_lock(&v->mu);
+        par_clip(run, v);
+        if (mpz_cmp(v->lo, v->hi) < 0) {
+            // Halve what the victim has left; a remainder no bigger than one
+            // chunk is taken whole rather than split into crumbs.
+            mpz_sub(mid, v->hi, v->lo);
+            if (mpz_cmp_ui(mid, run->chunk) <= 0) mpz_set(mid, v->lo);
+            else { mpz_fdiv_q_2exp(mid, mid, 1); mpz_add(mid, mid, v->lo); }
+            mpz_set(hi, v->hi);
+            mpz_set(v->hi, mid);
+            got = 1;
+        }
+        pthread_mutex_unlock(&v->mu);
+    }
+    if (got) {
+        pthread_mutex_lock(&own->mu);
+        mpz_set(own->lo, mid);
+        mpz_set(own->hi, hi);
+        par_take_front(run, own, lo, n);
+        pthread_mutex_unlock(&own->mu);
+    }
+    mpz_clear(mid);
+    mpz_clear(hi);
+    return got;
+}
+
+static void *par_walk(void *arg)
+{
+    struct par_worker *w = arg;
+    struct par_run *run = w->run;
+    void *ctx = run->ctx ? run->ctx[w->t] : NULL;
+    char *str = malloc((size_t)run->maxlen + 2);
+
+    // 'at' is the index the cursor stands on, valid while 'placed': a chunk
+    // that starts where the last one ended -- the usual case, eating one's own
+    // slice front to back -- is stepped into, not sought.
+    mpz_t lo, idx;
+    mpz_init(lo);
+    mpz_init(idx);
+    int placed = 0;
+    unsigned long n;
+
+    while (par_grab(run, w->t, lo, &n)) {
+        if (!str) {
+            // No buffer to walk with: the chunk cannot be walked, so its first
+            // member is where this thread's walk stops.
+            par_cancel(run, RXE_FOREACH_TOOBIG, lo);
+            break;
+        }
+        if (par_past(run, lo)) continue;
+        if (!placed || mpz_cmp(lo, idx)) {
+            mpz_set(idx, lo);
+            if (rxe_cursor_seek(w->cur, idx)) {
+                // Within a bounded range the index is never past the end, so
+                // a failed seek is a member too large to build. Unbounded, it
+                // is the same: an infinite set has no end to be past.
+                par_cancel(run, RXE_FOREACH_TOOBIG, idx);
+                placed = 0;
+                continue;
+            }
+            placed = 1;
+        }
+        for (unsigned long i = 0; i < n; i++) {
+            if (par_past(run, idx)) break;
+            char *end = rxe_cursor_current_delta(str, run->maxlen + 1, w->cur);
+            size_t len = (size_t)(end - str);
+            if (*rxe_cursor_reason(w->cur) || len > (size_t)run->maxlen) {
+                par_cancel(run, RXE_FOREACH_TOOBIG, idx);
+                placed = 0;
+                break;
+            }
+            if (run->emit && run->emit(str, len, idx, ctx)) {
+                par_cancel(run, RXE_FOREACH_STOP, idx);
+                break;
+            }
+            mpz_add_ui(idx, idx, 1);
+            rxe_cursor_iterate(w->cur);
+        }
+    }
+
+    mpz_clear(lo);
+    mpz_clear(idx);
     free(str);
+    return NULL;
+}
+
+int rxe_foreach_parallel(struct rxe *rxe, const mpz_t from, const mpz_t count,
+                         int maxlen, rxe_sink emit, void *const *ctx,
+                         int nthreads)
+{
+    if (!rxe || rxe->status || maxlen < 1 || mpz_sgn(from) < 0)
+        return RXE_FOREACH_RANGE;
+    if (nthreads < 1) nthreads = 1;
+
+    struct par_run run;
+    run.nthreads = nthreads;
+    run.maxlen = maxlen;
+    run.emit = emit;
+    run.ctx = ctx;
+    run.stop = 0;
+    run.stopped = 0;
+    run.bounded = 1;
+    mpz_init(run.next);
+    mpz_init(run.stop_at);
+
+    // The range to walk, [from, end). A count bounds it; a finite set bounds it
+    // too, and a 'from' already at the end of one is the serial RANGE. Only an
+    // infinite set walked without a count is left open.
+    mpz_t end;
+    mpz_init(end);
+    if (mpz_sgn(count)) mpz_add(end, from, count);
+    rxe_force_size(rxe);
+    if (!rxe_is_infinite(rxe)) {
+        if (mpz_cmp(from, rxe->nitems) >= 0) {
+            mpz_clear(end);
+            mpz_clear(run.next);
+            mpz_clear(run.stop_at);
+            return RXE_FOREACH_RANGE;
+        }
+        if (!mpz_sgn(count) || mpz_cmp(end, rxe->nitems) > 0)
+            mpz_set(end, rxe->nitems);
+    } else if (!mpz_sgn(count)) {
+        run.bounded = 0;
+        mpz_set(run.next, from);
+    }
+
+    // A chunk small enough that every thread gets several from a small range --
+    // so there is something left to steal -- and big enough that a large one
+    // pays its seek once per thousand members, not once per member.
+    run.chunk = PAR_CHUNK;
+    if (run.bounded) {
+        mpz_t q;
+        mpz_init(q);
+        mpz_sub(q, end, from);
+        mpz_fdiv_q_ui(q, q, (unsigned long)nthreads * 8);
+        if (mpz_cmp_ui(q, run.chunk) < 0) run.chunk = mpz_get_ui(q);
+        if (run.chunk < 1) run.chunk = 1;
+        mpz_clear(q);
+    }
+
+    // Deal the range in even slices, the first 'rem' one member longer.
+    run.slice = NEW(nthreads, struct par_slice);
+    {
+        mpz_t base, rem, off;
+        mpz_init(base);
+        mpz_init(rem);
+        mpz_init_set(off, from);
+        if (run.bounded) {
+            mpz_sub(base, end, from);
+            mpz_fdiv_qr_ui(base, rem, base, (unsigned long)nthreads);
+        }
+        for (int t = 0; t < nthreads; t++) {
+            struct par_slice *s = &run.slice[t];
+            pthread_mutex_init(&s->mu, NULL);
+            mpz_init_set(s->lo, off);
+            mpz_add(off, off, base);
+            if (mpz_cmp_ui(rem, (unsigned long)t) > 0) mpz_add_ui(off, off, 1);
+            mpz_init_set(s->hi, off);
+        }
+        mpz_clear(base);
+        mpz_clear(rem);
+        mpz_clear(off);
+    }
+    pthread_mutex_init(&run.mu, NULL);
+
+    struct par_worker *w = NEW(nthreads, struct par_worker);
+    for (int t = 0; t < nthreads; t++) {
+        w[t].run = &run;
+        w[t].t = t;
+        w[t].cur = rxe_cursor_new(rxe);
+    }
+
+    // Thread 0 is this one. A thread that will not spawn leaves its slice
+    // where the others will steal it, and its ctx simply goes unused.
+    pthread_t *tid = NEW(nthreads, pthread_t);
+    char *spun = NEW(nthreads, char);
+    for (int t = 1; t < nthreads; t++)
+        spun[t] = pthread_create(&tid[t], NULL, par_walk, &w[t]) == 0;
+    par_walk(&w[0]);
+    for (int t = 1; t < nthreads; t++)
+        if (spun[t]) pthread_join(tid[t], NULL);
+
+    int rc = run.stop ? run.stop : RXE_FOREACH_END;
+
+    for (int t = 0; t < nthreads; t++) {
+        rxe_cursor_free(w[t].cur);
+        pthread_mutex_destroy(&run.slice[t].mu);
+        mpz_clear(run.slice[t].lo);
+        mpz_clear(run.slice[t].hi);
+    }
+    pthread_mutex_destroy(&run.mu);
+    rxe_mem_free(tid);
+    rxe_mem_free(spun);
+    rxe_mem_free(w);
+    rxe_mem_free(run.slice);
+    mpz_clear(run.next);
+    mpz_clear(run.stop_at);
+    mpz_clear(end);
     return rc;
 }
@@ -19,6 +19,8 @@
 #include "rxe.h"
 #include "rxe_graph.h"
 #include "lens.h"    // rxe_seek_at_length, for rendering a lit repeat's text
+#include "plan.h"    // rxe_sync_tree, so a planned seek lights the tree too
+#include "repeat.h"  // rxe_repeat_digit, the index each position holds
 
 // The walk's running state: the visitor to drive, the next node id (sequential,
 // so ids match rxedot's old counter), the caller's options and the root source
@@ -76,20 +78,21 @@ static void node_text(char *b, size_t n, struct walk *w, struct rxe_node *node)
     char *end = b;      // rxe_current writes up to (maxlen) chars then a null, so
     b[0] = 0;           // it is always handed (bytes left) - 1.
     if (node->is_repeat || node->is_comb) {
-        for (int i = 0; i < node->rep_count && i < node->rep_alloc; i++) {
+        for (int i = 0; i < NS(node)->rep_count && i < NS(node)->rep_alloc; i++) {
             size_t left = n - (size_t)(end - b);
             if (left <= 1) break;
-            if (shortlex ? rxe_seek_at_length(node->rxe, node->rep_len[i], node->rep_digit[i])
-                         : rxe_seek(node->rxe, node->rep_digit[i])) break;
+            mpz_ptr digit = rxe_repeat_digit(node, i);
+            if (shortlex ? rxe_seek_at_length(node->rxe, NS(node)->rep_len[i], digit)
+                         : rxe_seek(node->rxe, digit)) break;
             end = rxe_current(end, (int)left - 1, node->rxe);
         }
     } else if (node->rxe) {
         end = rxe_current(end, (int)n - 1, node->rxe);
     } else if (node->is_dict) {
-        const char *word = node->words[node->iterator];
+        const char *word = node->words[NS(node)->iterator];
         while (*word && (size_t)(end - b) + 1 < n) *end++ = *word++;
     } else if (node->len) {
-        if (n > 1) *end++ = node->str[node->iterator];
+        if (n > 1) *end++ = node->str[NS(node)->iterator];
     }
     *end = 0;
 }
@@ -109,14 +112,14 @@ static void node_source(char *b, size_t n, struct walk *w, struct rxe_node *node
 static void repeat_choices(struct rxe_node *node, char *b, size_t n) {
     b[0] = 0;
     size_t p = 0;
-    for (int i = 0; i < node->rep_count && i < 24; i++) {
+    for (int i = 0; i < NS(node)->rep_count && i < 24; i++) {
         char piece[128];
-        rxe_seek(node->rxe, node->rep_digit[i]);
+        rxe_seek(node->rxe, rxe_repeat_digit(node, i));
         rxe_current(piece, sizeof piece - 1, node->rxe);
         p += snprintf(b + p, p < n ? n - p : 0, "%s%s", i ? " " : "→ ", piece);
         if (p >= n - 12) break;
     }
-    if (node->rep_count > 24 && p < n - 3)
+    if (NS(node)->rep_count > 24 && p < n - 3)
         snprintf(b + p, n - p, " …");
 }
 
@@ -216,7 +219,7 @@ static int draw_node(struct walk *w, struct rxe_node *node, const char *weight,
             unroll = node->rep_max;
         else {
             recurse = 1;
-            if (onpath && fixed && node->rep_count >= 1)
+            if (onpath && fixed && NS(node)->rep_count >= 1)
                 repeat_choices(node, choices, sizeof choices);
         }
     }
@@ -251,7 +254,7 @@ static int draw_node(struct walk *w, struct rxe_node *node, const char *weight,
 
     if (unroll) {
         for (int i = 0; i < unroll; i++) {
-            if (onpath && i < node->rep_count) rxe_seek(node->rxe, node->rep_digit[i]);
+            if (onpath && i < NS(node)->rep_count) rxe_seek(node->rxe, rxe_repeat_digit(node, i));
             draw_contents(w, id, node->rxe, onpath);
         }
     } else if (recurse && node->rxe) {
@@ -346,7 +349,7 @@ static void draw_contents(struct walk *w, int parent, struct rxe *rxe, int onpat
     int rev = w->opts->alt_reverse;
     struct rxe_alt *a = rev ? rxe->tail : rxe->head;
     for (k = rev ? nsub - 1 : 0; a; a = rev ? a->prev : a->next, k += rev ? -1 : 1) {
-        int branch = onpath && a == rxe->curr;
+        int branch = onpath && a == RS(rxe)->curr;
         char blabel[140];
         snprintf(blabel, sizeof blabel, "%s\n+%s", subs[k].start, subs[k].card);
         draw_seq(w, aid, k, a, branch, blabel);
@@ -357,6 +360,8 @@ static void draw_contents(struct walk *w, int parent, struct rxe *rxe, int onpat
 void rxe_graph_walk(struct rxe *rxe, const struct rxe_graph_opts *opts,
                     const struct rxe_graph_visitor *v, void *ctx) {
     struct walk w = { 0 };
+    // Every node is labelled with its count.
+    rxe_force_size(rxe);
     w.v = v; w.ctx = ctx; w.opts = opts; w.root = rxe; w.source = rxe->source;
     w.idc = 0;
     int root = w.idc++;
@@ -365,6 +370,9 @@ void rxe_graph_walk(struct rxe *rxe, const struct rxe_graph_opts *opts,
     int inf = rxe_is_infinite(rxe);
     gnum(card, sizeof card, rxe->nitems, inf);
     gexact(cardx, sizeof cardx, rxe->nitems, inf);
+    // A path is read off the tree's own state, which a planned seek leaves
+    // behind; have the tree catch up before reading it.
+    if (opts->on_path) rxe_sync_tree(rxe);
     if (opts->on_path) rxe_current(text, sizeof text, rxe);
     struct rxe_gnode_ev ev = { 0 };
     ev.id = root; ev.kind = RXE_G_ROOT; ev.line1 = "set"; ev.card = card;
@@ -0,0 +1,446 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+// Expression images: a parse written out so another process can have it back
+// without the pattern's dictionaries on hand.
+//
+// What makes a parse slow to repeat is rarely the pattern. It is what the
+// pattern names: a [:name:] goes through the resolver, which for rxenum means
+// finding and reading a word list, and a sharded job repeats that in every
+// worker -- each of which must also end up with the very same words, in the
+// same order, or the workers number the set differently and the shards
+// overlap. An image carries the words, so a worker loads it and is done, and
+// agrees by construction.
+//
+// The tree itself is not written out. It is the product of the pattern and
+// the options, and rebuilding it from them is quick and can never drift from
+// what rxe_parse would build; a copy of the nodes would have to track every
+// field a node kind grows. What is written instead is the set's exact count,
+// which the loader checks its rebuilt tree against, so an image taken to a
+// library that numbers the set differently is refused instead of used.
+//
+// The exception is a set numbered off its automaton (RXE_DISTINCT and
+// RXE_BYTE_ORDER; see lex.c). Its tree is as quick to rebuild as any, but the
+// automaton can take seconds to build and its counts more arithmetic still,
+// and every worker would repeat both. So the automaton is written out too,
+// states, moves and each state's counts, and the loader parses the tree
+// without it and puts the set on the automaton as read.
+//
+// The layout, in order, every integer a little-endian u32 and every part
+// padded to a multiple of four bytes:
+//
+//     "RXEIMAGE"   magic
+//     version      RXE_IMAGE_VERSION
+//     options      what rxe_parse was given
+//     source       byte count, then the pattern and a NUL
+//     count        byte count, then the count big-endian; 0xffffffff if the
+//                  count was put off (RXE_LAZY_SIZE) and so is not known
+//     ndicts       then for each: word count, name length, bytes of words,
+//                  the name and a NUL, and the words each ended by a NUL
+//     nstates      of the automaton, 0 when the set is numbered off its
+//                  tree; then its start, its column count, each byte's
+//                  column, every state's moves a column at a time, every
+//                  state's accepting flag a byte each, and every state's
+//                  weight and count, each written as the count above is
+//
+// Offsets only, no pointers, so the image means the same wherever it is
+// mapped. The loader reads the words in place rather than copying them, which
+// is what lets every worker that maps one file share its pages.
+
+#include <string.h>
+#include "rxe.h"
+#include "dict.h"
+#include "dfa.h"
+#include "lex.h"
+
+#define IMAGE_MAGIC   "RXEIMAGE"
+#define NO_COUNT      0xffffffffUL
+
+/* ------------------------------- Writing -------------------------------- */
+
+struct out {
+    unsigned char *buf;         // NULL while only sizing
+    size_t at;
+};
+
+static void put(struct out *o, const void *p, size_t n)
+{
+    if (o->buf && n) memcpy(o->buf + o->at, p, n);
+    o->at += n;
+}
+
+static void put_u32(struct out *o, unsigned long v)
+{
+    unsigned char b[4] = { v & 0xff, v >> 8 & 0xff, v >> 16 & 0xff, v >> 24 & 0xff };
+    put(o, b, 4);
+}
+
+static void pad(struct out *o)
+{
+    static const unsigned char zero[4];
+    put(o, zero, (4 - o->at % 4) % 4);
+}
+
+// A non-negative number: its byte count, then its bytes big-endian.
+static void put_num(struct out *o, mpz_srcptr z)
+{
+    size_t nb = mpz_sgn(z) ? mpz_sizeinbase(z,256) : 0;
+    put_u32(o, nb);
+    if (o->buf && nb) {
+        size_t got;
+        mpz_export(o->buf + o->at,&got,1,1,1,0,z);
+    }
+    o->at += nb;
+    pad(o);
+}
+
+static void put_lex(struct out *o, const struct rxe_lex *lex)
+{
+    int q, b;
+    if (!lex) {
+        put_u32(o, 0);
+        return;
+    }
+    const struct rxe_dfa *d = rxe_lex_dfa(lex);
+    put_u32(o, d->nstates);
+    put_u32(o, d->start);
+    put_u32(o, d->ncls);
+    for (b=0;b<256;b++) put_u32(o, d->cls[b]);
+    for (q=0;q<d->nstates * d->ncls;q++) put_u32(o, d->next[q]);
+    put(o, d->accept, d->nstates);
+    pad(o);
+    for (q=0;q<d->nstates;q++) {
+        put_num(o, rxe_lex_weight(lex,q));
+        put_num(o, rxe_lex_count(lex,q));
+    }
+}
+
+// The dictionaries a tree names, each once however many nodes name it.
+struct named {
+    char      **words;
+    int         nwords;
+    const char *name;
+    char       *copy;           // name, when it is the registry's, copied
+};
+
+static void free_named(struct named *list, int n)
+{
+    int i;
+    if (!list) return;
+    for (i=0;i<n;i++) if (list[i].copy) rxe_mem_free(list[i].copy);
+    rxe_mem_free(list);
+}
+
+static int collect(struct rxe *rxe, const struct rxe_baked *baked,
+                   struct named *list, int *n, int cap)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    int i;
+    for ( alt = rxe->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (node->is_dict) {
+                for (i=0;i<*n;i++) if (list[i].words == node->words) break;
+                if (i == *n) {
+                    const char *name = NULL;
+                    char *copy = NULL;
+                    // A loaded expression's words are the image's, which the
+                    // registry has never seen.
+                    if (baked)
+                        for (i=0;i<baked->ndicts && !name;i++)
+                            if (baked->dict[i].words == node->words)
+                                name = baked->dict[i].name;
+                    if (!name) name = copy = rxe_dict_name(node->words);
+                    if (!name || *n == cap) {
+                        if (copy) rxe_mem_free(copy);
+                        return 1;
+                    }
+                    list[*n].words = node->words;
+                    list[*n].nwords = node->nwords;
+                    list[*n].name = name;
+                    list[*n].copy = copy;
+                    (*n)++;
+                }
+            }
+            if (node->rxe && !node->is_backref &&
+                collect(node->rxe,baked,list,n,cap)) return 1;
+        }
+    return 0;
+}
+
+static int count_dict_nodes(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    int n = 0;
+    for ( alt = rxe->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            n += node->is_dict;
+            if (node->rxe && !node->is_backref) n += count_dict_nodes(node->rxe);
+        }
+    return n;
+}
+
+static void emit(struct out *o, struct rxe *rxe, const struct named *list, int n)
+{
+    int i, j;
+    put(o, IMAGE_MAGIC, 8);
+    put_u32(o, RXE_IMAGE_VERSION);
+    put_u32(o, (unsigned long)rxe->options);
+    size_t slen = strlen(rxe->source);
+    put_u32(o, slen);
+    put(o, rxe->source, slen + 1);
+    pad(o);
+    if (rxe->deferred) put_u32(o, NO_COUNT);
+    else put_num(o, rxe->nitems);
+    put_u32(o, n);
+    for (i=0;i<n;i++) {
+        size_t bytes = 0;
+        for (j=0;j<list[i].nwords;j++) bytes += strlen(list[i].words[j]) + 1;
+        size_t nl = strlen(list[i].name);
+        put_u32(o, list[i].nwords);
+        put_u32(o, nl);
+        put_u32(o, bytes);
+        put(o, list[i].name, nl + 1);
+        for (j=0;j<list[i].nwords;j++)
+            put(o, list[i].words[j], strlen(list[i].words[j]) + 1);
+        pad(o);
+    }
+    put_lex(o, rxe->lex);
+}
+
+// A filtered set is not saved: the image is rebuilt from the pattern alone,
+// and would come back as the whole set.
+
+size_t rxe_save(struct rxe *rxe, void *buf, size_t size)
+{
+    if (!rxe || rxe->status || !rxe->source || rxe->filter) return 0;
+    int cap = count_dict_nodes(rxe), n = 0;
+    struct named *list = cap ? NEW(cap,struct named) : NULL;
+    if (collect(rxe,rxe->baked,list,&n,cap)) {
+        free_named(list,n);
+        return 0;
+    }
+    struct out o = { NULL, 0 };
+    emit(&o,rxe,list,n);
+    size_t need = o.at;
+    if (buf && size >= need) {
+        o.buf = buf;
+        o.at = 0;
+        emit(&o,rxe,list,n);
+    }
+    free_named(list,n);
+    return need;
+}
+
+/* ------------------------------- Reading -------------------------------- */
+
+struct in {
+    const unsigned char *p;
+    size_t size, at;
+    int bad;                    // set on the first read past the end
+};
+
+static const unsigned char *take(struct in *in, size_t n)
+{
+    if (in->bad || n > in->size - in->at) { in->bad = 1; return NULL; }
+    const unsigned char *p = in->p + in->at;
+    in->at += n;
+    return p;
+}
+
+static unsigned long take_u32(struct in *in)
+{
+    const unsigned char *b = take(in,4);
+    if (!b) return 0;
+    return b[0] | (unsigned long)b[1] << 8 | (unsigned long)b[2] << 16 |
+           (unsigned long)b[3] << 24;
+}
+
+static void skip_pad(struct in *in)
+{
+    take(in,(4 - in->at % 4) % 4);
+}
+
+// A string of n bytes and its NUL, and no NUL before it.
+static const char *take_str(struct in *in, size_t n)
+{
+    const unsigned char *s = n < in->size ? take(in,n + 1) : NULL;
+    if (!s || s[n] || memchr(s,0,n)) { in->bad = 1; return NULL; }
+    return (const char *)s;
+}
+
+// A number as put_num wrote it.
+static void take_num(struct in *in, mpz_t out)
+{
+    unsigned long nb = take_u32(in);
+    const unsigned char *b = take(in,nb);
+    if (b) mpz_import(out,nb,1,1,1,0,b);
+    skip_pad(in);
+}
+
+static void free_nums(mpz_t *z, int n)
+{
+    for (int q=0;q<n;q++) mpz_clear(z[q]);
+    rxe_mem_free(z);
+}
+
+// The automaton put_lex wrote, checked for every column and move to lie in
+// range, so that walking it never leaves its tables. Its counts are taken as
+// written; rxe_lex_load and the walk refuse them where they cannot be right.
+// Returns 0 with *out NULL when the image has none, 1 when it is damaged.
+
+static int take_lex(struct in *in, struct rxe_dfa **out, mpz_t **weight,
+                    mpz_t **count)
+{
+    unsigned long S = take_u32(in), start, C, q, b;
+    *out = NULL;
+    if (!S) return in->bad;
+    start = take_u32(in);
+    C = take_u32(in);
+    // A move is four bytes, which bounds the table before it is allocated.
+    if (in->bad || S > RXE_DISTINCT_MAX_STATES || start >= S || !C || C > 256
+        || S * C > (in->size - in->at) / 4) return 1;
+    struct rxe_dfa *d = NEW(1,struct rxe_dfa);
+    d->nstates = (int)S;
+    d->start = (int)start;
+    d->ncls = (int)C;
+    d->next = NEW(S * C,int);
+    d->accept = NEW(S,unsigned char);
+    d->weight = NULL;
+    int bad = 0;
+    for (b=0;b<256;b++)
+        if ((d->cls[b] = (int)take_u32(in)) >= (int)C) bad = 1;
+    for (q=0;q<S * C;q++)
+        if ((d->next[q] = (int)take_u32(in)) >= (int)S || d->next[q] < 0) bad = 1;
+    const unsigned char *acc = take(in,S);
+    if (acc) memcpy(d->accept,acc,S);
+    skip_pad(in);
+    if (bad || in->bad) {
+        rxe_dfa_free(d);
+        return 1;
+    }
+    mpz_t *w = NEW(S,mpz_t), *n = NEW(S,mpz_t);
+    for (q=0;q<S;q++) {
+        mpz_init(w[q]);
+        mpz_init(n[q]);
+        take_num(in,w[q]);
+        take_num(in,n[q]);
+    }
+    if (in->bad) {
+        free_nums(w,(int)S);
+        free_nums(n,(int)S);
+        rxe_dfa_free(d);
+        return 1;
+    }
+    *out = d;
+    *weight = w;
+    *count = n;
+    return 0;
+}
+
+// A refusal is an expression all the same, as from rxe_parse, so the caller
+// asks rxe_error either way.
+static struct rxe *refused(enum rxe_parse_status status)
+{
+    struct rxe *rxe = rxe_new();
+    rxe->status = status;
+    return rxe;
+}
+
+struct rxe *rxe_load(const void *image, size_t size)
+{
+    struct in in = { image, size, 0, 0 };
+    const unsigned char *magic = take(&in,8);
+    if (!magic || memcmp(magic,IMAGE_MAGIC,8)) return refused(RXE_BAD_IMAGE);
+    if (take_u32(&in) != RXE_IMAGE_VERSION)
+        return refused(in.bad ? RXE_BAD_IMAGE : RXE_WRONG_IMAGE_VERSION);
+    int options = (int)take_u32(&in);
+    const char *source = take_str(&in,take_u32(&in));
+    skip_pad(&in);
+    unsigned long nb = take_u32(&in);
+    const unsigned char *count = NULL;
+    if (nb != NO_COUNT) {
+        count = take(&in,nb);
+        skip_pad(&in);
+    }
+    unsigned long ndicts = take_u32(&in);
+    // Each dictionary takes a dozen bytes at the least, which bounds a count
+    // that would otherwise be trusted with the allocation below.
+    if (in.bad || ndicts > (size - in.at) / 12) return refused(RXE_BAD_IMAGE);
+
+    struct rxe_baked *baked = rxe_baked_new((int)ndicts);
+    unsigned long i, j;
+    for (i=0;i<ndicts && !in.bad;i++) {
+        struct rxe_baked_dict *d = &baked->dict[i];
+        unsigned long nwords = take_u32(&in);
+        unsigned long nl = take_u32(&in);
+        unsigned long bytes = take_u32(&in);
+        d->name = take_str(&in,nl);
+        const char *w = (const char *)take(&in,bytes);
+        // Every word is at least its NUL, so there are no more than bytes.
+        if (in.bad || nwords > bytes || (bytes && w[bytes-1])) {
+            in.bad = 1;
+            break;
+        }
+        d->nwords = (int)nwords;
+        d->words = rxe_words_new((int)nwords,0);
+        const char *end = w + bytes;
+        for (j=0;j<nwords;j++) {
+            if (w >= end) { in.bad = 1; break; }
+            d->words[j] = (char *)w;       // read only, never written through
+            w += strlen(w) + 1;
+        }
+        if (w != end) in.bad = 1;
+        skip_pad(&in);
+    }
+    struct rxe_dfa *dfa = NULL;
+    mpz_t *weight = NULL, *nums = NULL;
+    if (!in.bad && take_lex(&in,&dfa,&weight,&nums)) in.bad = 1;
+    if (in.bad) {
+        rxe_baked_unref(baked);
+        return refused(RXE_BAD_IMAGE);
+    }
+
+    // The pattern is parsed against the image's dictionaries and nothing
+    // else, and the result keeps them. With an automaton on hand, the tree is
+    // parsed without building one and then put on it.
+    const struct rxe_baked *outer = rxe_baked_use(baked);
+    int lexed = dfa ? options & (RXE_DISTINCT|RXE_BYTE_ORDER) : 0;
+    struct rxe *rxe = rxe_parse(source,options & ~lexed);
+    rxe_baked_use(outer);
+    rxe->baked = baked;
+    if (dfa) {
+        int S = dfa->nstates;
+        if (!lexed || rxe->status) {
+            free_nums(weight,S);
+            free_nums(nums,S);
+            rxe_dfa_free(dfa);
+            if (!rxe->status) rxe->status = RXE_BAD_IMAGE;
+        } else {
+            rxe->options = options;
+            rxe->status = rxe_lex_load(rxe,dfa,weight,nums);
+        }
+    }
+    if (!rxe->status && count && !rxe->deferred) {
+        mpz_t saved;
+        mpz_init(saved);
+        mpz_import(saved,nb,1,1,1,0,count);
+        if (mpz_cmp(saved,rxe->nitems)) rxe->status = RXE_IMAGE_COUNT;
+        mpz_clear(saved);
+    }
+    return rxe;
+}
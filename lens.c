@@ -72,8 +72,23 @@
 
 #define LENS_MAX_LENGTH          100000
 
+// Below this many terms on either side a convolution is done term by term;
+// at and above it, as one multiplication of packed integers. See convolve().
+// 'make bench-lens' shows where the two cross.
+
+#define LENS_KRONECKER_MIN       768
+
+// From this many repeat counts up, a repetition's counts are summed as a
+// series rather than one convolution per count. See rep_series().
+
+#define LENS_SERIES_MIN          8
+
 /* ------------------------------------------------------------------------ */
 
+#ifndef RXE_CURSOR_WALK
+
+int rxe_lens_kronecker_min = LENS_KRONECKER_MIN;
+
 void rxe_lens_init(struct rxe_lens *lens)
 {
     lens->max   = -1;
@@ -89,6 +104,8 @@ void rxe_lens_free(struct rxe_lens *lens)
     rxe_lens_init(lens);
 }
 
+#endif
+
 // Make room for lengths 0..want, keeping whatever is already known.
 
 static void lens_reserve(struct rxe_lens *lens, int want)
@@ -106,6 +123,37 @@ static void lens_reserve(struct rxe_lens *lens, int want)
     lens->alloc = n;
 }
 
+// Where the tables of a subexpression, an alternation or a node are kept: in
+// the thing itself, or for a copy of a subexpression parsed before it, in the
+// original. A node's rest is the original's only when its whole alternation
+// is a copy, since it counts the node's neighbours; a dictionary node can
+// share its lens with another naming the same words while its rest is its
+// own. See rxe_parse's hash-consing in rxe.c.
+
+static struct rxe_lens *lens_of_rxe(struct rxe *rxe)
+{
+    while (rxe->twin) rxe = rxe->twin;
+    return &RS(rxe)->lens;
+}
+
+static struct rxe_lens *lens_of_alt(struct rxe_alt *alt)
+{
+    while (alt->twin) alt = alt->twin;
+    return &AS(alt)->lens;
+}
+
+static struct rxe_lens *lens_of(struct rxe_node *node)
+{
+    while (node->twin) node = node->twin;
+    return &NS(node)->lens;
+}
+
+static struct rxe_lens *rest_of(struct rxe_node *node)
+{
+    while (node->owner->twin) node = node->twin;
+    return &NS(node)->rest;
+}
+
 // The count at one length, zero for anything not computed or out of range.
 
 static void lens_at(mpz_t out, struct rxe_lens *lens, int L)
@@ -114,6 +162,120 @@ static void lens_at(mpz_t out, struct rxe_lens *lens, int L)
     else mpz_set(out,lens->count[L]);
 }
 
+/* --------------------------- Convolution -------------------------------- */
+
+// Every table below is built by convolving two others, and done term by term
+// that is a bignum multiply-add for each pair of lengths: quadratic in the
+// longest length asked about, and cubic for a repetition, which convolves
+// once per repeat count. That is nothing at the dozen or so lengths a walk
+// usually reaches, and everything at the thousands a long wordlist or
+// '(\w+ )*' over sentences asks for.
+//
+// The way out is the old Kronecker substitution. Counts are never negative,
+// so a table can be packed into one integer with each count in a slot of its
+// own, wide enough that no sum of products can spill into the next: then the
+// product of two packed tables holds their convolution, slot by slot, and
+// GMP's multiplication -- Toom and FFT at these sizes -- does in one call
+// what the double loop did in a quadratic number of them. The slots are
+// whole limbs so that packing and unpacking are copies rather than shifts;
+// the counts at lengths in the thousands run to thousands of bits, so the
+// rounding costs nothing worth having back.
+
+// 'n' counts packed into 'z', k limbs apart.
+
+static void kron_pack(mpz_t z, mpz_t *v, int n, size_t k)
+{
+    mp_limb_t *d = mpz_limbs_write(z,n*k);
+    int i;
+    memset(d,0,n*k*sizeof *d);
+    for (i=0;i<n;i++)
+        memcpy(d + i*k,mpz_limbs_read(v[i]),mpz_size(v[i])*sizeof *d);
+    mpz_limbs_finish(z,n*k);
+}
+
+// The slot at 'i' of a product packed k limbs apart.
+
+static void kron_slot(mpz_t out, const mpz_t z, int i, size_t k)
+{
+    size_t at = i*k, n = mpz_size(z);
+    if (at >= n) { mpz_set_ui(out,0); return; }
+    if (n - at < k) k = n - at;
+    mp_limb_t *d = mpz_limbs_write(out,k);
+    memcpy(d,mpz_limbs_read(z) + at,k*sizeof *d);
+    mpz_limbs_finish(out,k);
+}
+
+// Where a table's non-zero counts lie, how many there are and how wide the
+// widest is. Only that stretch is packed: the n-fold convolution of a body
+// at least two characters long is zero below length 2n, and packing the zeros
+// would multiply them too.
+
+struct span {
+    int lo, hi;                   // first and last non-zero, hi < lo if none
+    int nonzero;
+    size_t bits;
+};
+
+static void span_of(struct span *sp, mpz_t *v, int n)
+{
+    int i;
+    sp->lo = 0;
+    sp->hi = -1;
+    sp->nonzero = 0;
+    sp->bits = 0;
+    for (i=0;i<n;i++) {
+        if (!mpz_sgn(v[i])) continue;
+        size_t b = mpz_sizeinbase(v[i],2);
+        if (b > sp->bits) sp->bits = b;
+        if (!sp->nonzero++) sp->lo = i;
+        sp->hi = i;
+    }
+}
+
+// out[i] = the sum over l of a[l]*b[i-l], for i from 'from' to 'to'. 'a' holds
+// na counts and 'b' nb, and everything past them is zero. 'out' is neither.
+
+static void convolve(mpz_t *out, int from, int to, mpz_t *a, int na,
+                     mpz_t *b, int nb)
+{
+    struct span sa, sb;
+    int i, l;
+    span_of(&sa,a,na < to+1 ? na : to+1);
+    span_of(&sb,b,nb < to+1 ? nb : to+1);
+    if (!sa.nonzero || !sb.nonzero || sa.nonzero < rxe_lens_kronecker_min
+                                   || sb.nonzero < rxe_lens_kronecker_min) {
+        // Term by term, skipping the zeros, which is what a sparse table --
+        // a class is one length, a fixed word list a handful -- wants.
+        for (i=from;i<=to;i++) {
+            mpz_set_ui(out[i],0);
+            int lo = i-sb.hi > sa.lo ? i-sb.hi : sa.lo;
+            int hi = i-sb.lo < sa.hi ? i-sb.lo : sa.hi;
+            for (l=lo;l<=hi;l++) {
+                if (!mpz_sgn(a[l]) || !mpz_sgn(b[i-l])) continue;
+                mpz_addmul(out[i],a[l],b[i-l]);
+            }
+        }
+        return;
+    }
+    // A slot sums at most as many products as the sparser side has counts.
+    int m = sa.nonzero < sb.nonzero ? sa.nonzero : sb.nonzero;
+    size_t bits = sa.bits + sb.bits + 1, k;
+    for ( ; m ; m >>= 1 ) bits++;
+    k = (bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    mpz_t pa, pb;
+    mpz_init(pa);
+    mpz_init(pb);
+    kron_pack(pa,a + sa.lo,sa.hi - sa.lo + 1,k);
+    kron_pack(pb,b + sb.lo,sb.hi - sb.lo + 1,k);
+    mpz_mul(pa,pa,pb);
+    for (i=from;i<=to;i++) {
+        if (i < sa.lo + sb.lo) mpz_set_ui(out[i],0);
+        else kron_slot(out[i],pa,i - sa.lo - sb.lo,k);
+    }
+    mpz_clear(pa);
+    mpz_clear(pb);
+}
+
 /* ---------------------------- Counting ---------------------------------- */
 
 static void lens_node(struct rxe_node *node, int L);
@@ -124,40 +286,26 @@ static void lens_rest(struct rxe_node *node, int L);
 
 void rxe_lens_alt(struct rxe_alt *alt, int L)
 {
-    if (L <= alt->lens.max) return;
-    int i, from = alt->lens.max+1;
+    if (alt->twin) { rxe_lens_alt(alt->twin,L); return; }
+    struct rxe_alt_state *as = AS(alt);
+    if (L <= as->lens.max) return;
+    int i, from = as->lens.max+1;
     int l2r = alt->owner && (alt->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
     struct rxe_node *top = l2r ? alt->tail : alt->head;
-    lens_reserve(&alt->lens,L);
-    for (i=from;i<=L;i++) mpz_set_ui(alt->lens.count[i],0);
+    lens_reserve(&as->lens,L);
+    for (i=from;i<=L;i++) mpz_set_ui(as->lens.count[i],0);
     if (!top) {
         // No positions at all, so it matches the empty string and nothing
         // else. Not the same as matching nothing, which is count[0] == 0.
-        if (from == 0) mpz_set_ui(alt->lens.count[0],1);
-        alt->lens.max = L;
+        if (from == 0) mpz_set_ui(as->lens.count[0],1);
+        as->lens.max = L;
         return;
     }
     lens_node(top,L);
     lens_rest(top,L);
-    mpz_t sum,a,b;
-    mpz_init(sum);
-    mpz_init(a);
-    mpz_init(b);
-    for ( i = from ; i <= L ; i++ ) {
-        int l;
-        mpz_set_ui(sum,0);
-        for (l=0;l<=i;l++) {
-            lens_at(a,&top->lens,l);
-            if (!mpz_sgn(a)) continue;
-            lens_at(b,&top->rest,i-l);
-            mpz_addmul(sum,a,b);
-        }
-        mpz_set(alt->lens.count[i],sum);
-    }
-    alt->lens.max = L;
-    mpz_clear(sum);
-    mpz_clear(a);
-    mpz_clear(b);
+    struct rxe_lens *a = lens_of(top), *b = rest_of(top);
+    convolve(as->lens.count,from,L,a->count,a->max+1,b->count,b->max+1);
+    as->lens.max = L;
 }
 
 // Everything strictly less significant than this position, convolved. Under
@@ -166,41 +314,27 @@ void rxe_lens_alt(struct rxe_alt *alt, int L)
 
 static void lens_rest(struct rxe_node *node, int L)
 {
-    if (L <= node->rest.max) return;
+    if (node->owner->twin) { lens_rest(node->twin,L); return; }
+    struct rxe_node_state *ns = NS(node);
+    if (L <= ns->rest.max) return;
     int l2r = node->owner && node->owner->owner &&
               (node->owner->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
     struct rxe_node *next = l2r ? node->prev : node->next;
-    int i, from = node->rest.max+1;
-    lens_reserve(&node->rest,L);
-    for (i=from;i<=L;i++) mpz_set_ui(node->rest.count[i],0);
+    int i, from = ns->rest.max+1;
+    lens_reserve(&ns->rest,L);
+    for (i=from;i<=L;i++) mpz_set_ui(ns->rest.count[i],0);
     if (!next) {
         // Nothing below it, so the only way to spend no more length is to
         // spend none: the multiplicative identity.
-        if (from == 0) mpz_set_ui(node->rest.count[0],1);
-        node->rest.max = L;
+        if (from == 0) mpz_set_ui(ns->rest.count[0],1);
+        ns->rest.max = L;
         return;
     }
     lens_node(next,L);
     lens_rest(next,L);
-    mpz_t sum,a,b;
-    mpz_init(sum);
-    mpz_init(a);
-    mpz_init(b);
-    for ( i = from ; i <= L ; i++ ) {
-        int l;
-        mpz_set_ui(sum,0);
-        for (l=0;l<=i;l++) {
-            lens_at(a,&next->lens,l);
-            if (!mpz_sgn(a)) continue;
-            lens_at(b,&next->rest,i-l);
-            mpz_addmul(sum,a,b);
-        }
-        mpz_set(node->rest.count[i],sum);
-    }
-    node->rest.max = L;
-    mpz_clear(sum);
-    mpz_clear(a);
-    mpz_clear(b);
+    struct rxe_lens *a = lens_of(next), *b = rest_of(next);
+    convolve(ns->rest.count,from,L,a->count,a->max+1,b->count,b->max+1);
+    ns->rest.max = L;
 }
 
 // The n-fold convolution of the repeated body, W(n,L), written into 'row'
@@ -209,20 +343,92 @@ static void lens_rest(struct rxe_node *node, int L)
 
 static void rep_step(mpz_t *row, mpz_t *prev, struct rxe_lens *body, int L)
 {
-    int i,l;
-    mpz_t a,b;
-    mpz_init(a);
-    mpz_init(b);
-    for (i=0;i<=L;i++) {
-        mpz_set_ui(row[i],0);
-        for (l=0;l<=i;l++) {
-            lens_at(a,body,l);
-            if (!mpz_sgn(a)) continue;
-            mpz_addmul(row[i],a,prev[i-l]);
-        }
+    convolve(row,0,L,body->count,body->max+1,prev,L+1);
+}
+
+static mpz_t *table_new(int n)
+{
+    mpz_t *t = NEW(n,mpz_t);
+    int i;
+    for (i=0;i<n;i++) mpz_init(t[i]);
+    return t;
+}
+
+static void table_free(mpz_t *t, int n)
+{
+    int i;
+    for (i=0;i<n;i++) mpz_clear(t[i]);
+    rxe_mem_free(t);
+}
+
+// out = a * b up to length L, where 'out' may be either of them.
+
+static void series_mul(mpz_t *out, mpz_t *a, int na, mpz_t *b, int nb, int L)
+{
+    int i;
+    mpz_t *t = table_new(L+1);
+    convolve(t,0,L,a,na,b,nb);
+    for (i=0;i<=L;i++) mpz_swap(out[i],t[i]);
+    table_free(t,L+1);
+}
+
+// out = b^e up to length L, by squaring.
+
+static void series_pow(mpz_t *out, mpz_t *b, int nb, int e, int L)
+{
+    int i;
+    mpz_t *sq = table_new(L+1);
+    for (i=0;i<=L;i++) mpz_set_ui(out[i],0);
+    mpz_set_ui(out[0],1);
+    for (i=0;i<nb && i<=L;i++) mpz_set(sq[i],b[i]);
+    while (e) {
+        if (e & 1) series_mul(out,out,L+1,sq,L+1,L);
+        if (e >>= 1) series_mul(sq,sq,L+1,sq,L+1,L);
     }
-    mpz_clear(a);
-    mpz_clear(b);
+    table_free(sq,L+1);
+}
+
+// A repetition's members by length, all counts at once: the sum of B^n for n
+// from r0 to r0+m, B being the body's table as a power series. Summed one
+// convolution per count, as rep_walk does, that is L convolutions for an
+// unbounded repetition and cubic in L; as a series it is a handful.
+//
+// A body that cannot match the empty string has B[0] == 0, so 1 - B can be
+// inverted, and T = 1/(1-B) = 1 + B + B^2 + ... is every count at once. It is
+// found by Newton's iteration, which doubles the lengths it is right to at
+// each step: if g is T below length k, then (B g) between k and 2k is what g
+// lacks there, and g times that fills it in. Every term of both products is a
+// count, never negative, so convolve() can pack them. A bound is then taken
+// off the top, T - T B^(m+1), and the lower bound put on, B^r0 times the lot.
+
+static void rep_series(mpz_t *out, struct rxe_lens *body, int r0, int m,
+                       int L)
+{
+    int i, k, nb = body->max+1;
+    mpz_t *b = body->count;
+    mpz_t *g = table_new(L+1), *h = table_new(L+1), *t = table_new(L+1);
+    mpz_set_ui(g[0],1);
+    for ( k = 1 ; k <= L ; k *= 2 ) {
+        int top = 2*k-1 < L ? 2*k-1 : L;
+        for (i=0;i<k;i++) mpz_set_ui(h[i],0);
+        convolve(h,k,top,b,nb,g,k);
+        convolve(t,k,top,g,k,h,top+1);
+        for (i=k;i<=top;i++) mpz_swap(g[i],t[i]);
+    }
+    if (m < L) {
+        // B^(m+1) has nothing shorter than m+1, so past L the bound is moot.
+        series_pow(h,b,nb,m+1,L);
+        convolve(t,0,L,g,L+1,h,L+1);
+        for (i=0;i<=L;i++) mpz_sub(g[i],g[i],t[i]);
+    }
+    if (r0) {
+        series_pow(h,b,nb,r0,L);
+        series_mul(g,g,L+1,h,L+1,L);
+    }
+    for (i=0;i<=L;i++) mpz_swap(out[i],g[i]);
+    table_free(g,L+1);
+    table_free(h,L+1);
+    table_free(t,L+1);
 }
 
 // How many repeat counts can contribute at length L. A body that cannot match
@@ -236,7 +442,7 @@ static int rep_top(struct rxe_node *node, int L)
     mpz_t z;
     int can_be_empty;
     mpz_init(z);
-    lens_at(z,&node->rxe->lens,0);
+    lens_at(z,lens_of_rxe(node->rxe),0);
     can_be_empty = mpz_sgn(z) != 0;
     mpz_clear(z);
     // Unbounded, the body must cost at least one character -- the parser
@@ -260,7 +466,7 @@ static void rep_walk(struct rxe_node *node, int L, void *ctx,
     for (i=0;i<=L;i++) { mpz_init(cur[i]); mpz_init_set_ui(prev[i],0); }
     mpz_set_ui(prev[0],1);                       // W(0,L) is 1 at L == 0
     for (n=0;n<=hi;n++) {
-        if (n) rep_step(cur,prev,&node->rxe->lens,L);
+        if (n) rep_step(cur,prev,lens_of_rxe(node->rxe),L);
         else   for (i=0;i<=L;i++) mpz_set(cur[i],prev[i]);
         if (n >= node->rep_min && visit(ctx,n,cur)) break;
         for (i=0;i<=L;i++) mpz_set(prev[i],cur[i]);
@@ -279,14 +485,15 @@ static void rep_walk(struct rxe_node *node, int L, void *ctx,
 static int body_fixed_length(struct rxe_node *node, int L, int *m)
 {
     struct rxe *body = node->rxe;
-    int i, hi = L < body->lens.max ? L : body->lens.max;
+    struct rxe_lens *bl = lens_of_rxe(body);
+    int i, hi = L < bl->max ? L : bl->max;
     if (rxe_is_infinite(body)) return 0;
     for (i=1;i<=hi;i++) {
-        if (!mpz_sgn(body->lens.count[i])) continue;
+        if (!mpz_sgn(bl->count[i])) continue;
         // The shortest non-empty length. If it already accounts for the whole
         // cardinality there are no members of any other length -- including
         // the empty string, which would otherwise be counted at zero.
-        if (mpz_cmp(body->lens.count[i],body->nitems)) return 0;
+        if (mpz_cmp(bl->count[i],body->nitems)) return 0;
         *m = i;
         return 1;
     }
@@ -297,13 +504,15 @@ static int body_fixed_length(struct rxe_node *node, int L, int *m)
 
 static void lens_node(struct rxe_node *node, int L)
 {
-    if (L <= node->lens.max) return;
-    lens_reserve(&node->lens,L);
+    if (node->twin) { lens_node(node->twin,L); return; }
+    struct rxe_node_state *ns = NS(node);
+    if (L <= ns->lens.max) return;
+    lens_reserve(&ns->lens,L);
     int i;
-    for ( i = node->lens.max+1 ; i <= L ; i++ )
-        mpz_set_ui(node->lens.count[i],0);
-    int from = node->lens.max+1;
-    node->lens.max = L;
+    for ( i = ns->lens.max+1 ; i <= L ; i++ )
+        mpz_set_ui(ns->lens.count[i],0);
+    int from = ns->lens.max+1;
+    ns->lens.max = L;
     if (node->is_repeat) {
         int m;
         rxe_lens_rxe(node->rxe,L);
@@ -312,15 +521,23 @@ static void lens_node(struct rxe_node *node, int L)
             // the number of members is a plain power.
             mpz_t b;
             mpz_init(b);
-            lens_at(b,&node->rxe->lens,m);
+            lens_at(b,lens_of_rxe(node->rxe),m);
             for (i=from;i<=L;i++) {
                 int n = i/m;
                 if (i % m || n < node->rep_min) continue;
                 if (node->rep_max != RXE_REP_UNBOUNDED && n > node->rep_max)
                     continue;
-                mpz_pow_ui(node->lens.count[i],b,n);
+                mpz_pow_ui(ns->lens.count[i],b,n);
             }
             mpz_clear(b);
+        } else if (lens_of_rxe(node->rxe)->max >= 0 &&
+                   !mpz_sgn(lens_of_rxe(node->rxe)->count[0]) &&
+                   rep_top(node,L) - node->rep_min >= LENS_SERIES_MIN) {
+            int hi = rep_top(node,L);
+            mpz_t *w = table_new(L+1);
+            rep_series(w,lens_of_rxe(node->rxe),node->rep_min,hi - node->rep_min,L);
+            for (i=from;i<=L;i++) mpz_swap(ns->lens.count[i],w[i]);
+            table_free(w,L+1);
         } else {
             // Accumulate the n-fold convolutions over every length at once.
             // Doing it per length would repeat this whole sweep for each.
@@ -331,12 +548,12 @@ static void lens_node(struct rxe_node *node, int L)
             for (n=0;n<=hi;n++) {
                 if (n) {
                     mpz_t *swap;
-                    rep_step(t,w,&node->rxe->lens,L);
+                    rep_step(t,w,lens_of_rxe(node->rxe),L);
                     swap = w; w = t; t = swap;
                 }
                 if (n < node->rep_min) continue;
                 for (i=from;i<=L;i++)
-                    mpz_add(node->lens.count[i],node->lens.count[i],w[i]);
+                    mpz_add(ns->lens.count[i],ns->lens.count[i],w[i]);
             }
             for (i=0;i<=L;i++) { mpz_clear(w[i]); mpz_clear(t[i]); }
             rxe_mem_free(w);
@@ -346,7 +563,7 @@ static void lens_node(struct rxe_node *node, int L)
         // A backreference is handled by the caller falling back wholesale, so
         // reaching here means an ordinary subexpression.
         rxe_lens_rxe(node->rxe,L);
-        for (i=from;i<=L;i++) lens_at(node->lens.count[i],&node->rxe->lens,i);
+        for (i=from;i<=L;i++) lens_at(ns->lens.count[i],lens_of_rxe(node->rxe),i);
     } else if (node->is_dict) {
         // Each word contributes one member at its own length. A word is
         // counted in the one call whose [from,L] range first covers its
@@ -355,14 +572,14 @@ static void lens_node(struct rxe_node *node, int L)
         for (k=0;k<node->nwords;k++) {
             int wl = (int)strlen(node->words[k]);
             if (wl >= from && wl <= L)
-                mpz_add_ui(node->lens.count[wl],node->lens.count[wl],1);
+                mpz_add_ui(ns->lens.count[wl],ns->lens.count[wl],1);
         }
     } else if (node->len) {
         // A character class is one character long, whatever it holds.
-        if (from <= 1 && L >= 1) mpz_set_ui(node->lens.count[1],node->len);
+        if (from <= 1 && L >= 1) mpz_set_ui(ns->lens.count[1],node->len);
     } else {
         // Nothing to contribute: matches the empty string only.
-        if (from == 0) mpz_set_ui(node->lens.count[0],1);
+        if (from == 0) mpz_set_ui(ns->lens.count[0],1);
     }
 }
 
@@ -370,27 +587,32 @@ static void lens_node(struct rxe_node *node, int L)
 
 void rxe_lens_rxe(struct rxe *rxe, int L)
 {
-    if (L <= rxe->lens.max) return;
+    if (rxe->twin) { rxe_lens_rxe(rxe->twin,L); return; }
+    struct rxe_state *rs = RS(rxe);
+    if (L <= rs->lens.max) return;
     if (L > LENS_MAX_LENGTH) return;
     // Grow in doublings. rxe_seek_shortlex walks the lengths upward one at a
     // time, and a repetition's counts are built by a sweep over every length
     // at once rather than incrementally, so answering each request exactly
     // would rebuild that sweep once per length and turn a quadratic job cubic.
-    if (L < 2*rxe->lens.max) L = 2*rxe->lens.max;
+    if (L < 2*rs->lens.max) L = 2*rs->lens.max;
     if (L > LENS_MAX_LENGTH) L = LENS_MAX_LENGTH;
-    lens_reserve(&rxe->lens,L);
+    lens_reserve(&rs->lens,L);
     int i;
-    for ( i = rxe->lens.max+1 ; i <= L ; i++ ) mpz_set_ui(rxe->lens.count[i],0);
-    int from = rxe->lens.max+1;
-    rxe->lens.max = L;
+    for ( i = rs->lens.max+1 ; i <= L ; i++ ) mpz_set_ui(rs->lens.count[i],0);
+    int from = rs->lens.max+1;
+    rs->lens.max = L;
     struct rxe_alt *alt;
     for ( alt = rxe->head ; alt ; alt = alt->next ) {
         rxe_lens_alt(alt,L);
         for (i=from;i<=L;i++)
-            mpz_add(rxe->lens.count[i],rxe->lens.count[i],alt->lens.count[i]);
+            mpz_add(rs->lens.count[i],rs->lens.count[i],
+                    lens_of_alt(alt)->count[i]);
     }
 }
 
+#ifndef RXE_CURSOR_WALK
+
 int rxe_matches_empty(struct rxe *rxe)
 {
     mpz_t z;
@@ -402,11 +624,13 @@ int rxe_matches_empty(struct rxe *rxe)
     return rc;
 }
 
+#endif
+
 void rxe_count_at_length(mpz_t out, struct rxe *rxe, int L)
 {
     if (L < 0 || L > LENS_MAX_LENGTH) { mpz_set_ui(out,0); return; }
     rxe_lens_rxe(rxe,L);
-    lens_at(out,&rxe->lens,L);
+    lens_at(out,lens_of_rxe(rxe),L);
 }
 
 /* ----------------------------- Seeking ---------------------------------- */
@@ -436,9 +660,9 @@ static int seek_from(struct rxe_node *node, int L, const mpz_t idx)
     lens_node(node,L);
     lens_rest(node,L);
     for (l=L;l>=0;l--) {
-        lens_at(a,&node->lens,l);
+        lens_at(a,lens_of(node),l);
         if (!mpz_sgn(a)) continue;
-        lens_at(b,&node->rest,L-l);
+        lens_at(b,rest_of(node),L-l);
         if (!mpz_sgn(b)) continue;
         mpz_mul(block,a,b);
         if (mpz_cmp(r,block) >= 0) { mpz_sub(r,r,block); continue; }
@@ -446,6 +670,7 @@ static int seek_from(struct rxe_node *node, int L, const mpz_t idx)
         mpz_tdiv_qr(q,r,r,b);
         int l2r = node->owner && node->owner->owner &&
                   (node->owner->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
+        NS(node)->sl_len = l;
         if (seek_node(node,l,q)) goto done;
         rc = seek_from(l2r ? node->prev : node->next,L-l,r);
         goto done;
@@ -491,7 +716,7 @@ static int seek_rep_positions(struct rxe_node *node, int n, int L, mpz_t r,
         for (i=0;i<=L;i++) mpz_init(w[k][i]);
     }
     mpz_set_ui(w[0][0],1);
-    for (k=1;k<=n;k++) rep_step(w[k],w[k-1],&node->rxe->lens,L);
+    for (k=1;k<=n;k++) rep_step(w[k],w[k-1],lens_of_rxe(node->rxe),L);
     int left = L;
     mpz_t a,b,block,q;
     mpz_init(a);
@@ -506,7 +731,7 @@ static int seek_rep_positions(struct rxe_node *node, int n, int L, mpz_t r,
         int pos = l2r ? n-1-i : i;
         int l, taken = -1;
         for (l=left;l>=0;l--) {
-            lens_at(a,&node->rxe->lens,l);
+            lens_at(a,lens_of_rxe(node->rxe),l);
             if (!mpz_sgn(a)) continue;
             mpz_set(b,w[n-1-i][left-l]);
             if (!mpz_sgn(b)) continue;
@@ -517,8 +742,8 @@ static int seek_rep_positions(struct rxe_node *node, int n, int L, mpz_t r,
             break;
         }
         if (taken < 0) { rc = 1; break; }
-        node->rep_len[pos] = taken;
-        mpz_set(node->rep_digit[pos],q);
+        NS(node)->rep_len[pos] = taken;
+        rxe_repeat_set(node,pos,q);
         left -= taken;
     }
     if (!rc && (left || mpz_sgn(r))) rc = 1;
@@ -537,6 +762,7 @@ static int seek_rep_positions(struct rxe_node *node, int n, int L, mpz_t r,
 int rxe_repeat_seek_at_length(struct rxe_node *node, int L, const mpz_t idx,
                               int l2r)
 {
+    struct rxe_node_state *ns = NS(node);
     struct rep_seek_ctx c;
     int rc, fixed_m;
     rxe_lens_rxe(node->rxe,L);
@@ -554,11 +780,11 @@ int rxe_repeat_seek_at_length(struct rxe_node *node, int L, const mpz_t idx,
         if (L % fixed_m || n < node->rep_min) return 1;
         if (node->rep_max != RXE_REP_UNBOUNDED && n > node->rep_max) return 1;
         if (rxe_repeat_reserve(node,n)) return 1;
-        node->rep_count = n;
+        ns->rep_count = n;
         mpz_init(b);
         mpz_init(q);
         mpz_init_set(r,idx);
-        lens_at(b,&node->rxe->lens,fixed_m);
+        lens_at(b,lens_of_rxe(node->rxe),fixed_m);
         rc = 0;
         // Peeled least significant digit first, so i counts significance and
         // the position it drives is the last one under the default direction.
@@ -566,8 +792,8 @@ int rxe_repeat_seek_at_length(struct rxe_node *node, int L, const mpz_t idx,
             int pos = l2r ? i : n-1-i;
             if (!mpz_sgn(b)) { rc = 1; break; }
             mpz_tdiv_qr(q,r,r,b);
-            node->rep_len[pos] = fixed_m;
-            mpz_set(node->rep_digit[pos],r);
+            ns->rep_len[pos] = fixed_m;
+            rxe_repeat_set(node,pos,r);
             mpz_set(r,q);
         }
         if (!rc && mpz_sgn(r)) rc = 1;
@@ -583,7 +809,7 @@ int rxe_repeat_seek_at_length(struct rxe_node *node, int L, const mpz_t idx,
     rep_walk(node,L,&c,rep_seek_visit);
     if (!c.found) { mpz_clear(c.r); return 1; }
     if (rxe_repeat_reserve(node,c.n)) { mpz_clear(c.r); return 1; }
-    node->rep_count = c.n;
+    ns->rep_count = c.n;
     rc = seek_rep_positions(node,c.n,L,c.r,l2r);
     mpz_clear(c.r);
     return rc;
@@ -591,6 +817,7 @@ int rxe_repeat_seek_at_length(struct rxe_node *node, int L, const mpz_t idx,
 
 static int seek_node(struct rxe_node *node, int L, const mpz_t idx)
 {
+    struct rxe_node_state *ns = NS(node);
     int l2r = node->owner && node->owner->owner &&
               (node->owner->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
     if (node->is_repeat)
@@ -605,14 +832,14 @@ static int seek_node(struct rxe_node *node, int L, const mpz_t idx)
         if (!mpz_fits_ulong_p(idx)) return 1;
         for (k=0;k<node->nwords;k++) {
             if ((int)strlen(node->words[k]) != L) continue;
-            if (want == 0) { node->iterator = k; return 0; }
+            if (want == 0) { ns->iterator = k; return 0; }
             want--;
         }
         return 1;
     }
     if (node->len) {
         if (L != 1 || mpz_cmp_ui(idx,node->len) >= 0) return 1;
-        node->iterator = (int)mpz_get_ui(idx);
+        ns->iterator = (int)mpz_get_ui(idx);
         return 0;
     }
     return (L == 0 && !mpz_sgn(idx)) ? 0 : 1;
@@ -629,16 +856,18 @@ int rxe_seek_at_length(struct rxe *rxe, int L, const mpz_t idx)
     mpz_init(c);
     for ( alt = rxe->head ; alt ; alt = alt->next ) {
         rxe_lens_alt(alt,L);
-        lens_at(c,&alt->lens,L);
+        lens_at(c,lens_of_alt(alt),L);
         if (!mpz_sgn(c)) continue;
         if (mpz_cmp(r,c) >= 0) { mpz_sub(r,r,c); continue; }
-        rxe->curr = alt;
+        RS(rxe)->curr = alt;
         {
             int l2r = rxe->flags & RXE_FLAG_LEFT_TO_RIGHT;
             rc = seek_from(l2r ? alt->tail : alt->head,L,r);
         }
         break;
     }
+    // Only a member placed whole can be stepped from; see rxe_step_shortlex.
+    RS(rxe)->sl_len = rc ? -1 : L;
     mpz_clear(r);
     mpz_clear(c);
     return rc;
@@ -669,6 +898,414 @@ int rxe_seek_shortlex(struct rxe *rxe, const mpz_t pos)
     return 1;
 }
 
+/* ----------------------------- Stepping --------------------------------- */
+
+// The next member in shortlex order, reached by carrying rather than by seeking.
+//
+// rxe_seek_shortlex finds a member by dividing its index down through every
+// split of the length, and for a long time rxe_iterate on an infinite set did
+// nothing cleverer than add one and seek again -- so '\d+' paid a full length
+// search per member where '\d{8}' paid a carry. But the order within a length
+// is an odometer too, only with one more kind of digit: where a position sits
+// in its own members of its length, and how much of the length it takes. The
+// least significant position steps first; when it is exhausted, the one above
+// it steps and everything below restarts at the first member of whatever
+// length it was left; a position exhausted at its length gives some of it up
+// to the positions after it, which is the next split down; and only when the
+// whole length is exhausted does the walk move on to the next one.
+//
+// None of that needs an index. The counts are consulted only for whether a
+// length is reachable at all, and a position's place among its members is
+// compared against the count at its length, so a step costs a few word
+// compares and an occasional restart, not a division.
+//
+// The state stepped is exactly what the seek leaves: the alternation, each
+// node's iterator, each repetition's count, lengths and digits, and the length
+// each node took, which the seek records for this.
+
+static int first_from(struct rxe_node *node, int L);
+static int step_from(struct rxe_node *node, int L);
+
+// Whether anything at all has length L, without copying the count out.
+
+static int lens_has(struct rxe_lens *lens, int L)
+{
+    return L >= 0 && L <= lens->max && mpz_sgn(lens->count[L]) != 0;
+}
+
+static struct rxe_node *next_of(struct rxe_node *node)
+{
+    int l2r = node->owner && node->owner->owner &&
+              (node->owner->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
+    return l2r ? node->prev : node->next;
+}
+
+// Whether k copies of a repetition's body can fill exactly m characters, up
+// to the most positions that fit in L. A fixed-length body answers by
+// arithmetic; any other keeps a table, since a restart asks it for every
+// position it places. What the table says about k copies and m characters
+// does not depend on L, which only bounds it, so it is kept across lengths
+// and grown when a longer one needs more of it: a walk up through the lengths
+// fills each cell once, rather than the whole table again at every length.
+
+static int rep_fits(struct rxe_node *node, int k, int m, int L)
+{
+    struct rxe_node_state *ns = NS(node);
+    struct rxe_lens *body = lens_of_rxe(node->rxe);
+    int fixed_m, K, i, j, l;
+    if (k < 0 || m < 0) return 0;
+    if (body_fixed_length(node,L,&fixed_m)) return m == k*fixed_m;
+    K = rep_top(node,L);
+    if (k > K || m > L) return 0;
+    if (!ns->rep_fit || ns->rep_fit_l < L || ns->rep_fit_k < K) {
+        int oldk = ns->rep_fit ? ns->rep_fit_k : -1;
+        int oldl = ns->rep_fit ? ns->rep_fit_l : -1;
+        if (K < oldk) K = oldk;
+        if (L < oldl) L = oldl;
+        unsigned char *f = NEW((size_t)(K+1)*(L+1),unsigned char);
+        memset(f,0,(size_t)(K+1)*(L+1));
+        for (i=0;i<=oldk;i++)
+            memcpy(f+i*(L+1),ns->rep_fit+i*(oldl+1),(size_t)oldl+1);
+        f[0] = 1;
+        for (i=1;i<=K;i++)
+            for (j=i<=oldk ? oldl+1 : 0;j<=L;j++)
+                for (l=0;l<=j;l++)
+                    if (f[(i-1)*(L+1)+j-l] && lens_has(body,l)) {
+                        f[i*(L+1)+j] = 1;
+                        break;
+                    }
+        if (ns->rep_fit) rxe_mem_free(ns->rep_fit);
+        ns->rep_fit = f;
+        ns->rep_fit_k = K;
+        ns->rep_fit_l = L;
+    }
+    return ns->rep_fit[k*(ns->rep_fit_l+1)+m];
+}
+
+// Positions i..n-1 of a repetition, in significance order, restarted at the
+// first way they can share 'left': each takes as much as it can and still
+// leave the rest fillable, and its first member of that length.
+
+static int rep_fill(struct rxe_node *node, int i, int n, int left, int L,
+                    int l2r)
+{
+    struct rxe_lens *body = lens_of_rxe(node->rxe);
+    for (;i<n;i++) {
+        int pos = l2r ? n-1-i : i, l;
+        for (l=left;l>=0;l--)
+            if (lens_has(body,l) && rep_fits(node,n-1-i,left-l,L)) break;
+        if (l < 0) return 1;
+        NS(node)->rep_len[pos] = l;
+        rxe_repeat_set_ui(node,pos,0);
+        left -= l;
+    }
+    return left ? 1 : 0;
+}
+
+// The first member of length L a repetition has: the fewest repetitions that
+// can make it, each restarted.
+
+static int rep_first(struct rxe_node *node, int L, int l2r)
+{
+    int n, hi = rep_top(node,L);
+    rxe_lens_rxe(node->rxe,L);
+    for (n=node->rep_min;n<=hi;n++) {
+        if (!rep_fits(node,n,L,L)) continue;
+        if (rxe_repeat_reserve(node,n)) return 1;
+        NS(node)->rep_count = n;
+        return rep_fill(node,0,n,L,L,l2r);
+    }
+    return 1;
+}
+
+static int rep_advance(struct rxe_node *node, int L, int l2r)
+{
+    struct rxe_node_state *ns = NS(node);
+    struct rxe_lens *body = lens_of_rxe(node->rxe);
+    int n = ns->rep_count, hi = rep_top(node,L), i, suffix = 0;
+    if (n > ns->rep_alloc) { rxe_member_overflow = 1; return 1; }
+    // Least significant position first. 'suffix' is what the positions below
+    // this one hold between them, and stays theirs whatever this one does.
+    for (i=n-1;i>=0;i--) {
+        int pos = l2r ? n-1-i : i;
+        int have = ns->rep_len[pos] + suffix, l;
+        // A wrap leaves the digit at zero; a shorter length restarts it there
+        // anyway, and otherwise a more significant step refills it.
+        if (!rxe_repeat_bump(node,pos,body->count[ns->rep_len[pos]]))
+            return rep_fill(node,i+1,n,suffix,L,l2r);
+        for (l=ns->rep_len[pos]-1;l>=0;l--) {
+            if (!lens_has(body,l) || !rep_fits(node,n-1-i,have-l,L)) continue;
+            ns->rep_len[pos] = l;
+            rxe_repeat_set_ui(node,pos,0);
+            return rep_fill(node,i+1,n,have-l,L,l2r);
+        }
+        suffix = have;
+    }
+    // Every split of L over n positions is spent; the next block of this
+    // length is the next repeat count that can make it.
+    for (n=n+1;n<=hi;n++) {
+        if (!rep_fits(node,n,L,L)) continue;
+        if (rxe_repeat_reserve(node,n)) return 1;
+        ns->rep_count = n;
+        return rep_fill(node,0,n,L,L,l2r);
+    }
+    return 1;
+}
+
+static int first_at_length(struct rxe *rxe, int L);
+static int step_at_length(struct rxe *rxe, int L);
+
+static int first_node(struct rxe_node *node, int L)
+{
+    struct rxe_node_state *ns = NS(node);
+    int l2r = node->owner && node->owner->owner &&
+              (node->owner->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
+    if (node->is_repeat) return rep_first(node,L,l2r);
+    if (node->rxe) return first_at_length(node->rxe,L);
+    if (node->is_dict) {
+        int k;
+        for (k=0;k<node->nwords;k++)
+            if ((int)strlen(node->words[k]) == L) { ns->iterator = k; return 0; }
+        return 1;
+    }
+    if (node->len) {
+        if (L != 1) return 1;
+        ns->iterator = 0;
+        return 0;
+    }
+    return L ? 1 : 0;
+}
+
+static int step_node(struct rxe_node *node, int L)
+{
+    struct rxe_node_state *ns = NS(node);
+    int l2r = node->owner && node->owner->owner &&
+              (node->owner->owner->flags & RXE_FLAG_LEFT_TO_RIGHT);
+    if (node->is_repeat) return rep_advance(node,L,l2r);
+    if (node->rxe) return step_at_length(node->rxe,L);
+    if (node->is_dict) {
+        int k;
+        for (k=ns->iterator+1;k<node->nwords;k++)
+            if ((int)strlen(node->words[k]) == L) { ns->iterator = k; return 0; }
+        return 1;
+    }
+    if (node->len) {
+        if (ns->iterator+1 >= node->len) return 1;
+        ns->iterator++;
+        return 0;
+    }
+    return 1;
+}
+
+// The first member of length L over this position and everything after it:
+// this one takes the most it can, as the seek tries it first.
+
+static int first_from(struct rxe_node *node, int L)
+{
+    int l;
+    if (!node) return L ? 1 : 0;
+    lens_node(node,L);
+    lens_rest(node,L);
+    for (l=L;l>=0;l--) {
+        if (!lens_has(lens_of(node),l) || !lens_has(rest_of(node),L-l)) continue;
+        NS(node)->sl_len = l;
+        if (first_node(node,l)) return 1;
+        return first_from(next_of(node),L-l);
+    }
+    return 1;
+}
+
+static int step_from(struct rxe_node *node, int L)
+{
+    int l = node ? NS(node)->sl_len : 0;
+    if (!node) return 1;
+    struct rxe_node *next = next_of(node);
+    if (next && !step_from(next,L-l)) return 0;
+    if (!step_node(node,l)) return first_from(next,L-l);
+    // Exhausted at this share of the length: the next split gives up some of
+    // it to the positions after.
+    for (l=l-1;l>=0;l--) {
+        if (!lens_has(lens_of(node),l) || !lens_has(rest_of(node),L-l)) continue;
+        NS(node)->sl_len = l;
+        if (first_node(node,l)) return 1;
+        return first_from(next,L-l);
+    }
+    return 1;
+}
+
+static int first_at_length(struct rxe *rxe, int L)
+{
+    struct rxe_state *rs = RS(rxe);
+    struct rxe_alt *alt;
+    int l2r = rxe->flags & RXE_FLAG_LEFT_TO_RIGHT;
+    rxe_lens_rxe(rxe,L);
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        rxe_lens_alt(alt,L);
+        if (!lens_has(lens_of_alt(alt),L)) continue;
+        rs->curr = alt;
+        rs->sl_len = L;
+        if (first_from(l2r ? alt->tail : alt->head,L)) break;
+        return 0;
+    }
+    rs->sl_len = -1;
+    return 1;
+}
+
+static int step_at_length(struct rxe *rxe, int L)
+{
+    struct rxe_state *rs = RS(rxe);
+    struct rxe_alt *alt = rs->curr;
+    int l2r = rxe->flags & RXE_FLAG_LEFT_TO_RIGHT;
+    if (!alt) return 1;
+    if (!step_from(l2r ? alt->tail : alt->head,L)) return 0;
+    for ( alt = alt->next ; alt ; alt = alt->next ) {
+        rxe_lens_alt(alt,L);
+        if (!lens_has(lens_of_alt(alt),L)) continue;
+        rs->curr = alt;
+        return first_from(l2r ? alt->tail : alt->head,L);
+    }
+    return 1;
+}
+
+int rxe_step_shortlex(struct rxe *rxe, const mpz_t pos)
+{
+    int L;
+    if (!rxe) return 1;
+    // Nothing to step from until a seek by length has placed a member whole --
+    // a fresh parse, or a seek that failed part way -- so seek instead.
+    if (RS(rxe)->sl_len < 0) return rxe_seek_shortlex(rxe,pos);
+    L = RS(rxe)->sl_len;
+    if (!step_at_length(rxe,L)) return 0;
+    for (L=L+1;L<=LENS_MAX_LENGTH;L++) {
+        rxe_lens_rxe(rxe,L);
+        if (!lens_has(lens_of_rxe(rxe),L)) continue;
+        return first_at_length(rxe,L);
+    }
+    RS(rxe)->sl_len = -1;
+    return 1;
+}
+
+#ifndef RXE_CURSOR_WALK
+
+/* ----------------------------- Windows ---------------------------------- */
+
+// The members whose length lies in [a,b], and nothing else. A password sweep
+// or a capacity plan shards by length, and the counts above already say where
+// each length starts; what was missing was a way to begin at the first member
+// of length a without seeking through, and throwing away, everything shorter.
+//
+// The walk is over a private copy marked shortest first (rxe_clone_by_length),
+// so a finite set, which is otherwise a numeral in place-value order, is
+// walked by length too, and the caller's expression is left where it stood.
+// Each length is entered by first_at_length and stepped by step_at_length,
+// the same carries rxe_step_shortlex makes; a length with no members is
+// skipped on its count alone. A finite set stops at the length that completes
+// its cardinality, so a window wider than the set does not build tables out
+// to the window's end.
+//
+// The index handed to the sink is the member's place in shortest-first order,
+// members shorter than a included -- rxe_seek's index exactly when the set is
+// itself enumerated that way (rxe_is_shortlex). A finite set whose lengths
+// cannot be counted, one with a backreference or a combination, is walked in
+// its own order instead and filtered, each member carrying its own index; an
+// infinite one of that kind has no end to filter to and is refused.
+
+int rxe_length_count(struct rxe *rxe, int L, mpz_t out)
+{
+    if (!rxe_length_countable(rxe)) return 1;
+    rxe_count_at_length(out,rxe,L);
+    return 0;
+}
+
+static int lengths_filtered(struct rxe *rxe, int a, int b, int maxlen,
+                            rxe_sink emit, void *ctx)
+{
+    // Render one past the narrower of the window and the sink's width, so a
+    // member too long for either is told apart from one that just fits: too
+    // long for the window is skipped, too long for the sink within it stops.
+    int lim = b < maxlen ? b : maxlen;
+    char *str = malloc((size_t)lim + 2);
+    if (!str) return RXE_FOREACH_TOOBIG;
+    struct rxe *copy = rxe_deep_clone(rxe);
+    mpz_t idx;
+    mpz_init_set_ui(idx,0);
+    int rc = RXE_FOREACH_END;
+    rxe_check_overflow();
+    if (!rxe_seek(copy,idx)) for (;;) {
+        char *end = rxe_current(str,lim + 1,copy);
+        int len = (int)(end - str);
+        int huge = rxe_check_overflow();
+        if (huge || len > lim) {
+            if (lim < b) { rc = RXE_FOREACH_TOOBIG; break; }
+        } else if (len >= a && emit && emit(str,(size_t)len,idx,ctx)) {
+            rc = RXE_FOREACH_STOP;
+            break;
+        }
+        mpz_add_ui(idx,idx,1);
+        if (!rxe_next(copy)) break;
+    }
+    mpz_clear(idx);
+    rxe_free(copy);
+    free(str);
+    return rc;
+}
+
+int rxe_foreach_lengths(struct rxe *rxe, int a, int b, int maxlen,
+                        rxe_sink emit, void *ctx)
+{
+    if (!rxe || rxe->status || maxlen < 1) return RXE_FOREACH_RANGE;
+    if (a < 0) a = 0;
+    if (b > LENS_MAX_LENGTH) b = LENS_MAX_LENGTH;
+    if (a > b) return RXE_FOREACH_END;
+    // A finite walk ends at the length that completes the size.
+    rxe_force_size(rxe);
+    int finite = !rxe_is_infinite(rxe);
+    struct rxe *copy = rxe_clone_by_length(rxe);
+    if (!copy) return finite ? lengths_filtered(rxe,a,b,maxlen,emit,ctx)
+                             : RXE_FOREACH_RANGE;
+
+    char *str = malloc((size_t)maxlen + 2);
+    if (!str) { rxe_free(copy); return RXE_FOREACH_TOOBIG; }
+    mpz_t seen, c, idx;
+    mpz_init_set_ui(seen,0);
+    mpz_init(c);
+    mpz_init(idx);
+    int L, rc = RXE_FOREACH_END;
+    for (L=0;L<a;L++) {
+        rxe_count_at_length(c,copy,L);
+        mpz_add(seen,seen,c);
+    }
+    rxe_check_overflow();
+    for ( ; L <= b ; L++) {
+        if (finite && mpz_cmp(seen,rxe->nitems) >= 0) break;
+        rxe_count_at_length(c,copy,L);
+        if (!mpz_sgn(c)) continue;
+        mpz_set(idx,seen);
+        mpz_add(seen,seen,c);
+        if (first_at_length(copy,L)) continue;
+        do {
+            char *end = rxe_current(str,maxlen + 1,copy);
+            size_t len = (size_t)(end - str);
+            if (rxe_check_overflow() || len > (size_t)maxlen) {
+                rc = RXE_FOREACH_TOOBIG;
+                goto done;
+            }
+            if (emit && emit(str,len,idx,ctx)) {
+                rc = RXE_FOREACH_STOP;
+                goto done;
+            }
+            mpz_add_ui(idx,idx,1);
+        } while (!step_at_length(copy,L));
+    }
+done:
+    mpz_clear(seen);
+    mpz_clear(c);
+    mpz_clear(idx);
+    rxe_free(copy);
+    free(str);
+    return rc;
+}
+
 /* ----------------------------- Ranking ---------------------------------- */
 
 // The inverse of the shortlex seek. Given a string, find the shortlex index it
@@ -691,16 +1328,17 @@ static int rank_from(struct rxe_node *node, const char *s, int off, int L,
 static int repeat_body_fixed(struct rxe_node *node, int *m)
 {
     struct rxe *body = node->rxe;
+    struct rxe_lens *bl = lens_of_rxe(body);
     int L = 1;
     for (;;) {
         rxe_lens_rxe(body, L);
-        int hi = L < body->lens.max ? L : body->lens.max;
+        int hi = L < bl->max ? L : bl->max;
         for (int i = 1; i <= hi; i++)
-            if (mpz_sgn(body->lens.count[i])) {      // shortest non-empty length
+            if (mpz_sgn(bl->count[i])) {      // shortest non-empty length
                 *m = i;
-                return !mpz_cmp(body->lens.count[i], body->nitems);
+                return !mpz_cmp(bl->count[i], body->nitems);
             }
-        if (!mpz_cmp(body->lens.count[0], body->nitems)) return 0;  // empty only
+        if (!mpz_cmp(bl->count[0], body->nitems)) return 0;  // empty only
         if (L >= LENS_MAX_LENGTH) return 0;
         L *= 2;
     }
@@ -768,7 +1406,7 @@ static int rank_repeat_len(struct rxe_node *node, const char *s, int off, int L,
     if (node->rep_max != RXE_REP_UNBOUNDED && n > node->rep_max) return 0;
     mpz_t base, zero;
     mpz_init(base);
-    lens_at(base, &body->lens, m);
+    lens_at(base, lens_of_rxe(body), m);
     mpz_init_set_ui(zero, 0);
     struct rep_len_ctx c = { body, s, off, m, n, base, visit, ctx };
     int stop = rep_len_rec(&c, 0, zero);
@@ -871,13 +1509,13 @@ static int rank_from(struct rxe_node *node, const char *s, int off, int L,
     for (int l = 0; l <= L; l++) {
         mpz_set_ui(offset, 0);
         for (int lp = l + 1; lp <= L; lp++) {
-            lens_at(a, &node->lens, lp);
+            lens_at(a, lens_of(node), lp);
             if (!mpz_sgn(a)) continue;
-            lens_at(b, &node->rest, L - lp);
+            lens_at(b, rest_of(node), L - lp);
             if (!mpz_sgn(b)) continue;
             mpz_addmul(offset, a, b);
         }
-        lens_at(b, &node->rest, L - l);    // place value for this position
+        lens_at(b, rest_of(node), L - l);    // place value for this position
         struct rf_node o = { node->next, s, off + l, L - l,
                              visit, ctx, offset, b };
         if (rank_node_len(node, s, off, l, rf_node_visit, &o)) {
@@ -915,7 +1553,7 @@ static int rank_at_length(struct rxe *rxe, const char *s, int off, int L,
     rxe_lens_rxe(rxe, L);
     for (struct rxe_alt *alt = rxe->head; alt; alt = alt->next) {
         rxe_lens_alt(alt, L);
-        lens_at(c, &alt->lens, L);
+        lens_at(c, lens_of_alt(alt), L);
         if (mpz_sgn(c)) {
             struct at_ctx a = { visit, ctx, base };
             if (rank_from(alt->head, s, off, L, at_visit, &a)) {
@@ -962,3 +1600,5 @@ int rxe_rank_shortlex(struct rxe *rxe, const char *s, int len,
     mpz_clear(c);
     return 0;
 }
+
+#endif
@@ -24,8 +24,18 @@ void rxe_lens_rxe(struct rxe *rxe, int L);
 void rxe_lens_alt(struct rxe_alt *alt, int L);
 void rxe_count_at_length(mpz_t out, struct rxe *rxe, int L);
 
+// The fewest non-zero counts on each side of a convolution for it to be done
+// as one multiplication of packed integers rather than term by term. A tuning
+// knob for the benchmark; nothing else need touch it.
+extern int rxe_lens_kronecker_min;
+
 int rxe_seek_at_length(struct rxe *rxe, int L, const mpz_t idx);
 int rxe_seek_shortlex(struct rxe *rxe, const mpz_t pos);
+// Step from the member a shortlex seek (or step) left the tree on to the next,
+// by carrying, and on to the next length when this one is exhausted. 'pos' is
+// the index being stepped to, for the seek it falls back on when the tree has
+// not been placed by length yet. Returns 0 on success, as rxe_seek does.
+int rxe_step_shortlex(struct rxe *rxe, const mpz_t pos);
 int rxe_repeat_seek_at_length(struct rxe_node *node, int L, const mpz_t idx,
                               int l2r);
 
@@ -44,4 +54,9 @@ int rxe_rank_shortlex(struct rxe *rxe, const char *s, int len,
 // count at length zero does not converge and the parser refuses it.
 int rxe_matches_empty(struct rxe *rxe);
 
+// In rxe.c: whether the set can be counted by length at all, and a private
+// copy of it marked to be walked that way, or NULL when it cannot.
+int rxe_length_countable(struct rxe *rxe);
+struct rxe *rxe_clone_by_length(struct rxe *rxe);
+
 #endif // __RXE_LENS_H__
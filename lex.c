@@ -0,0 +1,595 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * lex -- a finite set numbered in byte order, off its automaton.
+ *
+ * The tree numbers a set by how the pattern spells its members, which is why
+ * '(a|a){22}' has four million members and one string: every way of spelling
+ * a member is a member of its own. rxedup throws the extra spellings away by
+ * remembering what it has seen, at a cost that grows with the set. Under
+ * RXE_DISTINCT the set is numbered by what its members are instead. The
+ * pattern becomes a DFA (dfa.c), where each string has one path whatever
+ * spelt it, and the members are the strings the automaton accepts, taken in
+ * byte order -- the order strcmp and sort(1) in the C locale put them in, a
+ * string before everything it is a prefix of. The tree stays, for whatever
+ * reads the pattern's shape, but no member is read from it.
+ *
+ * The numbering is the usual one over paths. count[q] is how many strings
+ * take state q to acceptance: one if q accepts, plus the count of each state
+ * a byte leads to. A finite language has no cycle through a state that can
+ * still reach acceptance, so the counts come off one depth-first pass. Index
+ * i from state q is then the empty string if q accepts and i is 0, or else
+ * falls among the bytes in order, each weighing the count of the state it
+ * leads to; a seek is one such choice per byte of the member, and a rank the
+ * same sums read the other way. The bytes that lead to the same state side by
+ * side are kept as a run, so '[a-z]' is one division, not twenty-six
+ * subtractions.
+ *
+ * A step needs no counts at all: the next string in byte order is the current
+ * one extended by the smallest byte that leads anywhere, or failing that, the
+ * deepest byte that can be raised, raised -- and then, either way, extended
+ * by smallest bytes until the automaton accepts. That touches only the bytes
+ * that change, and the render copies only those.
+ *
+ * RXE_BYTE_ORDER keeps the spellings and changes only the order: every string
+ * in byte order as above, each as many times over as the pattern spells it.
+ * The automaton is then the weighted one (rxe_dfa_build_spelt), whose states
+ * know how many ways the string ending in them is spelt; weight[q] is that,
+ * where for the distinct set it is one or none, and the counts, the seek and
+ * the rank above are the same sums with it in place of the one. A step on a
+ * string spelt more than once moves to its next spelling, which renders the
+ * same, so the repeats of a string are always side by side -- all a
+ * duplicate-finder needs to compare is each member with the one before.
+ *
+ * The automaton is capped at RXE_DISTINCT_MAX_STATES, past which the set is
+ * refused with RXE_AUTOMATON_TOO_BIG; and it must be an automaton, so a
+ * backreference, a choice or a policy is refused with RXE_NOT_REGULAR. The
+ * set must be finite (RXE_DISTINCT_SET, RXE_BYTE_ORDER_SET): byte order has
+ * no first member after 'a' in 'ab*', whose strings 'a', 'ab', 'abb', ... all
+ * come before 'b'.
+ */
+
+#include <string.h>
+#include "rxe.h"
+#include "rxe_alt.h"
+#include "dfa.h"
+#include "filter.h"
+#include "lex.h"
+
+struct lex_run {
+    int lo, hi;                   // bytes lo..hi, each leading to
+    int to;                       // ...this state, which can still accept
+};
+
+struct rxe_lex {
+    int refs;
+    struct rxe_dfa *dfa;
+    mpz_t *weight;                // members ending in each state: 1 or 0, or
+                                  // under RXE_BYTE_ORDER its spellings
+    mpz_t *count;                 // members from each state, 0 if none
+    int *at;                      // state q's runs are run[at[q]..at[q+1]-1],
+    struct lex_run *run;          // in byte order
+    int longest;                  // the longest member's length
+};
+
+struct rxe_lex_state {
+    char *buf;                    // the member, longest + 1 bytes
+    int  *q;                      // the state before each byte, and after the
+                                  // last
+    int   len;
+    int   keep;                   // bytes unchanged since the last render
+    mpz_t spelling;               // which of the member's spellings this is
+    mpz_t i, t;                   // a seek's remainder, and its scratch
+};
+
+/* ------------------------------ Building -------------------------------- */
+
+// The states from which some string reaches acceptance, found backwards from
+// the accepting ones over the moves reversed.
+
+static unsigned char *live_states(const struct rxe_dfa *d)
+{
+    int S = d->nstates, C = d->ncls, q, c, n = 0;
+    int *deg = NEW(S + 1,int), *from = NEW(S*C > 0 ? S*C : 1,int);
+    int *todo = NEW(S > 0 ? S : 1,int);
+    unsigned char *live = NEW(S > 0 ? S : 1,unsigned char);
+    memset(deg,0,(S + 1)*sizeof *deg);
+    memset(live,0,S > 0 ? (size_t)S : 1);
+    for (q=0;q<S;q++)
+        for (c=0;c<C;c++) deg[d->next[q*C + c] + 1]++;
+    for (q=0;q<S;q++) deg[q+1] += deg[q];
+    for (q=0;q<S;q++)
+        for (c=0;c<C;c++) from[deg[d->next[q*C + c]]++] = q;
+    // Each list was filled by advancing its start to the next one's; the
+    // starts are one list behind.
+    for (q=S;q>0;q--) deg[q] = deg[q-1];
+    deg[0] = 0;
+    for (q=0;q<S;q++)
+        if (d->accept[q]) {
+            live[q] = 1;
+            todo[n++] = q;
+        }
+    while (n) {
+        int t = todo[--n], k;
+        for (k=deg[t];k<deg[t+1];k++)
+            if (!live[from[k]]) {
+                live[from[k]] = 1;
+                todo[n++] = from[k];
+            }
+    }
+    rxe_mem_free(deg);
+    rxe_mem_free(from);
+    rxe_mem_free(todo);
+    return live;
+}
+
+// Each state's moves into live states, as runs of adjacent bytes that go to
+// the same one. Counted first, then laid.
+
+static void make_runs(struct rxe_lex *lex, const unsigned char *live)
+{
+    const struct rxe_dfa *d = lex->dfa;
+    int S = d->nstates, C = d->ncls, q, b, n, pass;
+    lex->at = NEW(S + 1,int);
+    lex->run = NULL;
+    for (pass=0;pass<2;pass++) {
+        n = 0;
+        for (q=0;q<S;q++) {
+            const int *row = d->next + q*C;
+            lex->at[q] = n;
+            for (b=0;b<256;b++) {
+                int t = row[d->cls[b]];
+                if (!live[t]) continue;
+                if (b && row[d->cls[b-1]] == t) {
+                    if (lex->run) lex->run[n-1].hi = b;
+                    continue;
+                }
+                if (lex->run) {
+                    lex->run[n].lo = lex->run[n].hi = b;
+                    lex->run[n].to = t;
+                }
+                n++;
+            }
+        }
+        lex->at[S] = n;
+        if (!pass) lex->run = NEW(n > 0 ? n : 1,struct lex_run);
+    }
+}
+
+// The counts, and the longest member, by one depth-first pass from the start
+// over the live states; only the longest if not 'sum', when the counts are
+// already known. Returns RXE_INFINITE if it finds a cycle: some string can
+// be pumped, and there are endlessly many.
+
+static int count_members(struct rxe_lex *lex, const unsigned char *live,
+                         int sum)
+{
+    const struct rxe_dfa *d = lex->dfa;
+    int S = d->nstates, q, k, sp = 0, status = RXE_OK;
+    unsigned char *colour = NEW(S,unsigned char);
+    int *stack = NEW(S,int), *cur = NEW(S,int), *deep = NEW(S,int);
+    if (sum) {
+        lex->count = NEW(S,mpz_t);
+        for (q=0;q<S;q++) mpz_init(lex->count[q]);
+    }
+    memset(colour,0,S);
+    lex->longest = 0;
+    if (live[d->start]) {
+        stack[sp++] = d->start;
+        colour[d->start] = 1;
+        cur[d->start] = lex->at[d->start];
+    }
+    while (sp && !status) {
+        q = stack[sp-1];
+        if (cur[q] < lex->at[q+1]) {
+            int t = lex->run[cur[q]++].to;
+            if (colour[t] == 1) status = RXE_INFINITE;
+            else if (!colour[t]) {
+                colour[t] = 1;
+                cur[t] = lex->at[t];
+                stack[sp++] = t;
+            }
+            continue;
+        }
+        // Everything q leads to is counted; q is the sum of it.
+        sp--;
+        colour[q] = 2;
+        if (sum) mpz_set(lex->count[q],lex->weight[q]);
+        deep[q] = 0;
+        for (k=lex->at[q];k<lex->at[q+1];k++) {
+            const struct lex_run *r = &lex->run[k];
+            if (sum) mpz_addmul_ui(lex->count[q],lex->count[r->to],
+                                   (unsigned long)(r->hi - r->lo + 1));
+            if (deep[r->to] + 1 > deep[q]) deep[q] = deep[r->to] + 1;
+        }
+    }
+    if (live[d->start] && !status) lex->longest = deep[d->start];
+    rxe_mem_free(colour);
+    rxe_mem_free(stack);
+    rxe_mem_free(cur);
+    rxe_mem_free(deep);
+    return status;
+}
+
+struct rxe_lex *rxe_lex_ref(struct rxe_lex *lex)
+{
+    if (lex) __atomic_add_fetch(&lex->refs,1,__ATOMIC_RELAXED);
+    return lex;
+}
+
+void rxe_lex_unref(struct rxe_lex *lex)
+{
+    int q;
+    if (!lex || __atomic_sub_fetch(&lex->refs,1,__ATOMIC_ACQ_REL)) return;
+    if (lex->count) {
+        for (q=0;q<lex->dfa->nstates;q++) mpz_clear(lex->count[q]);
+        rxe_mem_free(lex->count);
+    }
+    if (lex->weight) {
+        for (q=0;q<lex->dfa->nstates;q++) mpz_clear(lex->weight[q]);
+        rxe_mem_free(lex->weight);
+    }
+    if (lex->at) rxe_mem_free(lex->at);
+    if (lex->run) rxe_mem_free(lex->run);
+    rxe_dfa_free(lex->dfa);
+    rxe_mem_free(lex);
+}
+
+struct rxe_lex_state *rxe_lex_state_new(const struct rxe_lex *lex)
+{
+    struct rxe_lex_state *st = NEW(1,struct rxe_lex_state);
+    st->buf = NEW(lex->longest + 1,char);
+    st->q = NEW(lex->longest + 1,int);
+    st->len = 0;
+    st->keep = 0;
+    st->q[0] = lex->dfa->start;
+    mpz_init(st->spelling);
+    mpz_init(st->i);
+    mpz_init(st->t);
+    return st;
+}
+
+void rxe_lex_state_free(struct rxe_lex_state *st)
+{
+    if (!st) return;
+    rxe_mem_free(st->buf);
+    rxe_mem_free(st->q);
+    mpz_clear(st->spelling);
+    mpz_clear(st->i);
+    mpz_clear(st->t);
+    rxe_mem_free(st);
+}
+
+// The automaton of 'rxe' and its counts, weighted by spellings if 'spelt';
+// of a filtered set, the automaton of what both the tree and the filter
+// accept. Returns RXE_OK and sets *out, or the status that stopped it.
+
+static int build(struct rxe *rxe, int spelt, struct rxe_lex **out)
+{
+    struct rxe_dfa *dfa, *tree;
+    int q, status = spelt ? rxe_dfa_build_spelt(rxe,RXE_DISTINCT_MAX_STATES,&dfa)
+                          : rxe_dfa_build(rxe,0,RXE_DISTINCT_MAX_STATES,&dfa);
+    *out = NULL;
+    if (!status && rxe->filter) {
+        tree = dfa;
+        status = rxe_dfa_intersect(tree,rxe_filter_dfa(rxe->filter),
+                                   RXE_DISTINCT_MAX_STATES,&dfa);
+        rxe_dfa_free(tree);
+    }
+    if (status) return status;
+    struct rxe_lex *lex = NEW(1,struct rxe_lex);
+    lex->refs = 1;
+    lex->dfa = dfa;
+    lex->count = NULL;
+    if (dfa->weight) {
+        lex->weight = dfa->weight;
+        dfa->weight = NULL;
+    } else {
+        lex->weight = NEW(dfa->nstates,mpz_t);
+        for (q=0;q<dfa->nstates;q++) mpz_init_set_ui(lex->weight[q],dfa->accept[q]);
+    }
+    unsigned char *live = live_states(dfa);
+    make_runs(lex,live);
+    status = count_members(lex,live,1);
+    rxe_mem_free(live);
+    if (status) rxe_lex_unref(lex);
+    else *out = lex;
+    return status;
+}
+
+// Number 'rxe' off 'lex' from now on.
+
+static void attach(struct rxe *rxe, struct rxe_lex *lex)
+{
+    // The plan walks the tree's spellings, so it goes; the tree's own counts
+    // are settled, for whatever reads them, before the set's size replaces
+    // the root's.
+    rxe_uncompile(rxe);
+    rxe_force_size(rxe);
+    rxe->lex = lex;
+    rxe->walk.lex_state = rxe_lex_state_new(lex);
+    mpz_set(rxe->nitems,lex->count[lex->dfa->start]);
+    if (!mpz_sgn(rxe->nitems)) rxe->walk.curr = NULL;
+    else {
+        mpz_t z;
+        mpz_init(z);
+        rxe_seek(rxe,z);
+        mpz_clear(z);
+    }
+}
+
+// Put 'rxe', freshly parsed, on its distinct members. Returns RXE_OK, or the
+// status that refuses it with the expression left as it was.
+
+int rxe_lex_distinct(struct rxe *rxe)
+{
+    struct rxe_lex *lex;
+    if (rxe_is_infinite(rxe)) return RXE_DISTINCT_SET;
+    int status = build(rxe,0,&lex);
+    if (status) return status == RXE_INFINITE ? RXE_DISTINCT_SET : status;
+    attach(rxe,lex);
+    return RXE_OK;
+}
+
+// ...or on all its members, in byte order. The automaton's spellings must be
+// the tree's, member for member; they are built to be, and a set whose
+// count disagrees is refused rather than numbered wrongly.
+
+int rxe_lex_byte_order(struct rxe *rxe)
+{
+    struct rxe_lex *lex;
+    if (rxe_is_infinite(rxe)) return RXE_BYTE_ORDER_SET;
+    int status = build(rxe,1,&lex);
+    if (status) return status == RXE_INFINITE ? RXE_BYTE_ORDER_SET : status;
+    rxe_force_size(rxe);
+    if (mpz_cmp(lex->count[lex->dfa->start],rxe->nitems)) {
+        rxe_lex_unref(lex);
+        return RXE_NOT_REGULAR;
+    }
+    attach(rxe,lex);
+    return RXE_OK;
+}
+
+// Put 'rxe', parsed without RXE_DISTINCT or RXE_BYTE_ORDER but with them in
+// its options, on an automaton read back from an image (see image.c) rather
+// than built: the DFA, and each state's weight and count as they were saved,
+// all of which this takes. Building the automaton is what makes such a set
+// slow to parse, and summing its counts is the rest; here only the runs and
+// the longest member are made again, neither with any arithmetic. Returns
+// RXE_OK, or RXE_IMAGE_COUNT when the automaton cannot be the set's: endless,
+// or, in byte order, spelling a count the tree does not.
+
+int rxe_lex_load(struct rxe *rxe, struct rxe_dfa *dfa, mpz_t *weight,
+                 mpz_t *count)
+{
+    struct rxe_lex *lex = NEW(1,struct rxe_lex);
+    lex->refs = 1;
+    lex->dfa = dfa;
+    lex->weight = weight;
+    lex->count = count;
+    unsigned char *live = live_states(dfa);
+    make_runs(lex,live);
+    int status = count_members(lex,live,0);
+    rxe_mem_free(live);
+    if (!status && (rxe->options & RXE_BYTE_ORDER)) {
+        rxe_force_size(rxe);
+        if (mpz_cmp(count[dfa->start],rxe->nitems)) status = RXE_IMAGE_COUNT;
+    }
+    if (status) {
+        rxe_lex_unref(lex);
+        return RXE_IMAGE_COUNT;
+    }
+    attach(rxe,lex);
+    return RXE_OK;
+}
+
+// What rxe_save writes of an automaton: the DFA, and each state's weight and
+// count.
+
+const struct rxe_dfa *rxe_lex_dfa(const struct rxe_lex *lex)
+{
+    return lex->dfa;
+}
+
+mpz_srcptr rxe_lex_weight(const struct rxe_lex *lex, int q)
+{
+    return lex->weight[q];
+}
+
+mpz_srcptr rxe_lex_count(const struct rxe_lex *lex, int q)
+{
+    return lex->count[q];
+}
+
+// The same count, asked of any set and kept by none. An endless set spells
+// endlessly many strings, since the parse refuses an unbounded repetition of
+// anything that may be empty, so it is answered without an automaton.
+
+int rxe_count_distinct(struct rxe *rxe, mpz_t out)
+{
+    struct rxe_lex *lex;
+    if (rxe->status) return rxe->status;
+    if (rxe_is_infinite(rxe)) return RXE_INFINITE;
+    if (rxe->lex && (rxe->options & RXE_DISTINCT)) {
+        mpz_set(out,rxe->nitems);
+        return RXE_OK;
+    }
+    int status = build(rxe,0,&lex);
+    if (status) return status;
+    mpz_set(out,lex->count[lex->dfa->start]);
+    rxe_lex_unref(lex);
+    return RXE_OK;
+}
+
+/* ------------------------------- Walking -------------------------------- */
+
+static void push(struct rxe_lex_state *st, int b, int to)
+{
+    st->buf[st->len++] = (char)b;
+    st->q[st->len] = to;
+}
+
+int rxe_lex_seek(const struct rxe_lex *lex, struct rxe_lex_state *st,
+                 const mpz_t pos)
+{
+    const struct rxe_dfa *d = lex->dfa;
+    int q = d->start;
+    if (mpz_sgn(pos) < 0 || mpz_cmp(pos,lex->count[q]) >= 0) return 1;
+    mpz_set(st->i,pos);
+    st->len = 0;
+    st->keep = 0;
+    st->q[0] = q;
+    for (;;) {
+        if (d->accept[q]) {
+            if (mpz_cmp(st->i,lex->weight[q]) < 0) break;
+            mpz_sub(st->i,st->i,lex->weight[q]);
+        }
+        // The index is below what q has left, so some run holds it -- unless
+        // the counts came from a damaged image (see rxe_lex_load), which is
+        // refused here rather than walked off the runs.
+        const struct lex_run *r = &lex->run[lex->at[q]];
+        const struct lex_run *end = &lex->run[lex->at[q+1]];
+        for (;;r++) {
+            if (r == end) return 1;
+            unsigned long width = (unsigned long)(r->hi - r->lo + 1);
+            mpz_srcptr n = lex->count[r->to];
+            mpz_mul_ui(st->t,n,width);
+            if (mpz_cmp(st->i,st->t) < 0) break;
+            mpz_sub(st->i,st->i,st->t);
+        }
+        unsigned long k = 0;
+        if (r->hi > r->lo) {
+            mpz_fdiv_qr(st->t,st->i,st->i,lex->count[r->to]);
+            k = mpz_get_ui(st->t);
+            if (k > (unsigned long)(r->hi - r->lo)) return 1;
+        }
+        push(st,r->lo + (int)k,r->to);
+        q = r->to;
+    }
+    mpz_set(st->spelling,st->i);
+    return 0;
+}
+
+// The next member in byte order; 1, back on the first, after the last.
+
+int rxe_lex_iterate(const struct rxe_lex *lex, struct rxe_lex_state *st)
+{
+    const struct rxe_dfa *d = lex->dfa;
+    int depth = st->len, q = st->q[depth];
+    const struct lex_run *r;
+    mpz_add_ui(st->spelling,st->spelling,1);
+    if (mpz_cmp(st->spelling,lex->weight[q]) < 0) {
+        // The same string, spelt the next way: nothing to render anew.
+        st->keep = st->len;
+        return 0;
+    }
+    mpz_set_ui(st->spelling,0);
+    if (lex->at[q] < lex->at[q+1]) {
+        // Something longer starts here, and comes first.
+        r = &lex->run[lex->at[q]];
+        push(st,r->lo,r->to);
+    } else {
+        for (;;) {
+            if (!depth) {
+                mpz_t z;
+                mpz_init(z);
+                rxe_lex_seek(lex,st,z);
+                mpz_clear(z);
+                return 1;
+            }
+            int c = (unsigned char)st->buf[--depth];
+            q = st->q[depth];
+            for (r=&lex->run[lex->at[q]];r<&lex->run[lex->at[q+1]];r++)
+                if (r->hi > c) break;
+            if (r < &lex->run[lex->at[q+1]]) break;
+        }
+        int c = (unsigned char)st->buf[depth];
+        st->len = depth;
+        push(st,r->lo > c ? r->lo : c + 1,r->to);
+    }
+    if (depth < st->keep) st->keep = depth;
+    // ...and then the least that the automaton accepts from there.
+    for (q=st->q[st->len];!d->accept[q];q=r->to) {
+        r = &lex->run[lex->at[q]];
+        push(st,r->lo,r->to);
+    }
+    return 0;
+}
+
+// Rendered as the tree renders: at most maxlen bytes and a terminator. A
+// member cut short leaves nothing a delta render could build on.
+
+char *rxe_lex_render(struct rxe_lex_state *st, char *str, int maxlen)
+{
+    int n = st->len < maxlen ? st->len : maxlen;
+    memcpy(str,st->buf,n);
+    str[n] = 0;
+    st->keep = n;
+    return str + n;
+}
+
+char *rxe_lex_render_delta(struct rxe_lex_state *st, char *str, int maxlen)
+{
+    if (st->len >= maxlen) return rxe_lex_render(st,str,maxlen);
+    memcpy(str + st->keep,st->buf + st->keep,st->len - st->keep);
+    str[st->len] = 0;
+    st->keep = st->len;
+    return str + st->len;
+}
+
+int rxe_lex_touched(const struct rxe_lex_state *st)
+{
+    return st->keep;
+}
+
+// The index of 's', the same sums a seek subtracts, added: of its first
+// spelling, and 'spellings', if not NULL, says how many follow from there.
+// Returns 0 and sets both for a member, 1 for a string that is not one.
+
+int rxe_lex_rank(const struct rxe_lex *lex, const char *s, size_t len,
+                 mpz_t out, mpz_t spellings)
+{
+    const struct rxe_dfa *d = lex->dfa;
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    int q = d->start;
+    mpz_t i;
+    mpz_init(i);
+    for ( ; p < end ; p++) {
+        const struct lex_run *r;
+        int to = -1;
+        mpz_add(i,i,lex->weight[q]);
+        for (r=&lex->run[lex->at[q]];r<&lex->run[lex->at[q+1]];r++) {
+            if (r->lo > *p) break;
+            unsigned long below = r->hi < *p ? (unsigned long)(r->hi - r->lo + 1)
+                                             : (unsigned long)(*p - r->lo);
+            mpz_addmul_ui(i,lex->count[r->to],below);
+            if (r->hi >= *p) {
+                to = r->to;
+                break;
+            }
+        }
+        if (to < 0) break;
+        q = to;
+    }
+    int rc = p < end || !d->accept[q];
+    if (!rc) {
+        mpz_set(out,i);
+        if (spellings) mpz_set(spellings,lex->weight[q]);
+    }
+    mpz_clear(i);
+    return rc;
+}
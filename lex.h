@@ -0,0 +1,49 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+#ifndef __RXE_LEX_H__
+#define __RXE_LEX_H__
+
+// A finite set numbered in byte order, off its automaton; see lex.c. The
+// automaton and its counts are immutable once built and shared by every clone,
+// as the plan is; where a walk stands in it is each clone's own.
+
+struct rxe_lex;
+struct rxe_lex_state;
+struct rxe_dfa;
+
+int  rxe_lex_distinct(struct rxe *rxe);
+int  rxe_lex_byte_order(struct rxe *rxe);
+int  rxe_lex_load(struct rxe *rxe, struct rxe_dfa *dfa, mpz_t *weight,
+                  mpz_t *count);
+const struct rxe_dfa *rxe_lex_dfa(const struct rxe_lex *lex);
+mpz_srcptr rxe_lex_weight(const struct rxe_lex *lex, int q);
+mpz_srcptr rxe_lex_count(const struct rxe_lex *lex, int q);
+struct rxe_lex *rxe_lex_ref(struct rxe_lex *lex);
+void rxe_lex_unref(struct rxe_lex *lex);
+struct rxe_lex_state *rxe_lex_state_new(const struct rxe_lex *lex);
+void rxe_lex_state_free(struct rxe_lex_state *st);
+
+int   rxe_lex_seek(const struct rxe_lex *lex, struct rxe_lex_state *st,
+                   const mpz_t pos);
+int   rxe_lex_iterate(const struct rxe_lex *lex, struct rxe_lex_state *st);
+char *rxe_lex_render(struct rxe_lex_state *st, char *str, int maxlen);
+char *rxe_lex_render_delta(struct rxe_lex_state *st, char *str, int maxlen);
+int   rxe_lex_touched(const struct rxe_lex_state *st);
+int   rxe_lex_rank(const struct rxe_lex *lex, const char *s, size_t len,
+                   mpz_t out, mpz_t spellings);
+
+#endif // __RXE_LEX_H__
@@ -63,11 +63,8 @@ static void pair2(mpz_t out, const mpz_t x, const mpz_t y)
 // The inverse. z lies on diagonal w, the largest w with w(w+1)/2 <= z, which
 // is floor((sqrt(8z+1)-1)/2); y is how far along that diagonal it sits.
 
-static void unpair2(mpz_t x, mpz_t y, const mpz_t z)
+static void unpair2(mpz_t x, mpz_t y, const mpz_t z, mpz_t w, mpz_t t)
 {
-    mpz_t w,t;
-    mpz_init(w);
-    mpz_init(t);
     mpz_mul_2exp(w,z,3);            // w = 8z
     mpz_add_ui(w,w,1);              // w = 8z+1
     mpz_sqrt(w,w);                  // integer square root, rounded down
@@ -78,27 +75,25 @@ static void unpair2(mpz_t x, mpz_t y, const mpz_t z)
     mpz_tdiv_q_2exp(t,t,1);         // t = w(w+1)/2, the start of diagonal w
     mpz_sub(y,z,t);
     mpz_sub(x,w,y);
-    mpz_clear(w);
-    mpz_clear(t);
 }
 
 // Spread 'index' across 'n' dimensions, writing them into out[0..n-1]. With
 // one dimension this is the identity, which is the common case and is why
-// nothing else has to special-case a single unbounded quantifier.
+// nothing else has to special-case a single unbounded quantifier. 'tmp' is
+// three bignums of the caller's to work in, so a seek can lend its own.
 
-void rxe_unpair(mpz_t *out, int n, const mpz_t index)
+void rxe_unpair(mpz_t *out, int n, const mpz_t index, mpz_t *tmp)
 {
     int i;
     if (n <= 0) return;
-    mpz_t rest;
-    mpz_init_set(rest,index);
+    mpz_ptr rest = tmp[0];
+    mpz_set(rest,index);
     for (i=0;i<n-1;i++) {
         // Peel the leading coordinate off and carry the pairing of whatever
         // is left into the next round.
-        unpair2(out[i],rest,rest);
+        unpair2(out[i],rest,rest,tmp[1],tmp[2]);
     }
     mpz_set(out[n-1],rest);
-    mpz_clear(rest);
 }
 
 // The inverse of rxe_unpair, folding n dimensions back into one index.
@@ -17,7 +17,7 @@
 #ifndef __RXE_PAIR_H__
 #define __RXE_PAIR_H__
 
-void rxe_unpair(mpz_t *out, int n, const mpz_t index);
+void rxe_unpair(mpz_t *out, int n, const mpz_t index, mpz_t *tmp);
 void rxe_pair(mpz_t index, mpz_t *in, int n);
 
 #endif // __RXE_PAIR_H__
@@ -23,6 +23,7 @@
 #include "dict.h"
 #include "rxe_node.h"
 #include "bkreftbl.h"
+#include "parse.h"
 #include <string.h>
 #include <stdio.h> 
 
@@ -155,6 +156,12 @@ const char *rxe_error_message(struct rxe *rxe)
     return rxe_status_msgs[rxe->status];
 }
 
+const char *rxe_status_message(int status)
+{
+    if ((unsigned)status >= (unsigned)RXE_NSTATUS) return "unknown error";
+    return rxe_status_msgs[status];
+}
+
 int rxe_error_pos(struct rxe *rxe)
 {
     return rxe ? rxe->error_pos : 0;
@@ -333,6 +340,7 @@ const char *parse(struct rxe *rxe, mpz_t ret, const char *str, int flags,
                       if (!is_flag_group)
                           rxe_backref_table_add(rxe->brt,sub_rxe);
                       str = parse(sub_rxe,n,str,newflags,depth+1,base);
+                      rxe_note_deferred(sub_rxe);
                       node->rxe = sub_rxe;
                       mpz_set(node->rxe->nitems,n);
                       mpz_set(node->nitems,n);
@@ -361,6 +369,10 @@ const char *parse(struct rxe *rxe, mpz_t ret, const char *str, int flags,
                               rxe->status = RXE_SHUFFLE_INFINITE;
                               return parse_done(x,n,p,str);
                           }
+                          // It permutes the group's whole index range, so
+                          // the range has to be counted.
+                          rxe_force_node(node);
+                          mpz_set(n,node->nitems);
                           rxe_shuffle_make(node,shuffle_key,shuffle_key_len);
                       }
                       // A group is an element like any other, so a quantifier
@@ -523,7 +535,7 @@ const char *parse(struct rxe *rxe, mpz_t ret, const char *str, int flags,
                       // fall-thru - a dollar anywhere else is a literal
              default: i = 1;
                       node = rxe_new_node(alt);
-                      node->str = NEW(2,char);
+                      node->str = TREE_NEW(2,char);
                       node->str[0] = c;
                       if (flags & RXE_CASELESS) {
                           if ((c>='a' && c<='z') || (c>='A' && c<='Z')) {
@@ -631,6 +643,9 @@ const char *handle_backreferences(const char *str, mpz_t n, struct rxe_alt *alt,
         return NULL;
     }
     node->is_backref = 1;
+    // What the group holds is now read from outside it, so a repetition over
+    // it must leave it at its last position rather than copy its members.
+    node->rxe->flags |= RXE_FLAG_BACKREFERENCED;
     mpz_set_ui(node->nitems,1);
     mpz_set_ui(n,1);
     return str;
@@ -798,9 +813,12 @@ static struct rxe *demote_node(struct rxe_node *node, int flags)
     inner->is_repeat  = node->is_repeat;
     inner->rep_min    = node->rep_min;
     inner->rep_max    = node->rep_max;
-    inner->rep_count  = node->rep_count;
-    inner->rep_alloc  = node->rep_alloc;
-    inner->rep_digit  = node->rep_digit;
+    inner->walk.rep_count = node->walk.rep_count;
+    inner->walk.rep_alloc = node->walk.rep_alloc;
+    inner->walk.rep_digit = node->walk.rep_digit;
+    inner->walk.rep_word  = node->walk.rep_word;
+    inner->walk.rep_len   = node->walk.rep_len;
+    inner->walk.rep_at    = node->walk.rep_at;
     mpz_set(inner->nitems,node->nitems);
     mpz_set(alt->nitems,node->nitems);
     mpz_set(sub->nitems,node->nitems);
@@ -814,8 +832,11 @@ static struct rxe *demote_node(struct rxe_node *node, int flags)
     node->words      = NULL;
     node->is_inf     = 0;
     node->is_repeat  = 0;
-    node->rep_min = node->rep_max = node->rep_count = node->rep_alloc = 0;
-    node->rep_digit = NULL;
+    node->rep_min = node->rep_max = node->walk.rep_count = node->walk.rep_alloc = 0;
+    node->walk.rep_digit = NULL;
+    node->walk.rep_word  = NULL;
+    node->walk.rep_len   = NULL;
+    node->walk.rep_at    = NULL;
     return sub;
 }
 
@@ -843,12 +864,15 @@ int build_repeat(struct rxe_node *node, int r0, int r1, int flags,
     // handle_backreferences to refuse.
     if (r0 != r1 && node->rxe && !node->is_backref)
         node->rxe->flags |= RXE_FLAG_VARIABLE_REPEAT;
+    // What is repeated is a body, and a body's size is a radix: count it.
+    rxe_force_node(node);
     // A node that is already nothing but a subexpression can be repeated as
     // it stands; anything else has to be demoted into one first, so that the
     // repetition has a single thing to index into.
     if (!node->rxe || node->str || node->is_backref)
         node->rxe = demote_node(node,flags);
-    rxe_repeat_make(node,r0,r1);
+    if (flags & RXE_LAZY_SIZE) rxe_repeat_make_lazy(node,r0,r1);
+    else                       rxe_repeat_make(node,r0,r1);
     return 1;
 }
 
@@ -1004,6 +1028,7 @@ static int build_choose(struct rxe_node *node, int lo, int hi, int perm,
         *status = RXE_CHOOSE_INFINITE;
         return 0;
     }
+    rxe_force_node(node);
     if (!node->rxe || node->str || node->is_backref)
         node->rxe = demote_node(node,flags);
     if (nfloors > 0) {
@@ -1071,7 +1096,7 @@ const char *handle_dictionary(struct rxe *rxe, struct rxe_alt *alt, mpz_t ret,
     }
     struct rxe_node *node = rxe_new_node(alt);
     node->is_dict = 1;
-    node->words = words;                   // borrowed from the registry
+    node->words = words;                   // the lookup's reference, now the node's
     node->nwords = nwords;
     mpz_set_ui(node->nitems,nwords);
     mpz_set_ui(ret,nwords);
@@ -1164,7 +1189,7 @@ const char *handle_character_class(
              case  0 : // fall-thru
              case ']': if (invert) count = 256-count;
                        mpz_set_ui(ret,count);
-                       node->str = NEW(count,char);
+                       node->str = TREE_NEW(count,char);
                        for (n=m=0;n<256;n++) {
                            if (used[n]^invert) node->str[m++]=n;
                        }
@@ -24,4 +24,10 @@
 const char *parse(struct rxe *rxe, mpz_t ret, const char *str, int flags,
                   int depth, const char *base);
 
+// In rxe.c: the bookkeeping of counts put off by RXE_LAZY_SIZE. A finished
+// group notes what it leaves uncounted; a node about to become a body has its
+// count worked out.
+void rxe_note_deferred(struct rxe *rxe);
+void rxe_force_node(struct rxe_node *node);
+
 #endif // __RXE_PARSE_H__
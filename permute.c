@@ -33,6 +33,7 @@
 // not to withstand somebody who wants to work out the key.
 
 #include "rxe.h"
+#include "rxe_node.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,8 +49,14 @@ struct rxe_permutation {
     size_t   half_bits;   // width of each Feistel half
     uint64_t key;
     int      rounds;
+    mpz_t    l,r,f,t;     // the halves and the round's output, kept between
+                          // calls so mapping an index allocates nothing
+    unsigned char *buf;   // one half's bytes, for the round function
+    size_t   buf_len;
 };
 
+#ifndef RXE_CURSOR_WALK
+
 /* ---------------------------- Support Routines -------------------------- */
 
 // splitmix64's finalising mixer. Cheap, and good enough to spread the rounds.
@@ -65,37 +72,36 @@ static uint64_t mix64(uint64_t z)
 // The round function: absorbs one half of the index and squeezes out as many
 // bits as the other half needs. Only has to be deterministic and well spread.
 
+//
+// Both sides are one half wide, so they share the one buffer the permutation
+// keeps for them; it used to malloc two per round, sixteen per pass, and
+// keyed enumeration makes a pass or two per member.
+
 static void round_function(
     mpz_t out,
     uint64_t key,
     int round,
     const mpz_t in,
-    size_t out_bits
+    size_t out_bits,
+    unsigned char *buf
 ) {
     uint64_t state = mix64(key ^ ((uint64_t)(round+1) * 0x9E3779B97F4A7C15ULL));
 
-    size_t in_bytes = (mpz_sizeinbase(in,2) + 7) / 8;
-    unsigned char *ibuf = malloc(in_bytes ? in_bytes : 1);
     size_t written = 0;
-    if (!ibuf) { mpz_set_ui(out,0); return; }
-    mpz_export(ibuf,&written,1,1,0,0,in);
+    mpz_export(buf,&written,1,1,0,0,in);
     size_t i,j;
     for (i=0;i<written;i+=8) {
         uint64_t chunk = 0;
-        for (j=0;j<8 && i+j<written;j++) chunk = (chunk<<8) | ibuf[i+j];
+        for (j=0;j<8 && i+j<written;j++) chunk = (chunk<<8) | buf[i+j];
         state = mix64(state ^ chunk);
     }
-    free(ibuf);
 
     size_t out_bytes = (out_bits + 7) / 8;
-    unsigned char *obuf = malloc(out_bytes ? out_bytes : 1);
-    if (!obuf) { mpz_set_ui(out,0); return; }
     for (i=0;i<out_bytes;i+=8) {
         uint64_t v = mix64(state ^ (uint64_t)(i/8 + 1));
-        for (j=0;j<8 && i+j<out_bytes;j++) obuf[i+j] = (unsigned char)(v >> (8*j));
+        for (j=0;j<8 && i+j<out_bytes;j++) buf[i+j] = (unsigned char)(v >> (8*j));
     }
-    mpz_import(out,out_bytes,1,1,0,0,obuf);
-    free(obuf);
+    mpz_import(out,out_bytes,1,1,0,0,buf);
 
     mpz_fdiv_r_2exp(out,out,out_bits);   // trim to exactly one half's width
 }
@@ -106,20 +112,18 @@ static void round_function(
 
 static void feistel(mpz_t out, struct rxe_permutation *perm, const mpz_t in)
 {
-    mpz_t l,r,f,t;
-    mpz_init(l); mpz_init(r); mpz_init(f); mpz_init(t);
+    mpz_ptr l = perm->l, r = perm->r, f = perm->f, t = perm->t;
     mpz_fdiv_q_2exp(l,in,perm->half_bits);   // high half
     mpz_fdiv_r_2exp(r,in,perm->half_bits);   // low half
     int i;
     for (i=0;i<perm->rounds;i++) {
-        round_function(f,perm->key,i,r,perm->half_bits);
+        round_function(f,perm->key,i,r,perm->half_bits,perm->buf);
         mpz_xor(t,l,f);
         mpz_set(l,r);
         mpz_set(r,t);
     }
     mpz_mul_2exp(out,l,perm->half_bits);
     mpz_add(out,out,r);
-    mpz_clear(l); mpz_clear(r); mpz_clear(f); mpz_clear(t);
 }
 
 // One pass of the Feistel network run backwards, undoing feistel(). A forward
@@ -130,22 +134,20 @@ static void feistel(mpz_t out, struct rxe_permutation *perm, const mpz_t in)
 static void feistel_inverse(mpz_t out, struct rxe_permutation *perm,
                             const mpz_t in)
 {
-    mpz_t l,r,f,t;
-    mpz_init(l); mpz_init(r); mpz_init(f); mpz_init(t);
+    mpz_ptr l = perm->l, r = perm->r, f = perm->f, t = perm->t;
     mpz_fdiv_q_2exp(l,in,perm->half_bits);   // high half
     mpz_fdiv_r_2exp(r,in,perm->half_bits);   // low half
     int i;
     for (i=perm->rounds-1;i>=0;i--) {
         // Forward round i produced (l,r) = (r_prev, l_prev ^ F(r_prev,i)), and
         // r_prev is the current l, so F is taken over l here.
-        round_function(f,perm->key,i,l,perm->half_bits);
+        round_function(f,perm->key,i,l,perm->half_bits,perm->buf);
         mpz_xor(t,r,f);                       // l_prev
         mpz_set(r,l);                         // r_prev = current l
         mpz_set(l,t);
     }
     mpz_mul_2exp(out,l,perm->half_bits);
     mpz_add(out,out,r);
-    mpz_clear(l); mpz_clear(r); mpz_clear(f); mpz_clear(t);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -161,6 +163,23 @@ static uint64_t key_from_string(const char *key)
     return k;
 }
 
+// The scratch a permutation maps with: the halves, and the round function's
+// byte buffer, which never needs more than one half. GMP sizes a result by
+// its operands before it trims it, so a half can briefly want the whole
+// index's width and a limb more; sizing for that up front means it never
+// has to grow.
+
+static void scratch_init(struct rxe_permutation *perm)
+{
+    mp_bitcnt_t bits = 2*perm->half_bits + 2*GMP_NUMB_BITS;
+    mpz_init2(perm->l,bits);
+    mpz_init2(perm->r,bits);
+    mpz_init2(perm->f,bits);
+    mpz_init2(perm->t,bits);
+    perm->buf_len = (perm->half_bits + 7) / 8;
+    perm->buf = NEW(perm->buf_len ? perm->buf_len : 1,unsigned char);
+}
+
 struct rxe_permutation *rxe_permutation_new(const mpz_t domain, const char *key)
 {
     if (mpz_sgn(domain) <= 0) return NULL;
@@ -173,6 +192,7 @@ struct rxe_permutation *rxe_permutation_new(const mpz_t domain, const char *key)
     if (perm->half_bits < 1) perm->half_bits = 1;
     perm->key    = key_from_string(key);
     perm->rounds = RXE_PERMUTE_ROUNDS;
+    scratch_init(perm);
     return perm;
 }
 
@@ -180,6 +200,9 @@ void rxe_permutation_free(struct rxe_permutation *perm)
 {
     if (!perm) return;
     mpz_clear(perm->domain);
+    mpz_clear(perm->l); mpz_clear(perm->r);
+    mpz_clear(perm->f); mpz_clear(perm->t);
+    rxe_mem_free(perm->buf);
     rxe_mem_free(perm);
 }
 
@@ -243,6 +266,7 @@ struct rxe_permutation *rxe_permutation_clone(const struct rxe_permutation *perm
     copy->half_bits = perm->half_bits;
     copy->key       = perm->key;
     copy->rounds    = perm->rounds;
+    scratch_init(copy);
     return copy;
 }
 
@@ -258,10 +282,10 @@ void rxe_shuffle_make(struct rxe_node *node, const char *key, int keylen)
     if (keylen) memcpy(k,key,keylen);
     k[keylen] = 0;
     node->is_shuffle = 1;
-    node->shuffle    = rxe_permutation_new(node->rxe->nitems,k);
+    node->walk.shuffle = rxe_permutation_new(node->rxe->nitems,k);
     rxe_mem_free(k);
     mpz_set(node->nitems,node->rxe->nitems);
-    mpz_set_ui(node->comb_index,0);
+    mpz_set_ui(NS(node)->comb_index,0);
     if (mpz_sgn(node->nitems) > 0) {
         mpz_t z;
         mpz_init_set_ui(z,0);
@@ -270,17 +294,17 @@ void rxe_shuffle_make(struct rxe_node *node, const char *key, int keylen)
     }
 }
 
+#endif
+
 // Position the group at index 'pos' in its permuted order: map the index
 // through the key, then seek the subexpression to the result.
 
 int rxe_shuffle_seek(struct rxe_node *node, const mpz_t pos)
 {
-    mpz_t mapped;
-    mpz_init(mapped);
-    rxe_permutation_map(mapped,node->shuffle,pos);
+    mpz_ptr mapped = rxe_node_tmp(node)[0];
+    rxe_permutation_map(mapped,NS(node)->shuffle,pos);
     int rc = rxe_seek(node->rxe,mapped);
-    mpz_set(node->comb_index,pos);
-    mpz_clear(mapped);
+    mpz_set(NS(node)->comb_index,pos);
     return rc;
 }
 
@@ -288,19 +312,21 @@ int rxe_shuffle_seek(struct rxe_node *node, const mpz_t pos)
 
 int rxe_shuffle_iterate(struct rxe_node *node)
 {
-    mpz_t next;
+    mpz_ptr next = rxe_node_tmp(node)[1];   // [0] is the seek's own
     int carry = 0;
-    mpz_init(next);
-    mpz_add_ui(next,node->comb_index,1);
+    mpz_add_ui(next,NS(node)->comb_index,1);
     if (mpz_cmp(next,node->nitems) >= 0) { mpz_set_ui(next,0); carry = 1; }
     rxe_shuffle_seek(node,next);
-    mpz_clear(next);
     return carry;
 }
 
+#ifndef RXE_CURSOR_WALK
+
 void rxe_shuffle_free(struct rxe_node *node)
 {
-    if (node->shuffle) rxe_permutation_free(node->shuffle);
-    node->shuffle    = NULL;
+    if (node->walk.shuffle) rxe_permutation_free(node->walk.shuffle);
+    node->walk.shuffle = NULL;
     node->is_shuffle = 0;
 }
+
+#endif
@@ -0,0 +1,668 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * plan -- the odometer rxe_lay describes, run by the library itself.
+ *
+ * The interpreter walks linked lists of alternations and nodes and does a GMP
+ * call at every one of them, whatever the size of the set. For the sets a
+ * bruteforce actually walks -- a mask, a handful of words, a fixed repeat --
+ * the whole cardinality fits in a machine word, and every one of those calls
+ * is a division of a one-limb number dressed up as a bignum. rxe_lay already
+ * turns such a set into a run of wheels for rxejit to compile; this keeps the
+ * same wheels and executes them, with the index in an unsigned __int128.
+ *
+ * The plan is taken a root alternation at a time. Each branch is a run of
+ * wheels laid in string order, the last one least significant -- the order
+ * rxe_seek itself divides in -- so a member is a digit per wheel and seeking is
+ * the same mixed-radix division with native integers. A baked alternation or
+ * dictionary is one wheel with uneven alternatives; a fixed repeat is its
+ * body's wheels laid down k times; a backreference copies the bytes its group
+ * rendered. Anything rxe_lay cannot lay as plain wheels -- an unbounded or
+ * large variable repeat, a combinatorial choice, a policy, a shuffle, a set
+ * past 128 bits -- gets no plan, and the tree walks it as it always has.
+ *
+ * The plan owns everything it reads: the wheels' bytes are copied out of the
+ * tree into one block, so the plan can outlive the tree it came from and be
+ * shared, by reference, with every clone of it. The walker's state is a digit
+ * per wheel and nothing else, kept beside the plan rather than in it.
+ */
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PLAN_VECTOR 16
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define PLAN_VECTOR 16
+#endif
+#include "rxe.h"
+#include "rxe_lay.h"
+#include "plan.h"
+
+struct plan_wheel {
+    int n;                        // alternatives
+    int L;                        // their width when even
+    int maxL;                     // the widest of them
+    size_t base;                  // first byte in plan->bytes
+    int off;                      // first entry in aoff/alen when uneven, or -1
+                                  // when even (which an all-empty wheel is)
+};
+
+struct plan_branch {
+    int w0, nw;                   // its wheels, plan->w[w0..w0+nw)
+    int op0, nop;                 // its render ops, plan->ops[op0..op0+nop)
+    rxe_u128 start;               // its first index in the whole set
+    rxe_u128 nitems;              // how many members it holds
+};
+
+struct rxe_plan {
+    int refs;                     // clones sharing it; freed when the last goes
+    int nbranch, nwheel, nop, ngroup, maxnw;
+    struct plan_branch *br;
+    struct plan_wheel *w;
+    struct op *ops;               // OP_LAY / OPEN / CLOSE / COPY, as rxe_lay has them
+    char *bytes;                  // every wheel's alternatives, back to back
+    int *aoff, *alen;             // the uneven wheels' offsets and lengths
+    int *wop;                     // each wheel's OP_LAY, as an index into ops
+    size_t maxbytes;              // the longest member, to respect rxe_max_member
+    rxe_u128 total;               // the whole cardinality
+};
+
+// Set while a plan is being built. Laying a bounded variable repeat re-parses
+// its span, and that parse must not try to plan the same span again.
+_Thread_local int rxe_plan_building;
+
+int rxe_plan_vector_lanes = 1;
+
+static int u128_of(rxe_u128 *out, const mpz_t x)
+{
+    if (mpz_sgn(x) < 0 || mpz_sizeinbase(x,2) > 128) return 1;
+    rxe_u128 v = 0;
+    size_t i;
+    for ( i = mpz_size(x) ; i-- ; )
+        v = (v << GMP_NUMB_BITS) | (rxe_u128)mpz_getlimbn(x,i);
+    *out = v;
+    return 0;
+}
+
+static void mpz_of_u128(mpz_t out, rxe_u128 v)
+{
+    // Least significant word first, so the same call reads right whether a
+    // limb is 64 bits here or 32 in a browser build.
+    unsigned long long w[2] = { (unsigned long long)v,
+                                (unsigned long long)(v >> 64) };
+    mpz_import(out,2,-1,sizeof w[0],0,0,w);
+}
+
+// The product of the radices into *out; returns 1 if it would pass 128 bits.
+static int radix_product(rxe_u128 *out, const struct plan_wheel *w, int nw)
+{
+    rxe_u128 p = 1;
+    int i;
+    for ( i = 0 ; i < nw ; i++ ) {
+        if (p > ~(rxe_u128)0 / (rxe_u128)w[i].n) return 1;
+        p *= (rxe_u128)w[i].n;
+    }
+    *out = p;
+    return 0;
+}
+
+// Every COPY must name a group opened earlier in the same branch: the render
+// only knows where a group landed in the member being rendered. rxe_lay never
+// emits a forward reference, but a group from another branch would slip past
+// it, and the tree renders that as whatever state the group was last left in.
+static int branch_refs_ok(const struct rxe_plan *plan, const struct plan_branch *b)
+{
+    int i, ok = 1;
+    char *seen;
+    if (!plan->ngroup) return 1;
+    seen = NEW(plan->ngroup,char);
+    memset(seen,0,plan->ngroup);
+    for ( i = 0 ; i < b->nop && ok ; i++ ) {
+        const struct op *op = &plan->ops[b->op0 + i];
+        if (op->kind == OP_CLOSE) seen[op->arg] = 1;
+        if (op->kind == OP_COPY && !seen[op->arg]) ok = 0;
+    }
+    rxe_mem_free(seen);
+    return ok;
+}
+
+// The longest member a branch can render: every wheel at its widest, and a
+// copy as long as the longest its group could have been.
+static size_t branch_maxbytes(const struct rxe_plan *plan, const struct plan_branch *b)
+{
+    size_t n = 0, *gs = NULL, *glen = NULL;
+    int i;
+    if (plan->ngroup) {
+        gs = NEW(plan->ngroup,size_t);
+        glen = NEW(plan->ngroup,size_t);
+        memset(glen,0,plan->ngroup * sizeof *glen);
+    }
+    for ( i = 0 ; i < b->nop ; i++ ) {
+        const struct op *op = &plan->ops[b->op0 + i];
+        switch (op->kind) {
+        case OP_LAY:   n += plan->w[op->arg].maxL; break;
+        case OP_OPEN:  gs[op->arg] = n; break;
+        case OP_CLOSE: glen[op->arg] = n - gs[op->arg]; break;
+        case OP_COPY:  n += glen[op->arg]; break;
+        }
+    }
+    if (gs) { rxe_mem_free(gs); rxe_mem_free(glen); }
+    return n;
+}
+
+static void plan_free(struct rxe_plan *plan)
+{
+    if (plan->br)    rxe_mem_free(plan->br);
+    if (plan->w)     rxe_mem_free(plan->w);
+    if (plan->ops)   rxe_mem_free(plan->ops);
+    if (plan->bytes) rxe_mem_free(plan->bytes);
+    if (plan->aoff)  rxe_mem_free(plan->aoff);
+    if (plan->alen)  rxe_mem_free(plan->alen);
+    if (plan->wop)   rxe_mem_free(plan->wop);
+    rxe_mem_free(plan);
+}
+
+// Copy what the build laid out into one plan that owns its bytes: the class
+// wheels point into the tree's own strings, and the baked ones into buffers
+// the build frees, so neither can be kept as it is.
+static struct rxe_plan *plan_freeze(struct build *b, struct plan_branch *br,
+                                    int nbranch)
+{
+    struct rxe_plan *plan = NEW(1,struct rxe_plan);
+    size_t nbytes = 0;
+    int i, j, nuneven = 0;
+    memset(plan,0,sizeof *plan);
+    plan->refs = 1;
+    plan->nbranch = nbranch;
+    plan->nwheel = b->nw;
+    plan->nop = b->nops;
+    plan->ngroup = b->ngroup;
+    plan->br = br;
+    for ( i = 0 ; i < b->nw ; i++ ) {
+        const struct wheel *w = &b->w[i];
+        // A wheel whose alternatives are all empty is laid as fixed with no
+        // offsets at all, so the offsets, not L, say which kind a wheel is.
+        if (!w->aoff) nbytes += (size_t)w->n * w->L;
+        else {
+            nuneven += w->n;
+            for ( j = 0 ; j < w->n ; j++ ) nbytes += w->alen[j];
+        }
+    }
+    plan->w = NEW(b->nw ? b->nw : 1,struct plan_wheel);
+    plan->ops = NEW(b->nops ? b->nops : 1,struct op);
+    plan->bytes = NEW(nbytes ? nbytes : 1,char);
+    if (nuneven) {
+        plan->aoff = NEW(nuneven,int);
+        plan->alen = NEW(nuneven,int);
+    }
+    if (b->nops) memcpy(plan->ops,b->ops,b->nops * sizeof *b->ops);
+    // Every wheel is laid by exactly one op, so a render can start at any
+    // wheel by starting at its op.
+    plan->wop = NEW(b->nw ? b->nw : 1,int);
+    for ( i = 0 ; i < b->nops ; i++ )
+        if (b->ops[i].kind == OP_LAY) plan->wop[b->ops[i].arg] = i;
+    nbytes = 0;
+    nuneven = 0;
+    for ( i = 0 ; i < b->nw ; i++ ) {
+        const struct wheel *w = &b->w[i];
+        struct plan_wheel *pw = &plan->w[i];
+        pw->n = w->n;
+        pw->L = w->L;
+        pw->base = nbytes;
+        if (!w->aoff) {
+            pw->maxL = w->L;
+            pw->off = -1;
+            memcpy(plan->bytes + nbytes,w->base,(size_t)w->n * w->L);
+            nbytes += (size_t)w->n * w->L;
+        } else {
+            pw->maxL = 0;
+            pw->off = nuneven;
+            for ( j = 0 ; j < w->n ; j++ ) {
+                memcpy(plan->bytes + nbytes,w->base + w->aoff[j],w->alen[j]);
+                plan->aoff[nuneven + j] = (int)(nbytes - pw->base);
+                plan->alen[nuneven + j] = w->alen[j];
+                if (w->alen[j] > pw->maxL) pw->maxL = w->alen[j];
+                nbytes += w->alen[j];
+            }
+            nuneven += w->n;
+        }
+    }
+    return plan;
+}
+
+// Build the plan for a whole expression, or return NULL when it has none.
+// Only the root of a parse is planned: it is the only expression anyone seeks
+// from outside, and the one whose digits the plan stands in for.
+
+struct rxe_plan *rxe_plan_build(struct rxe *rxe)
+{
+    struct build b;
+    struct plan_branch *br;
+    struct rxe_plan *plan = NULL;
+    struct rxe_alt *alt;
+    rxe_u128 start = 0, prod;
+    int nbranch = 0, i, ok = 1;
+
+    if (!rxe || rxe->status || rxe->ninf || !rxe->head) return NULL;
+    if (rxe->flags & (RXE_FLAG_SHORTLEX | RXE_FLAG_LEFT_TO_RIGHT)) return NULL;
+    // A count put off by RXE_LAZY_SIZE is wider than RXE_DEFER_BITS, and so
+    // than a plan's; nitems is not the size until then, so ask first.
+    if (rxe->deferred) return NULL;
+    if (mpz_sizeinbase(rxe->nitems,2) > 127) return NULL;
+
+    rxe_plan_building = 1;
+    br = NEW(rxe->nalts,struct plan_branch);
+    if (rxe_lay_begin(&b,rxe)) ok = 0;
+    // Each alternation that holds anything becomes a branch starting where the
+    // tree says it starts; one that matches nothing is skipped, as seek skips it.
+    for ( alt = rxe->head ; ok && alt ; alt = alt->next ) {
+        if (!mpz_sgn(alt->nitems)) continue;
+        struct plan_branch *pb = &br[nbranch];
+        pb->w0 = b.nw;
+        pb->op0 = b.nops;
+        if (rxe_lay_alt(&b,alt)
+                || b.lr_active || b.perm_active || b.policy_active) {
+            ok = 0;
+            break;
+        }
+        pb->nw = b.nw - pb->w0;
+        pb->nop = b.nops - pb->op0;
+        if (u128_of(&pb->start,alt->start) || u128_of(&pb->nitems,alt->nitems)
+                || pb->start != start) {
+            ok = 0;
+            break;
+        }
+        start += pb->nitems;
+        nbranch++;
+    }
+    rxe_plan_building = 0;
+    if (ok && nbranch) plan = plan_freeze(&b,br,nbranch);
+    rxe_lay_free(&b);
+    if (!plan) {
+        rxe_mem_free(br);
+        return NULL;
+    }
+
+    // The wheels have to count exactly what the tree counts, branch by branch,
+    // or the two would number the set differently. They always should; this
+    // is what keeps a plan from ever being trusted when they do not.
+    plan->total = start;
+    for ( i = 0 ; i < plan->nbranch ; i++ ) {
+        struct plan_branch *pb = &plan->br[i];
+        size_t n;
+        if (radix_product(&prod,plan->w + pb->w0,pb->nw) || prod != pb->nitems
+                || !branch_refs_ok(plan,pb)) {
+            plan_free(plan);
+            return NULL;
+        }
+        if (pb->nw > plan->maxnw) plan->maxnw = pb->nw;
+        n = branch_maxbytes(plan,pb);
+        if (n > plan->maxbytes) plan->maxbytes = n;
+    }
+    return plan;
+}
+
+struct rxe_plan *rxe_plan_ref(struct rxe_plan *plan)
+{
+    __atomic_add_fetch(&plan->refs,1,__ATOMIC_RELAXED);
+    return plan;
+}
+
+void rxe_plan_unref(struct rxe_plan *plan)
+{
+    if (plan && !__atomic_sub_fetch(&plan->refs,1,__ATOMIC_ACQ_REL))
+        plan_free(plan);
+}
+
+// A plan renders every member whole, so it stands in for the tree only while
+// the longest of them is within the cap. Past it, the tree is the one that
+// knows how to refuse a member, and the caller gets that instead.
+
+int rxe_plan_usable(const struct rxe_plan *plan)
+{
+    return plan && (!rxe_max_member || plan->maxbytes <= rxe_max_member);
+}
+
+struct rxe_plan_state *rxe_plan_state_new(const struct rxe_plan *plan)
+{
+    struct rxe_plan_state *st = NEW(1,struct rxe_plan_state);
+    st->branch = 0;
+    st->digit = NEW(plan->maxnw ? plan->maxnw : 1,int);
+    memset(st->digit,0,(plan->maxnw ? plan->maxnw : 1) * sizeof *st->digit);
+    st->woff = NEW(plan->maxnw + 1,int);
+    st->touched = -1;
+    st->gstart = st->gend = NULL;
+    if (plan->ngroup) {
+        st->gstart = NEW(plan->ngroup,int);
+        st->gend = NEW(plan->ngroup,int);
+        memset(st->gstart,0,plan->ngroup * sizeof(int));
+        memset(st->gend,0,plan->ngroup * sizeof(int));
+    }
+    return st;
+}
+
+void rxe_plan_state_free(struct rxe_plan_state *st)
+{
+    if (!st) return;
+    rxe_mem_free(st->digit);
+    rxe_mem_free(st->woff);
+    if (st->gstart) rxe_mem_free(st->gstart);
+    if (st->gend) rxe_mem_free(st->gend);
+    rxe_mem_free(st);
+}
+
+// The same division rxe_alt_seek does, least significant wheel first, in
+// native integers: 128-bit while the quotient needs it, and plain 64-bit once
+// it has come down, which for any set that fits a word is from the start.
+
+int rxe_plan_seek(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                  const mpz_t pos)
+{
+    rxe_u128 p;
+    int lo = 0, hi = plan->nbranch - 1, i;
+    if (u128_of(&p,pos) || p >= plan->total) return 1;
+    // The branches are laid end to end in index order, so the one holding p
+    // is the last that starts at or before it.
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (plan->br[mid].start <= p) lo = mid; else hi = mid - 1;
+    }
+    const struct plan_branch *b = &plan->br[lo];
+    const struct plan_wheel *w = plan->w + b->w0;
+    p -= b->start;
+    for ( i = b->nw ; i-- && p >> 64 ; ) {
+        st->digit[i] = (int)(p % (rxe_u128)w[i].n);
+        p /= (rxe_u128)w[i].n;
+    }
+    {
+        unsigned long long q = (unsigned long long)p;
+        for ( i++ ; i-- ; ) {
+            st->digit[i] = (int)(q % (unsigned)w[i].n);
+            q /= (unsigned)w[i].n;
+        }
+    }
+    st->branch = lo;
+    st->touched = -1;
+    return 0;
+}
+
+// One step of the odometer: bump the last wheel and carry leftward. Carrying
+// out of a branch moves to the next; carrying out of the last wraps to the
+// first member and reports it, exactly as rxe_iterate does. The wheel the carry
+// stopped at is the first one that moved, which is what a delta render needs.
+
+int rxe_plan_iterate(const struct rxe_plan *plan, struct rxe_plan_state *st)
+{
+    const struct plan_branch *b = &plan->br[st->branch];
+    const struct plan_wheel *w = plan->w + b->w0;
+    int i;
+    for ( i = b->nw ; i-- ; ) {
+        if (++st->digit[i] < w[i].n) {
+            if (i < st->touched) st->touched = i;
+            return 0;
+        }
+        st->digit[i] = 0;
+    }
+    st->touched = -1;
+    // The carry zeroed only the wheels the old branch has; the new one may
+    // have more, still holding whatever an earlier seek left in them.
+    int carry = ++st->branch >= plan->nbranch;
+    if (carry) st->branch = 0;
+    memset(st->digit,0,plan->br[st->branch].nw * sizeof *st->digit);
+    return carry;
+}
+
+// Add 'delta' to the digits as a mixed-radix numeral, carrying only as far as
+// it reaches. Returns 1, with the digits untouched, when the sum leaves the
+// branch: the branches differ in their wheels, so there is no carrying into
+// the next one, and the caller seeks instead. The first pass only finds
+// whether it stays; the second writes.
+
+int rxe_plan_advance(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                     long delta)
+{
+    const struct plan_branch *b = &plan->br[st->branch];
+    const struct plan_wheel *w = plan->w + b->w0;
+    int pass, i;
+    for ( pass = 0 ; pass < 2 ; pass++ ) {
+        long c = delta;
+        for ( i = b->nw ; i-- && c ; ) {
+            long n = w[i].n, q = c / n, v = st->digit[i] + c % n;
+            if (v >= n) { v -= n; q++; }
+            else if (v < 0) { v += n; q--; }
+            if (pass) {
+                st->digit[i] = (int)v;
+                if (i < st->touched) st->touched = i;
+            }
+            c = q;
+        }
+        if (c) return 1;
+    }
+    return 0;
+}
+
+// Lay the member down from op 'i' on, with 's' where that op's output goes.
+// Where each wheel lands is noted on the way, so the next render can start
+// at whichever wheel moves first; a member cut short by maxlen leaves nothing
+// worth starting from.
+
+static char *render_from(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                         char *str, char *s, char *end, int i)
+{
+    const struct plan_branch *b = &plan->br[st->branch];
+    for ( ; i < b->nop && s < end ; i++ ) {
+        const struct op *op = &plan->ops[b->op0 + i];
+        const char *src;
+        int len;
+        if (op->kind == OP_LAY) {
+            const struct plan_wheel *w = &plan->w[op->arg];
+            int d = st->digit[op->arg - b->w0];
+            st->woff[op->arg - b->w0] = (int)(s - str);
+            if (w->L == 1) { *s++ = plan->bytes[w->base + d]; continue; }
+            if (w->off < 0) {
+                src = plan->bytes + w->base + (size_t)d * w->L;
+                len = w->L;
+            } else {
+                src = plan->bytes + w->base + plan->aoff[w->off + d];
+                len = plan->alen[w->off + d];
+            }
+        } else if (op->kind == OP_OPEN) {
+            st->gstart[op->arg] = (int)(s - str);
+            continue;
+        } else if (op->kind == OP_CLOSE) {
+            st->gend[op->arg] = (int)(s - str);
+            continue;
+        } else {
+            src = str + st->gstart[op->arg];
+            len = st->gend[op->arg] - st->gstart[op->arg];
+        }
+        if (len > end - s) len = (int)(end - s);
+        memmove(s,src,len);
+        s += len;
+    }
+    st->woff[b->nw] = (int)(s - str);
+    st->touched = i < b->nop || s == end ? -1 : b->nw;
+    *s = 0;
+    return s;
+}
+
+// Same contract as rxe_current: at most maxlen bytes, then a terminator,
+// returning where the terminator went.
+
+char *rxe_plan_render(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                      char *str, int maxlen)
+{
+    if (maxlen <= 0) return str;
+    return render_from(plan,st,str,str,str + maxlen,0);
+}
+
+// The same, over a buffer that still holds the last member this state rendered:
+// everything before the first wheel moved since is left as it is.
+
+char *rxe_plan_render_delta(const struct rxe_plan *plan,
+                            struct rxe_plan_state *st, char *str, int maxlen)
+{
+    const struct plan_branch *b = &plan->br[st->branch];
+    int t = st->touched;
+    if (maxlen <= 0) return str;
+    if (t < 0 || st->woff[t] >= maxlen)
+        return render_from(plan,st,str,str,str + maxlen,0);
+    if (t == b->nw) return str + st->woff[t];
+    return render_from(plan,st,str,str + st->woff[t],str + maxlen,
+                       plan->wop[b->w0 + t] - b->op0);
+}
+
+// Where the member may first differ from the one last rendered, as a byte
+// offset into it: all of it when that is not known.
+
+int rxe_plan_touched(const struct rxe_plan_state *st)
+{
+    return st->touched < 0 ? 0 : st->woff[st->touched];
+}
+
+#ifdef PLAN_VECTOR
+// Lanes of a member no wider than a vector register: the member is loaded
+// once, its last byte masked out, and each lane is that register with the
+// lane's class byte merged in, written with one unaligned store. A store
+// reaches past its own lane into the next, which is written after it, so the
+// spill is overwritten; only a store that would run past the buffer ('room'
+// bytes from 'run') cannot be made, and the lanes from there on are left to
+// the copying loop. Returns how many lanes, from the first, were laid.
+
+static size_t lay_lanes(char *run, size_t plen, size_t mlen,
+                        const char *cls, size_t lanes, size_t room)
+{
+    unsigned char pre[PLAN_VECTOR] = {0}, at[PLAN_VECTOR] = {0};
+    size_t j;
+    if (room < PLAN_VECTOR) return 0;
+    memcpy(pre,run,mlen);
+    at[plen] = 0xff;
+    if (lanes > (room - PLAN_VECTOR) / mlen)
+        lanes = (room - PLAN_VECTOR) / mlen;
+#if defined(__SSE2__)
+    __m128i mask = _mm_loadu_si128((const __m128i *)at);
+    __m128i keep = _mm_andnot_si128(mask,_mm_loadu_si128((const __m128i *)pre));
+    for ( j = 1 ; j <= lanes ; j++ ) {
+        __m128i b = _mm_and_si128(mask,_mm_set1_epi8(cls[j]));
+        _mm_storeu_si128((__m128i *)(run + j * mlen),_mm_or_si128(keep,b));
+    }
+#else
+    v128_t mask = wasm_v128_load(at);
+    v128_t keep = wasm_v128_andnot(wasm_v128_load(pre),mask);
+    for ( j = 1 ; j <= lanes ; j++ ) {
+        v128_t b = wasm_v128_and(mask,wasm_i8x16_splat(cls[j]));
+        wasm_v128_store(run + j * mlen,wasm_v128_or(keep,b));
+    }
+#endif
+    return lanes;
+}
+#endif
+
+// rxe_render_batch over the plan: up to n members laid end to end in buf, each
+// starting as a copy of the prefix the step left alone -- the member before
+// is right behind it -- and rendered on from the first wheel that moved. The
+// return and the rules for what fits are rxe_render_batch's; see foreach.c.
+// The state is left knowing no render, since the caller's own buffer does not
+// hold the last member this one laid.
+
+int rxe_plan_render_batch(const struct rxe_plan *plan,
+                          struct rxe_plan_state *st, size_t n, char *buf,
+                          size_t bufsize, size_t *offsets, size_t *produced)
+{
+    size_t k = 0, off = 0;
+    int rc = RXE_FOREACH_STOP;
+    offsets[0] = 0;
+    while (k < n && bufsize - off >= 2) {
+        const struct plan_branch *b = &plan->br[st->branch];
+        char *at = buf + off, *end = buf + bufsize - 1, *s;
+        int t = st->touched;
+        if (k && t >= 0) {
+            size_t keep = st->woff[t];
+            if (keep >= (size_t)(end - at)) break;
+            memcpy(at,buf + offsets[k-1],keep);
+            s = render_from(plan,st,at,at + keep,end,
+                            t == b->nw ? b->nop : plan->wop[b->w0 + t] - b->op0);
+        } else {
+            s = render_from(plan,st,at,at,end,0);
+        }
+        // Filled to the last byte, it may have been cut there.
+        if (s == end) {
+            if (!k) rc = RXE_FOREACH_TOOBIG;
+            break;
+        }
+        off = (size_t)(s - buf);
+        offsets[++k] = off;
+        // When the last thing laid is a one-byte wheel, every member until it
+        // carries is this one with another last byte: the rest of the wheel
+        // is laid as lanes, with no render and no step between them. The
+        // member is copied over the lanes in doubling blocks, so a wide class
+        // costs a few long copies rather than one short one per lane, and the
+        // class bytes are then set down the stride; where the build has
+        // vector registers and the member fits in one, each lane is instead
+        // one store (see lay_lanes). Nothing after the wheel can depend on
+        // it, since it is the branch's last op.
+        int last = b->nw - 1;
+        if (last >= 0 && plan->w[b->w0 + last].L == 1
+                && plan->wop[b->w0 + last] == b->op0 + b->nop - 1) {
+            const struct plan_wheel *w = &plan->w[b->w0 + last];
+            const char *cls = plan->bytes + w->base;
+            size_t plen = st->woff[last], mlen = plen + 1;
+            size_t lanes = (size_t)(w->n - 1 - st->digit[last]);
+            if (lanes > n - k) lanes = n - k;
+            if (off + 2 > bufsize) lanes = 0;
+            else if (lanes > (bufsize - 2 - off) / mlen)
+                lanes = (bufsize - 2 - off) / mlen;
+            char *run = buf + offsets[k-1];
+            int d = st->digit[last];
+            size_t j = 1, have = 1;
+#ifdef PLAN_VECTOR
+            if (rxe_plan_vector_lanes && mlen <= PLAN_VECTOR)
+                j = have += lay_lanes(run,plen,mlen,cls + d,lanes,
+                                      (size_t)(buf + bufsize - run));
+#endif
+            while (have <= lanes) {
+                size_t m = have <= lanes + 1 - have ? have : lanes + 1 - have;
+                memcpy(run + have * mlen,run,m * mlen);
+                have += m;
+            }
+            for ( ; j <= lanes ; j++ )
+                run[j * mlen + plen] = cls[d + j];
+            for ( j = 1 ; j <= lanes ; j++ )
+                offsets[++k] = off += mlen;
+            st->digit[last] = d + (int)lanes;
+        }
+        if (rxe_plan_iterate(plan,st)) { rc = RXE_FOREACH_END; break; }
+    }
+    st->touched = -1;
+    *produced = k;
+    return rc;
+}
+
+// The index the state stands at, which the plan never needs to keep: it is
+// the digits read back as a numeral, plus where their branch starts.
+
+void rxe_plan_index(const struct rxe_plan *plan,
+                    const struct rxe_plan_state *st, mpz_t out)
+{
+    const struct plan_branch *b = &plan->br[st->branch];
+    const struct plan_wheel *w = plan->w + b->w0;
+    rxe_u128 v = 0;
+    int i;
+    for ( i = 0 ; i < b->nw ; i++ ) v = v * (rxe_u128)w[i].n + st->digit[i];
+    mpz_of_u128(out,b->start + v);
+}
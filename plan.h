@@ -0,0 +1,74 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+#ifndef __RXE_PLAN_H__
+#define __RXE_PLAN_H__
+
+// The flat plan: the odometer rxe_lay describes, executed by the library
+// itself. See plan.c. The plan is immutable once built and may be shared by
+// every clone of the expression it was built from; each walker keeps its own
+// rxe_plan_state, which is nothing but a digit per wheel.
+
+typedef unsigned __int128 rxe_u128;
+
+struct rxe_plan;
+
+struct rxe_plan_state {
+    int  branch;                  // the root alternation the digits belong to
+    int *digit;                   // one per wheel of that branch, in string order
+    int *gstart, *gend;           // where each backreferenced group landed
+    int *woff;                    // where each wheel landed in the last render,
+                                  // and past the last one, where it ended
+    int  touched;                 // the first wheel moved since that render: the
+                                  // branch's wheel count if none, -1 if unknown
+};
+
+extern _Thread_local int rxe_plan_building;
+
+// Whether a batch lays a one-byte wheel's lanes with vector stores, where the
+// build has them; 0 keeps to the copying loop. A knob for the benchmark and
+// the tests; nothing else need touch it.
+extern int rxe_plan_vector_lanes;
+
+struct rxe_plan *rxe_plan_build(struct rxe *rxe);
+struct rxe_plan *rxe_plan_ref(struct rxe_plan *plan);
+void rxe_plan_unref(struct rxe_plan *plan);
+int  rxe_plan_usable(const struct rxe_plan *plan);
+
+struct rxe_plan_state *rxe_plan_state_new(const struct rxe_plan *plan);
+void rxe_plan_state_free(struct rxe_plan_state *st);
+
+int   rxe_plan_seek(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                    const mpz_t pos);
+int   rxe_plan_iterate(const struct rxe_plan *plan, struct rxe_plan_state *st);
+int   rxe_plan_advance(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                       long delta);
+char *rxe_plan_render(const struct rxe_plan *plan, struct rxe_plan_state *st,
+                      char *str, int maxlen);
+char *rxe_plan_render_delta(const struct rxe_plan *plan,
+                            struct rxe_plan_state *st, char *str, int maxlen);
+int   rxe_plan_touched(const struct rxe_plan_state *st);
+int   rxe_plan_render_batch(const struct rxe_plan *plan,
+                            struct rxe_plan_state *st, size_t n, char *buf,
+                            size_t bufsize, size_t *offsets, size_t *produced);
+// In rxe.c: seek the tree to where the plan stands, for code that reads the
+// tree's state after a seek -- the path a drawing lights up.
+void  rxe_sync_tree(struct rxe *rxe);
+
+void  rxe_plan_index(const struct rxe_plan *plan,
+                     const struct rxe_plan_state *st, mpz_t out);
+
+#endif // __RXE_PLAN_H__
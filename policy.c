@@ -130,6 +130,8 @@ static void policy_dp(struct rxe *base, int hi, const int *floors, int k, mpz_t
     rxe_mem_free(s);
 }
 
+#ifndef RXE_CURSOR_WALK
+
 void rxe_policy_nitems(mpz_t out, struct rxe *base, int lo, int hi,
                        const int *floors, int k)
 {
@@ -256,6 +258,8 @@ int rxe_policy_segments(const unsigned long *s_ul, int k, int lo, int hi,
     return rc;
 }
 
+#endif
+
 /* --------------------------- Decoding ----------------------------------- */
 
 // State threaded through the count-vector walk, which serves both directions.
@@ -354,7 +358,7 @@ static int policy_decode(struct rxe_node *node, const mpz_t pos)
     // 3. within the count-vector: arrangement (multiset permutation) and chars.
     int rc = 1;
     if (c.found && rxe_repeat_reserve(node, L) == 0) {
-        node->rep_count = L;
+        NS(node)->rep_count = L;
         mpz_t char_size, arr, chr;
         mpz_init(char_size); mpz_init(arr); mpz_init(chr);
         mpz_set_ui(char_size, 1);
@@ -387,7 +391,7 @@ static int policy_decode(struct rxe_node *node, const mpz_t pos)
         mpz_init(cidx);
         for (int p = L - 1; p >= 0; p--) {
             mpz_tdiv_qr(chr, cidx, chr, s[pos_cls[p]]);   // chr /= s, cidx = old chr mod s
-            mpz_add(node->rep_digit[p], start[pos_cls[p]], cidx);
+            mpz_add(NS(node)->rep_digit[p], start[pos_cls[p]], cidx);
         }
         mpz_clear(cidx);
 
@@ -403,6 +407,8 @@ static int policy_decode(struct rxe_node *node, const mpz_t pos)
     return rc;
 }
 
+#ifndef RXE_CURSOR_WALK
+
 // The local index of a member from its decomposition: the class of each
 // position (cls[p], a branch index) and the character chosen within it
 // (cidx[p]). Exact inverse of policy_decode -- shorter lengths, then the
@@ -481,24 +487,30 @@ void rxe_policy_local(struct rxe_node *node, const int *cls, const int *cidx,
     rxe_mem_free(s); rxe_mem_free(start); rxe_mem_free(cv);
 }
 
+#endif
+
 /* --------------------------- Public API --------------------------------- */
 
+#ifndef RXE_CURSOR_WALK
+
 void rxe_policy_make(struct rxe_node *node, int lo, int hi,
                      const int *floors, int k, int soaker)
 {
     node->is_policy     = 1;
     node->rep_min       = lo;
     node->rep_max       = hi;
-    node->rep_count     = 0;
-    node->rep_digit     = NULL;
-    node->rep_len       = NULL;
-    node->rep_alloc     = 0;
+    node->walk.rep_count = 0;
+    node->walk.rep_digit = NULL;
+    node->walk.rep_word  = NULL;
+    node->walk.rep_len   = NULL;
+    node->walk.rep_at    = NULL;
+    node->walk.rep_alloc = 0;
     node->is_inf        = 0;
     node->policy_nfloor = k;
     node->policy_soaker = soaker;
     node->policy_floor  = NEW(k, int);
     for (int i = 0; i < k; i++) node->policy_floor[i] = floors[i];
-    mpz_set_ui(node->comb_index, 0);
+    mpz_set_ui(node->walk.comb_index, 0);
     rxe_policy_nitems(node->nitems, node->rxe, lo, hi, floors, k);
     if (mpz_sgn(node->nitems) > 0) {
         mpz_t z;
@@ -508,22 +520,25 @@ void rxe_policy_make(struct rxe_node *node, int lo, int hi,
     }
 }
 
+#endif
+
 int rxe_policy_seek(struct rxe_node *node, const mpz_t pos)
 {
     if (policy_decode(node, pos)) return 1;
-    mpz_set(node->comb_index, pos);
+    mpz_set(NS(node)->comb_index, pos);
     return 0;
 }
 
 int rxe_policy_iterate(struct rxe_node *node)
 {
+    struct rxe_node_state *ns = NS(node);
     mpz_t next;
     int carry = 0;
     mpz_init(next);
-    mpz_add_ui(next, node->comb_index, 1);
+    mpz_add_ui(next, ns->comb_index, 1);
     if (mpz_cmp(next, node->nitems) >= 0) { mpz_set_ui(next, 0); carry = 1; }
     policy_decode(node, next);
-    mpz_set(node->comb_index, next);
+    mpz_set(ns->comb_index, next);
     mpz_clear(next);
     return carry;
 }
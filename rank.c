@@ -44,8 +44,12 @@
 #include "rxe.h"
 #include "lens.h"
 #include "policy.h"
+#include "filter.h"
+#include "lex.h"
 
-static const char *g_reason;
+// Thread-local, like rxe_member_overflow: a reason belongs to the call that
+// failed, and two threads ranking at once must each read back their own.
+static _Thread_local const char *g_reason;
 
 // The cardinality seek divides by at this node: a plain subexpression carries
 // its own, a repeat or comb the geometric or binomial sum in nitems.
@@ -97,22 +101,35 @@ static void place_before(mpz_t out, struct rxe_node *node)
 // bytes it produced -- so nothing is re-rendered and the group's own state is
 // left alone. Each match overwrites the last, so a repeated group's backref
 // binds to the final iteration, which is the one rxe's render leaves standing;
-// the previous value is saved and put back as the path unwinds. A backref adds
-// no index of its own, so none of this touches cardinality or place value.
-struct cap_save { const char *str; int len; int set; };
-static struct cap_save cap_push(struct rxe *g, const char *str, int len)
+// the previous value is shadowed and uncovered again as the path unwinds. A
+// backref adds no index of its own, so none of this touches cardinality or
+// place value.
+//
+// The captures used to be written into the groups themselves, which made rank
+// a writer of the tree it was reading, and so unsafe on a tree several threads
+// share. They are frames on the C stack now, one per binding, chained through
+// a per-thread pointer: the path being walked is exactly the chain, and the
+// innermost binding of a group is the first one found walking up it.
+struct cap_frame { struct rxe *g; const char *str; int len; struct cap_frame *up; };
+static _Thread_local struct cap_frame *g_caps;
+static void cap_push(struct cap_frame *f, struct rxe *g, const char *str, int len)
 {
-    struct cap_save old = { g->rank_cap, g->rank_cap_len, g->rank_cap_set };
-    g->rank_cap = str;
-    g->rank_cap_len = len;
-    g->rank_cap_set = 1;
-    return old;
+    f->g = g;
+    f->str = str;
+    f->len = len;
+    f->up = g_caps;
+    g_caps = f;
 }
-static void cap_pop(struct rxe *g, struct cap_save old)
+static void cap_pop(struct cap_frame *f)
 {
-    g->rank_cap = old.str;
-    g->rank_cap_len = old.len;
-    g->rank_cap_set = old.set;
+    g_caps = f->up;
+}
+static const struct cap_frame *cap_find(struct rxe *g)
+{
+    const struct cap_frame *f;
+    for ( f = g_caps ; f ; f = f->up )
+        if (f->g == g) return f;
+    return NULL;
 }
 
 // Whether any backreference appears in the tree. A backref ties two positions
@@ -396,10 +413,10 @@ static int rep_ext_sink(void *v, mpz_srcptr d)
     }
     // Bind a backref into this repeated group to the latest iteration's text,
     // the one rxe's render leaves standing; each iteration overwrites the last.
-    struct cap_save sv = cap_push(e->w->node->rxe, e->w->s + e->start,
-                                  e->q - e->start);
+    struct cap_frame f;
+    cap_push(&f, e->w->node->rxe, e->w->s + e->start, e->q - e->start);
     int stop = rep_go(e->w, e->q, e->j + 1, nv, nw);
-    cap_pop(e->w->node->rxe, sv);
+    cap_pop(&f);
     mpz_clear(nv);
     mpz_clear(nw);
     return stop;
@@ -432,10 +449,10 @@ static int enum_node(struct rxe_node *node, const char *s, int off, int len,
                      int l2r, emit_fn emit, void *ectx)
 {
     if (node->is_backref) {                   // must equal what its group matched
-        struct rxe *g = node->rxe;
-        int L = g->rank_cap_len;
-        if (!g->rank_cap_set) return 0;       // group not yet bound: no match
-        if (off + L > len || memcmp(g->rank_cap, s + off, L)) return 0;
+        const struct cap_frame *g = cap_find(node->rxe);
+        if (!g) return 0;                     // group not yet bound: no match
+        int L = g->len;
+        if (off + L > len || memcmp(g->str, s + off, L)) return 0;
         mpz_t z;
         mpz_init_set_ui(z, 0);                 // a backref carries no index
         int stop = emit(ectx, z, off + L);
@@ -460,10 +477,11 @@ static int enum_node(struct rxe_node *node, const char *s, int off, int len,
         return policy_walk(node, s, off, len, emit, ectx);
     if (node->is_shuffle) {                   // a keyed group: remap the index
         for (int q = off; q <= len; q++) {
-            struct shuf_bridge b = { emit, ectx, q, node->shuffle };
-            struct cap_save sv = cap_push(node->rxe, s + off, q - off);
+            struct shuf_bridge b = { emit, ectx, q, NS(node)->shuffle };
+            struct cap_frame f;
+            cap_push(&f, node->rxe, s + off, q - off);
             int stop = enum_rxe(node->rxe, s + off, q - off, shuf_sink, &b);
-            cap_pop(node->rxe, sv);
+            cap_pop(&f);
             if (stop) return 1;
         }
         return 0;
@@ -472,9 +490,10 @@ static int enum_node(struct rxe_node *node, const char *s, int off, int len,
         for (int q = off; q <= len; q++) {
             struct sub_bridge b = { emit, ectx, q };
             // Record what this group matched over [off,q), for any backref to it.
-            struct cap_save sv = cap_push(node->rxe, s + off, q - off);
+            struct cap_frame f;
+            cap_push(&f, node->rxe, s + off, q - off);
             int stop = enum_rxe(node->rxe, s + off, q - off, sub_sink, &b);
-            cap_pop(node->rxe, sv);
+            cap_pop(&f);
             if (stop) return 1;
         }
         return 0;
@@ -845,9 +864,46 @@ static void comb_count(mpz_t out, struct rxe_node *node,
 // infinite set to the length-indexed ranker in lens.c; a non-shortlex infinite
 // set -- a backreference that keeps an infinite set in diagonal order -- is
 // refused, as is a shortlex set the ranker does not cover yet.
+// A filtered set is ranked in the whole one. A string the filter rejects is
+// at no index; one it passes is wherever it is in the whole set, each of those
+// renumbered to its place among the members that pass.
+struct filter_ctx { struct rxe *rxe; rank_sink sink; void *ctx; mpz_t pos; };
+static int filter_sink(void *v, mpz_srcptr idx)
+{
+    struct filter_ctx *f = v;
+    rxe_filter_position(f->rxe, idx, f->pos);
+    return f->sink(f->ctx, f->pos);
+}
+
 static int rank_walk(struct rxe *rxe, const char *s, rank_sink sink, void *ctx)
 {
     if (!rxe) { g_reason = "null expression"; return -1; }
+    if (rxe->filter) {
+        struct filter_ctx f;
+        f.rxe = rxe;
+        f.sink = sink;
+        f.ctx = ctx;
+        if (!rxe_filter_accepts(rxe->filter, s, strlen(s))) return 0;
+        mpz_init(f.pos);
+        enum_rxe(rxe, s, (int)strlen(s), filter_sink, &f);
+        mpz_clear(f.pos);
+        return 0;
+    }
+    // A set in byte order, distinct or not, has each string's indices side
+    // by side, read off its automaton.
+    if (rxe->lex) {
+        mpz_t at, n;
+        mpz_init(at);
+        mpz_init(n);
+        if (!rxe_lex_rank(rxe->lex, s, strlen(s), at, n))
+            for ( ; mpz_sgn(n) ; mpz_sub_ui(n, n, 1), mpz_add_ui(at, at, 1))
+                if (sink(ctx, at)) break;
+        mpz_clear(at);
+        mpz_clear(n);
+        return 0;
+    }
+    // A rank is a sum of counts, every one of them needed exactly.
+    rxe_force_size(rxe);
     if (rxe_is_infinite(rxe)) {
         if (!rxe_is_shortlex(rxe)) {
             g_reason = "infinite set kept in diagonal order by a backreference";
@@ -880,6 +936,10 @@ static int min_sink(void *v, mpz_srcptr idx)
 int rxe_rank(struct rxe *rxe, const char *s, mpz_t out)
 {
     g_reason = NULL;
+    // In byte order the first index is the one the automaton gives, however
+    // many spellings follow it; walking them all to find the least would not
+    // do for '(a|a){100}'.
+    if (rxe && rxe->lex) return rxe_lex_rank(rxe->lex, s, strlen(s), out, NULL);
     struct min_ctx mc;
     mc.found = 0;
     mpz_init(mc.min);
@@ -904,6 +964,18 @@ static int tally_sink(void *v, mpz_srcptr idx)
 int rxe_rank_count(struct rxe *rxe, const char *s, mpz_t out)
 {
     g_reason = NULL;
+    rxe_force_size(rxe);
+    if (rxe && rxe->filter && !rxe_filter_accepts(rxe->filter, s, strlen(s))) {
+        mpz_set_ui(out, 0);
+        return 0;
+    }
+    if (rxe && rxe->lex) {
+        mpz_t at;
+        mpz_init(at);
+        if (rxe_lex_rank(rxe->lex, s, strlen(s), at, out)) mpz_set_ui(out, 0);
+        mpz_clear(at);
+        return 0;
+    }
     if (rxe && !rxe_is_infinite(rxe) && !has_backref(rxe)) {
         count_rxe(out, rxe, s, (int)strlen(s));   // the cheap, cap-free DP
         return 0;
@@ -34,12 +34,28 @@
 // where n is the length of the string being generated anyway. The
 // subexpression is held once and seeked to digit i when position i is
 // rendered, which is what lets a single copy stand in for all of them.
+//
+// The digits are bignums only because the base can be. Nearly every body a
+// repetition is written over -- a class, a dictionary, a short group -- has a
+// count that fits a machine word, and then so does every digit. Those runs
+// keep their digits as plain words, which for '[a-z]{1,1000000}' is a million
+// words in place of a million separately allocated mpz_t, and step them with
+// integer arithmetic; see rxe_repeat_reserve.
 
+#include <limits.h>
+#include <math.h>
+#include <string.h>
 #include "rxe.h"
 #include "repeat.h"
+#include "rxe_node.h"
+
+#define POW_LEVELS  32      // powers b^(2^k) kept: 2^31 positions is past any run
+#define PEEL_LIMBS  24      // below this an index is divided out directly
 
 /* ------------------------------------------------------------------------ */
 
+#ifndef RXE_CURSOR_WALK
+
 // The cardinality of the repetition, sum(base^j) for j from r0 to r1.
 //
 // The geometric closed form (b^(r1+1) - b^r0)/(b-1) is only valid for b >= 2:
@@ -91,83 +107,191 @@ int rxe_repeat_is_infinite(struct rxe_node *node)
     return body_endless && node->rep_max >= 1;
 }
 
+#endif
+
 // Make room for at least 'want' position indices. An unbounded repetition
 // cannot size this at parse time, and even a bounded one is better off not
 // doing so: 'a{1,1000000}' would otherwise reserve a million integers to
 // enumerate a set whose first element is one character long.
 
 // Returns non-zero, without allocating anything, when 'want' positions would
-// blow past rxe_max_member. Each position costs an mpz_t index of its own, so
-// the position count is capped directly at the byte limit -- a member cannot
-// have more positions than bytes anyway, since every position renders at least
+// blow past rxe_max_member. Each position costs an index of its own, so the
+// position count is capped directly at the byte limit -- a member cannot have
+// more positions than bytes anyway, since every position renders at least
 // nothing and most render more. The caller treats a refusal as "this member is
 // too large" and stops; the latch records it for the front-end.
 
+// Whether a repetition's digits can be words. Only a repetition's: a
+// combinatorial choice and a policy keep indices of their own kind in the
+// same array. And only over a body whose count is settled and fits a word --
+// a deferred body stands in as one until rxe_force_size counts it, and an
+// endless one has no count to be a radix. The answer is taken at the first
+// allocation and kept with the array.
+
+static int packs(struct rxe_node *node)
+{
+    struct rxe *sub = node->rxe;
+    return node->is_repeat && sub && !sub->deferred && !rxe_is_infinite(sub)
+        && mpz_fits_ulong_p(sub->nitems);
+}
+
 int rxe_repeat_reserve(struct rxe_node *node, int want)
 {
-    if (want <= node->rep_alloc) return 0;
+    struct rxe_node_state *ns = NS(node);
+    if (want <= ns->rep_alloc) return 0;
     if (rxe_max_member && (size_t)want > rxe_max_member) {
         rxe_member_overflow = 1;
         return 1;
     }
     int i;
-    size_t n = node->rep_alloc ? (size_t)node->rep_alloc : 8;
+    size_t n = ns->rep_alloc ? (size_t)ns->rep_alloc : 8;
     while (n < (size_t)want) n *= 2;
     // The doubling can overshoot 'want'; keep the array itself within the cap.
     if (rxe_max_member && n > rxe_max_member) n = rxe_max_member;
-    mpz_t *fresh = NEW(n,mpz_t);
-    for (i=0;i<node->rep_alloc;i++) {
-        // mpz_t is an array type, so this hands the limbs over rather than
-        // copying them; the old entries must not be cleared afterwards.
-        fresh[i][0] = node->rep_digit[i][0];
+    if (ns->rep_word || (!ns->rep_digit && packs(node))) {
+        unsigned long *words = NEW(n,unsigned long);
+        for (i=0;i<ns->rep_alloc;i++) words[i] = ns->rep_word[i];
+        for (i=ns->rep_alloc;i<(int)n;i++) words[i] = 0;
+        if (ns->rep_word) rxe_mem_free(ns->rep_word);
+        ns->rep_word = words;
+    } else {
+        mpz_t *fresh = NEW(n,mpz_t);
+        for (i=0;i<ns->rep_alloc;i++) {
+            // mpz_t is an array type, so this hands the limbs over rather than
+            // copying them; the old entries must not be cleared afterwards.
+            fresh[i][0] = ns->rep_digit[i][0];
+        }
+        for (i=ns->rep_alloc;i<(int)n;i++) mpz_init(fresh[i]);
+        if (ns->rep_digit) rxe_mem_free(ns->rep_digit);
+        ns->rep_digit = fresh;
     }
-    for (i=node->rep_alloc;i<(int)n;i++) mpz_init(fresh[i]);
-    if (node->rep_digit) rxe_mem_free(node->rep_digit);
-    node->rep_digit = fresh;
     // The parallel array of lengths, used only when the expression is
     // enumerated shortest first: there a position is addressed by the length
     // it takes and its index among the members of that length, rather than by
     // one index into the body's whole ordering.
     int *lens = NEW(n,int);
-    for (i=0;i<node->rep_alloc;i++) lens[i] = node->rep_len[i];
-    for (i=node->rep_alloc;i<(int)n;i++) lens[i] = 0;
-    if (node->rep_len) rxe_mem_free(node->rep_len);
-    node->rep_len = lens;
-    node->rep_alloc = (int)n;
+    for (i=0;i<ns->rep_alloc;i++) lens[i] = ns->rep_len[i];
+    for (i=ns->rep_alloc;i<(int)n;i++) lens[i] = 0;
+    if (ns->rep_len) rxe_mem_free(ns->rep_len);
+    ns->rep_len = lens;
+    // And where each position landed in the last render, so a render after a
+    // step can start at the first position that moved. A grown array holds
+    // positions never rendered, so the next render starts over.
+    int *at = NEW(n,int);
+    for (i=0;i<(int)n;i++) at[i] = 0;
+    if (ns->rep_at) rxe_mem_free(ns->rep_at);
+    ns->rep_at = at;
+    ns->rep_moved = 0;
+    ns->rep_alloc = (int)n;
     return 0;
 }
 
+#ifndef RXE_CURSOR_WALK
+
 // Turn an ordinary subexpression node into a repetition of it. The caller has
 // already moved the repeated thing into node->rxe and set node->nitems to its
 // cardinality; on return node->nitems is the cardinality of the repetition,
 // or zero if there is no such number because the repetition is unbounded.
 
-void rxe_repeat_make(struct rxe_node *node, int r0, int r1)
+static void repeat_shape(struct rxe_node *node, int r0, int r1)
 {
     node->is_repeat = 1;
     node->rep_min   = r0;
     node->rep_max   = r1;
-    node->rep_count = r0;
-    node->rep_digit = NULL;
-    node->rep_len   = NULL;
-    node->rep_alloc = 0;
+    node->walk.rep_count = r0;
+    node->walk.rep_digit = NULL;
+    node->walk.rep_word  = NULL;
+    node->walk.rep_len   = NULL;
+    node->walk.rep_at    = NULL;
+    node->walk.rep_alloc = 0;
     node->is_inf    = rxe_repeat_is_infinite(node);
     if (r0 > 0) rxe_repeat_reserve(node,r0);
+}
+
+void rxe_repeat_make(struct rxe_node *node, int r0, int r1)
+{
+    repeat_shape(node,r0,r1);
     rxe_repeat_nitems(node->nitems,node->rxe->nitems,r0,r1);
 }
 
-void rxe_repeat_free(struct rxe_node *node)
+// log2 of sum(b^j, j=r0..r1), from log2(b) alone, for b >= 2: the largest
+// term, b^r1, times the geometric tail below it, (1 - b^-(r1-r0+1))/(1 - 1/b).
+// Both factors of the tail are within a bit of one, so the estimate is as good
+// as r1*log2(b) is in a double -- a few parts in 10^15.
+
+double rxe_repeat_log2(double lb, int r0, int r1)
 {
-    if (!node->rep_digit) return;
+    double terms = (double)r1 - r0 + 1;
+    return r1*lb + log2(-expm1(-terms*lb*M_LN2)) - log2(-expm1(-lb*M_LN2));
+}
+
+// The same, but with the count left uncounted when it would be wider than
+// RXE_DEFER_BITS. Only a bounded repetition of a finite body of two or more
+// members is ever deferred -- the others are trivial to count -- and the body
+// itself must be counted already, since its size is the radix every seek and
+// step of the repetition divides by. A deferred count keeps nitems at one, a
+// stand-in that multiplies into the alternation's product as nothing at all,
+// and records the estimate in size_log2; rxe_force_size replaces both.
+
+void rxe_repeat_make_lazy(struct rxe_node *node, int r0, int r1)
+{
+    repeat_shape(node,r0,r1);
+    const mpz_srcptr b = node->rxe->nitems;
+    if (r1 != RXE_REP_UNBOUNDED && r1 >= r0 && !rxe_is_infinite(node->rxe)
+        && mpz_cmp_ui(b,2) >= 0) {
+        signed long e;
+        double m = mpz_get_d_2exp(&e,b);
+        double lg = rxe_repeat_log2(log2(m) + (double)e,r0,r1);
+        if (lg > (double)RXE_DEFER_BITS) {
+            node->size_log2 = lg;
+            mpz_set_ui(node->nitems,1);
+            return;
+        }
+    }
+    rxe_repeat_nitems(node->nitems,b,r0,r1);
+}
+
+void rxe_repeat_free(struct rxe_node_state *s)
+{
+    if (s->rep_fit) rxe_mem_free(s->rep_fit);
+    s->rep_fit = NULL;
+    s->rep_fit_k = s->rep_fit_l = -1;
+    if (s->memo) rxe_mem_free(s->memo);
+    if (s->memo_at) rxe_mem_free(s->memo_at);
+    if (s->memo_n) rxe_mem_free(s->memo_n);
+    s->memo = NULL;
+    s->memo_at = NULL;
+    s->memo_n = NULL;
+    s->memo_len = 0;
+    s->memo_ok = -1;
     int i;
-    for (i=0;i<node->rep_alloc;i++) mpz_clear(node->rep_digit[i]);
-    rxe_mem_free(node->rep_digit);
-    node->rep_digit = NULL;
-    if (node->rep_len) rxe_mem_free(node->rep_len);
-    node->rep_len = NULL;
-    node->rep_alloc = 0;
+    if (s->rep_pow) {
+        for (i=0;i<POW_LEVELS;i++) {
+            mpz_clear(s->rep_pow[i]);
+            mpz_clear(s->rep_quo[i]);
+        }
+        rxe_mem_free(s->rep_pow);
+        rxe_mem_free(s->rep_quo);
+        s->rep_pow = s->rep_quo = NULL;
+        s->rep_npow = 0;
+    }
+    if (!s->rep_digit && !s->rep_word) return;
+    if (s->rep_digit) {
+        for (i=0;i<s->rep_alloc;i++) mpz_clear(s->rep_digit[i]);
+        rxe_mem_free(s->rep_digit);
+    }
+    s->rep_digit = NULL;
+    if (s->rep_word) rxe_mem_free(s->rep_word);
+    s->rep_word = NULL;
+    if (s->rep_len) rxe_mem_free(s->rep_len);
+    s->rep_len = NULL;
+    if (s->rep_at) rxe_mem_free(s->rep_at);
+    s->rep_at = NULL;
+    s->rep_alloc = 0;
 }
 
+#endif
+
 // Position i of a run of n counts from the right by default, so that the last
 // repetition is the least significant digit, exactly as the last node of an
 // alternation is. Under (?L) it counts from the left instead.
@@ -177,25 +301,161 @@ static int digit_at(int n, int significance, int l2r)
     return l2r ? significance : n-1-significance;
 }
 
+// The digit at position i, in whichever form it is kept. A word is widened
+// into one of the node's seek temporaries, so what this returns is good until
+// the node is next seeked or asked again, which is long enough to seek the
+// body with it.
+
+mpz_ptr rxe_repeat_digit(struct rxe_node *node, int i)
+{
+    struct rxe_node_state *ns = NS(node);
+    if (!ns->rep_word) return ns->rep_digit[i];
+    mpz_ptr d = rxe_node_tmp(node)[RXE_NODE_TMP-1];
+    mpz_set_ui(d,ns->rep_word[i]);
+    return d;
+}
+
+void rxe_repeat_set(struct rxe_node *node, int i, const mpz_t v)
+{
+    struct rxe_node_state *ns = NS(node);
+    if (ns->rep_word) ns->rep_word[i] = mpz_get_ui(v);
+    else mpz_set(ns->rep_digit[i],v);
+}
+
+void rxe_repeat_set_ui(struct rxe_node *node, int i, unsigned long v)
+{
+    struct rxe_node_state *ns = NS(node);
+    if (ns->rep_word) ns->rep_word[i] = v;
+    else mpz_set_ui(ns->rep_digit[i],v);
+}
+
+static void zero_digits(struct rxe_node *node, int n)
+{
+    struct rxe_node_state *ns = NS(node);
+    int i;
+    if (ns->rep_word) memset(ns->rep_word,0,n * sizeof *ns->rep_word);
+    else for (i=0;i<n;i++) mpz_set_ui(ns->rep_digit[i],0);
+}
+
+// Add one to the digit at position i, wrapping it to zero at 'radix'.
+// Returns 1 when it wrapped.
+
+int rxe_repeat_bump(struct rxe_node *node, int i, const mpz_t radix)
+{
+    struct rxe_node_state *ns = NS(node);
+    if (ns->rep_word) {
+        if (++ns->rep_word[i] < mpz_get_ui(radix)) return 0;
+        ns->rep_word[i] = 0;
+        return 1;
+    }
+    mpz_add_ui(ns->rep_digit[i],ns->rep_digit[i],1);
+    if (mpz_cmp(ns->rep_digit[i],radix) < 0) return 0;
+    mpz_set_ui(ns->rep_digit[i],0);
+    return 1;
+}
+
+// Taking a run's digits off its index one division at a time costs a pass
+// over the whole index per digit, which is quadratic in the run's length:
+// seeking into '[a-z]{1,100000}' at random spent seconds there. A wide index
+// is split in two instead, at b^(2^k) for the largest 2^k below the digit
+// count, so each half is an index of its own with half the digits, and the
+// halves split again until they are short enough to divide out directly --
+// the usual subquadratic radix conversion. The powers b^(2^k) are squared up
+// from the body's count as a seek first needs them and kept on the node, as
+// is a quotient for each level of the split, so later seeks only divide.
+//
+// Below PEEL_LIMBS limbs an index is divided out directly: that is a handful
+// of digits per limb, which the direct loop does faster than a split would.
+
+static mpz_srcptr rep_power(struct rxe_node *node, int k)
+{
+    struct rxe_node_state *ns = NS(node);
+    mpz_srcptr b = node->rxe->nitems;
+    int i;
+    if (!ns->rep_pow) {
+        ns->rep_pow = NEW(POW_LEVELS,mpz_t);
+        ns->rep_quo = NEW(POW_LEVELS,mpz_t);
+        for (i=0;i<POW_LEVELS;i++) {
+            mpz_init(ns->rep_pow[i]);
+            mpz_init(ns->rep_quo[i]);
+        }
+        ns->rep_npow = 0;
+    }
+    // A count put off and worked out since is a different radix; start over.
+    if (ns->rep_npow && mpz_cmp(ns->rep_pow[0],b)) ns->rep_npow = 0;
+    if (!ns->rep_npow) {
+        mpz_set(ns->rep_pow[0],b);
+        ns->rep_npow = 1;
+    }
+    for ( ; ns->rep_npow <= k ; ns->rep_npow++)
+        mpz_mul(ns->rep_pow[ns->rep_npow],ns->rep_pow[ns->rep_npow-1],
+                ns->rep_pow[ns->rep_npow-1]);
+    return ns->rep_pow[k];
+}
+
+// The digits of significance lo to lo+cnt-1 of a run of n, from p, which is
+// below b^cnt and is consumed.
+
+static void peel_direct(struct rxe_node *node, mpz_ptr p, int lo, int cnt,
+                        int n, int l2r)
+{
+    struct rxe_node_state *ns = NS(node);
+    mpz_srcptr b = node->rxe->nitems;
+    int i;
+    if (ns->rep_word) {
+        // A word-sized base divides out of the bignum a word at a time, and
+        // once what is left fits a word itself the rest is plain division.
+        unsigned long bw = mpz_get_ui(b), v;
+        for (i=lo;i<lo+cnt && !mpz_fits_ulong_p(p);i++)
+            ns->rep_word[digit_at(n,i,l2r)] = mpz_tdiv_q_ui(p,p,bw);
+        for (v=mpz_get_ui(p);i<lo+cnt;i++) {
+            ns->rep_word[digit_at(n,i,l2r)] = v % bw;
+            v /= bw;
+        }
+    } else {
+        for (i=lo;i<lo+cnt;i++)
+            mpz_tdiv_qr(p,ns->rep_digit[digit_at(n,i,l2r)],p,b);
+    }
+}
+
+static void peel(struct rxe_node *node, mpz_ptr p, int lo, int cnt, int n,
+                 int l2r, int depth)
+{
+    int k = 0;
+    if (cnt < 2 || mpz_size(p) <= PEEL_LIMBS) {
+        peel_direct(node,p,lo,cnt,n,l2r);
+        return;
+    }
+    while ((2 << k) < cnt) k++;                 // 2^k < cnt <= 2^(k+1)
+    mpz_srcptr pw = rep_power(node,k);
+    mpz_ptr q = NS(node)->rep_quo[depth];
+    mpz_tdiv_qr(q,p,p,pw);
+    peel(node,p,lo,1 << k,n,l2r,depth+1);
+    peel(node,q,lo + (1 << k),cnt - (1 << k),n,l2r,depth+1);
+}
+
 // Select the item at 'pos' within this repetition. Returns 1 if pos is past
 // the end, in which case the node's state is left alone.
 
 int rxe_repeat_seek(struct rxe_node *node, const mpz_t pos, int l2r)
 {
+    struct rxe_node_state *ns = NS(node);
     struct rxe *sub = node->rxe;
     int unbounded = node->rep_max == RXE_REP_UNBOUNDED;
-    int n = node->rep_min, i, rc = 1;
-    mpz_t p,block,r;
-    mpz_init_set(p,pos);
-    mpz_init(block);
-    mpz_init(r);
+    int n = node->rep_min, rc = 1;
+    // Borrowed from the node rather than made here, so a seek that has been
+    // this wide before touches no allocator.
+    mpz_t *tmp = rxe_node_tmp(node);
+    mpz_ptr p = tmp[0], block = tmp[1], r = tmp[2];
+    ns->rep_moved = 0;
+    mpz_set(p,pos);
     if (mpz_sgn(p) < 0) goto done;
     if (!mpz_sgn(sub->nitems)) {
         // Nothing to repeat: only a run of length zero exists, and only if it
         // is allowed. This is the one way an unbounded repetition can turn
         // out to be finite.
         if (node->rep_min != 0 || mpz_sgn(p)) goto done;
-        node->rep_count = 0;
+        ns->rep_count = 0;
         rc = 0;
         goto done;
     }
@@ -207,37 +467,54 @@ int rxe_repeat_seek(struct rxe_node *node, const mpz_t pos, int l2r)
         // A run this long has to be renderable before it can be selected, and
         // an index that does not fit in a machine word never will be.
         if (!mpz_fits_slong_p(p)) goto done;
-        node->rep_count = node->rep_min + (int)mpz_get_ui(p);
-        if (rxe_repeat_reserve(node,node->rep_count)) goto done;
-        for (i=0;i<node->rep_count;i++) mpz_set_ui(node->rep_digit[i],0);
+        ns->rep_count = node->rep_min + (int)mpz_get_ui(p);
+        if (rxe_repeat_reserve(node,ns->rep_count)) goto done;
+        zero_digits(node,ns->rep_count);
         rc = 0;
         goto done;
     }
-    // Walk the repeat counts in ascending order, subtracting each block as it
-    // is passed. The base is two or more here, so the blocks grow
-    // geometrically and this ends after about log_base(pos) steps -- which is
-    // what lets an unbounded repetition be walked at all, the loop finding its
-    // own end rather than running out of counts.
-    mpz_pow_ui(block,sub->nitems,node->rep_min);
-    for (n=node->rep_min;unbounded || n<=node->rep_max;n++) {
-        if (mpz_cmp(p,block) < 0) break;
-        mpz_sub(p,p,block);
-        mpz_mul(block,block,sub->nitems);
+    // The runs shorter than n hold sum(b^j, j=r0..n-1) = (b^n - b^r0)/(b-1)
+    // members between them, so pos lies in the run of the largest n with
+    // b^n <= t = pos*(b-1) + b^r0, at (t - b^n)/(b-1) within it. The base is
+    // two or more here. n comes from logarithms and is then made exact, which
+    // costs a power and a step or two either side rather than a pass over
+    // every shorter run -- and an unbounded repetition needs no end to find.
+    mpz_srcptr b = sub->nitems;
+    signed long ep, eb;
+    mpz_sub_ui(r,b,1);
+    mpz_mul(p,p,r);
+    mpz_pow_ui(block,b,node->rep_min);
+    mpz_add(p,p,block);
+    double mp = mpz_get_d_2exp(&ep,p), mb = mpz_get_d_2exp(&eb,b);
+    double guess = floor((log2(mp) + (double)ep) / (log2(mb) + (double)eb));
+    if (guess < node->rep_min) guess = node->rep_min;
+    // Past the longest run, or longer than any run can be, with a step to
+    // spare for the correction below.
+    if (!unbounded && guess > (double)node->rep_max + 1) goto done;
+    if (guess > INT_MAX - 2) goto done;
+    n = (int)guess;
+    if (n != node->rep_min) mpz_pow_ui(block,b,n);
+    while (mpz_cmp(block,p) > 0) {
+        mpz_divexact(block,block,b);
+        n--;
+    }
+    for (;;) {
+        mpz_mul(r,block,b);
+        if (mpz_cmp(r,p) > 0) break;
+        mpz_swap(block,r);
+        n++;
     }
     if (!unbounded && n > node->rep_max) goto done;
-    node->rep_count = n;
+    mpz_sub(p,p,block);
+    mpz_sub_ui(r,b,1);
+    mpz_divexact(p,p,r);
+    ns->rep_count = n;
     if (rxe_repeat_reserve(node,n)) goto done;
-    // p is now an n-digit numeral in base sub->nitems. Peel the digits off
-    // least significant first and store each at the position it drives.
-    for (i=0;i<n;i++) {
-        mpz_tdiv_qr(p,r,p,sub->nitems);
-        mpz_set(node->rep_digit[digit_at(n,i,l2r)],r);
-    }
+    // p is now an n-digit numeral in base b. Take the digits off least
+    // significant first and store each at the position it drives.
+    peel(node,p,0,n,n,l2r,0);
     rc = 0;
 done:
-    mpz_clear(p);
-    mpz_clear(block);
-    mpz_clear(r);
     return rc;
 }
 
@@ -246,36 +523,160 @@ done:
 
 int rxe_repeat_iterate(struct rxe_node *node, int l2r)
 {
+    struct rxe_node_state *ns = NS(node);
     struct rxe *sub = node->rxe;
-    int i, n = node->rep_count;
+    int i, n = ns->rep_count;
     // Nothing to repeat: the empty run is the only item there is, so every
     // step carries. Without this the count would walk up into repeat counts
     // whose blocks hold no strings at all.
     if (!mpz_sgn(sub->nitems)) return 1;
     // A run wider than what was allocated can only mean a prior seek was
     // refused for exceeding the cap; do not walk off the end of the array.
-    if (n > node->rep_alloc) { rxe_member_overflow = 1; return 1; }
+    if (n > ns->rep_alloc) { rxe_member_overflow = 1; return 1; }
     // Ripple through the digits, least significant first.
     for (i=0;i<n;i++) {
-        mpz_t *d = &node->rep_digit[digit_at(n,i,l2r)];
-        mpz_add_ui(*d,*d,1);
-        if (mpz_cmp(*d,sub->nitems) < 0) return 0;
-        mpz_set_ui(*d,0);
+        if (!rxe_repeat_bump(node,digit_at(n,i,l2r),sub->nitems)) {
+            // Every position this ripple touched lies to one side of where it
+            // stopped; the leftmost of them is where a render must resume.
+            int first = l2r ? 0 : digit_at(n,i,l2r);
+            if (first < ns->rep_moved) ns->rep_moved = first;
+            return 0;
+        }
     }
     // Every digit wrapped, so the run of this length is exhausted; the next
     // block is the next repeat count up. There is always one when the
     // repetition is unbounded, which is why it never carries out.
     int carry = 0;
-    node->rep_count++;
+    ns->rep_count++;
     // Unbounded, there is always a next count, so it never carries out.
     if (node->rep_max != RXE_REP_UNBOUNDED &&
-        node->rep_count > node->rep_max) {
-        node->rep_count = node->rep_min;
+        ns->rep_count > node->rep_max) {
+        ns->rep_count = node->rep_min;
         carry = 1;
     }
     // The indices are allocated on demand, so a longer run than any reached
     // so far has to make room for itself before it can be cleared.
-    if (rxe_repeat_reserve(node,node->rep_count)) return 1;
-    for (i=0;i<node->rep_count;i++) mpz_set_ui(node->rep_digit[i],0);
+    if (rxe_repeat_reserve(node,ns->rep_count)) return 1;
+    zero_digits(node,ns->rep_count);
+    ns->rep_moved = 0;
     return carry;
 }
+
+// Add 'carry' to the run's digits as a numeral in the body's radix, least
+// significant first, and leave in it whatever comes out of the most
+// significant. The count is never changed here: a carry left over means the
+// step leaves this run length, which only a seek can place, so the caller
+// seeks instead. Returns 1 when the digits cannot be stepped at all.
+
+int rxe_repeat_advance(struct rxe_node *node, long *carry, int l2r)
+{
+    struct rxe_node_state *ns = NS(node);
+    struct rxe *sub = node->rxe;
+    int i, n = ns->rep_count;
+    long c = *carry;
+    if (!mpz_sgn(sub->nitems) || n > ns->rep_alloc) return 1;
+    mpz_t *q = rxe_node_tmp(node);
+    unsigned long b = ns->rep_word ? mpz_get_ui(sub->nitems) : 0;
+    for ( i = 0 ; i < n && c ; i++ ) {
+        int at = digit_at(n,i,l2r);
+        if (ns->rep_word) {
+            // Floor division as below, kept in words: the carry's magnitude
+            // splits into whole turns of the base and a remainder, and the
+            // remainder moves the digit one turn further if it passes an end.
+            // Neither sum can overflow, since the digit is below b.
+            unsigned long *d = &ns->rep_word[at];
+            unsigned long m = c > 0 ? (unsigned long)c : 0UL - (unsigned long)c;
+            unsigned long turns = m / b, rem = m % b;
+            if (c > 0) {
+                if (rem >= b - *d) { *d = rem - (b - *d); turns++; }
+                else *d += rem;
+                c = (long)turns;
+            } else {
+                if (rem > *d) { *d = b - (rem - *d); turns++; }
+                else *d -= rem;
+                c = (long)(0UL - turns);
+            }
+        } else {
+            mpz_t *d = &ns->rep_digit[at];
+            if (c > 0) mpz_add_ui(*d,*d,(unsigned long)c);
+            else mpz_sub_ui(*d,*d,0UL - (unsigned long)c);
+            mpz_fdiv_qr(q[0],*d,*d,sub->nitems);
+            c = mpz_get_si(q[0]);
+        }
+        int first = l2r ? 0 : at;
+        if (first < ns->rep_moved) ns->rep_moved = first;
+    }
+    *carry = c;
+    return 0;
+}
+
+// The members of the repeated thing, kept as positions render them.
+//
+// A repetition renders each position by seeking its body to the position's
+// index and rendering that, which for '([a-z][0-9]){12}' is twelve bignum seeks
+// and twelve recursive renders per member, to spell out one of only 260
+// strings each time. So a small body's members are kept the first time they
+// are rendered, and every later position holding the same index copies them.
+//
+// A body is kept only when nothing but the index decides how it renders: no
+// backreference inside it reads a group that may sit elsewhere, and no
+// backreference outside it reads a group inside it -- that one expects the
+// body to be left at the last position, which copying never does.
+
+static int renders_alone(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    if (rxe->flags & RXE_FLAG_BACKREFERENCED) return 0;
+    for ( alt = rxe->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (node->is_backref) return 0;
+            if (node->rxe && !renders_alone(node->rxe)) return 0;
+        }
+    return 1;
+}
+
+// The body's member at index 'digit' and its length, or NULL when it is not
+// kept and the caller has to render it itself.
+
+const char *rxe_repeat_memo(struct rxe_node *node, const mpz_t digit, int *len)
+{
+    struct rxe_node_state *ns = NS(node);
+    struct rxe *sub = node->rxe;
+    if (ns->memo_ok < 0) {
+        ns->memo_ok = !sub->ninf && mpz_sgn(sub->nitems) > 0
+                     && mpz_cmp_ui(sub->nitems,RXE_MEMO_ITEMS) <= 0
+                     && renders_alone(sub);
+        if (ns->memo_ok) {
+            int i, n = (int)mpz_get_ui(sub->nitems);
+            ns->memo_at = NEW(n,int);
+            ns->memo_n = NEW(n,unsigned char);
+            for (i=0;i<n;i++) ns->memo_at[i] = -1;
+        }
+    }
+    if (!ns->memo_ok) return NULL;
+    int d = (int)mpz_get_ui(digit);
+    if (ns->memo_at[d] == -1) {
+        // Rendered with room to spare, so a member that fills the room may
+        // have been cut short and is not kept; nor is one the cap refused.
+        char item[RXE_MEMO_ITEM_LEN];
+        int was = rxe_member_overflow, n;
+        rxe_member_overflow = 0;
+        if (rxe_seek(sub,(mpz_ptr)digit)) n = -1;
+        else n = (int)(rxe_current(item,sizeof item - 1,sub) - item);
+        if (n < 0 || n >= (int)sizeof item - 1 || rxe_member_overflow
+                || ns->memo_len + n > RXE_MEMO_BYTES) {
+            ns->memo_at[d] = -2;
+        } else {
+            if (!ns->memo) ns->memo = NEW(RXE_MEMO_BYTES,char);
+            memcpy(ns->memo + ns->memo_len,item,n);
+            ns->memo_at[d] = ns->memo_len;
+            ns->memo_n[d] = (unsigned char)n;
+            ns->memo_len += n;
+        }
+        rxe_member_overflow |= was;
+    }
+    if (ns->memo_at[d] < 0) return NULL;
+    *len = ns->memo_n[d];
+    return ns->memo + ns->memo_at[d];
+}
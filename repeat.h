@@ -19,10 +19,18 @@
 
 void rxe_repeat_nitems(mpz_t out, const mpz_t base, int r0, int r1);
 void rxe_repeat_make(struct rxe_node *node, int r0, int r1);
+void rxe_repeat_make_lazy(struct rxe_node *node, int r0, int r1);
+double rxe_repeat_log2(double lb, int r0, int r1);
 int  rxe_repeat_is_infinite(struct rxe_node *node);
 int rxe_repeat_reserve(struct rxe_node *node, int want);
-void rxe_repeat_free(struct rxe_node *node);
+mpz_ptr rxe_repeat_digit(struct rxe_node *node, int i);
+void rxe_repeat_set(struct rxe_node *node, int i, const mpz_t v);
+void rxe_repeat_set_ui(struct rxe_node *node, int i, unsigned long v);
+int  rxe_repeat_bump(struct rxe_node *node, int i, const mpz_t radix);
+void rxe_repeat_free(struct rxe_node_state *s);
 int  rxe_repeat_seek(struct rxe_node *node, const mpz_t pos, int l2r);
 int  rxe_repeat_iterate(struct rxe_node *node, int l2r);
+int  rxe_repeat_advance(struct rxe_node *node, long *carry, int l2r);
+const char *rxe_repeat_memo(struct rxe_node *node, const mpz_t digit, int *len);
 
 #endif // __RXE_REPEAT_H__
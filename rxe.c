@@ -16,6 +16,9 @@
  
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "rxe.h"
@@ -28,6 +31,12 @@
 #include "pair.h"
 #include "lens.h"
 #include "parse.h"
+#include "plan.h"
+#include "dict.h"
+#include "filter.h"
+#include "lex.h"
+
+#ifndef RXE_CURSOR_WALK
 
 /* ------------------------ Macro-Defined Constants ----------------------- */
 
@@ -55,6 +64,10 @@ size_t rxe_max_member = RXE_DEFAULT_MAX_MEMBER;
 // difference: there is only ever the one thread's copy.
 _Thread_local int rxe_member_overflow;
 
+// Raised by a fixed-width rxe_int operation that saturated; see rxe_int.h. Per
+// thread for the same reason as the latch above.
+_Thread_local int rxe_int_overflow;
+
 void rxe_set_max_member(size_t bytes)
 {
     rxe_max_member = bytes;
@@ -70,6 +83,10 @@ int rxe_check_overflow(void)
 /* -------------------------- Function Prototypes ------------------------- */
 
 void kmalloc_failed(size_t size, const char *file, int line);
+static struct rxe_arena *arena_new(void);
+static void arena_free(struct rxe_arena *arena);
+static struct rxe_arena *arena_use(struct rxe_arena *arena);
+static void number_tree(struct rxe *root);
 
 void rxe_set_alloc(
     void * (*malloc_func)(size_t),
@@ -100,6 +117,8 @@ void rxe_set_alloc(
     rxe_initialized = 1;
 }
 
+#endif
+
 // Returns the first alternation that contributes any string at all. An
 // alternation whose product is zero holds an impossible node -- an empty
 // character class, say -- and matches nothing, so enumeration must step over
@@ -114,6 +133,8 @@ static struct rxe_alt *rxe_first_alt(struct rxe *rxe)
     return NULL;
 }
 
+#ifndef RXE_CURSOR_WALK
+
 int rxe_is_infinite(struct rxe *rxe)
 {
     return rxe && rxe->ninf > 0;
@@ -165,6 +186,34 @@ static void mark_shortlex(struct rxe *rxe)
             if (node->rxe && !node->is_backref) mark_shortlex(node->rxe);
 }
 
+// Whether the members of this expression can be counted length by length at
+// all: the same test that decides the order of an infinite set, asked of any
+// set. See lens.c. A filtered set's tables would count the members the filter
+// drops as well, so it is walked in its own order instead.
+
+int rxe_length_countable(struct rxe *rxe)
+{
+    return rxe && !rxe->status && !tree_has_backref(rxe) && !rxe->filter
+           && !rxe->lex;
+}
+
+// A private copy of the tree to be walked length by length, for a finite set
+// as readily as an infinite one. The render reads a repetition's digits by the
+// order its expression is marked with, so the copy is marked shortest first
+// throughout, and the plan -- a place-value odometer, which knows nothing of
+// lengths -- is set aside. NULL when the lengths cannot be counted.
+
+struct rxe *rxe_clone_by_length(struct rxe *rxe)
+{
+    if (!rxe_length_countable(rxe)) return NULL;
+    struct rxe *copy = rxe_deep_clone(rxe);
+    copy->walk.plan_live = 0;
+    mark_shortlex(copy);
+    return copy;
+}
+
+#endif
+
 // The i-th alternation that has no largest member, counted in written order.
 
 static struct rxe_alt *rxe_nth_inf_alt(struct rxe *rxe, unsigned long i)
@@ -175,14 +224,16 @@ static struct rxe_alt *rxe_nth_inf_alt(struct rxe *rxe, unsigned long i)
     return NULL;
 }
 
-char *rxe_current(char *str, int maxlen, struct rxe *rxe)
+// Render the nodes of one alternation from 'node' on, into 'str'; 'base' is
+// where the member began, so each node can note where it landed. A repetition
+// first in line resumes at position 'at', 'str' being where that one landed.
+
+static char *render_nodes(char *str, int maxlen, struct rxe *rxe,
+                          struct rxe_node *node, char *base, int at)
 {
-    if (maxlen<=0) return str;
-    str[0] = 0;
-    struct rxe_alt *alt = rxe->curr;
-    struct rxe_node *node;
-    if (!alt) return str;
-    for ( node = alt->head ; node ; node = node->next ) {
+    for ( ; node ; node = node->next, at = 0 ) {
+        struct rxe_node_state *ns = NS(node);
+        if (!at) ns->out_at = (int)(str - base);
         if (node->is_repeat || node->is_comb || node->is_policy) {
             // One copy of the subexpression stands in for every position, so
             // it has to be seeked to each position's index in turn. Rendering
@@ -196,35 +247,49 @@ char *rxe_current(char *str, int maxlen, struct rxe *rxe)
             // Never read past what was allocated: a repetition whose reserve
             // was refused for exceeding the cap holds fewer digits than its
             // count, and the run it stands for cannot be rendered whole.
-            if (node->rep_count > node->rep_alloc) rxe_member_overflow = 1;
-            for ( i = 0 ; i < node->rep_count && i < node->rep_alloc ; i++ ) {
+            if (ns->rep_count > ns->rep_alloc) rxe_member_overflow = 1;
+            for ( i = at ; i < ns->rep_count && i < ns->rep_alloc ; i++ ) {
                 char *new_str;
+                ns->rep_at[i] = (int)(str - base);
                 // An unbounded repetition can select a run far longer than
                 // the caller's buffer -- 'a*' at index a billion is a billion
                 // characters -- so stop as soon as there is no room, rather
                 // than generating the rest of it to throw away.
                 if (maxlen <= 0) break;
-                // Addressed by the length it takes and its place among the
-                // members of that length, rather than by one index into the
-                // body's whole ordering, which an endless body does not have
-                // in a useful order.
-                if (shortlex
-                        ? rxe_seek_at_length(node->rxe,node->rep_len[i],
-                                             node->rep_digit[i])
-                        : rxe_seek(node->rxe,node->rep_digit[i])) break;
                 char *item = str;
-                new_str = rxe_current(str,maxlen,node->rxe);
+                const char *kept;
+                int n;
+                mpz_ptr digit = rxe_repeat_digit(node,i);
+                if (!shortlex && (kept = rxe_repeat_memo(node,digit,&n))) {
+                    // Rendered before at this index, by this or another
+                    // position; see repeat.c.
+                    if (n > maxlen) n = maxlen;
+                    memcpy(str,kept,n);
+                    new_str = str + n;
+                } else {
+                    // Addressed by the length it takes and its place among
+                    // the members of that length, rather than by one index
+                    // into the body's whole ordering, which an endless body
+                    // does not have in a useful order.
+                    if (shortlex
+                            ? rxe_seek_at_length(node->rxe,ns->rep_len[i],digit)
+                            : rxe_seek(node->rxe,digit)) break;
+                    new_str = rxe_current(str,maxlen,node->rxe);
+                }
                 maxlen -= new_str - str;
                 str = new_str;
                 // The '?' chop of a combinatorial choice: quell the base's last
                 // node in the last item -- the trailing separator. Only when it
                 // really is the last item and the buffer did not cut it short.
-                if (node->comb_chop && i == node->rep_count - 1
+                if (node->comb_chop && i == ns->rep_count - 1
                         && str - item >= node->comb_chop) {
                     str    -= node->comb_chop;
                     maxlen += node->comb_chop;
                 }
             }
+            // Rendered whole, no position has moved since; cut short, the
+            // next render of this node has to start from its first.
+            ns->rep_moved = i == ns->rep_count ? i : 0;
         } else if (node->rxe) {
             char *new_str = rxe_current(str,maxlen,node->rxe);
             maxlen -= new_str - str;
@@ -232,13 +297,13 @@ char *rxe_current(char *str, int maxlen, struct rxe *rxe)
         } else if (node->is_dict) {
             // A dictionary member is a whole word, not a character. Copy as
             // much of it as the buffer still holds.
-            const char *w = node->words[node->iterator];
+            const char *w = node->words[ns->iterator];
             while (*w && maxlen>0) { *str++ = *w++; maxlen--; }
         } else if (node->len) {
             // A node with no characters has nothing to contribute. Indexing
             // its str would read past a zero-length allocation.
             if (maxlen>0) {
-                *str++ = node->str[node->iterator];
+                *str++ = node->str[ns->iterator];
                 maxlen--;
             }
         }
@@ -247,18 +312,143 @@ char *rxe_current(char *str, int maxlen, struct rxe *rxe)
     return str;
 }
 
+char *rxe_current(char *str, int maxlen, struct rxe *rxe)
+{
+    struct rxe_state *rs = RS(rxe);
+    if (maxlen<=0) return str;
+    if (rs->plan_live) return rxe_plan_render(rxe->plan,rs->plan_state,
+                                               str,maxlen);
+    if (rxe->lex) {
+        // Cut short, the member leaves nothing for a delta render to keep.
+        char *end = rxe_lex_render(rs->lex_state,str,maxlen);
+        rs->moved_all = end - str >= maxlen;
+        return end;
+    }
+    str[0] = 0;
+    rs->moved = NULL;
+    rs->moved_all = 1;
+    if (!rs->curr) return str;
+    int was = rxe_member_overflow;
+    rxe_member_overflow = 0;
+    char *end = render_nodes(str,maxlen,rxe,rs->curr->head,str,0);
+    rs->out_len = (int)(end - str);
+    // Cut short, by the buffer or by a run too long to build, the member's
+    // tail is not in the buffer to be kept.
+    rs->moved_all = rs->out_len >= maxlen || rxe_member_overflow;
+    rxe_member_overflow |= was;
+    return end;
+}
+
+// The position a render of the first moved node can resume at, 0 being all
+// of it.
+
+static int resume_at(struct rxe_node *node)
+{
+    struct rxe_node_state *ns = NS(node);
+    return node->is_repeat && ns->rep_moved < ns->rep_count
+           ? ns->rep_moved : 0;
+}
+
+// The tree's half of the delta render. Each node of the current alternation
+// noted where it landed, and rxe_iterate notes the first node it moved, so the
+// member is the buffer's prefix up to that node and a render of the rest. A
+// repetition goes one level further: its positions noted where they landed
+// too, and a step that only turned its low digits resumes at the first of
+// them, which is what makes a long '[a-z]{30}' cheap to walk.
+
+char *rxe_current_delta(char *str, int maxlen, struct rxe *rxe)
+{
+    struct rxe_state *rs = RS(rxe);
+    if (maxlen<=0) return str;
+    if (rs->plan_live) return rxe_plan_render_delta(rxe->plan,
+                                                     rs->plan_state,str,maxlen);
+    if (rxe->lex) {
+        if (rs->moved_all) return rxe_current(str,maxlen,rxe);
+        char *end = rxe_lex_render_delta(rs->lex_state,str,maxlen);
+        rs->moved_all = end - str >= maxlen;
+        return end;
+    }
+    struct rxe_node *from = rs->moved;
+    if (rs->moved_all || !rs->curr || rs->out_len >= maxlen)
+        return rxe_current(str,maxlen,rxe);
+    if (!from) return str + rs->out_len;
+    int at = resume_at(from);
+    int off = at ? NS(from)->rep_at[at] : NS(from)->out_at;
+    if (off >= maxlen) return rxe_current(str,maxlen,rxe);
+    int was = rxe_member_overflow;
+    rxe_member_overflow = 0;
+    char *end = render_nodes(str + off,maxlen - off,rxe,from,str,at);
+    rs->moved = NULL;
+    rs->out_len = (int)(end - str);
+    rs->moved_all = rs->out_len >= maxlen || rxe_member_overflow;
+    rxe_member_overflow |= was;
+    return end;
+}
+
+#ifndef RXE_CURSOR_WALK
+
+int rxe_touched(struct rxe *rxe)
+{
+    struct rxe_state *rs = RS(rxe);
+    if (rs->plan_live) return rxe_plan_touched(rs->plan_state);
+    if (rs->moved_all || !rs->curr) return 0;
+    if (rxe->lex) return rxe_lex_touched(rs->lex_state);
+    struct rxe_node *from = rs->moved;
+    if (!from) return rs->out_len;
+    int at = resume_at(from);
+    return at ? NS(from)->rep_at[at] : NS(from)->out_at;
+}
+
+#endif
+
+static void rewind_alt(struct rxe_alt *alt, int l2r);
+static int tree_step(struct rxe *rxe);
+static int filtered_step(struct rxe *rxe);
+static mpz_ptr index_mpz(struct rxe *rxe);
+
 int rxe_iterate(struct rxe *rxe)
 {
-    if (!rxe || !rxe->curr) return 1;
+    if (!rxe) return 1;
+    struct rxe_state *rs = RS(rxe);
+    if (!rs->curr) return 1;
+    if (rs->plan_live) return rxe_plan_iterate(rxe->plan,rs->plan_state);
+    if (rxe->filter) return filtered_step(rxe);
+    if (rxe->lex) {
+        ri_add_ui(rs->index,rs->index,1);
+        if (!rxe_lex_iterate(rxe->lex,rs->lex_state)) return 0;
+        ri_set_ui(rs->index,0);
+        return 1;
+    }
     if (rxe->ninf) {
-        // No odometer walks this. The order over the endless dimensions is a
-        // diagonal, not place value, so the only way to step is to address
-        // the next index and seek to it. There is always a next one, which is
-        // why an infinite expression never carries out.
-        mpz_add_ui(rxe->index,rxe->index,1);
-        return rxe_seek(rxe,rxe->index);
-    }
-    struct rxe_alt *alt = rxe->curr;
+        rs->moved_all = 1;
+        // Shortest first, the order within a length and the lengths after it
+        // are an odometer of their own, stepped in lens.c. The diagonal order
+        // is not place value, so there the only way to step is to address the
+        // next index and seek to it. There is always a next one, which is why
+        // an infinite expression never carries out -- unless the library is
+        // built on a machine word, whose top is as far as it can count.
+        if (ri_full(rs->index)) return 1;
+        ri_add_ui(rs->index,rs->index,1);
+        if (rxe->flags & RXE_FLAG_SHORTLEX)
+            return rxe_step_shortlex(rxe,index_mpz(rxe));
+        return rxe_seek(rxe,index_mpz(rxe));
+    }
+    // Kept so rxe_advance has somewhere to add to when it has to seek; a
+    // wrap puts it back to zero.
+    ri_add_ui(rs->index,rs->index,1);
+    if (!tree_step(rxe)) return 0;
+    ri_set_ui(rs->index,0);
+    return 1;
+}
+
+// The odometer's step: the least significant digit up by one, carrying as far
+// as it must. Returns 1 when it carries out of the last alternation, leaving
+// the tree on its first member.
+
+static int tree_step(struct rxe *rxe)
+{
+    struct rxe_state *rs = RS(rxe);
+    struct rxe_alt *alt = rs->curr;
     // Which end of the alternation carries first: the last node is the least
     // significant digit by default, so that enumeration counts the way an
     // ordinary numeral does.
@@ -280,8 +470,9 @@ int rxe_iterate(struct rxe *rxe)
             }
             if (carry) {
                 int bound = node->is_dict ? node->nwords : node->len;
-                if (++node->iterator >= bound) {
-                    node->iterator = 0;
+                struct rxe_node_state *ns = NS(node);
+                if (++ns->iterator >= bound) {
+                    ns->iterator = 0;
                     node = l2r ? node->next : node->prev;
                     if (!node) break;
                 } else {
@@ -290,18 +481,288 @@ int rxe_iterate(struct rxe *rxe)
             }
         }
     }
+    // The node the carry stopped at is the first one that moved: those before
+    // it are as they were, those after it were reset. Running the other way
+    // round, everything up to it moved, which is as good as all of it.
+    if (!carry && !l2r && !rs->moved_all) {
+        struct rxe_node *n;
+        for ( n = node ; n && n != rs->moved ; n = n->next ) ;
+        if (!rs->moved || n) rs->moved = node;
+    } else {
+        rs->moved_all = 1;
+    }
     if (carry) {
         do { alt = alt->next; } while (alt && !mpz_sgn(alt->nitems));
         if (alt) {
-            rxe->curr = alt;
+            rs->curr = alt;
             carry = 0;
         } else {
-            rxe->curr = rxe_first_alt(rxe);
+            rs->curr = rxe_first_alt(rxe);
         }
+        // A carry leaves only the alternation it ran through at zero; the one
+        // taking over may still hold whatever an earlier seek left in it.
+        if (rs->curr) rewind_alt(rs->curr,l2r);
     }
     return carry;
 }
 
+// A filtered set's step (see filter.c). Seeking there is a pass over the whole
+// tree where the odometer's step is a digit, so the next few members of the
+// whole set are tried first, each rendered and run through the filter's
+// automaton -- for a filter that keeps much, one of them nearly always passes
+// -- and only when none does is the next filtered index seeked, which skips
+// the rest of the rejected run without rendering it. A member too long for the
+// trial buffer goes to the seek as well.
+
+#define FILTER_TRIES     8
+#define FILTER_PEEK      1024
+
+static int filtered_step(struct rxe *rxe)
+{
+    char buf[FILTER_PEEK];
+    struct rxe_state *rs = RS(rxe);
+    int i, was = rxe_member_overflow;
+    ri_add_ui(rs->index,rs->index,1);
+    if (mpz_cmp(index_mpz(rxe),rxe->nitems) >= 0) {
+        ri_set_ui(rs->index,0);
+        rxe_seek(rxe,index_mpz(rxe));
+        return 1;
+    }
+    for (i=0;i<FILTER_TRIES;i++) {
+        if (tree_step(rxe)) break;
+        char *end = rxe_current(buf,sizeof buf,rxe);
+        int cut = rxe_member_overflow || end - buf >= (int)sizeof buf - 1;
+        rxe_member_overflow = was;
+        if (cut) break;
+        if (rxe_filter_accepts(rxe->filter,buf,(size_t)(end - buf))) {
+            // The trial render is not the caller's, so a delta render after
+            // this must not read the caller's buffer as holding it.
+            rs->moved_all = 1;
+            return 0;
+        }
+    }
+    return rxe_seek(rxe,index_mpz(rxe));
+}
+
+/* ----------------------------- Deferred counts -------------------------- */
+
+// Under RXE_LAZY_SIZE a repetition too large to be worth counting is left
+// uncounted (rxe_repeat_make_lazy), and every count that would have been built
+// from it -- its group's, its alternation's product, the expression's sum and
+// the start of each alternation after it -- is left short by it. What makes
+// that safe to walk is that a deferred count is enormous: more than
+// RXE_DEFER_BITS bits. An index shorter than every deferred count below an
+// expression, which rxe->deferred records, is below each of them, so a seek
+// can take it through them without knowing them -- a deferred position takes
+// the whole of what is left, and no alternation after a deferred one can be
+// where it lands. Past that, the counts are worked out first. A step needs no
+// count above the bodies it carries through, and those are always counted.
+//
+// Only the spine is deferred: a body -- what a repetition, combination,
+// policy or shuffle is made of -- is counted as it is built on, since its
+// size is the radix everything above it works in.
+
+static long node_deferred(struct rxe_node *node)
+{
+    if (node->size_log2 > 0) return (long)node->size_log2 - 64;
+    if (node->rxe && !node->is_backref && !node->is_repeat && !node->is_comb
+        && !node->is_policy && !node->is_shuffle)
+        return node->rxe->deferred;
+    return 0;
+}
+
+#ifndef RXE_CURSOR_WALK
+
+// Record what a finished (sub)expression leaves uncounted. Its groups were
+// noted as each closed, so this looks one level down only. An alternation that
+// matches nothing is left out: it stands before no member, and nothing it
+// holds is ever asked for.
+
+void rxe_note_deferred(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    long bits = 0;
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        alt->deferred = 0;
+        if (!mpz_sgn(alt->nitems)) continue;
+        for ( node = alt->head ; node ; node = node->next ) {
+            long b = node_deferred(node);
+            if (!b) continue;
+            alt->deferred = 1;
+            if (!bits || b < bits) bits = b;
+        }
+    }
+    rxe->deferred = bits;
+}
+
+// Settling the counts is the one write a walk can make to a shared tree: every
+// cursor's first seek wants them. So it is done under one lock for the whole
+// process, and a tree's deferred is cleared last, with release, so a thread
+// that reads it clear with acquire sees every count that was filled in first.
+static pthread_mutex_t sizing = PTHREAD_MUTEX_INITIALIZER;
+
+static void force_size(struct rxe *rxe);
+
+static void force_node(struct rxe_node *node)
+{
+    if (node->size_log2 > 0) {
+        rxe_repeat_nitems(node->nitems,node->rxe->nitems,node->rep_min,
+                          node->rep_max);
+        node->size_log2 = 0;
+    } else if (node_deferred(node)) {
+        force_size(node->rxe);
+        mpz_set(node->nitems,node->rxe->nitems);
+    }
+}
+
+void rxe_force_node(struct rxe_node *node)
+{
+    pthread_mutex_lock(&sizing);
+    force_node(node);
+    pthread_mutex_unlock(&sizing);
+}
+
+// The counts the parse would have made, made now: each deferred alternation's
+// product again, over the nodes' counts as parse() multiplies them, then the
+// sum and the starts. A plan is not built afterwards; a count this wide is far
+// past the 127 bits one holds.
+
+static void force_size(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    if (!rxe->deferred) return;
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        if (!alt->deferred) continue;
+        mpz_set_ui(alt->nitems,1);
+        for ( node = alt->head ; node ; node = node->next ) {
+            force_node(node);
+            if (!node->is_inf && !node->is_backref)
+                mpz_mul(alt->nitems,alt->nitems,node->nitems);
+        }
+        alt->deferred = 0;
+    }
+    mpz_set_ui(rxe->nitems,0);
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        mpz_set(alt->start,rxe->nitems);
+        if (!alt->ninf) mpz_add(rxe->nitems,rxe->nitems,alt->nitems);
+    }
+    __atomic_store_n(&rxe->deferred,0,__ATOMIC_RELEASE);
+}
+
+void rxe_force_size(struct rxe *rxe)
+{
+    if (!rxe || !__atomic_load_n(&rxe->deferred,__ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&sizing);
+    force_size(rxe);
+    pthread_mutex_unlock(&sizing);
+}
+
+// log2 of a count that is exact, or -INFINITY for none.
+
+static double mpz_log2(const mpz_t x)
+{
+    signed long e;
+    if (!mpz_sgn(x)) return -INFINITY;
+    double m = mpz_get_d_2exp(&e,x);
+    return log2(m) + (double)e;
+}
+
+// log2(2^a + 2^b), without leaving the logarithms.
+
+static double log2_add(double a, double b)
+{
+    if (a < b) { double t = a; a = b; b = t; }
+    if (b == -INFINITY) return a;
+    return a + log1p(exp2(b - a))/M_LN2;
+}
+
+static double log2_size_of(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    if (!rxe->deferred) return mpz_log2(rxe->nitems);
+    double sum = -INFINITY;
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        if (alt->ninf) continue;
+        if (!alt->deferred) { sum = log2_add(sum,mpz_log2(alt->nitems)); continue; }
+        double prod = 0;
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (node->is_inf || node->is_backref) continue;
+            prod += node->size_log2 > 0 ? node->size_log2
+                  : node_deferred(node) ? log2_size_of(node->rxe)
+                  : mpz_log2(node->nitems);
+        }
+        sum = log2_add(sum,prod);
+    }
+    return sum;
+}
+
+double rxe_log2_size(struct rxe *rxe)
+{
+    if (!rxe) return -INFINITY;
+    if (rxe_is_infinite(rxe)) return INFINITY;
+    return log2_size_of(rxe);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------ */
+
+// The temporaries a seek works in. Each expression -- the root and every
+// subexpression -- keeps its own, so the recursion into a subexpression never
+// tramples its caller's, and they are made the first time it is seeked rather
+// than at every seek: initialising and clearing them per call, with a
+// dimension array on top for an endless alternation, was most of what a keyed
+// walk spent in the allocator. The slots are named below. The dimensions an
+// endless alternation is spread over are kept apart from them, since they
+// grow to the widest alternation seeked so far and may move when they do.
+
+enum { T_P, T_WHICH, T_Q, T_R, T_N, T_AP, T_IDX, T_PAIR, T_FIXED = T_PAIR + 3 };
+
+static mpz_t *seek_tmp(struct rxe *rxe)
+{
+    struct rxe_state *rs = RS(rxe);
+    if (!rs->tmp) {
+        int i;
+        rs->tmp = NEW(T_FIXED,mpz_t);
+        for (i=0;i<T_FIXED;i++) mpz_init(rs->tmp[i]);
+    }
+    return rs->tmp;
+}
+
+static mpz_t *seek_dim(struct rxe *rxe, int want)
+{
+    struct rxe_state *rs = RS(rxe);
+    if (want > rs->ndim) {
+        int i;
+        mpz_t *dim = NEW(want,mpz_t);
+        // Handing the limbs over, as rxe_repeat_reserve does.
+        for (i=0;i<rs->ndim;i++) dim[i][0] = rs->dim[i][0];
+        for (i=rs->ndim;i<want;i++) mpz_init(dim[i]);
+        if (rs->dim) rxe_mem_free(rs->dim);
+        rs->dim = dim;
+        rs->ndim = want;
+    }
+    return rs->dim;
+}
+
+// The expression's index where an mpz_t is wanted: the index itself under GMP,
+// or under a machine word a copy in its temporaries, good until it is next
+// asked for.
+
+static mpz_ptr index_mpz(struct rxe *rxe)
+{
+#if RXE_INT_BITS
+    mpz_ptr x = seek_tmp(rxe)[T_IDX];
+    ri_get_mpz(x,RS(rxe)->index);
+    return x;
+#else
+    return RS(rxe)->index;
+#endif
+}
+
 // Select the item at 'pos' within one alternation.
 //
 // The finite positions are the digits of a numeral, as they always were.
@@ -312,25 +773,77 @@ int rxe_iterate(struct rxe *rxe)
 // spreading is the identity and this is the old code with the division done
 // one step earlier.
 
-static int rxe_alt_seek(struct rxe_alt *alt, const mpz_t pos, int l2r)
+// Put one finite position on its digit, 'r'.
+
+static int seek_digit(struct rxe_node *node, mpz_t r, int l2r)
+{
+    if (node->is_repeat) return rxe_repeat_seek(node,r,l2r);
+    if (node->is_comb) return rxe_comb_seek(node,r);
+    if (node->is_policy) return rxe_policy_seek(node,r);
+    if (node->is_shuffle) return rxe_shuffle_seek(node,r);
+    if (node->rxe) rxe_seek(node->rxe,r);
+    else NS(node)->iterator = mpz_get_ui(r);
+    return 0;
+}
+
+#if RXE_INT_BITS
+
+// The same numeral in a library built on a machine word, for an alternation
+// whose count fits one: then every digit fits too, and they come off the
+// index by word division rather than GMP's. Only a position that goes on to
+// seek is handed its digit as an mpz_t; a plain one, which most are, takes it
+// as it is.
+
+static int alt_seek_word(struct rxe_alt *alt, const mpz_t pos, int l2r,
+                         mpz_t *tmp)
+{
+    struct rxe_node *node;
+    rxe_int p, q, r, n;
+    ri_set_mpz(p,pos);
+    for ( node = l2r ? alt->head : alt->tail ; node ;
+          node = l2r ? node->next : node->prev ) {
+        if (node->is_backref) continue;
+        ri_set_mpz(n,rxe_node_radix(node));
+        if (!ri_sgn(n)) return 1;
+        ri_tdiv_qr(q,r,p,n);
+        ri_set(p,q);
+        if (!node->rxe) {
+            NS(node)->iterator = ri_get_ui(r);
+            continue;
+        }
+        ri_get_mpz(tmp[T_R],r);
+        if (seek_digit(node,tmp[T_R],l2r)) return 1;
+    }
+    return ri_sgn(p);
+}
+
+#endif
+
+static int rxe_alt_seek(struct rxe_alt *alt, const mpz_t pos, int l2r,
+                        mpz_t *tmp)
 {
     struct rxe_node *node;
     mpz_t *dim = NULL;
-    mpz_t q,r,n,p;
-    int rc = 0, i = 0;
-    mpz_init(q);
-    mpz_init(r);
-    mpz_init(n);
-    mpz_init_set(p,pos);
+    mpz_ptr q = tmp[T_Q], r = tmp[T_R], n = tmp[T_N], p = tmp[T_AP];
+    int rc = 0, i = 0, j = 0;
+#if RXE_INT_BITS
+    if (!alt->ninf && !alt->deferred
+        && mpz_sizeinbase(alt->nitems,2) <= RXE_INT_BITS
+        && mpz_sizeinbase(pos,2) <= RXE_INT_BITS)
+        return alt_seek_word(alt,pos,l2r,tmp);
+#endif
+    mpz_set(p,pos);
     if (alt->ninf) {
         // alt->nitems counts the finite positions only, and is at least one
         // because an empty product is one, so this division is always safe.
         mpz_tdiv_qr(q,p,p,alt->nitems);
-        dim = NEW(alt->ninf,mpz_t);
-        for (i=0;i<alt->ninf;i++) mpz_init(dim[i]);
-        rxe_unpair(dim,alt->ninf,q);
-        i = 0;
+        dim = seek_dim(alt->owner,alt->ninf);
+        rxe_unpair(dim,alt->ninf,q,tmp + T_PAIR);
     }
+    // A wide index over many positions is split into its digits all at once,
+    // rather than divided by each in turn; see rxe_alt.c. p is left with what
+    // the digits could not absorb, just as the divisions would leave it.
+    mpz_t *digit = rxe_alt_split(alt,p,l2r);
     for ( node = l2r ? alt->head : alt->tail ; node ;
           node = l2r ? node->next : node->prev ) {
         if (node->is_backref) continue;
@@ -352,69 +865,72 @@ static int rxe_alt_seek(struct rxe_alt *alt, const mpz_t pos, int l2r)
         // A repetition or a combination is a node whose cardinality is not its
         // subexpression's: the geometric sum for one, the binomial sum for the
         // other. Both carry their own count in node->nitems.
-        mpz_set(n, node->rxe && !node->is_repeat && !node->is_comb
-                       && !node->is_policy
-                       ? node->rxe->nitems : node->nitems);
+        mpz_set(n,rxe_node_radix(node));
+        // A count not yet worked out is larger than anything left to divide
+        // by it -- tree_seek saw to that -- so the position takes all of it.
+        if (alt->deferred && node_deferred(node)) {
+            mpz_set(r,p);
+            mpz_set_ui(p,0);
+            if (node->is_repeat ? rxe_repeat_seek(node,r,l2r)
+                                : rxe_seek(node->rxe,r)) { rc = 1; break; }
+            continue;
+        }
         // An impossible node cannot be indexed into. Alternations holding one
         // are skipped by the caller, so reaching this means the caller seeked
         // into a set that has no such element; report failure rather than
         // abort.
         if (!mpz_sgn(n)) { rc = 1; break; }
-        mpz_tdiv_qr(q,r,p,n);
-        mpz_set(p,q);
-        if (node->is_repeat) {
-            if (rxe_repeat_seek(node,r,l2r)) { rc = 1; break; }
-        } else if (node->is_comb) {
-            if (rxe_comb_seek(node,r)) { rc = 1; break; }
-        } else if (node->is_policy) {
-            if (rxe_policy_seek(node,r)) { rc = 1; break; }
-        } else if (node->is_shuffle) {
-            if (rxe_shuffle_seek(node,r)) { rc = 1; break; }
-        } else if (node->rxe) {
-            rxe_seek(node->rxe,r);
+        if (digit) {
+            r = digit[j++];
         } else {
-            node->iterator = mpz_get_ui(r);
+            mpz_tdiv_qr(q,r,p,n);
+            mpz_set(p,q);
         }
+        if (seek_digit(node,r,l2r)) { rc = 1; break; }
     }
     // Whatever the numeral could not absorb is an index past the last item.
     // An alternation with an endless position has no last item, and its
     // leftover went into the pairing rather than staying here.
     if (!rc && mpz_sgn(p) > 0) rc = 1;
-    if (dim) {
-        for (i=0;i<alt->ninf;i++) mpz_clear(dim[i]);
-        rxe_mem_free(dim);
-    }
-    mpz_clear(q);
-    mpz_clear(r);
-    mpz_clear(n);
-    mpz_clear(p);
     return rc;
 }
 
-int rxe_seek(struct rxe *rxe, mpz_t pos)
+static void rewind_alt(struct rxe_alt *alt, int l2r)
+{
+    mpz_t *tmp = seek_tmp(alt->owner);
+    mpz_set_ui(tmp[T_P],0);
+    rxe_alt_seek(alt,tmp[T_P],l2r,tmp);
+}
+
+static int tree_seek(struct rxe *rxe, const mpz_t pos)
 {
-    if (!rxe || mpz_sgn(pos) < 0) return 1;
     if (rxe->flags & RXE_FLAG_SHORTLEX) {
         int rc = rxe_seek_shortlex(rxe,pos);
-        if (!rc) mpz_set(rxe->index,pos);
+        if (!rc) ri_set_mpz(RS(rxe)->index,pos);
         return rc;
     }
-    struct rxe_alt *alt = NULL;
+    struct rxe_alt *alt = NULL, *last = rxe->tail;
     int l2r = rxe->flags & RXE_FLAG_LEFT_TO_RIGHT;
     int rc;
-    mpz_t p;
-    mpz_init_set(p,pos);
+    // An index as wide as a count the parse put off may lie past it, and only
+    // the count can say; otherwise every alternation after the first deferred
+    // one starts past the index, and the search can stop at that one.
+    if (rxe->deferred && mpz_sizeinbase(pos,2) > (size_t)rxe->deferred)
+        rxe_force_size(rxe);
+    if (rxe->deferred)
+        for ( last = rxe->head ; !last->deferred ; last = last->next ) ;
+    mpz_t *tmp = seek_tmp(rxe);
+    mpz_ptr p = tmp[T_P];
+    mpz_set(p,pos);
     if (rxe->ninf && mpz_cmp(pos,rxe->nitems) >= 0) {
         // Past every finite alternation, so this is one of the endless ones.
         // They are dovetailed rather than laid end to end: consecutive
         // indices visit them in turn, because laying them end to end would
         // mean the second never started.
-        mpz_t which;
-        mpz_init(which);
+        mpz_ptr which = tmp[T_WHICH];
         mpz_sub(p,pos,rxe->nitems);
         mpz_tdiv_qr_ui(p,which,p,(unsigned long)rxe->ninf);
         alt = rxe_nth_inf_alt(rxe,mpz_get_ui(which));
-        mpz_clear(which);
     } else {
         // A linear scan, which is slow when an expression has a great many
         // alternations. It used to be the obvious thing to replace with a
@@ -423,50 +939,493 @@ int rxe_seek(struct rxe *rxe, mpz_t pos)
         // are counted rather than written out now, and hand-written
         // alternations do not run to those numbers: 20,000 of them still seek
         // in 0.02s. See the TODO.
-        for ( alt = rxe->tail ; alt ; alt = alt->prev ) {
+        for ( alt = last ; alt ; alt = alt->prev ) {
             if (alt->ninf) continue;               // indexed above, not here
             if (!mpz_sgn(alt->nitems)) continue;   // matches nothing; skip it
             if (mpz_cmp(alt->start,pos)<=0) { mpz_sub(p,p,alt->start); break; }
         }
     }
-    if (!alt) { mpz_clear(p); return 1; }
-    rc = rxe_alt_seek(alt,p,l2r);
+    if (!alt) return 1;
+    rc = rxe_alt_seek(alt,p,l2r,tmp);
     if (!rc) {
-        rxe->curr = alt;
-        mpz_set(rxe->index,pos);
+        RS(rxe)->curr = alt;
+        ri_set_mpz(RS(rxe)->index,pos);
     }
-    mpz_clear(p);
     return rc;
 }
 
+// Whichever of the plan and the tree seeks is the one the following iterate
+// and render read, so the choice is made here and recorded. It is the plan
+// whenever there is one that can render every member within the cap; the cap
+// is a global a caller may change after parsing, which is why this is asked at
+// each seek rather than settled once.
+
+int rxe_seek(struct rxe *rxe, mpz_t pos)
+{
+    if (!rxe || mpz_sgn(pos) < 0) return 1;
+    // Nor is there anything past what the library's integer can hold.
+    if (RXE_INT_BITS && mpz_sizeinbase(pos,2) > RXE_INT_BITS) return 1;
+    struct rxe_state *rs = RS(rxe);
+    if (rxe->plan && rxe_plan_usable(rxe->plan)) {
+        if (rxe_plan_seek(rxe->plan,rs->plan_state,pos)) return 1;
+        rs->plan_live = 1;
+        ri_set_mpz(rs->index,pos);
+        return 0;
+    }
+    rs->plan_live = 0;
+    rs->moved_all = 1;
+    if (rxe->filter) {
+        // The filtered index names a member of the whole set, found by the
+        // filter's counts, and the tree is seeked there; the index kept is
+        // the filtered one. pos may be rxe->index itself, which the tree's
+        // seek overwrites, hence the copy.
+        mpz_t at, k;
+        mpz_init(at);
+        mpz_init_set(k,pos);
+        int rc = rxe_filter_locate(rxe,k,at) || tree_seek(rxe,at);
+        if (!rc) ri_set_mpz(rs->index,k);
+        mpz_clear(at);
+        mpz_clear(k);
+        return rc;
+    }
+    if (rxe->lex) {
+        if (rxe_lex_seek(rxe->lex,rs->lex_state,pos)) return 1;
+        ri_set_mpz(rs->index,pos);
+        return 0;
+    }
+    return tree_seek(rxe,pos);
+}
+
+// rxe_advance: the step generalised to any distance. rxe_iterate adds one to
+// the least significant digit and carries; this adds 'delta', of either sign,
+// to the same numeral, so a carry goes only as far as the sum reaches and a
+// strided walk costs a few small additions a member rather than a division
+// through every node. Where a digit cannot simply be added to -- a carry out
+// of the alternation, a repetition changing its length, a combination or a
+// shuffle, whose orders are not place value -- the numeral gives way to a seek
+// to where the sum lands, which rxe->index says, since the tree walk keeps it.
+
+static void add_long(mpz_t x, long d)
+{
+    if (d >= 0) mpz_add_ui(x,x,(unsigned long)d);
+    else mpz_sub_ui(x,x,0UL - (unsigned long)d);
+}
+
+// Returns 1 when the numeral alone cannot take the step; what it has written
+// by then is overwritten by the seek the caller falls back on.
+
+static int tree_add(struct rxe *rxe, long delta)
+{
+    struct rxe_state *rs = RS(rxe);
+    struct rxe_alt *alt = rs->curr;
+    int l2r = rxe->flags & RXE_FLAG_LEFT_TO_RIGHT;
+    mpz_t *tmp = seek_tmp(rxe);
+    struct rxe_node *node, *last = NULL;
+    long c = delta;
+    for ( node = l2r ? alt->head : alt->tail ; node && c ;
+          node = l2r ? node->next : node->prev ) {
+        last = node;
+        if (node->is_repeat) {
+            if (rxe_repeat_advance(node,&c,l2r)) return 1;
+            // A run that would change length is a different block of the
+            // repetition, reached only by seeking.
+            if (c && node->rep_min != node->rep_max) return 1;
+        } else if (node->is_comb || node->is_policy || node->is_shuffle) {
+            return 1;
+        } else if (node->rxe && !node->is_backref) {
+            // A group is a digit whose value is its own index, in the radix of
+            // its own size. The group then takes the difference its way.
+            struct rxe *sub = node->rxe;
+            mpz_ptr q = tmp[T_Q], r = tmp[T_R], d = tmp[T_N];
+            if (sub->ninf || !mpz_sgn(sub->nitems)) return 1;
+            ri_get_mpz(d,RS(sub)->index);
+            mpz_set(r,d);
+            add_long(r,c);
+            mpz_fdiv_qr(q,r,r,sub->nitems);
+            c = mpz_get_si(q);
+            mpz_sub(d,r,d);
+            if (mpz_fits_slong_p(d) ? rxe_advance(sub,mpz_get_si(d))
+                                    : rxe_seek(sub,r)) return 1;
+        } else {
+            long n = node->is_dict ? node->nwords : node->len;
+            if (n <= 1) continue;
+            long q = c / n, v = NS(node)->iterator + c % n;
+            if (v >= n) { v -= n; q++; }
+            else if (v < 0) { v += n; q--; }
+            NS(node)->iterator = (int)v;
+            c = q;
+        }
+    }
+    if (c) return 1;
+    // The most significant node the sum reached is the first that moved, as
+    // rxe_iterate reckons it.
+    if (!l2r && !rs->moved_all && last) {
+        struct rxe_node *n;
+        for ( n = last ; n && n != rs->moved ; n = n->next ) ;
+        if (!rs->moved || n) rs->moved = last;
+    } else {
+        rs->moved_all = 1;
+    }
+    return 0;
+}
+
+int rxe_advance(struct rxe *rxe, long delta)
+{
+    if (!rxe) return 1;
+    struct rxe_state *rs = RS(rxe);
+    if (!rs->curr) return 1;
+    if (!delta) return 0;
+    // The sum is checked against the size, and a group's digit is carried in
+    // the radix of its own.
+    rxe_force_size(rxe);
+    if (rs->plan_live) {
+        if (!rxe_plan_advance(rxe->plan,rs->plan_state,delta)) return 0;
+        // The plan keeps no index; its digits are it.
+        mpz_ptr t = seek_tmp(rxe)[T_IDX];
+        rxe_plan_index(rxe->plan,rs->plan_state,t);
+        add_long(t,delta);
+        return rxe_seek(rxe,t);
+    }
+    mpz_ptr t = seek_tmp(rxe)[T_P];
+    ri_get_mpz(t,rs->index);
+    add_long(t,delta);
+    if (mpz_sgn(t) < 0 || (!rxe->ninf && mpz_cmp(t,rxe->nitems) >= 0))
+        return 1;
+    // Neither the filtered numbering nor byte order is the digits', so
+    // the sum is seeked.
+    if (rxe->filter || rxe->lex) return rxe_seek(rxe,t);
+    ri_set_mpz(rs->index,t);
+    if (rxe->ninf || tree_add(rxe,delta)) {
+        rs->moved_all = 1;
+        return tree_seek(rxe,index_mpz(rxe));
+    }
+    return 0;
+}
+
+#ifndef RXE_CURSOR_WALK
+
+int rxe_compile(struct rxe *rxe)
+{
+    if (!rxe) return 1;
+    if (rxe->plan) return 0;
+    // A plan walks every member, and a filtered set is walked only through
+    // the filter; one in byte order is walked off its automaton.
+    if (rxe->filter || rxe->lex) return 1;
+    // Laying a repeat re-parses its span, whose dictionaries are the image's
+    // if the expression came from one.
+    const struct rxe_baked *outer = rxe->baked ? rxe_baked_use(rxe->baked) : NULL;
+    rxe->plan = rxe_plan_build(rxe);
+    if (rxe->baked) rxe_baked_use(outer);
+    if (!rxe->plan) return 1;
+    rxe->walk.plan_state = rxe_plan_state_new(rxe->plan);
+    // Starts on the first member, where a freshly parsed tree starts. Building
+    // the plan seeked the subexpressions it baked, so the tree itself is no
+    // longer sitting there, and the plan has to be the one in charge.
+    rxe->walk.plan_live = rxe_plan_usable(rxe->plan);
+    return 0;
+}
+
+// Bring the tree to the member the plan stands on, for a reader of the tree's
+// own state. The plan stays in charge; the tree merely agrees with it until
+// the next step.
+
+void rxe_sync_tree(struct rxe *rxe)
+{
+    if (!rxe || !RS(rxe)->plan_live) return;
+    mpz_t pos;
+    mpz_init(pos);
+    rxe_plan_index(rxe->plan,RS(rxe)->plan_state,pos);
+    tree_seek(rxe,pos);
+    mpz_clear(pos);
+}
+
+void rxe_uncompile(struct rxe *rxe)
+{
+    if (!rxe || !rxe->plan) return;
+    rxe_sync_tree(rxe);
+    rxe_plan_state_free(rxe->walk.plan_state);
+    rxe_plan_unref(rxe->plan);
+    rxe->plan = NULL;
+    rxe->walk.plan_state = NULL;
+    rxe->walk.plan_live = 0;
+}
+
+int rxe_is_compiled(struct rxe *rxe)
+{
+    return rxe && rxe->plan && rxe_plan_usable(rxe->plan);
+}
+
+/* --------------------------- Shared tables ------------------------------ */
+
+// Whether two subexpressions are built alike, node for node: the same
+// characters, repeat bounds, dictionaries and kinds, in the same places, and
+// the same direction. Their counts by length are then the same, whatever
+// either is doing with them.
+
+static int same_shape(struct rxe *a, struct rxe *b)
+{
+    struct rxe_alt *aa, *ba;
+    struct rxe_node *an, *bn;
+    if (a->nalts != b->nalts ||
+        (a->flags ^ b->flags) & RXE_FLAG_LEFT_TO_RIGHT) return 0;
+    for ( aa = a->head, ba = b->head ; aa ; aa = aa->next, ba = ba->next ) {
+        if (aa->nnodes != ba->nnodes) return 0;
+        for ( an = aa->head, bn = ba->head ; an ; an = an->next, bn = bn->next ) {
+            if (an->len != bn->len || an->is_backref != bn->is_backref ||
+                an->is_repeat != bn->is_repeat || an->is_comb != bn->is_comb ||
+                an->is_policy != bn->is_policy || an->is_dict != bn->is_dict ||
+                an->comb_perm != bn->comb_perm ||
+                an->is_inf != bn->is_inf || an->words != bn->words ||
+                an->nwords != bn->nwords || !an->rxe != !bn->rxe)
+                return 0;
+            if (an->len && memcmp(an->str,bn->str,an->len)) return 0;
+            if ((an->is_repeat || an->is_comb || an->is_policy) &&
+                (an->rep_min != bn->rep_min || an->rep_max != bn->rep_max))
+                return 0;
+            if (an->rxe && !an->is_backref && !same_shape(an->rxe,bn->rxe))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static void set_twins(struct rxe *copy, struct rxe *orig)
+{
+    struct rxe_alt *ca, *oa;
+    struct rxe_node *cn, *on;
+    copy->twin = orig;
+    for ( ca = copy->head, oa = orig->head ; ca ; ca = ca->next, oa = oa->next ) {
+        ca->twin = oa;
+        for ( cn = ca->head, on = oa->head ; cn ; cn = cn->next, on = on->next ) {
+            cn->twin = on;
+            if (cn->rxe && !cn->is_backref)
+                set_twins(cn->rxe,on->rxe->twin ? on->rxe->twin : on->rxe);
+        }
+    }
+}
+
+// Hash-consing, for the part of a subexpression that is the same in every
+// copy of it: its counts by length. A (?N) subroutine is a deep copy of its
+// group, a template written out twenty times is twenty parses of the same
+// text, and a dictionary named in every field of a passphrase is one word
+// list behind many nodes. Each used to grow length tables of its own, node by
+// node, recounting the same convolutions in every copy. Only the iteration
+// state has to be separate -- which member each copy is on -- so a copy keeps
+// its nodes for that, and every table it would have grown is read from the
+// first of its shape instead: lens.c follows the twin pointers set here.
+//
+// Done once the parse is finished, when nothing will be demoted into a
+// repetition body or wrapped any more, and on the one tree: the original
+// lives exactly as long as its copies, since a parse is only ever freed
+// whole. A clone of the parse starts with no twins and counts for itself.
+
+static unsigned long mix(unsigned long h, unsigned long v)
+{
+    return (h ^ v) * 1099511628211UL;        // FNV-1a, a word at a time
+}
+
+static unsigned long shape_hash(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    int i;
+    unsigned long h = mix(1469598103934665603UL,rxe->nalts);
+    h = mix(h,rxe->flags & RXE_FLAG_LEFT_TO_RIGHT);
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        h = mix(h,alt->nnodes);
+        for ( node = alt->head ; node ; node = node->next ) {
+            h = mix(h,node->len);
+            for (i=0;i<node->len;i++) h = mix(h,(unsigned char)node->str[i]);
+            h = mix(h,node->is_repeat | node->is_comb << 1 |
+                      node->is_policy << 2 | node->is_dict << 3 |
+                      node->is_backref << 4);
+            h = mix(h,(unsigned long)node->rep_min);
+            h = mix(h,(unsigned long)node->rep_max);
+            h = mix(h,(unsigned long)(size_t)node->words);
+            if (node->rxe && !node->is_backref)
+                h = mix(h,shape_hash(node->rxe));
+        }
+    }
+    return h;
+}
+
+struct intern {
+    int size;                     // slots, a power of two
+    unsigned long *hash;
+    struct rxe **rxe;             // the first subexpression of each shape
+    struct rxe_node **dict;       // the first node of each word list
+    int ndict;
+};
+
+static int count_groups(struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    int n = 0;
+    for ( alt = rxe->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (node->is_dict) n++;
+            if (node->rxe && !node->is_backref)
+                n += 1 + count_groups(node->rxe);
+        }
+    return n;
+}
+
+// Top down, so that the largest shared subexpression is found first, and
+// never into a copy, whose nodes are all twins already.
+
+static void intern_walk(struct intern *t, struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    int i;
+    for ( alt = rxe->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (node->is_dict) {
+                for (i=0;i<t->ndict;i++)
+                    if (t->dict[i]->words == node->words &&
+                        t->dict[i]->nwords == node->nwords) break;
+                if (i < t->ndict) node->twin = t->dict[i];
+                else t->dict[t->ndict++] = node;
+            }
+            if (!node->rxe || node->is_backref) continue;
+            struct rxe *sub = node->rxe;
+            unsigned long h = shape_hash(sub);
+            for ( i = h & (t->size-1) ; t->rxe[i] ; i = (i+1) & (t->size-1) )
+                if (t->hash[i] == h && same_shape(sub,t->rxe[i])) break;
+            if (t->rxe[i]) {
+                set_twins(sub,t->rxe[i]);
+                continue;
+            }
+            t->hash[i] = h;
+            t->rxe[i] = sub;
+            intern_walk(t,sub);
+        }
+}
+
+static void intern_tree(struct rxe *root)
+{
+    struct intern t;
+    int n = count_groups(root);
+    if (n < 2) return;
+    for ( t.size = 4 ; t.size < 2*n ; t.size *= 2 ) ;
+    t.hash = NEW(t.size,unsigned long);
+    t.rxe  = NEW(t.size,struct rxe *);
+    t.dict = NEW(n,struct rxe_node *);
+    t.ndict = 0;
+    memset(t.rxe,0,t.size * sizeof *t.rxe);
+    intern_walk(&t,root);
+    rxe_mem_free(t.hash);
+    rxe_mem_free(t.rxe);
+    rxe_mem_free(t.dict);
+}
+
+/* ------------------------------------------------------------------------ */
+
 struct rxe *rxe_parse(const char *str, int flags)
 {
     if (!rxe_initialized) rxe_init();
+    struct rxe_arena *arena = flags & RXE_ARENA ? arena_new() : NULL;
+    struct rxe_arena *outer = arena_use(arena);
     struct rxe *rxe = rxe_new();
+    rxe->arena = arena;
+    rxe->options = flags;
     rxe->brt = rxe_backref_table_new(10);
     rxe->flags |= RXE_FLAG_HAS_BKRTABLE;
     // Keep a private copy of the input, so node spans can point into it and
     // outlive the caller's string. The parse runs over this copy, so every
     // offset it records is relative to source itself.
     size_t slen = strlen(str);
-    rxe->source = NEW(slen + 1, char);
+    rxe->source = TREE_NEW(slen + 1, char);
     memcpy(rxe->source, str, slen + 1);
     const char *base = rxe->source, *p = rxe->source;
     if (*p == '^') p++;
     parse(rxe,rxe->nitems,p,flags,0,base);
+    if (!rxe->status) intern_tree(rxe);
+    // Deferred counts are walked past only in place value, the one order that
+    // indexes by them; anything else has them worked out now. That is an
+    // endless set, whose order counts by length, and anything whose own order
+    // is not the numeral's.
+    rxe_note_deferred(rxe);
+    if (rxe->deferred && (rxe->status || rxe_is_infinite(rxe)
+                          || tree_has_backref(rxe)))
+        rxe_force_size(rxe);
+    // A library built on a machine word can count no further than the word,
+    // so a finite set it could not count is refused here, once, rather than
+    // enumerated with counts that have quietly pinned. Under GMP this never
+    // fires. A deferred count is wider than any word already.
+    if (!rxe->status && rxe->deferred && RXE_INT_BITS)
+        rxe->status = RXE_EXCEEDS_INT;
+    else if (!rxe->status && !rxe_is_infinite(rxe)) {
+        rxe_int n;
+        ri_init(n);
+        if (ri_set_mpz(n,rxe->nitems)) rxe->status = RXE_EXCEEDS_INT;
+        ri_clear(n);
+    }
     // Only an infinite expression is enumerated by length; a finite one is a
     // numeral and keeps the order it has always had, which the radix
     // conversion in the manual page depends on.
     if (!rxe->status && rxe_is_infinite(rxe) && !tree_has_backref(rxe))
         mark_shortlex(rxe);
+    // A distinct set is numbered off its automaton, whatever the tree's order,
+    // and so is a set in byte order.
+    if (!rxe->status && (flags & RXE_DISTINCT))
+        rxe->status = rxe_lex_distinct(rxe);
+    else if (!rxe->status && (flags & RXE_BYTE_ORDER))
+        rxe->status = rxe_lex_byte_order(rxe);
+    // Planned once the order is settled, since the order decides whether there
+    // can be a plan at all. Not while a plan is being built: laying a variable
+    // repeat re-parses its span, and planning that would lay it again.
+    if (!rxe->status && !rxe_plan_building) rxe_compile(rxe);
+    if (!rxe->status) number_tree(rxe);
+    arena_use(outer);
     return rxe;
 }
 
+// An expression's share of a walk, as a fresh parse leaves it: on its first
+// alternation, at index zero, nothing counted. A plan or an automaton gets a
+// state of its own to walk it with when the walk is a cursor's; see
+// rxe_walk_new.
+
+static void rxe_state_init(struct rxe_state *s, struct rxe *rxe)
+{
+    s->curr = rxe->head;
+    ri_init(s->index);
+    rxe_lens_init(&s->lens);
+    s->sl_len = -1;
+    s->moved = NULL;
+    s->moved_all = 1;
+    s->out_len = 0;
+    s->plan_state = NULL;
+    s->plan_live = 0;
+    s->tmp = NULL;
+    s->dim = NULL;
+    s->ndim = 0;
+    s->lex_state = NULL;
+}
+
+static void rxe_state_free(struct rxe_state *s)
+{
+    int i;
+    ri_clear(s->index);
+    rxe_lens_free(&s->lens);
+    rxe_plan_state_free(s->plan_state);
+    rxe_lex_state_free(s->lex_state);
+    if (s->tmp) {
+        for (i=0;i<T_FIXED;i++) mpz_clear(s->tmp[i]);
+        rxe_mem_free(s->tmp);
+    }
+    if (s->dim) {
+        for (i=0;i<s->ndim;i++) mpz_clear(s->dim[i]);
+        rxe_mem_free(s->dim);
+    }
+}
+
 struct rxe *rxe_new(void)
 {
 
-    struct rxe *rxe = NEW(1,struct rxe);
-    rxe->head = rxe-> tail = rxe->curr = NULL;
+    struct rxe *rxe = TREE_NEW(1,struct rxe);
+    rxe->head = rxe-> tail = NULL;
     rxe->nalts = 0;
     rxe->ninf = 0;
     rxe->status = RXE_OK;
@@ -474,12 +1433,18 @@ struct rxe *rxe_new(void)
     rxe->brt = NULL;
     rxe->flags = 0;
     rxe->source = NULL;
-    rxe->rank_cap = NULL;
-    rxe->rank_cap_len = 0;
-    rxe->rank_cap_set = 0;
+    rxe->plan = NULL;
+    rxe->deferred = 0;
     mpz_init(rxe->nitems);
-    mpz_init(rxe->index);
-    rxe_lens_init(&rxe->lens);
+    rxe->twin = NULL;
+    rxe->arena = NULL;
+    rxe->baked = NULL;
+    rxe->options = 0;
+    rxe->filter = NULL;
+    rxe->lex = NULL;
+    rxe->slot = 0;
+    rxe->nslots[0] = rxe->nslots[1] = rxe->nslots[2] = 0;
+    rxe_state_init(&rxe->walk,rxe);
     return rxe;
 }
 
@@ -499,8 +1464,8 @@ void rxe_node_deep_clone(struct rxe_alt *alt, struct rxe_node *src_node)
     }
     if (src_node->len) {
         dst_node->len = src_node->len;
-        assert(src_node->len<256);
-        dst_node->str = NEW(dst_node->len,char);
+        assert(src_node->len<=256);    // a class can hold every byte
+        dst_node->str = TREE_NEW(dst_node->len,char);
         memcpy(dst_node->str,src_node->str,dst_node->len);
     }
     dst_node->is_backref = src_node->is_backref;
@@ -510,21 +1475,27 @@ void rxe_node_deep_clone(struct rxe_alt *alt, struct rxe_node *src_node)
     dst_node->src_start  = src_node->src_start;
     dst_node->src_end    = src_node->src_end;
     dst_node->refers_to  = src_node->refers_to;
-    // A dictionary node borrows its words, so the copy borrows the same ones.
+    // A dictionary node holds a reference to its words, and the copy takes
+    // another to the same ones.
     dst_node->is_dict    = src_node->is_dict;
     dst_node->nwords     = src_node->nwords;
-    dst_node->words      = src_node->words;
+    dst_node->words      = rxe_words_ref(src_node->words);
     mpz_set(dst_node->nitems,src_node->nitems);
     if (src_node->is_repeat) {
         // rxe_repeat_make recomputes nitems from the subexpression, so the
         // copy above is redundant here but harmless, and the clone starts at
         // the first item rather than wherever the original happens to sit.
-        rxe_repeat_make(dst_node,src_node->rep_min,src_node->rep_max);
+        // A count the original put off, the copy puts off the same way.
+        if (src_node->size_log2 > 0)
+            rxe_repeat_make_lazy(dst_node,src_node->rep_min,src_node->rep_max);
+        else
+            rxe_repeat_make(dst_node,src_node->rep_min,src_node->rep_max);
     } else if (src_node->is_comb) {
         // Likewise a combination is rebuilt from its subexpression and size
         // range, starting at its first choice.
         rxe_comb_make(dst_node,src_node->rep_min,src_node->rep_max,
                       src_node->comb_perm);
+        dst_node->comb_chop = src_node->comb_chop;
     } else if (src_node->is_policy) {
         // A policy composition is rebuilt from its subexpression's branches,
         // its length range, and its floors.
@@ -535,8 +1506,8 @@ void rxe_node_deep_clone(struct rxe_alt *alt, struct rxe_node *src_node)
         // A shuffled group carries the same key; clone the permutation and
         // start it at its first member.
         dst_node->is_shuffle = 1;
-        dst_node->shuffle = rxe_permutation_clone(src_node->shuffle);
-        mpz_set_ui(dst_node->comb_index,0);
+        dst_node->walk.shuffle = rxe_permutation_clone(src_node->walk.shuffle);
+        mpz_set_ui(dst_node->walk.comb_index,0);
         mpz_t z;
         mpz_init_set_ui(z,0);
         rxe_shuffle_seek(dst_node,z);
@@ -544,19 +1515,68 @@ void rxe_node_deep_clone(struct rxe_alt *alt, struct rxe_node *src_node)
     }
 }
 
+// The group in a copy that sits where 'target' sits in the original, found by
+// walking the two trees in step. NULL when the target is not in this subtree.
+
+static struct rxe *counterpart(struct rxe *src, struct rxe *dst,
+                               struct rxe *target)
+{
+    struct rxe_alt *sa, *da;
+    struct rxe_node *sn, *dn;
+    if (src == target) return dst;
+    for ( sa = src->head, da = dst->head ; sa && da ; sa = sa->next, da = da->next )
+        for ( sn = sa->head, dn = da->head ; sn && dn ; sn = sn->next, dn = dn->next ) {
+            struct rxe *found;
+            if (!sn->rxe || sn->is_backref) continue;
+            if ((found = counterpart(sn->rxe,dn->rxe,target))) return found;
+        }
+    return NULL;
+}
+
+// A copy of a whole parse must not share its groups with the original, or its
+// backreferences would spell whatever the original's groups were last left at
+// rather than what the copy's own groups hold. Point each at its counterpart.
+
+static void repoint_backrefs(struct rxe *src_root, struct rxe *dst_root,
+                             struct rxe *dst)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    for ( alt = dst->head ; alt ; alt = alt->next )
+        for ( node = alt->head ; node ; node = node->next ) {
+            if (!node->rxe) continue;
+            if (node->is_backref) {
+                struct rxe *mine = counterpart(src_root,dst_root,node->rxe);
+                if (mine) node->rxe = mine;
+            } else {
+                repoint_backrefs(src_root,dst_root,node->rxe);
+            }
+        }
+}
+
 struct rxe *rxe_deep_clone(struct rxe *src_rxe)
 {
+   // A tree carved from an arena is cloned into one of its own. Anything
+   // else -- a subexpression copied for a (?N), or a part of the tree being
+   // cloned -- goes wherever the tree being built around it does.
+   struct rxe_arena *arena = NULL, *outer = NULL;
+   if (src_rxe->arena) outer = arena_use(arena = arena_new());
    struct rxe *dst_rxe = rxe_new();
+   dst_rxe->arena = arena;
+   // The image's dictionaries go along too, for their names when it is saved.
+   dst_rxe->baked = rxe_baked_ref(src_rxe->baked);
    struct rxe_alt *src_alt;
    // Carry the subexpression's own flags across -- the enumeration direction
    // among them -- but never the ownership bit: only the root owns the
    // backreference table, and this clone has none to free.
    dst_rxe->flags = src_rxe->flags & ~RXE_FLAG_HAS_BKRTABLE;
    dst_rxe->ninf  = src_rxe->ninf;
+   dst_rxe->deferred = src_rxe->deferred;
    mpz_set(dst_rxe->nitems,src_rxe->nitems);
    for ( src_alt = src_rxe->head ; src_alt ; src_alt = src_alt->next ) {
        struct rxe_alt *dst_alt = rxe_new_alt(dst_rxe);
        dst_alt->ninf = src_alt->ninf;
+       dst_alt->deferred = src_alt->deferred;
        mpz_set(dst_alt->nitems,src_alt->nitems);
        mpz_set(dst_alt->start,src_alt->start);
        struct rxe_node *src_node;
@@ -564,12 +1584,49 @@ struct rxe *rxe_deep_clone(struct rxe *src_rxe)
            rxe_node_deep_clone(dst_alt,src_node);
        }
    }
+   // Only a whole parse -- the root, which owns the backreference table -- is
+   // copied in full. A subexpression copied for a (?N) subroutine keeps its
+   // backreferences aimed at the groups they were numbered after.
+   if (src_rxe->flags & RXE_FLAG_HAS_BKRTABLE) {
+       repoint_backrefs(src_rxe,dst_rxe,dst_rxe);
+       number_tree(dst_rxe);
+   }
+   // The plan is read-only and owns its bytes, so a clone shares it rather than
+   // building its own, and only gets a state of its own to walk it with. Like a
+   // fresh parse, the clone starts on the first member.
+   if (src_rxe->plan) {
+       dst_rxe->plan = rxe_plan_ref(src_rxe->plan);
+       dst_rxe->walk.plan_state = rxe_plan_state_new(dst_rxe->plan);
+       dst_rxe->walk.plan_live = rxe_plan_usable(dst_rxe->plan);
+   }
+   // The filter is read-only too, and shared the same way; the clone is then
+   // put on the first member that passes it.
+   if (src_rxe->filter) {
+       dst_rxe->filter = rxe_filter_ref(src_rxe->filter);
+       mpz_t z;
+       mpz_init(z);
+       if (rxe_seek(dst_rxe,z)) dst_rxe->walk.curr = NULL;
+       mpz_clear(z);
+   }
+   // So is the automaton of a set in byte order; the clone walks it from the
+   // first member with a state of its own.
+   if (src_rxe->lex) {
+       dst_rxe->lex = rxe_lex_ref(src_rxe->lex);
+       dst_rxe->walk.lex_state = rxe_lex_state_new(dst_rxe->lex);
+       mpz_t z;
+       mpz_init(z);
+       if (rxe_seek(dst_rxe,z)) dst_rxe->walk.curr = NULL;
+       mpz_clear(z);
+   }
+   if (arena) arena_use(outer);
    return dst_rxe;
 }
 
 void rxe_free(struct rxe *rxe)
 {
     struct rxe_alt *alt,*next;
+    struct rxe_arena *arena = rxe->arena, *outer = NULL;
+    if (arena) outer = arena_use(arena);
     for ( alt = rxe->head ; alt ; alt = next ) {
         next = alt->next;
         rxe_free_alt(alt);
@@ -577,20 +1634,120 @@ void rxe_free(struct rxe *rxe)
     if (rxe->flags & RXE_FLAG_HAS_BKRTABLE)
         rxe_backref_table_free(rxe->brt);
     mpz_clear(rxe->nitems);
-    mpz_clear(rxe->index);
-    rxe_lens_free(&rxe->lens);
-    if (rxe->source) rxe_mem_free(rxe->source);   // root only; NULL elsewhere
-    rxe_mem_free(rxe);
+    rxe_state_free(&rxe->walk);
+    rxe_plan_unref(rxe->plan);
+    rxe_filter_unref(rxe->filter);
+    rxe_lex_unref(rxe->lex);
+    if (rxe->source) kfree_tree(rxe->source);     // root only; NULL elsewhere
+    rxe_baked_unref(rxe->baked);
+    kfree_tree(rxe);
+    if (arena) {
+        arena_use(outer);
+        arena_free(arena);
+    }
+}
+
+/* -------------------------------- Walks --------------------------------- */
+
+// Every expression, alternation and node of a whole parse gets a slot, in
+// tree order, numbered apart for the three; a walk is then three arrays
+// indexed by them. A backreference's group is numbered where it is parsed,
+// and the reference reads it there, as it reads the tree's own.
+
+static void number(struct rxe *rxe, int *n)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    rxe->slot = n[0]++;
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        alt->slot = n[1]++;
+        for ( node = alt->head ; node ; node = node->next ) {
+            node->slot = n[2]++;
+            if (node->rxe && !node->is_backref) number(node->rxe,n);
+        }
+    }
+}
+
+static void number_tree(struct rxe *root)
+{
+    root->nslots[0] = root->nslots[1] = root->nslots[2] = 0;
+    number(root,root->nslots);
+}
+
+static void walk_init(struct rxe_walk *w, struct rxe *rxe)
+{
+    struct rxe_alt *alt;
+    struct rxe_node *node;
+    rxe_state_init(&w->rxe[rxe->slot],rxe);
+    for ( alt = rxe->head ; alt ; alt = alt->next ) {
+        rxe_alt_state_init(&w->alt[alt->slot],alt);
+        for ( node = alt->head ; node ; node = node->next ) {
+            struct rxe_node_state *ns = &w->node[node->slot];
+            rxe_node_state_init(ns);
+            // The permutation's mapping writes scratch of its own, so each
+            // walk maps through a copy of the key's.
+            if (node->walk.shuffle)
+                ns->shuffle = rxe_permutation_clone(node->walk.shuffle);
+            if (node->rxe && !node->is_backref) walk_init(w,node->rxe);
+        }
+    }
+}
+
+// The counts are settled first, since a deferred one is filled in on the tree
+// the first time a seek needs it, and this walk must not be that seek; see
+// rxe_force_size for why that is safe however many threads make walks at once.
+// The slots were numbered when the tree was parsed or cloned.
+
+struct rxe_walk *rxe_walk_new(struct rxe *root)
+{
+    rxe_force_size(root);
+    struct rxe_walk *w = NEW(1,struct rxe_walk);
+    int i;
+    for (i=0;i<3;i++) w->nslots[i] = root->nslots[i];
+    w->rxe  = NEW(w->nslots[0],struct rxe_state);
+    w->alt  = NEW(w->nslots[1] ? w->nslots[1] : 1,struct rxe_alt_state);
+    w->node = NEW(w->nslots[2] ? w->nslots[2] : 1,struct rxe_node_state);
+    walk_init(w,root);
+    struct rxe_state *rs = &w->rxe[root->slot];
+    if (root->plan) rs->plan_state = rxe_plan_state_new(root->plan);
+    if (root->lex)  rs->lex_state  = rxe_lex_state_new(root->lex);
+    mpz_t z;
+    mpz_init(z);
+    if (rxe_walk_seek(w,root,z) && (root->filter || root->lex))
+        rs->curr = NULL;
+    mpz_clear(z);
+    return w;
+}
+
+void rxe_walk_free(struct rxe_walk *w)
+{
+    int i;
+    if (!w) return;
+    for (i=0;i<w->nslots[0];i++) rxe_state_free(&w->rxe[i]);
+    for (i=0;i<w->nslots[1];i++) rxe_alt_state_free(&w->alt[i]);
+    for (i=0;i<w->nslots[2];i++) rxe_node_state_free(&w->node[i]);
+    rxe_mem_free(w->rxe);
+    rxe_mem_free(w->alt);
+    rxe_mem_free(w->node);
+    rxe_mem_free(w);
 }
 
 /* ---------------------------- Support Routines -------------------------- */
 
+static _Thread_local unsigned long alloc_calls;
+
+unsigned long rxe_alloc_calls(void)
+{
+    return alloc_calls;
+}
+
 void *kmalloc(size_t size, const char *file, int line)
 {
     // Any public entry point can be the first one called -- creating a
     // permutation before parsing anything, for instance -- so the allocator
     // has to be in place here rather than only in rxe_parse.
     if (!rxe_initialized) rxe_init();
+    alloc_calls++;
     void *p = rxe_mem_alloc(size);
     if (p) return p;
     // The hook is expected not to return, but nothing enforces that, and
@@ -606,3 +1763,106 @@ void kmalloc_failed(size_t size, const char *file, int line)
     exit(111);
 }
 
+// RXE_ARENA's blocks, each carved front to back and chained newest first; only
+// the newest still has room. Nothing carved is handed back until the whole
+// arena is, so kfree_tree need only recognise arena memory, which it does by
+// address: blocks double in size, and a tree of thousands of nodes fits in a
+// handful of them.
+//
+// The arena in use is per thread and set only for the length of a parse, a
+// clone or a free of its tree. A tree is only ever built or freed whole, by
+// one thread, and what is allocated afterwards -- seek temporaries, length
+// tables, repetition digits -- comes from the heap whatever the tree, because
+// it grows and is freed piecemeal.
+
+#define ARENA_FIRST_BLOCK   (16*1024)
+#define ARENA_LARGEST_BLOCK (1024*1024)
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size, used;
+    max_align_t data[];
+};
+
+struct rxe_arena {
+    struct arena_block *head;
+    size_t next_size;               // what the next block will hold
+};
+
+static _Thread_local struct rxe_arena *arena_in_use;
+
+static struct rxe_arena *arena_new(void)
+{
+    struct rxe_arena *arena = NEW(1,struct rxe_arena);
+    arena->head = NULL;
+    arena->next_size = ARENA_FIRST_BLOCK;
+    return arena;
+}
+
+static void arena_free(struct rxe_arena *arena)
+{
+    struct arena_block *b, *next;
+    if (!arena) return;
+    for ( b = arena->head ; b ; b = next ) {
+        next = b->next;
+        rxe_mem_free(b);
+    }
+    rxe_mem_free(arena);
+}
+
+// Makes 'arena' the one in use and returns the one it replaces, for putting
+// back. NULL means the heap: a pattern parsed without the flag while another
+// is being parsed with it -- the plan re-parses spans -- must not land in it.
+static struct rxe_arena *arena_use(struct rxe_arena *arena)
+{
+    struct rxe_arena *was = arena_in_use;
+    arena_in_use = arena;
+    return was;
+}
+
+static void *arena_take(struct rxe_arena *arena, size_t size,
+                        const char *file, int line)
+{
+    const size_t unit = sizeof(max_align_t);
+    // Never zero: an empty character class still gets a pointer, and one just
+    // past a full block would not be recognised as the arena's.
+    size = size ? (size + unit - 1) / unit * unit : unit;
+    struct arena_block *b = arena->head;
+    if (!b || b->size - b->used < size) {
+        size_t room = arena->next_size > size ? arena->next_size : size;
+        b = kmalloc(sizeof *b + room,file,line);
+        if (!b) return NULL;
+        b->size = room;
+        b->used = 0;
+        b->next = arena->head;
+        arena->head = b;
+        if (arena->next_size < ARENA_LARGEST_BLOCK) arena->next_size *= 2;
+    }
+    void *p = (char *)b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+static int arena_owns(const struct rxe_arena *arena, const void *p)
+{
+    const struct arena_block *b;
+    for ( b = arena->head ; b ; b = b->next )
+        if ((const char *)p >= (const char *)b->data &&
+            (const char *)p <  (const char *)b->data + b->size) return 1;
+    return 0;
+}
+
+void *kmalloc_tree(size_t size, const char *file, int line)
+{
+    if (arena_in_use) return arena_take(arena_in_use,size,file,line);
+    return kmalloc(size,file,line);
+}
+
+void kfree_tree(void *p)
+{
+    if (!p) return;
+    if (arena_in_use && arena_owns(arena_in_use,p)) return;
+    rxe_mem_free(p);
+}
+
+#endif
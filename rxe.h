@@ -19,6 +19,7 @@
 
 #include <gmp.h>
 #include <stdlib.h>
+#include "rxe_int.h"
 
 #define RXE_VERSION "1.1.0"
 
@@ -30,6 +31,32 @@
 #define RXE_CASELESS                 0x0001
 #define RXE_DOTALL                   0x0002
 #define RXE_LEFT_TO_RIGHT            0x0004
+// Count lazily: leave the cardinality of a repetition too large to be worth
+// working out (see RXE_DEFER_BITS) until something asks for it, so the first
+// members of '([a-z]{1,10000}){1,3000}' come as fast as those of '[a-z]'. Only
+// rxe->nitems is affected: it is exact once rxe_force_size has run, and until
+// then is not the size of the set. rxe_log2_size estimates it either way.
+#define RXE_LAZY_SIZE                0x0008
+// Carve the tree from a few large blocks instead of one allocation per node,
+// alternation and string, for a caller that parses and frees patterns by the
+// thousand. The blocks go back in one go when the tree is freed, and a clone
+// of the tree gets blocks of its own. Counts and temporaries, which grow after
+// the parse, are allocated as usual.
+#define RXE_ARENA                    0x0010
+// For rxe_parse_filtered: keep the members the filter does not match, rather
+// than those it does.
+#define RXE_FILTER_EXCLUDE           0x0020
+// Number the distinct strings of a finite set rather than its spellings, in
+// byte order: '(a|a){22}' then has one member, not four million, and
+// '(19|20)?[0-9]{2}|[0-9]{4}' has the 10100 strings it matches. nitems, seek,
+// iterate, advance and rank all work on that set. See lex.c.
+#define RXE_DISTINCT                 0x0040
+// Keep every member of a finite set, but number them in byte order: each
+// string as many times over as the pattern spells it, its repeats side by
+// side, so '(a|b|a)' is a, a, b. seek and rank work in that order, and a walk
+// finds every duplicate by comparing a member with the one before. RXE_DISTINCT
+// is that order with the repeats left out, and wins if both are given.
+#define RXE_BYTE_ORDER               0x0080
 
 // Flags recorded on the parse tree itself, in struct rxe's 'flags' field.
 // These used to be #defined in two separate .c files, out of sight of each
@@ -54,12 +81,29 @@
 // the cardinality stays unbounded, and seeking still reaches every index.
 #define RXE_DEFAULT_MAX_MEMBER       (1u<<20)   // one mebibyte
 
+// A repetition over a small body keeps the body's members as it renders them,
+// so the next time a position holds the same index it is copied rather than
+// seeked and rendered again. Only a body with at most RXE_MEMO_ITEMS members
+// is kept, at most RXE_MEMO_BYTES of them per repetition, each shorter than
+// RXE_MEMO_ITEM_LEN; past either limit positions render the slow way.
+#define RXE_MEMO_ITEMS               4096
+#define RXE_MEMO_BYTES               (1<<16)
+#define RXE_MEMO_ITEM_LEN            256
+
 // A hard ceiling on a fixed repetition count, well above any real use, that
 // keeps '{n}' from overflowing the int it is parsed into (and from demanding a
 // cardinality integer the size of a disk). Distinct from the soft byte cap
 // above: this one bounds the count, not the rendered size.
 #define RXE_MAX_REPEAT               (100*1000*1000)
 
+// Under RXE_LAZY_SIZE, a repetition whose count would run to more bits than
+// this is not counted at parse. Below it the geometric sum costs less than the
+// bookkeeping to put it off; past it the sum is a division of numbers megabits
+// wide, and it is paid again for every group that repeats it. An index shorter
+// than the deferred counts -- every index a walk from the start will ever
+// reach -- is still seeked without them.
+#define RXE_DEFER_BITS               (1L<<18)
+
 // A policy composition '(A|B|...){{n,m!...}}' counts by a dynamic program that
 // is quadratic in the length bound, so the bound is capped well above any real
 // password length (its members are short by nature) to keep counting instant.
@@ -68,11 +112,24 @@
 #define RXE_POLICY_MAX_LEN           4096
 #define RXE_POLICY_MAXCLASS          256
 
+// The most states a filter's automaton may have once determinised and
+// minimised (see dfa.c). Every count and seek of a filtered set carries a
+// bignum per state across the tree, so the cap is on the cost of each of
+// those as much as on memory; a filter past it is refused with
+// RXE_AUTOMATON_TOO_BIG.
+#define RXE_FILTER_MAX_STATES        4096
+
+// The most states the automaton of an RXE_DISTINCT set may have. It holds a
+// bignum per state, and a row of moves; a set past it is refused with
+// RXE_AUTOMATON_TOO_BIG rather than the host run out of memory building it.
+#define RXE_DISTINCT_MAX_STATES      (1<<16)
+
 #define RXE_FLAG_CLOSED_BRACKET      0x0100
 #define RXE_FLAG_HAS_BKRTABLE        0x0200
 #define RXE_FLAG_VARIABLE_REPEAT     0x0400
 #define RXE_FLAG_LEFT_TO_RIGHT       0x0800
 #define RXE_FLAG_SHORTLEX            0x1000
+#define RXE_FLAG_BACKREFERENCED      0x2000
 
 /* -------------------------- Global Declarations ------------------------- */
 
@@ -118,7 +175,22 @@
     X(RXE_POLICY_WIDTH,                                                        \
       "policy composition needs single-character alternatives")                \
     X(RXE_POLICY_SOAKER,                "at most one policy soaker ('+')")     \
-    X(RXE_TOO_BIG,                      "member too large to materialize")
+    X(RXE_TOO_BIG,                      "member too large to materialize")     \
+    X(RXE_BAD_IMAGE,                    "not an expression image, or a damaged one") \
+    X(RXE_WRONG_IMAGE_VERSION,          "expression image of another version") \
+    X(RXE_IMAGE_COUNT,                                                         \
+      "expression image counts its set differently from this library")       \
+    X(RXE_BAD_FILTER,                   "the filter pattern does not parse")  \
+    X(RXE_FILTER_SET,                                                          \
+      "a filtered set must be finite, with no backreference, choice, policy or shuffle") \
+    X(RXE_NOT_REGULAR,                                                         \
+      "not regular: a backreference, choice or policy")                       \
+    X(RXE_AUTOMATON_TOO_BIG,            "automaton too large")                \
+    X(RXE_DISTINCT_SET,                 "a duplicate-free set must be finite") \
+    X(RXE_BYTE_ORDER_SET,               "a set in byte order must be finite") \
+    X(RXE_NO_MEMORY,                    "out of memory")                      \
+    X(RXE_EXCEEDS_INT,                                                         \
+      "set too large for the integer width this library was built with")
 
 enum rxe_parse_status {
 #define RXE_STATUS_ENUM_ENTRY(name,msg) name,
@@ -142,6 +214,12 @@ enum rxe_parse_status {
 
 struct rxe;         // forward definitions needed due to the recursive...
 struct rxe_node;    // ...nature of the data structures
+struct rxe_split;   // A long alternation's place values; see rxe_alt.c
+struct rxe_filter;  // A second pattern members must match; see filter.c
+struct rxe_lex;     // A set numbered off its automaton; see lex.c
+struct rxe_lex_state;
+struct rxe_plan_state;
+struct rxe_permutation;
 
 // How many members an expression has of each length, rather than in total.
 //
@@ -162,21 +240,95 @@ struct rxe_lens {
     mpz_t *count;                 // count[L] members of length exactly L
 };
 
+// Where a walk stands, apart from what it walks.
+//
+// The tree is the set; a walk is a position in it. Every field a seek, a step
+// or a render writes -- the alternation and node chosen, a repetition's count
+// and digits, where the last render put each part, the scratch the arithmetic
+// reuses, and the tables a walk by length fills in as it goes -- is in one of
+// these, one per expression, alternation and node. The tree holds one of each
+// for its own walk, which rxe_seek and rxe_iterate move as they always have. A
+// cursor holds a whole set of its own (struct rxe_walk, below), and its calls
+// run a build of the same code that reads and writes there instead, so any
+// number of cursors walk one tree and none of them writes to it.
+
+struct rxe_alt_state {
+    struct rxe_node *curr;        // Current node being iterated
+    struct rxe_split *split;      // Under a wide seek of many positions, their
+                                  //   place values multiplied up in pairs
+    struct rxe_lens lens;         // Members by length, over all its nodes
+};
+
+struct rxe_node_state {
+    int   iterator;               // Current item being iterated
+    mpz_t comb_index;             // When is_comb or is_shuffle: current index
+    struct rxe_permutation *shuffle; // The keyed permutation, when is_shuffle;
+                                  //   its mapping writes scratch of its own
+    int   rep_count;              // Repetitions currently selected
+    int   rep_alloc;              // How many digit entries are live
+    mpz_t *rep_digit;             // One index into rxe per position
+    unsigned long *rep_word;      //   ...or, when rxe's count fits a word, these
+    int   *rep_len;               // That position's length, in length order
+    mpz_t *rep_pow;               // Under a wide seek: rxe's count squared and
+    mpz_t *rep_quo;               //   squared again, and a quotient for each
+    int   rep_npow;               //   of those worked out, see repeat.c
+    unsigned char *rep_fit;       // Under shortlex: whether k positions can
+    int   rep_fit_k, rep_fit_l;   //   fill length l exactly, for k, l up to these
+    int   sl_len;                 // Under shortlex: the length this node takes
+                                  //   in the current member
+    int   out_at;                 // Where it landed in the last render
+    int   *rep_at;                //   ...and where each of its positions did
+    int   rep_moved;              // The first position moved since that render
+    int   memo_ok;                // Whether rxe's members are kept: -1 undecided
+    char  *memo;                  // Those kept, end to end
+    int   *memo_at;               //   where each index's begins, -1 if not yet
+                                  //   kept, -2 if it never will be
+    unsigned char *memo_n;        //   ...and how long it is
+    int   memo_len;               //   bytes of memo in use
+    mpz_t *tmp;                   // Temporaries a repetition's or a shuffle's
+                                  //   seek reuses, made on first use
+    struct rxe_lens lens;         // Members of this node by length
+    struct rxe_lens rest;         // ...of every node less significant than it
+};
+
+struct rxe_state {
+    struct rxe_alt *curr;          // current item being iterated
+    rxe_int index;                 // index the expression currently sits at,
+                                  // stepped with every member; see rxe_int.h
+    struct rxe_lens lens;          // Members by length, over all its alternations
+    int sl_len;                    // under shortlex, the current member's length;
+                                  // -1 until a seek by length has placed it
+    struct rxe_node *moved;        // the first node stepped since the last render,
+    int moved_all;                 // ...or whether all may have; and that
+    int out_len;                   // render's length. See rxe_current_delta
+    struct rxe_plan_state *plan_state; // root only: where it stands in the plan
+    int   plan_live;               // whether the plan, not the tree, holds the
+                                  // current member: set by whichever seeked last
+    mpz_t *tmp;                    // temporaries its seek reuses, made on first use
+    mpz_t *dim;                    // ...and the dimensions an endless alternation
+    int    ndim;                   // is spread over, as many as seeked so far
+    struct rxe_lex_state *lex_state; // root only: where it stands in the
+                                  // automaton, under RXE_DISTINCT; see lex.c
+};
+
 // An alternation node, arranged as a doubly linked list with head and tail
 // anchors in 'struct rxe'.
 
 struct rxe_alt {
     int nnodes;                   // Number of nodes in this alternation
     int ninf;                     // How many of its nodes are infinite
-    struct rxe_lens lens;         // Members by length, over all its nodes
+    struct rxe_alt *twin;         // Its counterpart in an identical subexpression
+                                  //   whose tables it reads instead
     mpz_t nitems;                 // Number of items, counting finite nodes only
     mpz_t start;                  // Start point in the integer mapping
-    struct rxe_node *curr;        // Current node being iterated
+    int deferred;                 // Whether nitems still waits on a node's count
     struct rxe_node *head;        // Start of the linked list of nodes
     struct rxe_node *tail;        // End of the linked list of nodes
     struct rxe_alt  *prev;        // Pointer to the next alternation
     struct rxe_alt  *next;        // Pointer to the previous alternation
     struct rxe      *owner;       // The expression this belongs to
+    int slot;                     // Its place in a cursor's walk; see rxe_walk
+    struct rxe_alt_state walk;    // The tree's own walk of it
 };
 
 // A single node, representing a character class, a subexpression, a
@@ -203,7 +355,6 @@ struct rxe_node {
     int   len;                    // Number of chars in *str
     char *str;                    // string with possible characters
     mpz_t nitems;                 // No of items in this set and its subsets
-    int   iterator;               // Current item being iterated
     int   is_backref;             // True if this node is a backreference
     int   is_repeat;              // True if this node is a repetition
     int   is_comb;                // True if this is a combination/permutation
@@ -211,7 +362,6 @@ struct rxe_node {
     int   comb_chop;              // When is_comb: bytes to quell from the last
                                   //   item -- its base's last node, for {{...?}}
                                   //   (0 = no '?'); the trailing-separator fix
-    mpz_t comb_index;             // When is_comb or is_shuffle: current index
     int   is_policy;              // True if this is a policy composition
     int  *policy_floor;           // When is_policy: min count per branch, one
                                   //   per top-level alternation of the base
@@ -219,27 +369,26 @@ struct rxe_node {
     int   policy_soaker;          // When is_policy: branch that absorbs the
                                   //   surplus for the minimal-first order, or -1
     int   is_shuffle;             // True if this group carries a shuffle key
-    struct rxe_permutation *shuffle; // The keyed permutation, when is_shuffle
     int   is_dict;                // True if this node draws from a dictionary
     int   nwords;                 // Number of words, when is_dict
-    char **words;                 // The words, borrowed from the registry
+    char **words;                 // The words, a counted reference (dict.h)
     int   is_inf;                 // True if this node has no largest member
     int   rep_min;                // Fewest repetitions, when is_repeat
     int   rep_max;                // Most repetitions, or RXE_REP_UNBOUNDED
-    int   rep_count;              // Repetitions currently selected
-    int   rep_alloc;              // How many rep_digit entries are live
-    mpz_t *rep_digit;             // One index into rxe per position
-    int   *rep_len;               // That position's length, in length order
-    struct rxe_lens lens;         // Members of this node by length
-    struct rxe_lens rest;         // ...of every node less significant than it
+    struct rxe_node *twin;        // The node whose lens it reads instead, and its
+                                  //   rest too when the alternations are twins
     struct rxe *rxe;              // Pointer to a subexpression or backref
     struct rxe *refers_to;        // For a (?N) subroutine: the group it copies,
                                   // so a drawing can collapse the copy to a link
     int   src_start;              // This node's span in the root's source text,
     int   src_end;                // as byte offsets [start,end); 0,0 if unknown
+    double size_log2;             // A repetition not yet counted: log2 of its
+                                  //   count, estimated; 0 once nitems holds it
     struct rxe_node *prev;        // Pointer to the next node
     struct rxe_node *next;        // Pointer to the previous node
     struct rxe_alt  *owner;       // The alternation this belongs to
+    int slot;                     // Its place in a cursor's walk; see rxe_walk
+    struct rxe_node_state walk;   // The tree's own walk of it
 };
 
 // A backreference table. All subexpressions point to it, but only the root
@@ -262,19 +411,71 @@ struct rxe {
                                   // meaningful when status is not RXE_OK
     struct rxe_alt *head;          // start of the linked list of alternations
     struct rxe_alt *tail;          // end of the linked list of alternations
-    struct rxe_alt *curr;          // current item being iterated
     mpz_t nitems;                  // items in the set, finite alternations only
-    mpz_t index;                   // index the expression currently sits at
-    struct rxe_lens lens;          // Members by length, over all its alternations
+    long deferred;                 // bits each count not yet worked out beneath
+                                  // it exceeds; 0 when nitems is exact
+    struct rxe *twin;              // an identical subexpression parsed earlier,
+                                  // whose length tables this one reads instead
     struct rxe_backref_table *brt; // backreferences table (only on root node)
     int flags;                     // miscellaneous flags
     char *source;                  // a private copy of the input text, on the
                                   // root only, that node spans point into
-    const char *rank_cap;          // rank scratch: the substring this group
-    int   rank_cap_len;            // matched on the current path, for a later
-    int   rank_cap_set;            // backreference to compare against. See rank.c
+    struct rxe_plan *plan;         // the flat plan, on the root only; see plan.c
+    struct rxe_arena *arena;       // under RXE_ARENA, the blocks the tree was
+                                  // carved from; root only, NULL otherwise
+    struct rxe_baked *baked;       // loaded from an image, the dictionaries it
+                                  // brought; root only. See image.c
+    int options;                   // the options rxe_parse was given; root only
+    struct rxe_filter *filter;     // under rxe_parse_filtered, the automaton
+                                  // members must pass; root only. nitems and
+                                  // index then count only those that do
+    struct rxe_lex *lex;           // under RXE_DISTINCT or RXE_BYTE_ORDER, the
+                                  // automaton the set is numbered off; root
+                                  // only. See lex.c
+    int slot;                      // its place in a cursor's walk; see rxe_walk
+    int nslots[3];                 // root only: how many expressions, alternations
+                                  // and nodes the tree was numbered with
+    struct rxe_state walk;         // the tree's own walk of it
+};
+
+// A walk of its own, kept apart from the tree it walks.
+struct rxe_walk {
+    struct rxe_state      *rxe;    // one per expression in the tree, by slot
+    struct rxe_alt_state  *alt;    // ...per alternation
+    struct rxe_node_state *node;   // ...and per node
+    int nslots[3];                 // how many of each, as the tree was numbered
 };
 
+// Where an expression, an alternation and a node stand. The walk code is built
+// twice: as itself, for the tree's own walk, where that is a field of the part
+// and costs nothing, and again in walk.c with RXE_CURSOR_WALK, for a cursor's,
+// where it is the part's slot in the walk the call was handed.
+#ifdef RXE_CURSOR_WALK
+#define RS(r) (&rxe_walking->rxe[(r)->slot])
+#define AS(a) (&rxe_walking->alt[(a)->slot])
+#define NS(n) (&rxe_walking->node[(n)->slot])
+#else
+#define RS(r) (&(r)->walk)
+#define AS(a) (&(a)->walk)
+#define NS(n) (&(n)->walk)
+#endif
+
+// rxe_walk_new settles the root's deferred counts (see rxe_force_size), the
+// one write it makes to the tree, and starts a walk of it at nothing in
+// particular; seek before reading it.
+struct rxe_walk *rxe_walk_new(struct rxe *root);
+void rxe_walk_free(struct rxe_walk *walk);
+
+// rxe_seek, rxe_iterate, rxe_advance and the renders below, in 'walk' rather
+// than in the tree. See walk.c.
+int rxe_walk_seek(struct rxe_walk *walk, struct rxe *rxe, mpz_t pos);
+int rxe_walk_iterate(struct rxe_walk *walk, struct rxe *rxe);
+int rxe_walk_advance(struct rxe_walk *walk, struct rxe *rxe, long delta);
+char *rxe_walk_current(struct rxe_walk *walk, char *str, int maxlen,
+                       struct rxe *rxe);
+char *rxe_walk_current_delta(struct rxe_walk *walk, char *str, int maxlen,
+                             struct rxe *rxe);
+
 extern void *(*rxe_mem_alloc)(size_t);
 extern void (*rxe_mem_free)(void *);
 
@@ -292,12 +493,37 @@ void rxe_set_max_member(size_t bytes);
 extern _Thread_local int rxe_member_overflow;
 int rxe_check_overflow(void);
 
+// How many times this thread has gone to rxe_mem_alloc. A seek draws its
+// temporaries from the tree it walks, so once a tree has been seeked across
+// its widest alternation, seeking it again should leave this alone. The bignums
+// themselves are GMP's to allocate; a caller who wants those counted as well
+// installs its own functions with mp_set_memory_functions.
+unsigned long rxe_alloc_calls(void);
+
 
 /* -------------------------- Function Prototypes ------------------------- */
 
 struct rxe *rxe_parse(const char *str, int flags);
+
+// The members of 'str' that the regex 'filter' matches, as a set of their own:
+// rxe->nitems is how many there are, and seek, iterate, advance, rank and the
+// walks built on them number them 0, 1, 2, ... in the order 'str' has them,
+// counted and found without rendering the members left out. The filter is
+// searched for anywhere in a member, as grep would, unless a leading '^' or a
+// trailing '$' anchors it; under RXE_FILTER_EXCLUDE the members it does not
+// match are kept instead. 'str' must be finite, with no backreference, choice,
+// policy or shuffle, and not RXE_DISTINCT (RXE_FILTER_SET), and 'filter'
+// regular (RXE_NOT_REGULAR);
+// a filter whose automaton outgrows RXE_FILTER_MAX_STATES is refused with
+// RXE_AUTOMATON_TOO_BIG. A filtered set has no plan, and cannot be saved as
+// an image. See filter.c.
+struct rxe *rxe_parse_filtered(const char *str, const char *filter, int flags);
+
 enum rxe_parse_status rxe_error(struct rxe *rxe);
 const char *rxe_error_message(struct rxe *rxe);
+// The message of a status some call returned rather than set, such as
+// rxe_count_distinct's.
+const char *rxe_status_message(int status);
 
 // Where in the input a parse error was found, as a byte offset. Only meaningful
 // when rxe_error() is not RXE_OK; a front-end can point a caret at it.
@@ -309,6 +535,20 @@ int rxe_error_pos(struct rxe *rxe);
 
 int rxe_is_infinite(struct rxe *rxe);
 
+// Under RXE_LAZY_SIZE: work out every count the parse put off, after which
+// rxe->nitems is the exact size of the set. A no-op when there are none. The
+// library calls it itself before anything that needs the size -- a seek past
+// the deferred counts, a rank, an advance -- so only a caller reading nitems
+// directly has to. It may be called from any number of threads at once: the
+// counts are filled in under a lock, once.
+void rxe_force_size(struct rxe *rxe);
+
+// The base-two logarithm of the set's size, without working the size out: a
+// count deferred by RXE_LAZY_SIZE is estimated from the sizes it is built of,
+// to a few parts in 10^15. INFINITY for an infinite set, -INFINITY for an
+// empty one. Cheap enough to show the moment a pattern is parsed.
+double rxe_log2_size(struct rxe *rxe);
+
 // Non-zero when the expression is enumerated shortest member first. True of
 // every infinite expression whose lengths can be counted; a backreference
 // ties two positions' lengths together and defeats that, and such an
@@ -321,6 +561,71 @@ char *rxe_current(char *str, int maxlen, struct rxe *rxe);
 int rxe_iterate(struct rxe *rxe);
 int rxe_seek(struct rxe *rxe, mpz_t pos);
 
+// Move by 'delta' members, forward or back, from wherever the expression
+// stands. The sum is carried through the digits as rxe_iterate carries one,
+// so a stride of k costs about what k's own digits do, not a seek; where the
+// order is not place value it seeks to the sum instead. Returns 1, without
+// moving, when the sum falls before the first member or past the last.
+int rxe_advance(struct rxe *rxe, long delta);
+
+// The delta render. A step usually moves only the least significant wheel, so
+// most of the member is what the last render already put in the buffer.
+// rxe_iterate notes the first position it moved; rxe_current_delta keeps the
+// buffer up to there and renders only the rest. 'str' must hold what the last
+// render of this expression left in it, at the same maxlen -- rxe_current and
+// rxe_current_delta both leave it so -- and when that cannot be trusted (after
+// a seek, a change of alternation, a member cut short, an infinite set) it
+// renders the whole member, so it is never wrong, only sometimes not cheaper.
+//
+// rxe_touched reports the byte offset from which the current member may differ
+// from the one last rendered: 0 when all of it may, its length when nothing
+// moved. A sink that hashes or compares members can start from there too.
+char *rxe_current_delta(char *str, int maxlen, struct rxe *rxe);
+int rxe_touched(struct rxe *rxe);
+
+// The flat plan. rxe_parse compiles every expression it can into a run of
+// wheels with native-integer radices -- a finite set in the default order,
+// whose cardinality fits 128 bits and whose every position rxe_lay can lay --
+// and from then on rxe_seek, rxe_iterate and rxe_current execute that instead
+// of walking the tree. Nothing about the numbering changes; it is the same
+// odometer, run without the pointer-chasing or a GMP call per node. What the
+// plan cannot express keeps the tree walk it always had.
+//
+// rxe_compile builds the plan if there is none and returns 0 when one is in
+// place, 1 when the expression has none. rxe_uncompile drops it and leaves the
+// tree at the member the plan stood on, for a caller that reads the tree's own
+// state -- rxedot drawing a path -- or wants the tree walk for comparison.
+// rxe_is_compiled says which of the two an expression is using.
+int rxe_compile(struct rxe *rxe);
+void rxe_uncompile(struct rxe *rxe);
+int rxe_is_compiled(struct rxe *rxe);
+
+// A cursor: a position in a set, held apart from the parse so that any number
+// of walkers can share one struct rxe. rxe_seek and rxe_iterate keep their
+// position in the tree, which is why a thread that wanted its own walk used to
+// need its own rxe_deep_clone. A cursor over an expression with a plan (see
+// rxe_compile) is nothing but the plan's digits; without a plan it walks the
+// tree itself, with everything the walk writes kept in the cursor (see struct
+// rxe_walk). Either way it never writes to the tree, save that the first
+// cursor made over a lazily counted one settles its counts (rxe_force_size),
+// which is safe from any number of threads at once.
+//
+// The calls mirror the tree's own: seek returns 0 or 1 past the end, iterate
+// returns 1 when it wraps to the first member, current renders as rxe_current
+// does. Each cursor is also the context of its own failures: after a call
+// returns non-zero, or a render comes back truncated, rxe_cursor_reason names
+// why. Use one cursor from one thread at a time; the struct rxe itself must not
+// be freed, or seeked through the calls above, while cursors over it are live.
+struct rxe_cursor;
+struct rxe_cursor *rxe_cursor_new(struct rxe *rxe);
+int   rxe_cursor_seek(struct rxe_cursor *cur, const mpz_t pos);
+int   rxe_cursor_iterate(struct rxe_cursor *cur);
+int   rxe_cursor_advance(struct rxe_cursor *cur, long delta);
+char *rxe_cursor_current(char *str, int maxlen, struct rxe_cursor *cur);
+char *rxe_cursor_current_delta(char *str, int maxlen, struct rxe_cursor *cur);
+const char *rxe_cursor_reason(struct rxe_cursor *cur);
+void  rxe_cursor_free(struct rxe_cursor *cur);
+
 // rxe_foreach -- walk a contiguous range of the set and hand each member to a
 // sink. It is the increment path made whole: seek to 'from' once, then step the
 // odometer with rxe_iterate, so a division is paid only at the start and the
@@ -355,6 +660,69 @@ enum { RXE_FOREACH_END    =  0, RXE_FOREACH_STOP   =  1,
 int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
                 int maxlen, rxe_sink emit, void *ctx);
 
+// rxe_seek_many -- the members at each of 'n' indices, in list order, to the
+// sink, as rxe_foreach hands them. Only the first index is seeked; each after
+// it is reached from the one before by rxe_advance, so a sorted list whose
+// neighbours share their high digits costs little more than a walk. The
+// returns are rxe_foreach's: RXE_FOREACH_RANGE when an index lies outside the
+// set, the members before it having been handed over.
+int rxe_seek_many(struct rxe *rxe, const mpz_t *idx, size_t n, int maxlen,
+                  rxe_sink emit, void *ctx);
+
+// rxe_foreach_lengths -- only the members whose length lies in [a,b], shortest
+// first, to the sink. Each length is entered at its first member by the counts
+// lens.c keeps, so nothing outside the window is rendered or thrown away, and
+// the caller's expression does not move. The index the sink is handed is the
+// member's place in shortest-first order, which is rxe_seek's own index when
+// rxe_is_shortlex is true. A finite set whose lengths cannot be counted (a
+// backreference, a combination) is walked in its own order and filtered, with
+// its own indices; an infinite one of that kind returns RXE_FOREACH_RANGE.
+// Otherwise the returns are rxe_foreach's.
+int rxe_foreach_lengths(struct rxe *rxe, int a, int b, int maxlen,
+                        rxe_sink emit, void *ctx);
+
+// rxe_length_count -- how many members have length L. Returns 0 and sets 'out',
+// or 1 when the set's lengths cannot be counted, as above.
+int rxe_length_count(struct rxe *rxe, int L, mpz_t out);
+
+// rxe_render_batch -- the walk without a sink: up to 'n' members, starting with
+// the one the expression stands on, rendered back to back into 'buf'. Member i
+// is the bytes from offsets[i] to offsets[i+1], so 'offsets' has room for n+1
+// entries; none is terminated, and the bytes past the last are scratch. The
+// count taken is left in *produced, and the expression on the member after
+// the last of them, so the next call carries on where this one stopped.
+//
+// Returns RXE_FOREACH_STOP when it stopped with members still to come -- 'n'
+// of them taken, or the buffer full -- and RXE_FOREACH_END when a finite set
+// ran out, the expression then being back on its first member. A member is
+// taken only when it fits with a byte to spare; one that cannot fit even an
+// empty buffer, or overflowed what could be built, returns RXE_FOREACH_TOOBIG
+// with nothing taken.
+int rxe_render_batch(struct rxe *rxe, size_t n, char *buf, size_t bufsize,
+                     size_t *offsets, size_t *produced);
+
+// rxe_foreach_parallel -- the same walk over 'nthreads' threads, the calling
+// thread one of them. The range is dealt out in even slices; a thread walks its
+// own in chunks and, when it runs dry, steals the back half of another's, so
+// a slice of expensive members does not leave the rest idle. An infinite set
+// with no count is handed out chunk by chunk from one shared frontier.
+//
+// 'ctx' holds one context per thread, and thread t's sink is always called with
+// ctx[t], so a sink can keep its own tallies without a lock; NULL hands every
+// sink NULL. Each sink sees its members in index order within a chunk, but the
+// threads interleave, so across the walk the order is not the index order --
+// the index argument says where each member sits. A sink's stop verdict, or a
+// member too big to render, cancels every member past it: a thread beyond it
+// finishes the member it is on and takes no more, while the members before it
+// are still walked, as a serial walk would have walked them.
+//
+// The walk reads 'rxe' through a cursor per thread and never moves it. Returns
+// as rxe_foreach does over the same range; when more than one member stops the
+// walk, the verdict is the one at the lowest index, however the threads ran.
+int rxe_foreach_parallel(struct rxe *rxe, const mpz_t from, const mpz_t count,
+                         int maxlen, rxe_sink emit, void *const *ctx,
+                         int nthreads);
+
 // rank -- the inverse of seek. Given a string, find where it sits in the set.
 // A member can appear at more than one index (a set may hold duplicates), so
 // rank is many-valued: rxe_rank returns the smallest index the string reaches,
@@ -363,7 +731,8 @@ int rxe_foreach(struct rxe *rxe, const mpz_t from, const mpz_t count,
 //
 // rxe_rank returns 0 and sets out when the string is a member, 1 when it is
 // not, and -1 when the set is one rank cannot handle, in which case
-// rxe_rank_reason() names why. Every finite set is answered, and an infinite
+// rxe_rank_reason() names why -- the reason of the calling thread's last rank,
+// so threads ranking at once each read their own. Every finite set is answered, and an infinite
 // one too when it is shortlex with a fixed-length repeat body (a*, \d+, a*b*);
 // what is refused is a variable-length body, a backreference's diagonal order,
 // or (?L) over an infinite set. rxe_rank_count returns 0 on
@@ -376,6 +745,38 @@ int  rxe_rank_count(struct rxe *rxe, const char *s, mpz_t out);
 long rxe_rank_all(struct rxe *rxe, const char *s, rxe_rank_cb cb, void *ctx);
 const char *rxe_rank_reason(void);
 
+// How many distinct strings the set has, however many ways it spells each:
+// the size of the set RXE_DISTINCT would number, counted off the same
+// automaton and without a walk, so it costs the same for 10^30 members as for
+// ten. A filtered set counts what both patterns accept. Returns RXE_OK and
+// sets out, or says why not: RXE_INFINITE for an endless set,
+// RXE_NOT_REGULAR for a backreference, a choice or a policy, and
+// RXE_AUTOMATON_TOO_BIG for one past RXE_DISTINCT_MAX_STATES. See lex.c.
+int  rxe_count_distinct(struct rxe *rxe, mpz_t out);
+
+// The same question answered by sampling, for a set rxe_count_distinct
+// refuses or one too costly to walk: 'samples' indices drawn uniformly from
+// 'rs', each rendered (in at most 'maxlen' bytes) and ranked with
+// rxe_rank_count over 'nthreads' threads. A draw that lands on a string spelt
+// m ways counts 1/m, so the mean estimates the share of the index range that
+// is distinct -- nitems times it the number of distinct strings, one minus it
+// the fraction that is duplicate -- whatever nitems is. The interval is 95%;
+// see estimate.c for how it is drawn when no draw was repeated. A given
+// generator state gives the same answer at any thread count.
+//
+// Returns RXE_OK and fills 'out', RXE_INFINITE for an endless set (there is
+// no uniform draw from one), RXE_TOO_BIG for a member past 'maxlen',
+// RXE_UNIMPLEMENTED for one rank cannot read back -- a member holding a NUL --
+// or RXE_NO_MEMORY when a thread could not get its buffer or its cursor.
+struct rxe_estimate {
+    unsigned long samples;          // indices drawn
+    unsigned long repeated;         // how many landed on a string spelt twice or more
+    double share, share_lo, share_hi;   // distinct strings per index, and its interval
+};
+int  rxe_estimate_distinct(struct rxe *rxe, unsigned long samples,
+                           gmp_randstate_t rs, int maxlen, int nthreads,
+                           struct rxe_estimate *out);
+
 void rxe_init(void);
 struct rxe *rxe_new(void);
 void rxe_node_deep_clone(struct rxe_alt *alt, struct rxe_node *src_node);
@@ -383,6 +784,12 @@ struct rxe *rxe_deep_clone(struct rxe *src_rxe);
 void rxe_free(struct rxe *rxe);
 
 void *kmalloc(size_t size, const char *file, int line);
+// The tree's own structures -- expressions, alternations, nodes and their
+// strings -- come from these, which draw on the tree's arena while it is being
+// parsed, cloned or freed, and on kmalloc otherwise. Anything that is resized
+// later must not: an arena hands out memory, but never takes any back.
+void *kmalloc_tree(size_t size, const char *file, int line);
+void kfree_tree(void *p);
 
 // Named dictionaries, written [:name:] in a pattern. A word dictionary is a
 // list of strings, one per member, so '[:bip39en:]{24}' enumerates the
@@ -397,10 +804,32 @@ int  rxe_register_dict(const char *name, const char **words, int nwords);
 void rxe_set_dict_resolver(int (*resolver)(const char *name));
 void rxe_free_dicts(void);
 
+// A parsed expression as a self-contained image: the pattern, its parse
+// options, the words of every dictionary it names and its exact count -- and
+// under RXE_DISTINCT or RXE_BYTE_ORDER its automaton and that automaton's
+// counts, which rxe_load then takes instead of building -- laid out with no
+// pointers in it, so it can be written to a file and mapped back
+// by any process. rxe_load needs neither the registry nor the resolver, and
+// a worker that loads the image numbers the set exactly as the one that
+// saved it did, or is refused with RXE_IMAGE_COUNT.
+//
+// rxe_save writes the image into buf when size is enough and returns the
+// size it needs either way, so call it with NULL to learn the size first;
+// zero means the expression cannot be saved (it failed to parse, or names a
+// dictionary since replaced). rxe_load always returns an expression, with
+// rxe_error set if the image is unusable. Its words are read in place, so the
+// image must stay put, and mapped, for as long as the expression and any of
+// its clones are alive. The library does no I/O: reading and mapping the file
+// are the caller's, as rxenum's --save and --load show.
+#define RXE_IMAGE_VERSION 2
+size_t rxe_save(struct rxe *rxe, void *buf, size_t size);
+struct rxe *rxe_load(const void *image, size_t size);
+
 // A keyed permutation of the integer mapping, so a set can be walked in an
 // order that depends on a key while every member is still visited exactly
 // once. See permute.c. Pass an index in [0, domain) to rxe_permutation_map
-// and seek to what comes back.
+// and seek to what comes back. A permutation keeps its own scratch for the
+// rounds, so two threads mapping through one need one each.
 
 struct rxe_permutation;
 
@@ -428,6 +857,8 @@ void rxe_permutation_unmap(mpz_t result, struct rxe_permutation *perm,
 /* ------------------------ Macro-Defined Functions ----------------------- */
 
 #define NEW(n,type) ((type *)kmalloc(sizeof(type)*(n),__FILE__,__LINE__))
+#define TREE_NEW(n,type) \
+    ((type *)kmalloc_tree(sizeof(type)*(n),__FILE__,__LINE__))
 
 #define rxe_next(rxe) (!rxe_iterate(rxe))
 
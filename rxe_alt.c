@@ -19,26 +19,34 @@
 #include "rxe_alt.h"
 #include "rxe_node.h"
 
+#ifndef RXE_CURSOR_WALK
+
 struct rxe_alt *rxe_new_alt(struct rxe *rxe)
 {
-    struct rxe_alt *alt = NEW(1,struct rxe_alt);
+    struct rxe_alt *alt = TREE_NEW(1,struct rxe_alt);
     alt->head = NULL;
     alt->tail = NULL;
     alt->next = NULL;
     alt->prev = rxe->tail;
     mpz_init(alt->nitems);
     mpz_init(alt->start);
+    alt->nnodes = 0;
     alt->ninf = 0;
+    alt->deferred = 0;
     alt->owner = rxe;
-    rxe_lens_init(&alt->lens);
+    alt->slot = 0;
+    rxe_alt_state_init(&alt->walk,alt);
+    alt->twin = NULL;
     rxe->nalts++;
     if (rxe->tail)  rxe->tail->next = alt;
     rxe->tail = alt;
     if (!rxe->head) rxe->head = alt;
-    if (!rxe->curr) rxe->curr = alt;
+    if (!rxe->walk.curr) rxe->walk.curr = alt;
     return alt;
 }
 
+static void split_free(struct rxe_split *s);
+
 void rxe_free_alt(struct rxe_alt *alt)
 {
     struct rxe_node *node,*next;
@@ -48,6 +56,156 @@ void rxe_free_alt(struct rxe_alt *alt)
     }
     mpz_clear(alt->start);
     mpz_clear(alt->nitems);
-    rxe_lens_free(&alt->lens);
-    rxe_mem_free(alt);
+    rxe_alt_state_free(&alt->walk);
+    kfree_tree(alt);
+}
+
+// An alternation's share of a walk, as a fresh parse leaves it: on its first
+// node, nothing counted yet.
+
+void rxe_alt_state_init(struct rxe_alt_state *s, struct rxe_alt *alt)
+{
+    s->curr = alt->head;
+    s->split = NULL;
+    rxe_lens_init(&s->lens);
+}
+
+void rxe_alt_state_free(struct rxe_alt_state *s)
+{
+    rxe_lens_free(&s->lens);
+    split_free(s->split);
+    s->split = NULL;
+}
+
+// The radix a node is a digit in: its subexpression's count, except where the
+// node counts something else -- the geometric sum of a repetition, the
+// binomial sum of a combination, a policy's tally -- and carries that count
+// itself.
+
+mpz_srcptr rxe_node_radix(const struct rxe_node *node)
+{
+    return node->rxe && !node->is_repeat && !node->is_comb && !node->is_policy
+           ? node->rxe->nitems : node->nitems;
+}
+
+#endif
+
+// Splitting a wide index over a long alternation.
+//
+// A seek takes an alternation's digits off its index one division at a time,
+// and each division passes over what is left of the index, so a concatenation
+// of many positions seeks in time quadratic in their number. When the index
+// is wide and the positions many, the index is split at the product of the
+// less significant half of the place values instead, each half split again,
+// and so on down to spans short enough to divide out directly: the
+// subquadratic radix conversion, over mixed radices. The products are built
+// once for the alternation, the first time a seek wants them, in a tree over
+// the positions; the counts they multiply do not change once the alternation
+// is counted, and a deferred one is not split at all.
+
+#define SPLIT_NODES   16    // fewer positions than this are divided directly
+#define SPLIT_LIMBS   24    // and so is an index narrower than this
+#define SPLIT_DEPTH   32
+
+struct rxe_split {
+    int l2r;                      // The order of significance it was built in
+    int n;                        // Its digits: the finite positions
+    struct rxe_node **node;       //   ...each, least significant first
+    mpz_t *prod;                  // The products over spans of them, as a heap
+    mpz_t *digit;                 // Each digit, as the last split left it
+    mpz_t quo[SPLIT_DEPTH];       // A quotient for each level of the split
+};
+
+static void split_free(struct rxe_split *s)
+{
+    int i;
+    if (!s) return;
+    for (i=0;i<4*s->n;i++) mpz_clear(s->prod[i]);
+    for (i=0;i<s->n;i++) mpz_clear(s->digit[i]);
+    for (i=0;i<SPLIT_DEPTH;i++) mpz_clear(s->quo[i]);
+    rxe_mem_free(s->prod);
+    rxe_mem_free(s->digit);
+    rxe_mem_free(s->node);
+    rxe_mem_free(s);
+}
+
+static void split_build(struct rxe_split *s, int at, int lo, int hi)
+{
+    if (hi - lo == 1) {
+        mpz_set(s->prod[at],rxe_node_radix(s->node[lo]));
+        return;
+    }
+    int mid = lo + (hi - lo) / 2;
+    split_build(s,2*at+1,lo,mid);
+    split_build(s,2*at+2,mid,hi);
+    mpz_mul(s->prod[at],s->prod[2*at+1],s->prod[2*at+2]);
+}
+
+static struct rxe_split *split_new(struct rxe_alt *alt, int l2r)
+{
+    struct rxe_node *node;
+    int i, n = 0;
+    for ( node = alt->head ; node ; node = node->next )
+        n += !node->is_backref && !node->is_inf;
+    struct rxe_split *s = NEW(1,struct rxe_split);
+    s->l2r = l2r;
+    s->n = n;
+    s->node = NEW(n,struct rxe_node *);
+    for ( i = 0, node = l2r ? alt->head : alt->tail ; node ;
+          node = l2r ? node->next : node->prev )
+        if (!node->is_backref && !node->is_inf) s->node[i++] = node;
+    // A heap over n leaves split at the middle needs fewer than 4n slots.
+    s->prod = NEW(4*n,mpz_t);
+    for (i=0;i<4*n;i++) mpz_init(s->prod[i]);
+    s->digit = NEW(n,mpz_t);
+    for (i=0;i<n;i++) mpz_init(s->digit[i]);
+    for (i=0;i<SPLIT_DEPTH;i++) mpz_init(s->quo[i]);
+    split_build(s,0,0,n);
+    return s;
+}
+
+// The digits lo..hi-1 of v, which is below the product over them and is
+// consumed.
+
+static void split_digits(struct rxe_split *s, mpz_ptr v, int at, int lo,
+                         int hi, int depth)
+{
+    int i;
+    if (hi - lo == 1) {
+        mpz_swap(s->digit[lo],v);
+        return;
+    }
+    if (mpz_size(v) <= SPLIT_LIMBS || depth == SPLIT_DEPTH) {
+        for (i=lo;i<hi;i++)
+            mpz_tdiv_qr(v,s->digit[i],v,rxe_node_radix(s->node[i]));
+        return;
+    }
+    int mid = lo + (hi - lo) / 2;
+    mpz_ptr q = s->quo[depth];
+    mpz_tdiv_qr(q,v,v,s->prod[2*at+1]);
+    split_digits(s,v,2*at+1,lo,mid,depth+1);
+    split_digits(s,q,2*at+2,mid,hi,depth+1);
+}
+
+// The digits of p over the alternation's finite positions, least significant
+// first, with p left holding what they could not absorb; or NULL, p
+// untouched, when a direct division is the better way.
+
+mpz_t *rxe_alt_split(struct rxe_alt *alt, mpz_ptr p, int l2r)
+{
+    struct rxe_alt_state *as = AS(alt);
+    if (alt->nnodes < SPLIT_NODES || mpz_size(p) <= SPLIT_LIMBS) return NULL;
+    if (alt->deferred || mpz_sgn(alt->nitems) <= 0) return NULL;
+    if (as->split && as->split->l2r != l2r) {
+        split_free(as->split);
+        as->split = NULL;
+    }
+    if (!as->split) as->split = split_new(alt,l2r);
+    struct rxe_split *s = as->split;
+    if (s->n < SPLIT_NODES) return NULL;
+    mpz_ptr q = s->quo[0];
+    mpz_tdiv_qr(q,p,p,s->prod[0]);
+    split_digits(s,p,0,0,s->n,1);
+    mpz_swap(p,q);
+    return s->digit;
 }
@@ -19,5 +19,9 @@
 
 struct rxe_alt *rxe_new_alt(struct rxe *rxe);
 void rxe_free_alt(struct rxe_alt *alt);
+void rxe_alt_state_init(struct rxe_alt_state *s, struct rxe_alt *alt);
+void rxe_alt_state_free(struct rxe_alt_state *s);
+mpz_srcptr rxe_node_radix(const struct rxe_node *node);
+mpz_t *rxe_alt_split(struct rxe_alt *alt, mpz_ptr p, int l2r);
 
 #endif // __RXE_ALT_H__
@@ -0,0 +1,219 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+#ifndef __RXE_INT_H__
+#define __RXE_INT_H__
+
+// The base-type shim the TODO asked for: the sixteen mpz operations the core
+// uses, under names that can mean GMP or a machine word, chosen when the
+// library is built -- 'make RXE_INT=u64', 'RXE_INT=u128', or the default,
+// 'RXE_INT=gmp'.
+//
+// rxe_int is an array of one in every build, as mpz_t is, so a call reads the
+// same whichever it is: passed by reference, never assigned, and an operand
+// may be its own result -- which is why each result below goes through a
+// local, the overflow builtins not promising to read their operands before
+// they store. Under GMP the names are the mpz calls themselves and cost
+// nothing. Under a word, a result that will not fit is not wrapped -- a
+// wrapped count is a wrong answer that looks right -- but pinned to the
+// nearest end of the range, and rxe_int_overflow raised, for whoever is
+// counting to notice. A GMP build never raises it.
+//
+// What a fixed width means for the library is decided once, at parse time: a
+// finite set whose cardinality does not fit the word is refused with
+// RXE_EXCEEDS_INT, so every count of its members that is kept in an rxe_int
+// fits. An endless set has no cardinality to check; its index stops at the
+// top of the word, ri_full says when it is there, and what lies past it is
+// out of reach. Under GMP nothing is ever full.
+//
+// ri_set_mpz and ri_get_mpz cross to the bignums the public interface speaks.
+// ri_set_mpz returns 1 when the value did not fit, having saturated.
+
+extern _Thread_local int rxe_int_overflow;
+
+#if defined(RXE_INT_U64) || defined(RXE_INT_U128)
+
+#include <stdint.h>
+
+#ifdef RXE_INT_U64
+typedef uint64_t rxe_word;
+#define RXE_INT_BITS 64
+#else
+typedef unsigned __int128 rxe_word;
+#define RXE_INT_BITS 128
+#endif
+
+typedef rxe_word rxe_int[1];
+
+#define RXE_WORD_MAX (~(rxe_word)0)
+
+static inline void ri_init(rxe_int x)                  { x[0] = 0; }
+static inline void ri_clear(rxe_int x)                 { (void)x; }
+static inline void ri_set(rxe_int r, const rxe_int a)  { r[0] = a[0]; }
+static inline void ri_set_ui(rxe_int r, unsigned long u) { r[0] = u; }
+static inline void ri_init_set(rxe_int r, const rxe_int a) { r[0] = a[0]; }
+static inline void ri_init_set_ui(rxe_int r, unsigned long u) { r[0] = u; }
+static inline int  ri_sgn(const rxe_int a)             { return a[0] != 0; }
+static inline unsigned long ri_get_ui(const rxe_int a) { return (unsigned long)a[0]; }
+static inline int  ri_full(const rxe_int a)            { return a[0] == RXE_WORD_MAX; }
+
+static inline int ri_cmp(const rxe_int a, const rxe_int b)
+{
+    return (a[0] > b[0]) - (a[0] < b[0]);
+}
+
+static inline int ri_cmp_ui(const rxe_int a, unsigned long u)
+{
+    return (a[0] > u) - (a[0] < u);
+}
+
+static inline void ri_add(rxe_int r, const rxe_int a, const rxe_int b)
+{
+    rxe_word v;
+    if (__builtin_add_overflow(a[0],b[0],&v)) {
+        v = RXE_WORD_MAX;
+        rxe_int_overflow = 1;
+    }
+    r[0] = v;
+}
+
+static inline void ri_add_ui(rxe_int r, const rxe_int a, unsigned long u)
+{
+    rxe_word v;
+    if (__builtin_add_overflow(a[0],(rxe_word)u,&v)) {
+        v = RXE_WORD_MAX;
+        rxe_int_overflow = 1;
+    }
+    r[0] = v;
+}
+
+// Unsigned: a difference below zero is the bottom of the range.
+static inline void ri_sub(rxe_int r, const rxe_int a, const rxe_int b)
+{
+    rxe_word v;
+    if (__builtin_sub_overflow(a[0],b[0],&v)) {
+        v = 0;
+        rxe_int_overflow = 1;
+    }
+    r[0] = v;
+}
+
+static inline void ri_mul(rxe_int r, const rxe_int a, const rxe_int b)
+{
+    rxe_word v;
+    if (__builtin_mul_overflow(a[0],b[0],&v)) {
+        v = RXE_WORD_MAX;
+        rxe_int_overflow = 1;
+    }
+    r[0] = v;
+}
+
+// GMP traps a division by zero; a word build reports it instead, with the
+// quotient pinned high and nothing left over.
+static inline void ri_tdiv_qr(rxe_int q, rxe_int r, const rxe_int n,
+                              const rxe_int d)
+{
+    rxe_word nn = n[0], dd = d[0];
+    if (!dd) {
+        q[0] = RXE_WORD_MAX;
+        r[0] = 0;
+        rxe_int_overflow = 1;
+        return;
+    }
+    q[0] = nn / dd;
+    r[0] = nn % dd;
+}
+
+static inline void ri_pow_ui(rxe_int r, const rxe_int b, unsigned long e)
+{
+    rxe_word p = 1, x = b[0];
+    int over = 0;
+    for ( ; e ; e >>= 1) {
+        if (e & 1) over |= __builtin_mul_overflow(p,x,&p);
+        if (e > 1) over |= __builtin_mul_overflow(x,x,&x);
+    }
+    if (over && b[0] > 1) {
+        p = RXE_WORD_MAX;
+        rxe_int_overflow = 1;
+    }
+    r[0] = p;
+}
+
+static inline int ri_set_mpz(rxe_int r, const mpz_t x)
+{
+    if (mpz_sgn(x) < 0) {
+        r[0] = 0;
+        rxe_int_overflow = 1;
+        return 1;
+    }
+    if (mpz_sizeinbase(x,2) > RXE_INT_BITS) {
+        r[0] = RXE_WORD_MAX;
+        rxe_int_overflow = 1;
+        return 1;
+    }
+    rxe_word v = 0;
+    size_t i;
+    for ( i = mpz_size(x) ; i-- ; )
+        v = (rxe_word)((unsigned __int128)v << GMP_NUMB_BITS)
+          | (rxe_word)mpz_getlimbn(x,i);
+    r[0] = v;
+    return 0;
+}
+
+static inline void ri_get_mpz(mpz_t out, const rxe_int a)
+{
+    // Least significant word first, as the plan writes its indices out.
+    unsigned __int128 v = a[0];
+    unsigned long long w[2] = { (unsigned long long)v,
+                                (unsigned long long)(v >> 64) };
+    mpz_import(out,2,-1,sizeof w[0],0,0,w);
+}
+
+#else // GMP
+
+typedef mpz_t rxe_int;
+
+#define RXE_INT_BITS 0                // unbounded
+
+#define ri_init         mpz_init
+#define ri_clear        mpz_clear
+#define ri_set          mpz_set
+#define ri_set_ui       mpz_set_ui
+#define ri_init_set     mpz_init_set
+#define ri_init_set_ui  mpz_init_set_ui
+#define ri_sgn          mpz_sgn
+#define ri_get_ui       mpz_get_ui
+#define ri_cmp          mpz_cmp
+#define ri_cmp_ui       mpz_cmp_ui
+#define ri_add          mpz_add
+#define ri_add_ui       mpz_add_ui
+#define ri_sub          mpz_sub
+#define ri_mul          mpz_mul
+#define ri_tdiv_qr      mpz_tdiv_qr
+#define ri_pow_ui       mpz_pow_ui
+#define ri_full(a)      0
+
+static inline int ri_set_mpz(rxe_int r, const mpz_t x)
+{
+    mpz_set(r,x);
+    return 0;
+}
+
+#define ri_get_mpz      mpz_set
+
+#endif
+
+#endif // __RXE_INT_H__
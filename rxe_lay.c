@@ -20,7 +20,9 @@
 #include "rxe.h"
 #include "rxe_lay.h"
 
-static const char *reason;         // why a pattern was declined, for the message
+// Why a pattern was declined, for the message. Thread-local, since every parse
+// lays its plan and parses may run on several threads at once.
+static _Thread_local const char *reason;
 
 const char *rxe_lay_reason(void) { return reason; }
 
@@ -123,7 +125,8 @@ static int bake_alt(struct build *b, struct rxe *rxe)
             if (!nb) { reason = "out of memory"; goto fail; }
             buf = nb;
         }
-        memcpy(buf + total, tmp, (size_t)len);
+        // An empty member adds nothing, and buf may not exist yet to add to.
+        if (len) memcpy(buf + total, tmp, (size_t)len);
         aoff[i] = (int)total; alen[i] = len; total += (unsigned long)len;
     }
     mpz_clear(idx);
@@ -449,9 +452,9 @@ static int find_refs(struct build *b, struct rxe *rxe)
     return 0;
 }
 
-// Gather the wheels for the whole pattern. Returns the count, or -1 with
-// 'reason' set. On success the caller must free the buffers (free_build).
-int rxe_lay_build(struct build *b, struct rxe *rxe)
+// Start a build over the whole pattern: empty, but with the backreferenced
+// groups already known, so wheels can be laid a branch at a time.
+int rxe_lay_begin(struct build *b, struct rxe *rxe)
 {
     b->nw = 0; b->bake = NULL; b->nbake = 0; b->cbake = 0; b->root = rxe;
     b->ops = NULL; b->nops = 0; b->cops = 0;
@@ -459,7 +462,29 @@ int rxe_lay_build(struct build *b, struct rxe *rxe)
     b->lr_active = 0; b->perm_active = 0; b->policy_active = 0;
     b->w = malloc(MAXW * sizeof *b->w);
     if (!b->w) { reason = "out of memory"; return -1; }
-    if (find_refs(b, rxe)) return -1;
+    // Wheels are sized from the counts, so none may be left for later.
+    rxe_force_size(rxe);
+    return find_refs(b, rxe);
+}
+
+// Lay one alternation's nodes, in order, rather than baking the alternation it
+// belongs to into a single wheel. The library's own plan takes the root's
+// branches this way, since it indexes them by their start, not as one wheel.
+int rxe_lay_alt(struct build *b, struct rxe_alt *alt)
+{
+    if (alt->owner->flags & (RXE_FLAG_LEFT_TO_RIGHT | RXE_FLAG_SHORTLEX)) {
+        reason = "a non-default enumeration order"; return -1;
+    }
+    for (struct rxe_node *nd = alt->head; nd; nd = nd->next)
+        if (add_node(b, nd)) return -1;
+    return 0;
+}
+
+// Gather the wheels for the whole pattern. Returns the count, or -1 with
+// 'reason' set. On success the caller must free the buffers (free_build).
+int rxe_lay_build(struct build *b, struct rxe *rxe)
+{
+    if (rxe_lay_begin(b, rxe)) return -1;
     if (add_rxe(b, rxe)) return -1;
     // A loop super-wheel renders a variable-length tail, so every pre/post wheel
     // around it must be fixed and no backreference may reach across it -- the
@@ -10,8 +10,10 @@
  *
  *          It is the analysis half that rxejit grew, lifted into the library so
  *          more than one back end can consume it. rxejit emits C and OpenCL from
- *          the wheels; the jsrxe crack tab emits WGSL. Neither concern lives
- *          here -- rxe_lay knows odometers, not code generators.
+ *          the wheels; the jsrxe crack tab emits WGSL; and the library runs
+ *          them itself, as the plan rxe_seek and rxe_iterate execute (plan.c).
+ *          None of those concerns lives here -- rxe_lay knows odometers, not
+ *          what is done with them.
  *
  *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
  *
@@ -102,6 +104,12 @@ struct build {
 int rxe_lay_build(struct build *b, struct rxe *rxe);
 void rxe_lay_free(struct build *b);
 
+// The same, a piece at a time: rxe_lay_begin readies 'b' for the pattern, and
+// rxe_lay_alt appends the wheels of one of its alternations, node by node. Each
+// returns 0, or -1 with rxe_lay_reason() set; either way rxe_lay_free cleans up.
+int rxe_lay_begin(struct build *b, struct rxe *rxe);
+int rxe_lay_alt(struct build *b, struct rxe_alt *alt);
+
 // Why the last rxe_lay_build declined (returned -1). Valid until the next call.
 const char *rxe_lay_reason(void);
 
@@ -15,51 +15,126 @@
  */
  
  #include "rxe.h"
+#include "dict.h"
+#include "rxe_node.h"
 #include "repeat.h"
 #include "lens.h"
 
+#ifndef RXE_CURSOR_WALK
+
 struct rxe_node *rxe_new_node(struct rxe_alt *alt)
 {
-    struct rxe_node *node = NEW(1,struct rxe_node);
+    struct rxe_node *node = TREE_NEW(1,struct rxe_node);
     node->next = NULL;
     node->prev = alt->tail;
     mpz_init(node->nitems);
-    node->len = node->iterator = 0;
+    node->len = 0;
     node->is_backref = 0;
     node->is_repeat = 0;
     node->is_comb = 0;
     node->comb_perm = 0;
     node->comb_chop = 0;
-    mpz_init(node->comb_index);
     node->is_policy = 0;
     node->policy_floor = NULL;
     node->policy_nfloor = 0;
     node->policy_soaker = -1;
     node->is_shuffle = 0;
-    node->shuffle = NULL;
     node->is_inf = 0;
     node->is_dict = 0;
     node->nwords = 0;
     node->words = NULL;
-    node->rep_min = node->rep_max = node->rep_count = 0;
-    node->rep_alloc = 0;
-    node->rep_digit = NULL;
-    node->rep_len = NULL;
+    node->rep_min = node->rep_max = 0;
     node->str = NULL;
     node->rxe = NULL;
     node->refers_to = NULL;
     node->src_start = node->src_end = 0;
+    node->size_log2 = 0;
     node->owner = alt;
-    rxe_lens_init(&node->lens);
-    rxe_lens_init(&node->rest);
+    node->slot = 0;
+    rxe_node_state_init(&node->walk);
+    node->twin = NULL;
     alt->nnodes++;
     if (alt->tail) alt->tail->next = node;
     alt->tail = node;
     if (!alt->head) alt->head = node;
-    if (!alt->curr) alt->curr = node;
+    if (!alt->walk.curr) alt->walk.curr = node;
     return node;
 }
 
+// A node's share of a walk, as a fresh parse leaves it: on its first item, no
+// digits, nothing kept or counted yet. rxe_new_node starts the tree's own walk
+// with it, and rxe_walk_new a cursor's.
+
+void rxe_node_state_init(struct rxe_node_state *s)
+{
+    s->iterator = 0;
+    mpz_init(s->comb_index);
+    s->shuffle = NULL;
+    s->rep_count = 0;
+    s->rep_alloc = 0;
+    s->rep_digit = NULL;
+    s->rep_word = NULL;
+    s->rep_len = NULL;
+    s->rep_pow = NULL;
+    s->rep_quo = NULL;
+    s->rep_npow = 0;
+    s->rep_fit = NULL;
+    s->rep_fit_k = s->rep_fit_l = -1;
+    s->sl_len = 0;
+    s->out_at = 0;
+    s->rep_at = NULL;
+    s->rep_moved = 0;
+    s->memo_ok = -1;
+    s->memo = NULL;
+    s->memo_at = NULL;
+    s->memo_n = NULL;
+    s->memo_len = 0;
+    s->tmp = NULL;
+    rxe_lens_init(&s->lens);
+    rxe_lens_init(&s->rest);
+}
+
+static void tmp_free(struct rxe_node_state *s)
+{
+    if (s->tmp) {
+        int i;
+        for (i=0;i<RXE_NODE_TMP;i++) mpz_clear(s->tmp[i]);
+        rxe_mem_free(s->tmp);
+        s->tmp = NULL;
+    }
+}
+
+void rxe_node_state_free(struct rxe_node_state *s)
+{
+    rxe_repeat_free(s);
+    tmp_free(s);
+    if (s->shuffle) rxe_permutation_free(s->shuffle);
+    s->shuffle = NULL;
+    mpz_clear(s->comb_index);
+    rxe_lens_free(&s->lens);
+    rxe_lens_free(&s->rest);
+}
+
+#endif
+
+// The node's seek temporaries. A repetition re-divides its index into digits
+// at every seek, and a shuffle maps its index through the key first; keeping
+// the bignums that takes in the walk means a warm seek leaves the heap alone,
+// since they grow to the widest index they have held and stay there.
+
+mpz_t *rxe_node_tmp(struct rxe_node *node)
+{
+    struct rxe_node_state *s = NS(node);
+    if (!s->tmp) {
+        int i;
+        s->tmp = NEW(RXE_NODE_TMP,mpz_t);
+        for (i=0;i<RXE_NODE_TMP;i++) mpz_init(s->tmp[i]);
+    }
+    return s->tmp;
+}
+
+#ifndef RXE_CURSOR_WALK
+
 void rxe_free_node_data(struct rxe_node *node)
 {
     // A backreference node only aliases the subexpression it refers to; the
@@ -69,13 +144,15 @@ void rxe_free_node_data(struct rxe_node *node)
         if (!node->is_backref) rxe_free(node->rxe);
         node->rxe = NULL;
     }
-    // A dictionary node only borrows its words from the registry, which owns
-    // them, so it clears the pointer without freeing anything.
+    // A dictionary node holds a reference to its words, which the registry or
+    // an image's dictionaries hold too; the last one let go frees them.
+    rxe_words_unref(node->words);
     node->is_dict = 0;
     node->nwords = 0;
     node->words = NULL;
     // A repetition owns one index per position it can occupy.
-    rxe_repeat_free(node);
+    rxe_repeat_free(&node->walk);
+    tmp_free(&node->walk);
     node->is_repeat = 0;
     node->is_comb = 0;
     node->comb_perm = 0;
@@ -89,11 +166,11 @@ void rxe_free_node_data(struct rxe_node *node)
     node->policy_soaker = -1;
     rxe_shuffle_free(node);
     node->is_inf = 0;
-    node->rep_min = node->rep_max = node->rep_count = 0;
+    node->rep_min = node->rep_max = node->walk.rep_count = 0;
     // Keyed off the pointer, not the length: an empty character class still
     // allocates a (zero-length) block, and testing len left it behind.
     if (node->str) {
-        rxe_mem_free(node->str);
+        kfree_tree(node->str);
         node->len = 0;
         node->str = NULL;
     }
@@ -103,10 +180,8 @@ void rxe_free_node(struct rxe_node *node)
 {
     rxe_free_node_data(node);
     mpz_clear(node->nitems);
-    mpz_clear(node->comb_index);
-    rxe_lens_free(&node->lens);
-    rxe_lens_free(&node->rest);
-    rxe_mem_free(node);
+    rxe_node_state_free(&node->walk);
+    kfree_tree(node);
 }
 
-
+#endif
@@ -17,8 +17,14 @@
 #ifndef __RXE_NODE_H__
 #define __RXE_NODE_H__
 
+// Bignums a node's own seek borrows; see rxe_node_tmp.
+#define RXE_NODE_TMP                 3
+
 struct rxe_node *rxe_new_node(struct rxe_alt *alt);
 void rxe_free_node_data(struct rxe_node *node);
 void rxe_free_node(struct rxe_node *node);
+mpz_t *rxe_node_tmp(struct rxe_node *node);
+void rxe_node_state_init(struct rxe_node_state *s);
+void rxe_node_state_free(struct rxe_node_state *s);
 
 #endif // __RXE_NODE_H__
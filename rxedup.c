@@ -2,7 +2,7 @@
  * rxedup - brute-force duplicate detection over the set a regex describes.
  *          Where the structural certifier proves a set has no repeated
  *          spellings without looking at them, this walks the members and finds
- *          the repeats outright: it enumerates through rxe_foreach, hashes each
+ *          the repeats outright: it enumerates through rxe_foreach_parallel, hashes each
  *          rendered member into an exact set, and reports how many were seen
  *          more than once. It is the muscle behind the cheap proof -- the tier
  *          you reach for when the structure will not certify and the set is
@@ -14,6 +14,16 @@
  *          set was walked; over a capped or infinite set it means "none in the
  *          part we saw", nothing about the rest.
  *
+ *          --estimate walks nothing. It ranks a few thousand indices drawn at
+ *          random (rxe_estimate_distinct) and says roughly how many of the
+ *          set's strings are distinct -- the question to ask before an exact
+ *          walk of hours, at the cost of the draws alone.
+ *
+ *          --sorted keeps no table. It walks the set in byte order, where the
+ *          repeats of a string come one after another, and compares each
+ *          member with the last -- an exact answer in constant memory, for a
+ *          set finite and regular enough to be numbered that way.
+ *
  *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
  *
  * This program is free software; you can redistribute it and/or
@@ -33,6 +43,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <getopt.h>
+#include <math.h>
 #include <pthread.h>
 #include <unistd.h>
 #include "rxe.h"
@@ -40,6 +51,7 @@
 #define MAXSTRLEN     2048          // default render width, as rxenum's
 #define DEFAULT_CAP   1000000L      // members walked without an explicit -c
 #define THREAD_MIN    100000L       // below this many members, one thread wins
+#define DEFAULT_DRAWS 10000UL       // indices --estimate ranks without a count
 
 // Exit status, chosen so a script can branch on the three real answers:
 //   0  every member walked was distinct, and the whole set was walked  -- a
@@ -194,8 +206,8 @@ static void hset_free(struct hset *h)
 }
 
 // Fold one thread's entry into a master table, summing multiplicity: a member
-// distinct within its own shard is still a duplicate if another shard rendered
-// it too. The bytes are not copied -- the master borrows the pointer into the
+// distinct within its own thread's set is still a duplicate if another thread
+// rendered it too. The bytes are not copied -- the master borrows the pointer into the
 // thread's arena, which outlives the merge -- so the master's own arena stays
 // empty and it frees only its slots. Its capacity is sized up front to hold
 // every entry, so no grow (and no allocation) happens here.
@@ -246,23 +258,64 @@ static int dup_sink(const char *s, size_t len, const mpz_t index, void *v)
     return 0;
 }
 
-// One thread's slice of the walk. The index range [from, from+count) is its
-// own, its rxe is its own clone, and its set has its own arena, so the threads
-// share nothing writable and need no lock. fr is where its rxe_foreach return
-// lands, read back after the join.
-struct shard {
-    struct rxe   *rxe;
-    mpz_t         from, count;
-    int           width;
-    struct run    run;
-    int           fr;
+/* ------------------------------ the sorted walk ---------------------------- */
+/* --sorted: the set numbered in byte order (RXE_BYTE_ORDER), where a string's
+ * every spelling sits at consecutive indices, so a member repeats exactly when
+ * it equals the member before it. No table then, only that one member: the
+ * memory is a render buffer per thread, however big the set.
+ *
+ * A thread walks its slice in chunks, and the member before a chunk's first
+ * lies in some other chunk -- perhaps another thread's. Rank stands in for it:
+ * in byte order it gives the first index a string sits at, and a member past
+ * that index is a repeat of the one before. */
+
+struct sorted_run {
+    struct rxe   *rxe;             // to rank a chunk's first member
+    char         *prev;            // the member before, width bytes
+    size_t        plen;
+    int           have;            // prev holds the member at index at - 1
+    mpz_t         at, first;
+    unsigned long total, dups;
+    unsigned long mult;            // -v: how many times prev has come so far
+    int           verbose;
+    int           fail;            // a chunk began on a member rank cannot read
 };
 
-static void *worker(void *arg)
+static void sorted_flush(struct sorted_run *r)
+{
+    if (r->verbose && r->have && r->mult > 1)
+        printf("  %lu× %.*s\n", r->mult, (int)r->plen, r->prev);
+}
+
+static int sorted_sink(const char *s, size_t len, const mpz_t index, void *v)
 {
-    struct shard *s = arg;
-    s->fr = rxe_foreach(s->rxe, s->from, s->count, s->width, dup_sink, &s->run);
-    return NULL;
+    struct sorted_run *r = v;
+    int dup;
+    r->total++;
+    if (r->have && !mpz_cmp(index, r->at)) {
+        dup = len == r->plen && !memcmp(s, r->prev, len);
+    } else if (!mpz_sgn(index)) {
+        dup = 0;
+    } else {
+        // Rank reads up to a NUL, so a member holding one cannot be placed.
+        if (memchr(s, 0, len) || rxe_rank(r->rxe, s, r->first)) {
+            r->fail = 1;
+            return 1;
+        }
+        dup = mpz_cmp(index, r->first) > 0;
+    }
+    if (dup) {
+        r->dups++;
+        r->mult++;
+    } else {
+        sorted_flush(r);
+        r->mult = 1;
+    }
+    memcpy(r->prev, s, len);
+    r->plen = len;
+    r->have = 1;
+    mpz_add_ui(r->at, index, 1);
+    return 0;
 }
 
 static int nproc(void)
@@ -328,6 +381,8 @@ static void usage(FILE *out)
 {
     fprintf(out,
 "usage: %s [-c count] [-w width] [-j jobs] [-D dir] [-v] [-q] REGEX\n"
+"       %s --sorted [-c count] [-w width] [-j jobs] [-D dir] [-v] [-q] REGEX\n"
+"       %s --estimate[=draws] [--seed=n] [-w width] [-j jobs] [-D dir] [-q] REGEX\n"
 "\n"
 "Walk the members of the set REGEX describes and report duplicate renderings.\n"
 "\n"
@@ -337,14 +392,28 @@ static void usage(FILE *out)
 "            inconclusive unless a duplicate turns up.\n"
 "  -w width  render buffer in bytes (default %d); a longer member is refused.\n"
 "  -j jobs   split the walk across this many threads (default: one per CPU);\n"
-"            each takes a contiguous slice of the index range.\n"
+"            each walks a slice of the index range and, done early, steals\n"
+"            from another's.\n"
 "  -D dir    also look in 'dir' for a [:name:] dictionary's name.dict file.\n"
 "  -v        after the summary, list the repeated members and their counts.\n"
 "  -q        print nothing; report only through the exit status.\n"
+"  --sorted  number the set in byte order, where a string's repeats sit side\n"
+"            by side, and compare each member with the one before: no table,\n"
+"            so the memory stays a buffer per thread however big the set.\n"
+"            The set must be finite and regular. -v then lists the repeats\n"
+"            as the walk meets them, on one thread.\n"
+"  --estimate[=draws]\n"
+"            walk nothing: rank 'draws' (default %lu) indices drawn at random\n"
+"            and estimate how many of the set's strings are distinct and what\n"
+"            share of it is duplicate, with 95%% intervals. The cost is the\n"
+"            draws', whatever the size of the set; it must be finite.\n"
+"  --seed=n  draw from a generator seeded with n rather than /dev/urandom,\n"
+"            for an estimate that can be repeated.\n"
 "\n"
 "exit: 0 all distinct (whole set walked), 1 a duplicate found,\n"
-"      2 none found but the walk was capped or infinite, 3 error.\n",
-        prog, DEFAULT_CAP, MAXSTRLEN);
+"      2 none found but the walk was capped or infinite, 3 error.\n"
+"      An estimate exits 1 when a draw was repeated, else 2.\n",
+        prog, prog, prog, DEFAULT_CAP, MAXSTRLEN, DEFAULT_DRAWS);
 }
 
 static void list_repeats(const struct hset *h)
@@ -356,6 +425,181 @@ static void list_repeats(const struct hset *h)
     }
 }
 
+// The summary and the exit status, whichever walk found them. A found
+// duplicate is conclusive however the walk fared, so it wins over a too-big or
+// out-of-memory that only clouds the rest. 'repeats' is the table to list the
+// repeated members from, or NULL for none.
+static int report(unsigned long total, unsigned long distinct, int toobig,
+                  int oom, int whole, int infinite, int quiet,
+                  const struct hset *repeats)
+{
+    unsigned long dups = total - distinct;
+    int status;
+    if (dups > 0) {
+        if (!quiet)
+            printf("%lu member%s, %lu distinct, %lu duplicate%s -- NOT distinct\n",
+                   total, total == 1 ? "" : "s", distinct,
+                   dups, dups == 1 ? "" : "s");
+        if (repeats && !quiet) list_repeats(repeats);
+        status = EX_DUPLICATE;
+    } else if (toobig) {
+        if (!quiet)
+            fprintf(stderr, "%s: a member is larger than the render width; raise -w\n", prog);
+        status = EX_ERROR;
+    } else if (oom) {
+        if (!quiet)
+            printf("%lu members, all distinct so far, then out of memory "
+                   "-- inconclusive\n", total);
+        status = EX_PARTIAL;
+    } else if (whole) {
+        if (!quiet)
+            printf("%lu member%s, all distinct\n", total, total == 1 ? "" : "s");
+        status = EX_DISTINCT;
+    } else {
+        if (!quiet)
+            printf("%lu member%s walked, all distinct -- inconclusive (%s)\n",
+                   total, total == 1 ? "" : "s",
+                   infinite ? "the set is infinite" : "the walk was capped");
+        status = EX_PARTIAL;
+    }
+
+    return status;
+}
+
+/* ------------------------------- the estimate ------------------------------ */
+/* --estimate: no walk, no table -- rxe_estimate_distinct's draws and ranks, and
+ * the interval it gives turned into the two numbers worth reading: how many
+ * distinct strings, and what share of the indices repeat one. */
+
+static int seed_from_urandom(gmp_randstate_t rs)
+{
+    unsigned char bytes[32];
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (!fp) return 0;
+    size_t got = fread(bytes, 1, sizeof bytes, fp);
+    fclose(fp);
+    if (got != sizeof bytes) return 0;
+    mpz_t seed;
+    mpz_init(seed);
+    mpz_import(seed, sizeof bytes, 1, 1, 0, 0, bytes);
+    gmp_randseed(rs, seed);
+    mpz_clear(seed);
+    return 1;
+}
+
+static int estimate(struct rxe *rxe, unsigned long draws, const char *seed,
+                    int width, int jobs, int quiet)
+{
+    if (rxe_is_infinite(rxe)) {
+        if (!quiet)
+            fprintf(stderr, "%s: --estimate needs a finite set to draw from\n", prog);
+        return EX_ERROR;
+    }
+    gmp_randstate_t rs;
+    gmp_randinit_mt(rs);
+    if (seed) {
+        mpz_t s;
+        mpz_init(s);
+        if (mpz_set_str(s, seed, 10) || mpz_sgn(s) < 0) {
+            if (!quiet) fprintf(stderr, "%s: --seed needs a number >= 0\n", prog);
+            mpz_clear(s);
+            gmp_randclear(rs);
+            return EX_ERROR;
+        }
+        gmp_randseed(rs, s);
+        mpz_clear(s);
+    } else if (!seed_from_urandom(rs)) {
+        if (!quiet) fprintf(stderr, "%s: unable to read from /dev/urandom\n", prog);
+        gmp_randclear(rs);
+        return EX_ERROR;
+    }
+
+    struct rxe_estimate e;
+    int rc = rxe_estimate_distinct(rxe, draws, rs, width, jobs, &e);
+    gmp_randclear(rs);
+    if (rc == RXE_TOO_BIG) {
+        if (!quiet)
+            fprintf(stderr, "%s: a member is larger than the render width; raise -w\n", prog);
+        return EX_ERROR;
+    }
+    if (rc != RXE_OK) {
+        if (!quiet)
+            fprintf(stderr, "%s: cannot estimate: %s\n", prog, rxe_status_message(rc));
+        return EX_ERROR;
+    }
+
+    if (!quiet) {
+        double n = mpz_get_d(rxe->nitems);
+        gmp_printf("%Zd member%s, %lu drawn, %lu on a repeated string\n",
+                   rxe->nitems, mpz_cmp_ui(rxe->nitems, 1) ? "s" : "",
+                   e.samples, e.repeated);
+        printf("distinct   ~%.6g (95%%: %.6g .. %.6g)\n",
+               round(e.share * n), floor(e.share_lo * n), ceil(e.share_hi * n));
+        printf("duplicate  ~%.3g%% of indices (95%%: %.3g%% .. %.3g%%)\n",
+               100 * (1 - e.share), 100 * (1 - e.share_hi),
+               100 * (1 - e.share_lo));
+    }
+    return e.repeated ? EX_DUPLICATE : EX_PARTIAL;
+}
+
+// The walk for --sorted: one sorted_run per thread, each a render buffer and
+// nothing that grows. -v names each repeat as its run of spellings ends, which
+// needs the runs met in order, so it walks on the one thread.
+static int sorted_walk(struct rxe *rxe, long cap, int width, int T, int verbose,
+                       int quiet)
+{
+    if (verbose) T = 1;
+    struct sorted_run *run = calloc((size_t)T, sizeof *run);
+    void **ctx = calloc((size_t)T, sizeof *ctx);
+    int ok = run && ctx;
+    for (int t = 0; ok && t < T; t++) {
+        run[t].rxe = rxe;
+        run[t].verbose = verbose && !quiet;
+        ok = (run[t].prev = malloc((size_t)width)) != NULL;
+        mpz_init(run[t].at);
+        mpz_init(run[t].first);
+        ctx[t] = &run[t];
+    }
+
+    int status = EX_ERROR;
+    if (!ok) {
+        if (!quiet) fprintf(stderr, "%s: out of memory\n", prog);
+    } else {
+        mpz_t from, count;
+        mpz_init(from);
+        mpz_init(count);
+        if (cap > 0) mpz_set_si(count, cap);
+        int fr = rxe_foreach_parallel(rxe, from, count, width, sorted_sink, ctx, T);
+        mpz_clear(from);
+        mpz_clear(count);
+
+        unsigned long total = 0, dups = 0;
+        int fail = 0;
+        for (int t = 0; t < T; t++) {
+            sorted_flush(&run[t]);
+            total += run[t].total;
+            dups  += run[t].dups;
+            fail  |= run[t].fail;
+        }
+        if (fail) {
+            if (!quiet)
+                fprintf(stderr, "%s: --sorted cannot place a member holding a NUL\n", prog);
+        } else {
+            int whole = mpz_cmp_ui(rxe->nitems, total) == 0;
+            status = report(total, total - dups, fr == RXE_FOREACH_TOOBIG, 0,
+                            whole, 0, quiet, NULL);
+        }
+    }
+
+    for (int t = 0; run && t < T; t++) {
+        if (ctx && ctx[t]) { mpz_clear(run[t].at); mpz_clear(run[t].first); }
+        free(run[t].prev);
+    }
+    free(run);
+    free(ctx);
+    return status;
+}
+
 int main(int argc, char **argv)
 {
     long   cap     = DEFAULT_CAP;
@@ -363,11 +607,30 @@ int main(int argc, char **argv)
     int    jobs    = 0;                 // 0 = one per CPU
     int    verbose = 0, quiet = 0;
     int    opt;
+    int    have_cap = 0, do_estimate = 0, sorted = 0;
+    unsigned long draws = DEFAULT_DRAWS;
+    const char *seed = NULL;
+    static const struct option long_options[] = {
+        { "estimate", optional_argument, NULL, 'E' },
+        { "seed",     required_argument, NULL, 'S' },
+        { "sorted",   no_argument,       NULL, 'O' },
+        { NULL, 0, NULL, 0 }
+    };
 
     if (argc > 0) prog = argv[0];
-    while ((opt = getopt(argc, argv, "c:w:j:D:vqh")) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:w:j:D:vqh", long_options, NULL)) != -1) {
         switch (opt) {
-            case 'c': cap = strtol(optarg, NULL, 10);
+            case 'E': do_estimate = 1;
+                      if (optarg) {
+                          char *end;
+                          long n = strtol(optarg, &end, 10);
+                          if (*end || n < 1) { fprintf(stderr, "%s: --estimate needs at least one draw\n", prog); return EX_ERROR; }
+                          draws = (unsigned long)n;
+                      }
+                      break;
+            case 'S': seed = optarg; break;
+            case 'O': sorted = 1; break;
+            case 'c': cap = strtol(optarg, NULL, 10); have_cap = 1;
                       if (cap < 0) { fprintf(stderr, "%s: -c needs a count >= 0\n", prog); return EX_ERROR; }
                       break;
             case 'w': width = atoi(optarg);
@@ -384,12 +647,24 @@ int main(int argc, char **argv)
         }
     }
     if (optind != argc - 1) { usage(stderr); return EX_ERROR; }
+    if (do_estimate && (have_cap || verbose)) {
+        fprintf(stderr, "%s: -c and -v walk; --estimate does not\n", prog);
+        return EX_ERROR;
+    }
+    if (do_estimate && sorted) {
+        fprintf(stderr, "%s: --sorted walks; --estimate does not\n", prog);
+        return EX_ERROR;
+    }
+    if (seed && !do_estimate) {
+        fprintf(stderr, "%s: --seed only seeds --estimate\n", prog);
+        return EX_ERROR;
+    }
     const char *pattern = argv[optind];
 
     rxe_init();
     rxe_set_dict_resolver(dict_resolver);
     atexit(rxe_free_dicts);
-    struct rxe *rxe = rxe_parse(pattern, 0);
+    struct rxe *rxe = rxe_parse(pattern, sorted ? RXE_BYTE_ORDER : 0);
     if (rxe_error(rxe) != RXE_OK) {
         if (!quiet)
             fprintf(stderr, "%s: %s\n", prog, rxe_error_message(rxe));
@@ -397,17 +672,24 @@ int main(int argc, char **argv)
         return EX_ERROR;
     }
 
-    int infinite = rxe_is_infinite(rxe);
+    if (do_estimate) {
+        int status = estimate(rxe, draws, seed, width, jobs > 0 ? jobs : nproc(),
+                              quiet);
+        rxe_free(rxe);
+        return status;
+    }
+
+    int infinite = rxe_is_infinite(rxe);      // never, in byte order
 
-    // How much of the set the walk covers, as a concrete count the threads can
-    // divide. A finite set is bounded by its own size, capped by -c; an infinite
-    // one only by -c. The one range that cannot be split is an infinite set with
-    // no cap (-c 0) -- it never ends -- so that stays a single unbounded thread.
+    // How much of the set the walk covers, to decide whether it is worth more
+    // than one thread. A finite set is bounded by its own size, capped by -c; an
+    // infinite one only by -c. An infinite set with no cap (-c 0) never ends,
+    // so it is always worth them all -- the threads share one frontier there.
     mpz_t nwalk;
     mpz_init(nwalk);
-    int splittable = 1;
+    int unbounded = 0;
     if (infinite) {
-        if (cap == 0) splittable = 0;
+        if (cap == 0) unbounded = 1;
         else          mpz_set_si(nwalk, cap);
     } else if (cap > 0 && mpz_cmp_si(rxe->nitems, cap) > 0) {
         mpz_set_si(nwalk, cap);
@@ -416,89 +698,67 @@ int main(int argc, char **argv)
     }
 
     int T = jobs > 0 ? jobs : nproc();
-    if (!splittable || mpz_cmp_ui(nwalk, THREAD_MIN) < 0) T = 1;
-    if (T > 1 && mpz_cmp_ui(nwalk, (unsigned long)T) < 0) T = (int)mpz_get_ui(nwalk);
+    if (!unbounded && mpz_cmp_ui(nwalk, THREAD_MIN) < 0) T = 1;
+    if (T > 1 && !unbounded && mpz_cmp_ui(nwalk, (unsigned long)T) < 0)
+        T = (int)mpz_get_ui(nwalk);
     if (T < 1) T = 1;
 
-    struct shard *sh = calloc((size_t)T, sizeof *sh);
-    if (!sh) { if (!quiet) fprintf(stderr, "%s: out of memory\n", prog);
-               mpz_clear(nwalk); rxe_free(rxe); return EX_ERROR; }
-
-    // Build the shards. Shard 0 keeps the already-parsed rxe; the rest each get
-    // an independent clone. The index range is split as evenly as it divides,
-    // the first 'rem' shards taking one extra. A single thread keeps the old
-    // semantics exactly: the whole set, or -c members, count 0 meaning no limit.
-    int ok = 1;
-    if (T == 1) {
-        mpz_init_set_ui(sh[0].from, 0);
-        mpz_init(sh[0].count);
-        if (cap > 0) mpz_set_si(sh[0].count, cap);     // else 0 = unlimited
-        sh[0].width = width;
-        sh[0].rxe   = rxe;
-        ok = hset_init(&sh[0].run.set);
-    } else {
-        mpz_t base, off;
-        mpz_init(base);
-        mpz_init_set_ui(off, 0);
-        unsigned long rem = 0;
-        { mpz_t r; mpz_init(r); mpz_tdiv_qr_ui(base, r, nwalk, (unsigned long)T);
-          rem = mpz_get_ui(r); mpz_clear(r); }
-        for (int t = 0; t < T; t++) {
-            mpz_init_set(sh[t].from, off);
-            mpz_init_set(sh[t].count, base);
-            if ((unsigned long)t < rem) mpz_add_ui(sh[t].count, sh[t].count, 1);
-            mpz_add(off, off, sh[t].count);
-            sh[t].width = width;
-            sh[t].rxe   = t == 0 ? rxe : rxe_deep_clone(rxe);
-            if (!sh[t].rxe || !hset_init(&sh[t].run.set)) ok = 0;
-        }
-        mpz_clear(base);
-        mpz_clear(off);
+    if (sorted) {
+        int status = sorted_walk(rxe, cap, width, T, verbose, quiet);
+        rxe_free(rxe);
+        mpz_clear(nwalk);
+        return status;
+    }
+
+    // One run per thread: rxe_foreach_parallel calls thread t's sink with
+    // run[t], so each set has its own arena and no lock is taken per member.
+    // The walk itself -- the split, the stealing, stopping everyone when one
+    // set runs out of memory -- is the library's.
+    struct run *run = calloc((size_t)T, sizeof *run);
+    void **ctx      = calloc((size_t)T, sizeof *ctx);
+    int ok = run && ctx;
+    for (int t = 0; ok && t < T; t++) {
+        ok = hset_init(&run[t].set);
+        ctx[t] = &run[t];
     }
     if (!ok) { if (!quiet) fprintf(stderr, "%s: out of memory\n", prog);
-               for (int t = 0; t < T; t++) { hset_free(&sh[t].run.set);
-                   if (sh[t].rxe) rxe_free(sh[t].rxe);
-                   mpz_clear(sh[t].from); mpz_clear(sh[t].count); }
-               free(sh); mpz_clear(nwalk); return EX_ERROR; }
-
-    // Run them: a thread each for shards 1..T-1, shard 0 on this thread, then
-    // join. A thread that will not spawn is simply run here instead.
-    pthread_t *tid  = calloc((size_t)T, sizeof *tid);
-    char      *spun = calloc((size_t)T, 1);
-    for (int t = 1; t < T; t++)
-        if (pthread_create(&tid[t], NULL, worker, &sh[t]) == 0) spun[t] = 1;
-        else worker(&sh[t]);
-    worker(&sh[0]);
-    for (int t = 1; t < T; t++) if (spun[t]) pthread_join(tid[t], NULL);
-    free(tid);
-    free(spun);
-
-    // Gather the shards. total is the members walked; a too-big member or an
-    // out-of-memory in any shard colours the whole answer.
+               for (int t = 0; run && t < T; t++) hset_free(&run[t].set);
+               free(run); free(ctx); mpz_clear(nwalk); rxe_free(rxe);
+               return EX_ERROR; }
+
+    mpz_t from, count;
+    mpz_init(from);
+    mpz_init(count);
+    if (cap > 0) mpz_set_si(count, cap);        // else 0 = unlimited
+    int fr = rxe_foreach_parallel(rxe, from, count, width, dup_sink, ctx, T);
+    mpz_clear(from);
+    mpz_clear(count);
+
+    // Gather the runs. total is the members walked; a too-big member or an
+    // out-of-memory in any thread colours the whole answer.
     unsigned long total = 0;
-    int any_toobig = 0, any_oom = 0;
+    int any_toobig = fr == RXE_FOREACH_TOOBIG, any_oom = 0;
     for (int t = 0; t < T; t++) {
-        total += sh[t].run.total;
-        if (sh[t].fr == RXE_FOREACH_TOOBIG) any_toobig = 1;
-        if (sh[t].run.set.oom)              any_oom = 1;
+        total += run[t].total;
+        if (run[t].set.oom) any_oom = 1;
     }
 
-    // Distinct count. One shard's set is the answer outright; several must be
-    // merged, since a member distinct within each shard is still a duplicate if
-    // two shards rendered it. The merge borrows the shards' stored bytes, so the
-    // shard sets must outlive it.
+    // Distinct count. One thread's set is the answer outright; several must be
+    // merged, since a member distinct within each thread's set is still a
+    // duplicate if two threads rendered it. The merge borrows the sets' stored
+    // bytes, so they must outlive it.
     struct hset  master;
     int          have_master = 0;
-    struct hset *dset = &sh[0].run.set;
+    struct hset *dset = &run[0].set;
     if (T > 1) {
         size_t sumused = 0;
-        for (int t = 0; t < T; t++) sumused += sh[t].run.set.used;
+        for (int t = 0; t < T; t++) sumused += run[t].set.used;
         if (!hset_init_for(&master, sumused)) {
             any_oom = 1;
         } else {
             have_master = 1;
             for (int t = 0; t < T; t++) {
-                struct hset *s = &sh[t].run.set;
+                struct hset *s = &run[t].set;
                 for (size_t i = 0; i < s->cap; i++)
                     if (s->slot[i].bytes) hset_absorb(&master, &s->slot[i]);
             }
@@ -506,51 +766,18 @@ int main(int argc, char **argv)
         }
     }
     unsigned long distinct = (unsigned long)dset->used;
-    unsigned long dups     = total - distinct;
 
     // Whether the whole set was seen -- a finite set walked to its size, none of
     // it left behind. An infinite set never is.
     int whole = !infinite && mpz_cmp_ui(rxe->nitems, total) == 0;
 
-    // A found duplicate is conclusive however the walk fared, so it wins over a
-    // too-big or out-of-memory that only clouds the rest.
-    int status;
-    if (dups > 0) {
-        if (!quiet)
-            printf("%lu member%s, %lu distinct, %lu duplicate%s -- NOT distinct\n",
-                   total, total == 1 ? "" : "s", distinct,
-                   dups, dups == 1 ? "" : "s");
-        if (verbose && !quiet) list_repeats(dset);
-        status = EX_DUPLICATE;
-    } else if (any_toobig) {
-        if (!quiet)
-            fprintf(stderr, "%s: a member is larger than the render width; raise -w\n", prog);
-        status = EX_ERROR;
-    } else if (any_oom) {
-        if (!quiet)
-            printf("%lu members, all distinct so far, then out of memory "
-                   "-- inconclusive\n", total);
-        status = EX_PARTIAL;
-    } else if (whole) {
-        if (!quiet)
-            printf("%lu member%s, all distinct\n", total, total == 1 ? "" : "s");
-        status = EX_DISTINCT;
-    } else {
-        if (!quiet)
-            printf("%lu member%s walked, all distinct -- inconclusive (%s)\n",
-                   total, total == 1 ? "" : "s",
-                   infinite ? "the set is infinite" : "the walk was capped");
-        status = EX_PARTIAL;
-    }
-
+    int status = report(total, distinct, any_toobig, any_oom, whole, infinite,
+                        quiet, verbose ? dset : NULL);
     if (have_master) hset_free(&master);
-    for (int t = 0; t < T; t++) {
-        hset_free(&sh[t].run.set);
-        rxe_free(sh[t].rxe);           // shard 0's is the original; freed once, here
-        mpz_clear(sh[t].from);
-        mpz_clear(sh[t].count);
-    }
-    free(sh);
+    for (int t = 0; t < T; t++) hset_free(&run[t].set);
+    free(run);
+    free(ctx);
+    rxe_free(rxe);
     mpz_clear(nwalk);
     return status;
 }
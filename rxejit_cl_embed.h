@@ -0,0 +1,289 @@
+static const char RXEJIT_CL[] =
+"/* rxejit_cl.cl - the device-side runtime for the -G (OpenCL) backend.\n"
+" *\n"
+" * The reusable half of a generated GPU kernel: the keycracking hashes -- MD5\n"
+" * (RFC 1321), NTLM = MD4 (RFC 1320) of UTF-16LE, and SHA-1 (RFC 3174) -- and a\n"
+" * binary search over the sorted target digests. rxejit emits the pattern-specific\n"
+" * half after this -- the __constant wheel alphabets and the crack() kernel that\n"
+" * unranks a lane's index into a candidate, hashes it, and appends a hit. Kept\n"
+" * as real OpenCL C so it can be read and checked on its own; the Makefile turns\n"
+" * it into a C string the generated host program hands to clBuildProgram.\n"
+" *\n"
+" * Same constants and rounds as rt_md5 in rxejit_rt.h, so a lane's digest is\n"
+" * bit-identical to the CPU's -- the CPU stays the oracle. The one difference is\n"
+" * for speed: the 16 message words are built straight from the candidate and the\n"
+" * pad (not through a byte buffer) and the rounds are unrolled, so when the\n"
+" * candidate length is a compile-time constant -- the baked fixed path -- the ~11\n"
+" * words that are pure padding/length fold into the round constants and never\n"
+" * occupy a register, which lifts occupancy on a register-starved GPU.\n"
+" */\n"
+"\n"
+"#define CL_ROTL(x, c) (((x) << (c)) | ((x) >> (32 - (c))))\n"
+"#define CL_ROTR(x, c) (((x) >> (c)) | ((x) << (32 - (c))))\n"
+"\n"
+"/* Unrolling the 64 rounds turns g / CLK[i] / CLS[i] into constants and folds a\n"
+" * fixed-length candidate's constant message words into the round adds -- a win\n"
+" * on Intel NEO. On a register-starved GPU the code bloat can cost more than it\n"
+" * saves, so it is a knob: rxejit passes -D RXEJIT_UNROLL=0 when RXEJIT_NO_UNROLL\n"
+" * is set in the environment, to A/B it per device. */\n"
+"#ifndef RXEJIT_UNROLL\n"
+"#define RXEJIT_UNROLL 1\n"
+"#endif\n"
+"#if RXEJIT_UNROLL\n"
+"#define MD5_UNROLL _Pragma(\"unroll\")\n"
+"#else\n"
+"#define MD5_UNROLL\n"
+"#endif\n"
+"\n"
+"__constant uint  CLK[64] = {\n"
+"    0xd76aa478,0xe8c7b756,0x242070db,0xc1bdceee,0xf57c0faf,0x4787c62a,0xa8304613,0xfd469501,\n"
+"    0x698098d8,0x8b44f7af,0xffff5bb1,0x895cd7be,0x6b901122,0xfd987193,0xa679438e,0x49b40821,\n"
+"    0xf61e2562,0xc040b340,0x265e5a51,0xe9b6c7aa,0xd62f105d,0x02441453,0xd8a1e681,0xe7d3fbc8,\n"
+"    0x21e1cde6,0xc33707d6,0xf4d50d87,0x455a14ed,0xa9e3e905,0xfcefa3f8,0x676f02d9,0x8d2a4c8a,\n"
+"    0xfffa3942,0x8771f681,0x6d9d6122,0xfde5380c,0xa4beea44,0x4bdecfa9,0xf6bb4b60,0xbebfbc70,\n"
+"    0x289b7ec6,0xeaa127fa,0xd4ef3085,0x04881d05,0xd9d4d039,0xe6db99e5,0x1fa27cf8,0xc4ac5665,\n"
+"    0xf4292244,0x432aff97,0xab9423a7,0xfc93a039,0x655b59c3,0x8f0ccc92,0xffeff47d,0x85845dd1,\n"
+"    0x6fa87e4f,0xfe2ce6e0,0xa3014314,0x4e0811a1,0xf7537e82,0xbd3af235,0x2ad7d2bb,0xeb86d391 };\n"
+"__constant uchar CLS[64] = {\n"
+"    7,12,17,22,7,12,17,22,7,12,17,22,7,12,17,22,\n"
+"    5,9,14,20,5,9,14,20,5,9,14,20,5,9,14,20,\n"
+"    4,11,16,23,4,11,16,23,4,11,16,23,4,11,16,23,\n"
+"    6,10,15,21,6,10,15,21,6,10,15,21,6,10,15,21 };\n"
+"\n"
+"/* Compress one already-assembled 16-word message block. Taking the words\n"
+" * directly (not a byte buffer) lets a caller with constant words -- the padding\n"
+" * and length of a fixed-length candidate -- have them folded into the rounds. */\n"
+"static void cl_md5_block(uint abcd[4], const uint M[16])\n"
+"{\n"
+"    uint A = abcd[0], B = abcd[1], C = abcd[2], D = abcd[3];\n"
+"    MD5_UNROLL\n"
+"    for (int i = 0; i < 64; i++) {\n"
+"        uint F; int g;\n"
+"        if      (i < 16) { F = (B & C) | (~B & D);  g = i;              }\n"
+"        else if (i < 32) { F = (D & B) | (~D & C);  g = (5*i + 1) & 15; }\n"
+"        else if (i < 48) { F = B ^ C ^ D;           g = (3*i + 5) & 15; }\n"
+"        else             { F = C ^ (B | ~D);        g = (7*i)     & 15; }\n"
+"        F += A + CLK[i] + M[g];\n"
+"        A = D; D = C; C = B; B += CL_ROTL(F, CLS[i]);\n"
+"    }\n"
+"    abcd[0] += A; abcd[1] += B; abcd[2] += C; abcd[3] += D;\n"
+"}\n"
+"\n"
+"/* A candidate is a mask width -- short -- so its padded message is one block\n"
+" * (len < 56). The message words are built straight from the candidate and the\n"
+" * pad, not through a 64-byte buffer: when len is a compile-time constant (the\n"
+" * baked fixed path) every word past the candidate is a constant the compiler\n"
+" * folds into the round, and never lives in a register. */\n"
+"static void cl_md5(const uchar *msg, uint len, uchar out[16])\n"
+"{\n"
+"    uint abcd[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };\n"
+"    uint M[16];\n"
+"#pragma unroll\n"
+"    for (int w = 0; w < 14; w++) {\n"
+"        uint word = 0;\n"
+"#pragma unroll\n"
+"        for (int t = 0; t < 4; t++) {\n"
+"            uint pos = (uint)(w * 4 + t);\n"
+"            uint b = pos < len ? msg[pos] : (pos == len ? 0x80u : 0u);\n"
+"            word |= b << (8 * t);\n"
+"        }\n"
+"        M[w] = word;\n"
+"    }\n"
+"    M[14] = len * 8;                   /* one block: bit length fits 32 bits */\n"
+"    M[15] = 0;\n"
+"    cl_md5_block(abcd, M);\n"
+"    for (int k = 0; k < 4; k++) {\n"
+"        out[k*4]   = (uchar)(abcd[k]        & 0xff);\n"
+"        out[k*4+1] = (uchar)((abcd[k] >> 8) & 0xff);\n"
+"        out[k*4+2] = (uchar)((abcd[k] >> 16)& 0xff);\n"
+"        out[k*4+3] = (uchar)((abcd[k] >> 24)& 0xff);\n"
+"    }\n"
+"}\n"
+"\n"
+"/* NTLM = MD4(UTF-16LE(candidate)). MD4 (RFC 1320) shares MD5's little-endian\n"
+" * word layout but runs three rounds of sixteen with its own functions/shifts;\n"
+" * cl_md4_block is the classic unrolled form over an assembled 16-word block. */\n"
+"static void cl_md4_block(uint abcd[4], const uint M[16])\n"
+"{\n"
+"    uint a = abcd[0], b = abcd[1], c = abcd[2], d = abcd[3];\n"
+"#define M4F(x,y,z) (((x) & (y)) | (~(x) & (z)))\n"
+"#define M4G(x,y,z) (((x) & (y)) | ((x) & (z)) | ((y) & (z)))\n"
+"#define M4H(x,y,z) ((x) ^ (y) ^ (z))\n"
+"#define M4FF(a,b,c,d,k,s) a = CL_ROTL(a + M4F(b,c,d) + M[k], s)\n"
+"#define M4GG(a,b,c,d,k,s) a = CL_ROTL(a + M4G(b,c,d) + M[k] + 0x5a827999u, s)\n"
+"#define M4HH(a,b,c,d,k,s) a = CL_ROTL(a + M4H(b,c,d) + M[k] + 0x6ed9eba1u, s)\n"
+"    M4FF(a,b,c,d,0,3);  M4FF(d,a,b,c,1,7);  M4FF(c,d,a,b,2,11);  M4FF(b,c,d,a,3,19);\n"
+"    M4FF(a,b,c,d,4,3);  M4FF(d,a,b,c,5,7);  M4FF(c,d,a,b,6,11);  M4FF(b,c,d,a,7,19);\n"
+"    M4FF(a,b,c,d,8,3);  M4FF(d,a,b,c,9,7);  M4FF(c,d,a,b,10,11); M4FF(b,c,d,a,11,19);\n"
+"    M4FF(a,b,c,d,12,3); M4FF(d,a,b,c,13,7); M4FF(c,d,a,b,14,11); M4FF(b,c,d,a,15,19);\n"
+"    M4GG(a,b,c,d,0,3);  M4GG(d,a,b,c,4,5);  M4GG(c,d,a,b,8,9);   M4GG(b,c,d,a,12,13);\n"
+"    M4GG(a,b,c,d,1,3);  M4GG(d,a,b,c,5,5);  M4GG(c,d,a,b,9,9);   M4GG(b,c,d,a,13,13);\n"
+"    M4GG(a,b,c,d,2,3);  M4GG(d,a,b,c,6,5);  M4GG(c,d,a,b,10,9);  M4GG(b,c,d,a,14,13);\n"
+"    M4GG(a,b,c,d,3,3);  M4GG(d,a,b,c,7,5);  M4GG(c,d,a,b,11,9);  M4GG(b,c,d,a,15,13);\n"
+"    M4HH(a,b,c,d,0,3);  M4HH(d,a,b,c,8,9);  M4HH(c,d,a,b,4,11);  M4HH(b,c,d,a,12,15);\n"
+"    M4HH(a,b,c,d,2,3);  M4HH(d,a,b,c,10,9); M4HH(c,d,a,b,6,11);  M4HH(b,c,d,a,14,15);\n"
+"    M4HH(a,b,c,d,1,3);  M4HH(d,a,b,c,9,9);  M4HH(c,d,a,b,5,11);  M4HH(b,c,d,a,13,15);\n"
+"    M4HH(a,b,c,d,3,3);  M4HH(d,a,b,c,11,9); M4HH(c,d,a,b,7,11);  M4HH(b,c,d,a,15,15);\n"
+"#undef M4F\n"
+"#undef M4G\n"
+"#undef M4H\n"
+"#undef M4FF\n"
+"#undef M4GG\n"
+"#undef M4HH\n"
+"    abcd[0] += a; abcd[1] += b; abcd[2] += c; abcd[3] += d;\n"
+"}\n"
+"\n"
+"/* A candidate fits one MD4 block once widened (2*len < 56, i.e. len < 28). The\n"
+" * UTF-16LE message words are built straight from the candidate: even byte\n"
+" * positions carry a candidate byte, odd positions the zero high byte, and the\n"
+" * pad/length fold into constants for a fixed length, exactly like cl_md5. */\n"
+"static void cl_ntlm(const uchar *msg, uint len, uchar out[16])\n"
+"{\n"
+"    uint abcd[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };\n"
+"    uint elen = len * 2;\n"
+"    uint M[16];\n"
+"#pragma unroll\n"
+"    for (int w = 0; w < 14; w++) {\n"
+"        uint word = 0;\n"
+"#pragma unroll\n"
+"        for (int t = 0; t < 4; t++) {\n"
+"            uint pos = (uint)(w * 4 + t);\n"
+"            uint b = pos < elen ? ((pos & 1) ? 0u : (uint)msg[pos >> 1])\n"
+"                                : (pos == elen ? 0x80u : 0u);\n"
+"            word |= b << (8 * t);\n"
+"        }\n"
+"        M[w] = word;\n"
+"    }\n"
+"    M[14] = elen * 8;\n"
+"    M[15] = 0;\n"
+"    cl_md4_block(abcd, M);\n"
+"    for (int k = 0; k < 4; k++) {\n"
+"        out[k*4]   = (uchar)(abcd[k]        & 0xff);\n"
+"        out[k*4+1] = (uchar)((abcd[k] >> 8) & 0xff);\n"
+"        out[k*4+2] = (uchar)((abcd[k] >> 16)& 0xff);\n"
+"        out[k*4+3] = (uchar)((abcd[k] >> 24)& 0xff);\n"
+"    }\n"
+"}\n"
+"\n"
+"/* SHA-1 (RFC 3174), single block (len < 56). Big-endian words and digest, and\n"
+" * eighty rounds of a mixing function chosen by the round quarter. The first 14\n"
+" * words come straight from the candidate + pad (constant-folded at a fixed\n"
+" * length); the schedule extends them to 80. 20-byte digest. */\n"
+"static void cl_sha1(const uchar *msg, uint len, uchar out[20])\n"
+"{\n"
+"    uint h0 = 0x67452301, h1 = 0xefcdab89, h2 = 0x98badcfe, h3 = 0x10325476, h4 = 0xc3d2e1f0;\n"
+"    uint w[80];\n"
+"#pragma unroll\n"
+"    for (int i = 0; i < 14; i++) {\n"
+"        uint word = 0;\n"
+"#pragma unroll\n"
+"        for (int t = 0; t < 4; t++) {\n"
+"            uint pos = (uint)(i * 4 + t);\n"
+"            uint b = pos < len ? (uint)msg[pos] : (pos == len ? 0x80u : 0u);\n"
+"            word = (word << 8) | b;\n"
+"        }\n"
+"        w[i] = word;\n"
+"    }\n"
+"    w[14] = 0;\n"
+"    w[15] = len * 8;\n"
+"    MD5_UNROLL\n"
+"    for (int i = 16; i < 80; i++)\n"
+"        w[i] = CL_ROTL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);\n"
+"    uint a = h0, b = h1, c = h2, d = h3, e = h4;\n"
+"    MD5_UNROLL\n"
+"    for (int i = 0; i < 80; i++) {\n"
+"        uint f, k;\n"
+"        if      (i < 20) { f = (b & c) | (~b & d);          k = 0x5a827999; }\n"
+"        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }\n"
+"        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }\n"
+"        else             { f = b ^ c ^ d;                   k = 0xca62c1d6; }\n"
+"        uint t = CL_ROTL(a, 5) + f + e + k + w[i];\n"
+"        e = d; d = c; c = CL_ROTL(b, 30); b = a; a = t;\n"
+"    }\n"
+"    h0 += a; h1 += b; h2 += c; h3 += d; h4 += e;\n"
+"    uint hh[5] = { h0, h1, h2, h3, h4 };\n"
+"    for (int k = 0; k < 5; k++) {\n"
+"        out[k*4]   = (uchar)((hh[k] >> 24) & 0xff);\n"
+"        out[k*4+1] = (uchar)((hh[k] >> 16) & 0xff);\n"
+"        out[k*4+2] = (uchar)((hh[k] >> 8)  & 0xff);\n"
+"        out[k*4+3] = (uchar)( hh[k]        & 0xff);\n"
+"    }\n"
+"}\n"
+"\n"
+"/* SHA-256 (FIPS 180-4), single block (len < 56). Big-endian words and a 32-byte\n"
+" * digest, sixty-four rounds whose schedule extends the first 16 words (candidate\n"
+" * + pad, constant-folded at a fixed length) to 64. */\n"
+"__constant uint CK256[64] = {\n"
+"    0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,\n"
+"    0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,\n"
+"    0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,\n"
+"    0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,\n"
+"    0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,\n"
+"    0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,\n"
+"    0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,\n"
+"    0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2 };\n"
+"static void cl_sha256(const uchar *msg, uint len, uchar out[32])\n"
+"{\n"
+"    uint h0 = 0x6a09e667, h1 = 0xbb67ae85, h2 = 0x3c6ef372, h3 = 0xa54ff53a,\n"
+"         h4 = 0x510e527f, h5 = 0x9b05688c, h6 = 0x1f83d9ab, h7 = 0x5be0cd19;\n"
+"    uint w[64];\n"
+"#pragma unroll\n"
+"    for (int i = 0; i < 14; i++) {\n"
+"        uint word = 0;\n"
+"#pragma unroll\n"
+"        for (int t = 0; t < 4; t++) {\n"
+"            uint pos = (uint)(i * 4 + t);\n"
+"            uint b = pos < len ? (uint)msg[pos] : (pos == len ? 0x80u : 0u);\n"
+"            word = (word << 8) | b;\n"
+"        }\n"
+"        w[i] = word;\n"
+"    }\n"
+"    w[14] = 0;\n"
+"    w[15] = len * 8;\n"
+"    MD5_UNROLL\n"
+"    for (int i = 16; i < 64; i++) {\n"
+"        uint s0 = CL_ROTR(w[i-15], 7) ^ CL_ROTR(w[i-15], 18) ^ (w[i-15] >> 3);\n"
+"        uint s1 = CL_ROTR(w[i-2], 17) ^ CL_ROTR(w[i-2], 19) ^ (w[i-2] >> 10);\n"
+"        w[i] = w[i-16] + s0 + w[i-7] + s1;\n"
+"    }\n"
+"    uint a = h0, b = h1, c = h2, d = h3, e = h4, f = h5, g = h6, hh = h7;\n"
+"    MD5_UNROLL\n"
+"    for (int i = 0; i < 64; i++) {\n"
+"        uint S1 = CL_ROTR(e, 6) ^ CL_ROTR(e, 11) ^ CL_ROTR(e, 25);\n"
+"        uint ch = (e & f) ^ (~e & g);\n"
+"        uint t1 = hh + S1 + ch + CK256[i] + w[i];\n"
+"        uint S0 = CL_ROTR(a, 2) ^ CL_ROTR(a, 13) ^ CL_ROTR(a, 22);\n"
+"        uint maj = (a & b) ^ (a & c) ^ (b & c);\n"
+"        uint t2 = S0 + maj;\n"
+"        hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;\n"
+"    }\n"
+"    uint hh8[8] = { h0+a, h1+b, h2+c, h3+d, h4+e, h5+f, h6+g, h7+hh };\n"
+"    for (int k = 0; k < 8; k++) {\n"
+"        out[k*4]   = (uchar)((hh8[k] >> 24) & 0xff);\n"
+"        out[k*4+1] = (uchar)((hh8[k] >> 16) & 0xff);\n"
+"        out[k*4+2] = (uchar)((hh8[k] >> 8)  & 0xff);\n"
+"        out[k*4+3] = (uchar)( hh8[k]        & 0xff);\n"
+"    }\n"
+"}\n"
+"\n"
+"/* The targets are DGLEN-byte digests the host uploaded sorted (16 for MD5/NTLM,\n"
+" * 20 for SHA-1, 32 for SHA-256 -- baked in per build), so a lane finds its\n"
+" * digest (or not) in log2(ntgt) comparisons -- no contention, all read-only. */\n"
+"#ifndef DGLEN\n"
+"#define DGLEN 16\n"
+"#endif\n"
+"static int cl_tgt_has(__global const uchar *t, uint ntgt, const uchar dg[DGLEN])\n"
+"{\n"
+"    int lo = 0, hi = (int)ntgt - 1;\n"
+"    while (lo <= hi) {\n"
+"        int mid = (lo + hi) >> 1;\n"
+"        __global const uchar *e = t + (uint)mid * DGLEN;\n"
+"        int c = 0;\n"
+"        for (int i = 0; i < DGLEN; i++)\n"
+"            if (dg[i] != e[i]) { c = dg[i] < e[i] ? -1 : 1; break; }\n"
+"        if (c == 0) return 1;\n"
+"        if (c < 0) hi = mid - 1; else lo = mid + 1;\n"
+"    }\n"
+"    return 0;\n"
+"}\n"
+;
@@ -18,10 +18,15 @@
 
 #include <stdio.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "rxe.h"
 
 /* ------------------------ Macro-Defined Constants ----------------------- */
@@ -46,6 +51,9 @@ void die(int code, char *msg, ...);
 void enumerate(struct rxe *rxe, int flags, int offset, mpz_t from, mpz_t cnt,
                char sep, struct rxe_permutation *perm);
 int mpz_len(mpz_t x);
+void by_length(struct rxe *rxe, int a, int b, int options, int offset,
+               mpz_t count, char sep);
+void length_histogram(struct rxe *rxe, int a, int b, char sep);
 
 /* --------------------------- Dictionary Loading ------------------------- */
 
@@ -64,6 +72,39 @@ static int         ndict_dirs;
 // legal to materialise yet longer than one wants printed. Settable with -w.
 static int str_width = MAXSTRLEN;
 
+// Long options have no letter of their own; these stand in for one.
+#define OPT_LENGTHS            256
+#define OPT_LENGTH_HISTOGRAM   257
+#define OPT_SAVE               258
+#define OPT_LOAD               259
+
+static const struct option long_options[] = {
+    { "lengths",          required_argument, NULL, OPT_LENGTHS          },
+    { "length-histogram", no_argument,       NULL, OPT_LENGTH_HISTOGRAM },
+    { "save",             required_argument, NULL, OPT_SAVE             },
+    { "load",             required_argument, NULL, OPT_LOAD             },
+    { NULL,               0,                 NULL, 0                    }
+};
+
+// A window of lengths as written after --lengths: "a-b", "a-" for a and
+// everything longer, or "a" for that one length alone. Returns 0 on success.
+static int parse_lengths(const char *arg, int *a, int *b)
+{
+    char *end;
+    long lo = strtol(arg,&end,10), hi = lo;
+    if (end == arg || lo < 0) return 1;
+    if (*end == '-') {
+        const char *p = end+1;
+        hi = *p ? strtol(p,&end,10) : INT_MAX;
+        if (*p && (end == p || hi < lo)) return 1;
+        if (!*p) end = (char *)p;
+    }
+    if (*end || lo > INT_MAX) return 1;
+    *a = (int)lo;
+    *b = hi > INT_MAX ? INT_MAX : (int)hi;
+    return 0;
+}
+
 static char **load_dict_file(const char *path, int *nwords)
 {
     FILE *fp = fopen(path,"rb");
@@ -108,12 +149,68 @@ static int dict_resolver(const char *name)
     return 0;
 }
 
+/* ---------------------------- Expression Images ------------------------- */
+
+// A parse, or the reason there is none, with a caret under where it failed.
+
+static struct rxe *parse_or_die(const char *pat, int flags)
+{
+    struct rxe *rxe = rxe_parse(pat,flags);
+    if (rxe_error(rxe)) {
+        int pos = rxe_error_pos(rxe), len = (int)strlen(pat);
+        if (pos < 0) pos = 0;
+        if (pos > len) pos = len;
+        fprintf(stderr,"%s\n",rxe_error_message(rxe));   // line 1 unchanged
+        fprintf(stderr,"    %s\n",pat);
+        fprintf(stderr,"    %*s^\n",pos,"");
+        exit(1);
+    }
+    return rxe;
+}
+
+// --save writes the parse out as an image (see rxe_save) and --load maps one
+// back in place of a regex. Mapped, not read: a sharded job starts one rxenum
+// per shard off the same image, and they share its pages, dictionaries and
+// all, instead of each holding a copy.
+
+static void save_image(struct rxe *rxe, const char *path)
+{
+    size_t size = rxe_save(rxe,NULL,0);
+    if (!size) die(1,"%s: the expression names a dictionary that cannot be saved\n",path);
+    char *buf = malloc(size);
+    if (!buf) die(1,"%s: out of memory\n",path);
+    rxe_save(rxe,buf,size);
+    FILE *fp = fopen(path,"wb");
+    if (!fp || fwrite(buf,1,size,fp) != size || fclose(fp))
+        die(1,"%s: cannot write the image\n",path);
+    free(buf);
+}
+
+static struct rxe *load_image(const char *path)
+{
+    int fd = open(path,O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd,&st) || st.st_size <= 0)
+        die(1,"%s: cannot read the image\n",path);
+    // Left mapped until the process exits: the expression reads its words
+    // out of the mapping for as long as it lives.
+    void *map = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (map == MAP_FAILED) die(1,"%s: cannot map the image\n",path);
+    struct rxe *rxe = rxe_load(map,(size_t)st.st_size);
+    if (rxe_error(rxe)) die(1,"%s: %s\n",path,rxe_error_message(rxe));
+    return rxe;
+}
+
 /* ------------------------------ Main Program ---------------------------- */
 
 int main(int argc, char **argv)
 {
     if (argc<2) {
-        die(0,"Usage: rxenum [-isLnezr] [-k key] [-c count] [-f from] [-t to] [-M bytes] [-w width] <regex>\n");
+        die(0,"Usage: rxenum [-isLubnezrU] [-k key] [-c count] [-f from] [-t to] [-M bytes] [-w width]\n"
+              "              [-F filter | -X filter] [--lengths a-b] [--length-histogram]\n"
+              "              [--save file] <regex>\n"
+              "       rxenum [options] --load file\n");
     }
     int flags = 0;
     int do_enumerate = 0;
@@ -123,6 +220,10 @@ int main(int argc, char **argv)
     int have_to = 0;
     int have_random = 0;
     int report_order = 0;
+    int have_lengths = 0, histogram = 0;
+    int distinct_summary = 0;
+    int len_a = 0, len_b = 0;
+    const char *save_path = NULL, *load_path = NULL, *filter = NULL;
     char *key = NULL;
     char sep = ',';
     mpz_t from,to,count;
@@ -135,7 +236,8 @@ int main(int argc, char **argv)
     // it under a leak checker.
     atexit(rxe_free_dicts);
     for (;;) {
-        int o = getopt(argc,argv,"isLenzf:t:c:r.,_~k:QD:M:w:");
+        int o = getopt_long(argc,argv,"isLubUenzf:t:c:r.,_~k:QD:M:w:F:X:",
+                            long_options,NULL);
         if (o < 0) break;
         switch(o) {
             case 'i': flags |= RXE_CASELESS;
@@ -144,6 +246,12 @@ int main(int argc, char **argv)
                       break;
             case 'L': flags |= RXE_LEFT_TO_RIGHT;
                       break;
+            case 'u': flags |= RXE_DISTINCT;
+                      break;
+            case 'b': flags |= RXE_BYTE_ORDER;
+                      break;
+            case 'U': distinct_summary = 1;
+                      break;
             case 'n': options |= ENUM_NUMBER;
                       do_enumerate = 1;
                       break;
@@ -177,44 +285,100 @@ int main(int argc, char **argv)
             case 'w': str_width = atoi(optarg);
                       if (str_width < 1) die(1,"-w needs a positive width\n");
                       break;
+            case 'X': flags |= RXE_FILTER_EXCLUDE;
+                      // fall-thru
+            case 'F': if (filter) die(1,"one -F or -X at a time\n");
+                      filter = optarg;
+                      break;
             case ',':
             case '_':
             case '.': sep = o;
                       break;
             case '~': sep = 0;
                       break;
-             default: die(1,"Unknown option '%c'\n",o);
+            case OPT_LENGTHS:
+                      if (parse_lengths(optarg,&len_a,&len_b))
+                          die(1,"--lengths takes a window such as 8-10, 8- or 8\n");
+                      have_lengths = 1;
+                      break;
+            case OPT_LENGTH_HISTOGRAM:
+                      histogram = 1;
+                      break;
+            case OPT_SAVE:
+                      save_path = optarg;
+                      break;
+            case OPT_LOAD:
+                      load_path = optarg;
+                      break;
+             default: die(1,"Unknown option '%s'\n",argv[optind-1]);
                       exit(1);
         }
     }
 
+    // The summary is a line under the count, so it goes where the count does.
+    if (distinct_summary && (do_enumerate || have_random || report_order
+                             || have_lengths || histogram || save_path))
+        die(1,"-U adds a line to the count, and takes no -e, -n, -f, -t, -c, "
+              "-k, -r, -Q, --lengths, --length-histogram or --save\n");
+
     struct rxe *rxe;
-    if (!argv[optind]) die(1,"missing regex\n");
-    // GNU getopt reorders argv so that options may follow the regex; the musl
-    // and BSD ones stop at the first thing that is not an option, as POSIX
-    // says. That difference used to make 'rxenum -z <regex> -f 3999' quietly
-    // ignore the -f and print a count instead, which is a worse answer than
-    // refusing. The usage line has always put the options first.
-    if (argv[optind+1])
-        die(1,"unexpected argument '%s': options must come before the regex\n",
-            argv[optind+1]);
-    rxe = rxe_parse(argv[optind],flags);
-    if (rxe_error(rxe)) {
-        const char *pat = argv[optind];
-        int pos = rxe_error_pos(rxe), len = (int)strlen(pat);
-        if (pos < 0) pos = 0;
-        if (pos > len) pos = len;
-        fprintf(stderr,"%s\n",rxe_error_message(rxe));   // line 1 unchanged
-        fprintf(stderr,"    %s\n",pat);
-        fprintf(stderr,"    %*s^\n",pos,"");
-        exit(1);
+    if (load_path) {
+        // The image says how it was parsed, regex and options both.
+        if (argv[optind]) die(1,"--load takes no regex: the image holds it\n");
+        if (flags) die(1,"-i, -s, -L, -u and -b come from the image with --load\n");
+        if (filter) die(1,"-F and -X do not combine with --load\n");
+        rxe = load_image(load_path);
+    } else {
+        if (!argv[optind]) die(1,"missing regex\n");
+        // GNU getopt reorders argv so that options may follow the regex; the
+        // musl and BSD ones stop at the first thing that is not an option, as
+        // POSIX says. That difference used to make 'rxenum -z <regex> -f 3999'
+        // quietly ignore the -f and print a count instead, which is a worse
+        // answer than refusing. The usage line has always put the options
+        // first.
+        if (argv[optind+1])
+            die(1,"unexpected argument '%s': options must come before the regex\n",
+                argv[optind+1]);
+        // Counted lazily: a walk from the start needs no count above the
+        // bodies it steps through, so the first members of an enormous pattern
+        // come out at once. Whatever does need the size asks for it below.
+        rxe = parse_or_die(argv[optind],
+                           (flags & ~(RXE_DISTINCT|RXE_BYTE_ORDER))|RXE_LAZY_SIZE);
+        if (flags & (RXE_DISTINCT|RXE_BYTE_ORDER)) {
+            // Parsed plainly first, as with -F, for the caret; what refuses
+            // the set in byte order is the set, not a place in the pattern.
+            if (filter) die(1,"-u and -b do not combine with -F or -X\n");
+            rxe_free(rxe);
+            rxe = rxe_parse(argv[optind],flags|RXE_LAZY_SIZE);
+            if (rxe_error(rxe)) die(1,"%s\n",rxe_error_message(rxe));
+        }
+        if (filter) {
+            // The filtered set is a set of its own, counted and numbered
+            // apart from the whole one; every option below works on it. Both
+            // patterns are parsed alone first, so a syntax error in either
+            // gets its caret.
+            if (save_path || have_lengths || histogram)
+                die(1,"-F and -X do not combine with --save, --lengths or "
+                      "--length-histogram\n");
+            rxe_free(rxe);
+            rxe_free(parse_or_die(filter,flags & (RXE_CASELESS|RXE_DOTALL)));
+            rxe = rxe_parse_filtered(argv[optind],filter,flags|RXE_LAZY_SIZE);
+            if (rxe_error(rxe)) die(1,"%s\n",rxe_error_message(rxe));
+        }
+    }
+    if (save_path) {
+        save_image(rxe,save_path);
+        rxe_free(rxe);
+        mpz_clear(from); mpz_clear(to); mpz_clear(count);
+        return 0;
     }
 
     if (report_order) {
-        // Which of the two orders this expression is enumerated in. Used by
-        // the test suite to know which invariants apply; see ENUMERATION
-        // ORDER in the manual page.
-        printf("%s\n", rxe_is_shortlex(rxe) ? "shortlex" :
+        // Which of the orders this expression is enumerated in. Used by the
+        // test suite to know which invariants apply; see ENUMERATION ORDER in
+        // the manual page.
+        printf("%s\n", rxe->options & (RXE_DISTINCT|RXE_BYTE_ORDER) ? "byte order" :
+                        rxe_is_shortlex(rxe) ? "shortlex" :
                         rxe_is_infinite(rxe) ? "diagonal" : "place value");
         rxe_free(rxe);
         mpz_clear(from); mpz_clear(to); mpz_clear(count);
@@ -229,6 +393,24 @@ int main(int argc, char **argv)
         if (key)        die(1,"-k needs a finite set to permute\n");
         if (have_random) die(1,"-r needs a finite set to choose from\n");
     }
+    if (histogram) {
+        length_histogram(rxe,len_a,have_lengths ? len_b : -1,sep);
+        rxe_free(rxe);
+        mpz_clear(from); mpz_clear(to); mpz_clear(count);
+        return 0;
+    }
+    if (have_lengths) {
+        // A window is its own range; a start, an end, a shuffle or a random
+        // pick each name members by where they sit in the whole set instead.
+        if (have_from || have_to || key || have_random)
+            die(1,"--lengths takes no -f, -t, -k or -r; -c still limits it\n");
+        by_length(rxe,len_a,len_b,options,offset,count,sep);
+        rxe_free(rxe);
+        mpz_clear(from); mpz_clear(to); mpz_clear(count);
+        return 0;
+    }
+    // Both draw from the whole index range.
+    if (key || have_random) rxe_force_size(rxe);
     struct rxe_permutation *perm = NULL;
     if (key) perm = rxe_permutation_new(rxe->nitems,key);
 
@@ -298,6 +480,7 @@ int main(int argc, char **argv)
         // an unbounded amount.
         printf("infinite\n");
     } else {
+        rxe_force_size(rxe);
         print_grouped(stdout,NULL,rxe->nitems,"\n",sep);
         // The logarithms are meaningless for an empty set, and log(0) is
         // -infinity, which mpz_pow_ui turns into a GMP abort.
@@ -337,6 +520,17 @@ int main(int argc, char **argv)
             }
         }
     }
+    if (distinct_summary) {
+        // What the set comes to once every string is counted once, or why
+        // that cannot be said.
+        mpz_t n;
+        mpz_init(n);
+        int st = rxe_count_distinct(rxe,n);
+        if (!st) print_grouped(stdout,"distinct ",n,"\n",sep);
+        else if (st == RXE_INFINITE) printf("distinct infinite\n");
+        else printf("distinct unknown: %s\n",rxe_status_message(st));
+        mpz_clear(n);
+    }
     //rxe_backref_table_free(rxe->brt);
     rxe_permutation_free(perm);
     rxe_free(rxe);
@@ -354,8 +548,8 @@ void enumerate(struct rxe *rxe, int flags, int offset, mpz_t from, mpz_t cnt,
     if (mpz_sgn(cnt)) {
         mpz_add(final,from,cnt);
         mpz_sub_ui(final,final,1);
-    } else if (rxe_is_infinite(rxe)) {
-        // No last element to count digits up to. Leave room for a wide
+    } else if (rxe_is_infinite(rxe) || rxe->deferred) {
+        // No last element to count digits up to, or none worth counting. Leave room for a wide
         // number: this only sizes the field the index is printed in.
         mpz_set_ui(final,1000000000);
     } else {
@@ -400,8 +594,16 @@ void enumerate(struct rxe *rxe, int flags, int offset, mpz_t from, mpz_t cnt,
     }
     char *str = malloc((size_t)str_width + 1);
     if (!str) die(1,"out of memory for a %d-byte render buffer\n",str_width);
+    // The countdown is stepped once a member, so it is kept in the library's
+    // own integer, a register in a fixed-width build, and handed back in cnt.
+    rxe_int left, one;
+    ri_init(left);
+    ri_set_mpz(left,cnt);
+    ri_init_set_ui(one,1);
     for (;;) {
-         rxe_current(str,str_width,rxe);
+         // The buffer holds the member before, so only what the step moved
+         // is rendered again; after a seek that is all of it.
+         rxe_current_delta(str,str_width,rxe);
          if (flags & ENUM_NUMBER) {
             printf("%*s",nd,"");
             print_grouped(stdout,NULL,count," ",sep);
@@ -423,11 +625,14 @@ void enumerate(struct rxe *rxe, int flags, int offset, mpz_t from, mpz_t cnt,
              if (!rxe_next(rxe)) break;
          }
          if (flags & ENUM_ONCE) break;
-         if (mpz_sgn(cnt)) {
-             mpz_sub_ui(cnt,cnt,1);
-             if (!mpz_sgn(cnt)) break;
+         if (ri_sgn(left)) {
+             ri_sub(left,left,one);
+             if (!ri_sgn(left)) break;
          }
     }
+    ri_get_mpz(cnt,left);
+    ri_clear(left);
+    ri_clear(one);
     free(str);
     // -r calls this once per sample, so leaving these behind accumulated.
     mpz_clear(idx);
@@ -439,6 +644,124 @@ void enumerate(struct rxe *rxe, int flags, int offset, mpz_t from, mpz_t cnt,
     mpz_clear(q);
 }
 
+/* ---------------------------- Length Windows ---------------------------- */
+
+struct window_print {
+    int options, offset;
+    char sep;
+    mpz_t left;                   // -c: members still to print, or 0 for all
+};
+
+static int window_print(const char *str, size_t len, const mpz_t index,
+                        void *v)
+{
+    struct window_print *w = v;
+    if (w->options & ENUM_NUMBER) {
+        mpz_t n;
+        mpz_init(n);
+        mpz_add_ui(n,index,w->offset);
+        print_grouped(stdout,NULL,n," ",w->sep);
+        mpz_clear(n);
+    }
+    fwrite(str,1,len,stdout);
+    putchar('\n');
+    if (mpz_sgn(w->left)) {
+        mpz_sub_ui(w->left,w->left,1);
+        if (!mpz_sgn(w->left)) return 1;
+    }
+    return 0;
+}
+
+// --lengths: the members from length a to b, shortest first. -n numbers each
+// with its place in that order over the whole set, so the numbers say where a
+// shard sits as well as what is in it.
+
+void by_length(struct rxe *rxe, int a, int b, int options, int offset,
+               mpz_t count, char sep)
+{
+    struct window_print w;
+    w.options = options;
+    w.offset  = offset;
+    w.sep     = sep;
+    mpz_init_set(w.left,count);
+    int rc = rxe_foreach_lengths(rxe,a,b,str_width,window_print,&w);
+    mpz_clear(w.left);
+    if (rc == RXE_FOREACH_RANGE)
+        die(1,"the lengths of this set cannot be counted, and it has no end "
+              "to filter to\n");
+    if (rc == RXE_FOREACH_TOOBIG)
+        die(1,"a member in the window is longer than -w %d\n",str_width);
+}
+
+// Tally of a walk, for a set whose lengths cannot be counted in closed form.
+
+struct tally { int max; mpz_t *n; };
+
+static int tally_length(const char *str, size_t len, const mpz_t index,
+                        void *v)
+{
+    struct tally *t = v;
+    (void)str; (void)index;
+    if ((int)len <= t->max) mpz_add_ui(t->n[len],t->n[len],1);
+    return 0;
+}
+
+// --length-histogram: "length count" for each length in the window that has
+// members at all. Without a window a finite set is covered whole, stopping at
+// the length that completes its size; an infinite one has no last length and
+// needs a window. A set whose lengths cannot be counted is walked and tallied,
+// which only a finite one permits, and only as far as -w reaches.
+
+void length_histogram(struct rxe *rxe, int a, int b, char sep)
+{
+    int finite = !rxe_is_infinite(rxe), L;
+    mpz_t c, seen;
+    rxe_force_size(rxe);
+    mpz_init(c);
+    mpz_init_set_ui(seen,0);
+    if (b < 0 && !finite)
+        die(1,"--length-histogram needs --lengths on an infinite set\n");
+    if (!rxe_length_count(rxe,0,c)) {
+        for (L=0;L<a;L++) {
+            rxe_length_count(rxe,L,c);
+            mpz_add(seen,seen,c);
+        }
+        for ( ; b < 0 || L <= b ; L++) {
+            if (finite && mpz_cmp(seen,rxe->nitems) >= 0) break;
+            rxe_length_count(rxe,L,c);
+            mpz_add(seen,seen,c);
+            if (!mpz_sgn(c)) continue;
+            printf("%d ",L);
+            print_grouped(stdout,NULL,c,"\n",sep);
+        }
+    } else {
+        if (!finite)
+            die(1,"the lengths of this set cannot be counted, and it has no "
+                  "end to tally to\n");
+        int hi = b < 0 || b > str_width ? str_width : b;
+        struct tally t = { hi, malloc(((size_t)hi+1)*sizeof(mpz_t)) };
+        if (!t.n) die(1,"out of memory for a histogram of %d lengths\n",hi+1);
+        for (L=0;L<=hi;L++) mpz_init(t.n[L]);
+        rxe_foreach_lengths(rxe,a,hi,str_width,tally_length,&t);
+        for (L=a;L<=hi;L++) {
+            mpz_add(seen,seen,t.n[L]);
+            if (!mpz_sgn(t.n[L])) continue;
+            printf("%d ",L);
+            print_grouped(stdout,NULL,t.n[L],"\n",sep);
+        }
+        for (L=0;L<=hi;L++) mpz_clear(t.n[L]);
+        free(t.n);
+        // Counted by walking, so anything past the buffer went unseen; say so
+        // rather than let the rows pass for the whole set.
+        fflush(stdout);
+        if (b < 0 && mpz_cmp(seen,rxe->nitems) < 0)
+            fprintf(stderr,"members longer than -w %d were not counted\n",
+                    str_width);
+    }
+    mpz_clear(c);
+    mpz_clear(seen);
+}
+
 void print_grouped(FILE *fp, char *prefix, mpz_t x, char *suffix, char sep)
 {
     if (prefix) fprintf(fp,"%s",prefix);
@@ -470,16 +793,19 @@ void print_grouped(FILE *fp, char *prefix, mpz_t x, char *suffix, char sep)
 
 // FIXME: perhaps we could replace this by mpz_sizeinbase
 
+// The decimal digits in x, one at the least. mpz_sizeinbase may answer one
+// over, so a power settles it: counting up by repeated multiplication cost a
+// pass over x per digit, which for a member picked at random from a long
+// repetition took longer than the seek to it.
+
 int mpz_len(mpz_t x)
 {
+    if (mpz_cmp_ui(x,10) < 0) return 1;
+    int len = (int)mpz_sizeinbase(x,10);
     mpz_t r;
-    mpz_init_set_ui(r,10);
-    int len = 0;
-    for (;;) {
-        len++;
-        if (mpz_cmp(r,x)>0) break;
-        mpz_mul_ui(r,r,10);
-    }
+    mpz_init(r);
+    mpz_ui_pow_ui(r,10,(unsigned long)len - 1);
+    if (mpz_cmp(r,x) > 0) len--;
     mpz_clear(r);
     return len;
 }
@@ -10,10 +10,13 @@
  * string literal -- the most natural thing any caller does -- segfaulted.
  */
 
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include "rxe.h"
 #include "lens.h"
+#include "plan.h"
 
 static int failures = 0;
 
@@ -32,6 +35,14 @@ static void check_int(const char *what, long want, long got)
     check(what, w, g);
 }
 
+// Whether a library built on a machine word refused 'rxe' as too large to
+// count. A check written for a set that wide has nothing to say about such a
+// build, beyond the refusal. Under GMP, never.
+static int exceeds_int(struct rxe *rxe)
+{
+    return RXE_INT_BITS && rxe->status == RXE_EXCEEDS_INT;
+}
+
 // A sink for rxe_foreach: joins members with '/' just as collect() does, so the
 // two walks can be compared byte for byte. It also records the last index it
 // was handed and, when stop_after is set, asks to stop once it has seen that
@@ -44,6 +55,42 @@ struct catctx {
     char   lastidx[64];  // the index of the last member, for an order check
 };
 
+// Drops and registers a dictionary until told to stop, for the registry test:
+// a save racing it has the name its words had, or nothing, but never a freed
+// one.
+static void *dict_churn(void *arg)
+{
+    static const char *words[] = { "plum", "pear" };
+    while (!__atomic_load_n((int *)arg, __ATOMIC_RELAXED)) {
+        rxe_free_dicts();
+        rxe_register_dict("churn", words, 2);
+    }
+    return NULL;
+}
+
+// Makes a cursor over a shared lazily counted set and renders a member deep
+// in it, for the lazy count test: whichever thread's cursor settles the
+// counts, every thread sees them whole.
+struct lazy_walk {
+    struct rxe *rxe;
+    char got[64];
+};
+
+static void *lazy_walker(void *arg)
+{
+    struct lazy_walk *w = arg;
+    struct rxe_cursor *cur = rxe_cursor_new(w->rxe);
+    mpz_t at;
+    mpz_init(at);
+    mpz_ui_pow_ui(at, 27, 40);
+    w->got[0] = 0;
+    if (cur && !rxe_cursor_seek(cur, at))
+        rxe_cursor_current(w->got, sizeof w->got - 1, cur);
+    mpz_clear(at);
+    rxe_cursor_free(cur);
+    return NULL;
+}
+
 static int cat_sink(const char *s, size_t len, const mpz_t index, void *v)
 {
     struct catctx *c = v;
@@ -75,6 +122,117 @@ static void collect(struct rxe *rxe, char *out, size_t outsz)
     } while (rxe_next(rxe));
 }
 
+// Sorts a '/'-joined list in place, so two walks of the same members in
+// different orders compare equal.
+static int cmp_member(const void *x, const void *y)
+{
+    return strcmp(*(char *const *)x, *(char *const *)y);
+}
+
+static void sort_members(char *list)
+{
+    char *copy = strdup(list), *part[1024], *p;
+    int n = 0;
+    for (p = strtok(copy, "/"); p && n < 1024; p = strtok(NULL, "/"))
+        part[n++] = p;
+    qsort(part, n, sizeof *part, cmp_member);
+    list[0] = 0;
+    for (int i = 0; i < n; i++) {
+        strcat(list, part[i]);
+        strcat(list, "/");
+    }
+    free(copy);
+}
+
+// Drops each member equal to the one before it, from a list sort_members has
+// put in order.
+static void uniq_members(char *list)
+{
+    char *out = list, *p = list, *last = NULL;
+    size_t lastlen = 0;
+    while (*p) {
+        char *e = strchr(p, '/');
+        size_t n = (size_t)(e - p);
+        if (!last || n != lastlen || memcmp(last, p, n)) {
+            memmove(out, p, n + 1);
+            last = out;
+            lastlen = n;
+            out += n + 1;
+        }
+        p = e + 1;
+    }
+    *out = 0;
+}
+
+// Seeks a second copy of the set to each index it is handed and counts the
+// members that are not what the seek renders there.
+struct seekcheck { struct rxe *ref; int wrong; };
+
+static int seek_sink(const char *s, size_t len, const mpz_t index, void *v)
+{
+    struct seekcheck *sc = v;
+    char item[128];
+    mpz_t i;
+    mpz_init_set(i, index);
+    rxe_seek(sc->ref, i);
+    mpz_clear(i);
+    rxe_current(item, sizeof item - 1, sc->ref);
+    if (strlen(item) != len || memcmp(item, s, len)) sc->wrong++;
+    return 0;
+}
+
+// Checks the indices rxe_rank_all emits run one after another from 'next',
+// as a string's spellings do in byte order.
+struct rankrun { mpz_t next; int gaps; };
+
+static int run_sink(const mpz_t index, void *v)
+{
+    struct rankrun *r = v;
+    r->gaps += mpz_cmp(index, r->next) != 0;
+    mpz_add_ui(r->next, index, 1);
+    return 0;
+}
+
+// One thread's share of a parallel walk. With 'limit' set it stops at that
+// index and checks each member is a^index b; otherwise it files each member
+// under its index, where the threads' writes never overlap.
+struct par_tally {
+    char (*got)[6];
+    long n;
+    int  bad;
+    long limit;
+};
+
+static int par_sink(const char *s, size_t len, const mpz_t index, void *v)
+{
+    struct par_tally *t = v;
+    unsigned long i = mpz_get_ui(index);
+    if (t->limit >= 0) {
+        if (i >= (unsigned long)t->limit) return 1;
+        if (len != i + 1 || s[i] != 'b' || memchr(s, 'b', i)) t->bad = 1;
+    } else {
+        memcpy(t->got[i], s, len);
+        t->got[i][len] = 0;
+    }
+    t->n++;
+    return 0;
+}
+
+// GMP's allocations, counted so a test can tell a seek that touches the heap
+// from one that does not.
+static unsigned long gmp_calls;
+static void *(*gmp_alloc)(size_t);
+static void *(*gmp_realloc)(void *, size_t, size_t);
+static void (*gmp_free)(void *, size_t);
+
+static void *count_alloc(size_t n) { gmp_calls++; return gmp_alloc(n); }
+static void *count_realloc(void *p, size_t o, size_t n)
+{
+    gmp_calls++;
+    return gmp_realloc(p, o, n);
+}
+static void count_free(void *p, size_t n) { gmp_calls++; gmp_free(p, n); }
+
 int main(void)
 {
     char buf[256];
@@ -193,7 +351,10 @@ int main(void)
     //    wanted about 26GB.
     {
         struct rxe *rxe = rxe_parse("[a-z]{1,20000}", 0);
-        check_int("a 20000-wide repetition parses", RXE_OK, rxe_error(rxe));
+        // A library built on a machine word refuses to count it, but the
+        // tree is there all the same, and seeks as it always has.
+        check_int("a 20000-wide repetition parses",
+                  RXE_INT_BITS ? RXE_EXCEEDS_INT : RXE_OK, rxe_error(rxe));
         // sum(26^j, j=1..20000) has 28300 decimal digits.
         check_int("its cardinality has 28300 digits", 28300,
                   (long)mpz_sizeinbase(rxe->nitems, 10));
@@ -378,6 +539,26 @@ int main(void)
                   RXE_UNKNOWN_DICT, rxe_error(rxe));
         rxe_free(rxe);
 
+        // An expression keeps the words it was parsed with, and so does its
+        // clone: registering the name again, or dropping every dictionary,
+        // leaves theirs alone.
+        const char *birds[] = { "owl" };
+        rxe = rxe_parse("[:animals:]", 0);
+        rxe_uncompile(rxe);
+        struct rxe *twin = rxe_deep_clone(rxe);
+        rxe_register_dict("animals", birds, 1);
+        rxe_free_dicts();
+        mpz_init_set_ui(pos, 1);
+        rxe_seek(rxe, pos);
+        rxe_seek(twin, pos);
+        mpz_clear(pos);
+        rxe_current(buf, sizeof(buf) - 1, rxe);
+        check("a replaced dictionary's words outlive it", "dog", buf);
+        rxe_free(rxe);
+        rxe_current(buf, sizeof(buf) - 1, twin);
+        check("in the clone as well", "dog", buf);
+        rxe_free(twin);
+
         rxe_free_dicts();
     }
 
@@ -539,6 +720,1610 @@ int main(void)
         rxe_free(rxe);
     }
 
+    {
+        // The flat plan stands in for the tree walk, so the two must number a
+        // set identically. Each pattern is walked whole and seeked at a few
+        // indices both ways: once as parsed, once with the plan dropped.
+        static const char *pats[] = {
+            "[a-c]{3}", "(foo|ba[rz]){2}[0-9]", "x(ab|c)(d|ef|)y|z[12]|",
+            "(a|bc)\\1-\\1", "(?:(a|b)c){2}\\1", "[ab]{0,2}(x|yy)", "[]a",
+            "(?i)k[a-b]", NULL
+        };
+        for (int i = 0; pats[i]; i++) {
+            struct rxe *planned = rxe_parse(pats[i], 0);
+            struct rxe *tree = rxe_parse(pats[i], 0);
+            char a[512], b[512];
+            rxe_uncompile(tree);
+            check_int(pats[i], 0, rxe_is_compiled(tree));
+            collect(planned, a, sizeof a);
+            collect(tree, b, sizeof b);
+            check(pats[i], b, a);
+            for (unsigned long k = 0; k < 40; k += 7) {
+                mpz_t at;
+                mpz_init_set_ui(at, k);
+                int rp = rxe_seek(planned, at), rt = rxe_seek(tree, at);
+                check_int("plan and tree agree on which seeks fail", rt, rp);
+                if (!rp && !rt) {
+                    rxe_current(a, 64, planned);
+                    rxe_current(b, 64, tree);
+                    check(pats[i], b, a);
+                }
+                mpz_clear(at);
+            }
+            rxe_free(planned);
+            rxe_free(tree);
+        }
+
+        struct rxe *rxe = rxe_parse("[0-9]{4}", 0);
+        check_int("a mask is compiled", 1, rxe_is_compiled(rxe));
+        struct rxe *copy = rxe_deep_clone(rxe);
+        check_int("and its clone shares the plan", 1, rxe_is_compiled(copy));
+        mpz_t at;
+        mpz_init_set_ui(at, 4321);
+        rxe_seek(copy, at);
+        rxe_current(buf, 8, copy);
+        check("the clone walks on its own", "4321", buf);
+        rxe_current(buf, 8, rxe);
+        check("without moving the original", "0000", buf);
+        rxe_free(copy);
+
+        // A carry into the next alternation finds it at its first member, not
+        // wherever an earlier seek into it left it -- in the plan and the tree
+        // alike.
+        static const struct {
+            const char *pat; unsigned long far, near; const char *next;
+        } carry[] = {
+            { "a|[bc][de]", 4, 0, "bd" },
+            { "q|[ab]{3,5}|r(c|[de]{2,4})", 77, 56, "rc" },
+        };
+        for (int c = 0; c < 2; c++)
+            for (int tree = 0; tree < 2; tree++) {
+                struct rxe *walk = rxe_parse(carry[c].pat, 0);
+                if (tree) rxe_uncompile(walk);
+                mpz_set_ui(at, carry[c].far);
+                rxe_seek(walk, at);
+                mpz_set_ui(at, carry[c].near);
+                rxe_seek(walk, at);
+                rxe_iterate(walk);
+                rxe_current(buf, 8, walk);
+                check(tree ? "the tree carries into a fresh alternation"
+                           : "the plan carries into a fresh alternation",
+                      carry[c].next, buf);
+                rxe_free(walk);
+            }
+
+        // A member past the cap is one only the tree knows how to refuse.
+        rxe_set_max_member(2);
+        check_int("a plan wider than the cap stands aside", 0, rxe_is_compiled(rxe));
+        rxe_set_max_member(RXE_DEFAULT_MAX_MEMBER);
+        rxe_free(rxe);
+        mpz_clear(at);
+        check_int("an infinite set has no plan", 0,
+                  rxe_is_compiled(rxe = rxe_parse("a*b", 0)));
+        rxe_free(rxe);
+    }
+
+    {
+        // Cursors: many walkers over one parse. Over a planned set they share
+        // the tree outright; each keeps its own digits, and the tree's own
+        // position is never touched.
+        struct rxe *rxe = rxe_parse("(ab|c)[0-9]{2}", 0);
+        struct rxe_cursor *c1 = rxe_cursor_new(rxe), *c2 = rxe_cursor_new(rxe);
+        mpz_t at;
+        mpz_init_set_ui(at, 150);
+        check_int("a cursor seeks", 0, rxe_cursor_seek(c1, at));
+        rxe_cursor_current(buf, 16, c1);
+        check("to its own member", "c50", buf);
+        rxe_cursor_current(buf, 16, c2);
+        check("while another stays on the first", "ab00", buf);
+        rxe_cursor_iterate(c1);
+        rxe_cursor_current(buf, 16, c1);
+        check("and steps from where it is", "c51", buf);
+        rxe_current(buf, 16, rxe);
+        check("leaving the tree where it was", "ab00", buf);
+        mpz_set_ui(at, 200);
+        check_int("past the end is refused", 1, rxe_cursor_seek(c2, at));
+        check("with a reason", "index past the end of the set", rxe_cursor_reason(c2));
+        rxe_cursor_free(c1);
+        rxe_cursor_free(c2);
+        rxe_free(rxe);
+
+        // Without a plan a cursor walks the shared tree, keeping only where it
+        // stands, to the same effect.
+        rxe = rxe_parse("a*b", 0);
+        c1 = rxe_cursor_new(rxe);
+        mpz_set_ui(at, 3);
+        rxe_cursor_seek(c1, at);
+        rxe_cursor_current(buf, 16, c1);
+        check("and seeks in it", "aaab", buf);
+        rxe_current(buf, 16, rxe);
+        check("leaving the tree alone", "b", buf);
+        rxe_cursor_free(c1);
+        rxe_free(rxe);
+
+        // However many of them, through repetitions, a backreference and a
+        // keyed shuffle, each walks on its own; and making one costs a walk's
+        // few arrays, not a copy of every node.
+        {
+            const char *pat = "(?~k:[a-e]{2})(x|yz)\\1(?:[0-9]|q|r|s|t|u|v|w)+";
+            struct rxe *ref = rxe_parse(pat, 0);
+            struct rxe *tree = rxe_parse(pat, 0);
+            struct rxe_cursor *cs[3];
+            char want[64];
+            int i, k, bad = -1;
+            unsigned long before = rxe_alloc_calls();
+            struct rxe *copy = rxe_deep_clone(tree);
+            unsigned long by_copy = rxe_alloc_calls() - before;
+            rxe_free(copy);
+            before = rxe_alloc_calls();
+            cs[0] = rxe_cursor_new(tree);
+            unsigned long by_cursor = rxe_alloc_calls() - before;
+            check_int("a cursor is cheaper than a copy", 1, by_cursor < by_copy);
+            cs[1] = rxe_cursor_new(tree);
+            cs[2] = rxe_cursor_new(tree);
+            for (k = 0; k < 3; k++) {
+                mpz_set_ui(at, 1000 * k + 7);
+                rxe_cursor_seek(cs[k], at);
+            }
+            for (i = 0; i < 300 && bad < 0; i++)
+                for (k = 0; k < 3 && bad < 0; k++) {
+                    mpz_set_ui(at, 1000 * k + 7 + i);
+                    rxe_seek(ref, at);
+                    rxe_current(want, sizeof want - 1, ref);
+                    rxe_cursor_current(buf, sizeof want - 1, cs[k]);
+                    if (strcmp(want, buf)) bad = i;
+                    rxe_cursor_iterate(cs[k]);
+                }
+            check_int("interleaved cursors keep their own places", -1, bad);
+            mpz_set_ui(at, 0);
+            rxe_seek(ref, at);
+            rxe_current(want, sizeof want - 1, ref);
+            rxe_current(buf, sizeof want - 1, tree);
+            check("while the tree stays on its own", want, buf);
+            for (k = 0; k < 3; k++) rxe_cursor_free(cs[k]);
+            rxe_free(tree);
+            rxe_free(ref);
+        }
+
+        // A copy of the whole parse gets its own groups: its backreference
+        // must spell what its group holds, not what the original's does.
+        rxe = rxe_parse("(a|b)\\1(?:x|y)", 0);
+        rxe_uncompile(rxe);
+        struct rxe *copy = rxe_deep_clone(rxe);
+        mpz_set_ui(at, 3);
+        rxe_seek(copy, at);
+        rxe_current(buf, 16, copy);
+        check("a clone's backreference names its own group", "bby", buf);
+        rxe_free(copy);
+        rxe_free(rxe);
+
+        // Rank no longer writes its backreference captures into the tree.
+        rxe = rxe_parse("(a|b)\\1", 0);
+        check_int("rank through a backreference", 0, rxe_rank(rxe, "bb", at));
+        check_int("finds the index", 1, mpz_get_ui(at));
+        check_int("and refuses a mismatch", 1, rxe_rank(rxe, "ab", at));
+        rxe_free(rxe);
+        mpz_clear(at);
+    }
+
+    {
+        // The parallel walk: every member once, on whichever thread, each
+        // thread's sink with its own context; and one stop halts them all.
+        struct rxe *rxe = rxe_parse("[a-d]{4}[0-9]", 0);
+        static char got[2560][6], want[2560][6];
+        struct par_tally tally[4] = { { got, 0, 0, -1 }, { got, 0, 0, -1 },
+                                      { got, 0, 0, -1 }, { got, 0, 0, -1 } };
+        void *ctx[4] = { &tally[0], &tally[1], &tally[2], &tally[3] };
+        mpz_t from, count;
+        mpz_init(from);
+        mpz_init(count);
+        check_int("a parallel walk ends", RXE_FOREACH_END,
+                  rxe_foreach_parallel(rxe, from, count, 8, par_sink, ctx, 4));
+        long seen = 0;
+        for (int t = 0; t < 4; t++) seen += tally[t].n;
+        check_int("having walked every member", 2560, seen);
+        for (int i = 0; i < 2560; i++) {
+            mpz_set_ui(from, i);
+            rxe_seek(rxe, from);
+            *rxe_current(want[i], 6, rxe) = 0;
+        }
+        check_int("each at its own index", 0, memcmp(got, want, sizeof got));
+
+        // A sub-range, through a walk that has no plan to share.
+        memset(got, 0, sizeof got);
+        for (int t = 0; t < 4; t++) tally[t].n = 0;
+        rxe_free(rxe);
+        rxe = rxe_parse("[a-d]{1,5}", 0);
+        mpz_set_ui(from, 100);
+        mpz_set_ui(count, 1000);
+        check_int("a sub-range ends", RXE_FOREACH_END,
+                  rxe_foreach_parallel(rxe, from, count, 8, par_sink, ctx, 3));
+        seen = tally[0].n + tally[1].n + tally[2].n;
+        check_int("at its count", 1000, seen);
+        mpz_set_ui(from, 1099);
+        rxe_seek(rxe, from);
+        *rxe_current(buf, 8, rxe) = 0;
+        check("its last member is in place", buf, got[1099]);
+        check("and the one past it is not", "", got[1100]);
+
+        // One sink's stop reaches every thread; an infinite set with no count
+        // is walked only until then.
+        rxe_free(rxe);
+        rxe = rxe_parse("a*b", 0);
+        for (int t = 0; t < 4; t++) tally[t] = (struct par_tally){ NULL, 0, 0, 50 };
+        mpz_set_ui(from, 0);
+        mpz_set_ui(count, 0);
+        check_int("a stop ends the walk", RXE_FOREACH_STOP,
+                  rxe_foreach_parallel(rxe, from, count, 64, par_sink, ctx, 4));
+        int bad = 0;
+        for (int t = 0; t < 4; t++) bad |= tally[t].bad;
+        check_int("and every member seen was right", 0, bad);
+
+        // Threads dealt slices further out meet members too long for the
+        // buffer before the first slice reaches the stop at 50. The verdict is
+        // the serial walk's all the same, however the threads happened to run.
+        rxe_free(rxe);
+        rxe = rxe_parse("a{0,3999}b", 0);
+        int verdicts = 0;
+        for (int run = 0; run < 20; run++) {
+            for (int t = 0; t < 4; t++) tally[t] = (struct par_tally){ NULL, 0, 0, 50 };
+            verdicts += rxe_foreach_parallel(rxe, from, count, 64, par_sink,
+                                             ctx, 4) == RXE_FOREACH_STOP;
+        }
+        check_int("the lowest stop is the verdict, every time", 20, verdicts);
+        rxe_free(rxe);
+        rxe = rxe_parse("[ab]{2}", 0);
+        mpz_set_ui(from, 4);
+        check_int("from past a finite end is refused", RXE_FOREACH_RANGE,
+                  rxe_foreach_parallel(rxe, from, count, 8, par_sink, ctx, 2));
+        rxe_free(rxe);
+        mpz_clear(from);
+        mpz_clear(count);
+    }
+
+    {
+        // Stepping shortest first carries instead of seeking; every step must
+        // land where a seek to the same index does, across the change of
+        // split, of repeat count, of alternation and of length.
+        static const char *pat[] = {
+            "\\d+", "a*b*", "(ab|c)*d", "[ab]+(x|yz)*", "(?:[a-c]{1,2}|dd)+",
+            "x(a|bc)*y|[0-9]*", "(?L)[ab]*c[de]*", "(\\w{1,2},)*", "(a|)b+",
+            "(ab|c)d+", "(a|bc|d+)e*",
+        };
+        char want[64];
+        mpz_t at;
+        mpz_init(at);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *walk = rxe_parse(pat[p], 0), *seek = rxe_parse(pat[p], 0);
+            int bad = -1;
+            mpz_set_ui(at, 37);
+            rxe_seek(walk, at);
+            for (int i = 37; i < 3000 && bad < 0; i++) {
+                mpz_set_ui(at, i);
+                rxe_seek(seek, at);
+                rxe_current(want, sizeof want - 1, seek);
+                rxe_current(buf, sizeof want - 1, walk);
+                if (strcmp(want, buf) || ri_cmp_ui(walk->walk.index, i)) bad = i;
+                rxe_iterate(walk);
+            }
+            sprintf(want, "shortlex steps agree with seeks on %s", pat[p]);
+            check_int(want, -1, bad);
+            rxe_free(walk);
+            rxe_free(seek);
+        }
+        mpz_clear(at);
+    }
+
+    {
+        // A delta render keeps the buffer's untouched prefix and redraws the
+        // rest; whatever it keeps has to be what a full render would write,
+        // through the plan, the tree, a repetition's positions and a buffer
+        // that cuts every member short.
+        static const char *pat[] = {
+            "[a-c]{2}(x|yz)[0-9]", "[a-z0-9]{30}", "q(a|bc|){2,6}", "([ab]{2})-\\1",
+            "(?L)[a-c]{3,5}", "[ab]{1,6}(x|y){0,3}", "(ab|c)*d",
+        };
+        static const int cap[] = { 63, 4 };
+        char want[64], last[64], note[96];
+        mpz_t at;
+        mpz_init(at);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            for (size_t c = 0; c < sizeof cap / sizeof *cap; c++) {
+                struct rxe *walk = rxe_parse(pat[p], 0), *seek = rxe_parse(pat[p], 0);
+                int bad = -1;
+                last[0] = 0;
+                for (int i = 0; i < 2000 && bad < 0; i++) {
+                    mpz_set_ui(at, i);
+                    if (rxe_seek(seek, at)) break;
+                    rxe_current(want, cap[c], seek);
+                    int keep = rxe_touched(walk);
+                    rxe_current_delta(buf, cap[c], walk);
+                    if (strcmp(want, buf) || strncmp(last, buf, keep)) bad = i;
+                    strcpy(last, buf);
+                    rxe_iterate(walk);
+                }
+                sprintf(note, "delta renders agree on %s within %d", pat[p], cap[c]);
+                check_int(note, -1, bad);
+                rxe_free(walk);
+                rxe_free(seek);
+            }
+        }
+        mpz_clear(at);
+    }
+
+    {
+        // A small body's members are kept and copied in, position by
+        // position; what comes out must be what seeking the body spells.
+        struct rxe *rxe = rxe_parse("([a-c][0-9]){30}", 0);
+        char want[64], got[64];
+        mpz_t at, q;
+        mpz_init(at);
+        mpz_init(q);
+        int bad = -1;
+        for (int i = 0; i < 500 && bad < 0 && !exceeds_int(rxe); i++) {
+            mpz_ui_pow_ui(at, 30, 30);
+            mpz_mul_ui(at, at, (unsigned long)i * 7919 % 1000);
+            mpz_tdiv_q_ui(at, at, 1000);
+            mpz_add_ui(at, at, i);
+            mpz_set(q, at);
+            for (int p = 29; p >= 0; p--) {
+                unsigned long d = mpz_tdiv_q_ui(q, q, 30);
+                want[2 * p] = "abc"[d / 10];
+                want[2 * p + 1] = '0' + d % 10;
+            }
+            want[60] = 0;
+            rxe_seek(rxe, at);
+            rxe_current(got, sizeof got - 1, rxe);
+            if (strcmp(want, got)) bad = i;
+        }
+        check_int("kept body members spell the member", -1, bad);
+        rxe_free(rxe);
+
+        // A group read back later is left at its last position, not copied.
+        rxe = rxe_parse("([ab]){3}-\\1", 0);
+        bad = -1;
+        for (int i = 0; i < 8; i++) {
+            mpz_set_ui(at, i);
+            rxe_seek(rxe, at);
+            rxe_current(got, sizeof got - 1, rxe);
+            if (got[2] != got[4]) bad = i;
+        }
+        check_int("a backreferenced body is still seeked", -1, bad);
+        rxe_free(rxe);
+
+        // A body member too long to keep still renders in full.
+        static char big[1024];
+        rxe = rxe_parse("(x{300}|y){2}", 0);
+        mpz_set_ui(at, 1);
+        rxe_seek(rxe, at);
+        check_int("a long body member is rendered", 301,
+                  (int)(rxe_current(big, sizeof big - 1, rxe) - big));
+        check_int("and ends in its other one", 'y', big[300]);
+        rxe_free(rxe);
+        mpz_clear(at);
+        mpz_clear(q);
+    }
+
+    {
+        // A warmed-up seek borrows every temporary from the tree it walks, so
+        // it makes no heap calls at all -- the library's or GMP's -- whether
+        // through a repetition, an endless alternation's pairing, a shuffled
+        // group, the plan, or a keyed permutation in front of it.
+        static const char *pat[] = {
+            "([a-z][0-9]){30}", "(?~k:[a-c])[xy]*[zw]*",
+            "(?~k:[a-f]{3})x[0-9]{40}", "[a-z]{6}",
+        };
+        // The caller's own bignums are the caller's to size.
+        mpz_t at, top, mapped;
+        mpz_init2(at, 512);
+        mpz_init(top);
+        mpz_init2(mapped, 512);
+        mp_get_memory_functions(&gmp_alloc, &gmp_realloc, &gmp_free);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *rxe = rxe_parse(pat[p], 0);
+            if (rxe->ninf) mpz_ui_pow_ui(top, 10, 20);
+            else mpz_sub_ui(top, rxe->nitems, 1);
+            struct rxe_permutation *perm = rxe_permutation_new(top, "key");
+            // The first pass warms the tree up; the second is counted.
+            unsigned long before = 0;
+            for (int pass = 0; pass < 2; pass++) {
+                if (pass) {
+                    mp_set_memory_functions(count_alloc, count_realloc, count_free);
+                    before = rxe_alloc_calls();
+                    gmp_calls = 0;
+                }
+                for (unsigned long i = 1; i < 500; i++) {
+                    mpz_tdiv_q_ui(at, top, i * i);
+                    mpz_add_ui(at, at, i);
+                    rxe_permutation_map(mapped, perm, at);
+                    rxe_seek(rxe, mapped);
+                }
+            }
+            long calls = (long)(rxe_alloc_calls() - before + gmp_calls);
+            mp_set_memory_functions(gmp_alloc, gmp_realloc, gmp_free);
+            sprintf(buf, "a warm keyed seek allocates nothing on %s", pat[p]);
+            check_int(buf, 0, calls);
+            rxe_permutation_free(perm);
+            rxe_free(rxe);
+        }
+        mpz_clear(at);
+        mpz_clear(top);
+        mpz_clear(mapped);
+    }
+
+    // Batches: the members come back end to end, split by the offsets, and
+    // read the same as a walk one at a time, whatever the batch and buffer
+    // sizes cut them into -- across the plan and the tree walk alike, across
+    // a batch that stopped on a full buffer, and with a last class laid as
+    // lanes by vector stores or by the copying loop.
+    {
+        const char *pat[] = { "[a-c][0-9]", "(ab|c)[xy]{0,2}", "a{0,3}b|cd",
+                              "(?~k:[a-e])-[01]", "(x|yz)-\\1",
+                              "[a-z0-9]{2}", "(a|bc)[0-9]", "[0-9]", "(x)[0-9]\\1" };
+        const size_t cap[][2] = { { 1, 64 }, { 5, 16 }, { 100, 9 }, { 3, 7 },
+                                  { 40, 64 }, { 100, 64 } };
+        char want[8192], got[8192], chunk[64];
+        size_t offsets[101], produced;
+        mpz_t zero;
+        mpz_init(zero);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *rxe = rxe_parse(pat[p], 0);
+            collect(rxe, want, sizeof want);
+            for (size_t c = 0; c < 2 * sizeof cap / sizeof *cap; c++) {
+                int rc, rounds = 0;
+                rxe_plan_vector_lanes = c % 2;
+                rxe_seek(rxe, zero);
+                got[0] = 0;
+                do {
+                    rc = rxe_render_batch(rxe, cap[c/2][0], chunk, cap[c/2][1],
+                                          offsets, &produced);
+                    for (size_t i = 0; i < produced; i++) {
+                        size_t len = offsets[i+1] - offsets[i];
+                        if (strlen(got) + len + 2 < sizeof got) {
+                            strncat(got, chunk + offsets[i], len);
+                            strcat(got, "/");
+                        }
+                    }
+                } while (rc == RXE_FOREACH_STOP && ++rounds < 10000);
+                sprintf(buf, "a batch walk of %s, %zu at a time in %zu bytes%s",
+                        pat[p], cap[c/2][0], cap[c/2][1],
+                        c % 2 ? "" : ", lanes by loop");
+                check(buf, want, got);
+                check_int("ends with the set", RXE_FOREACH_END, rc);
+            }
+            rxe_free(rxe);
+        }
+        // Members about as wide as a vector register, whose last lane's store
+        // runs up against the end of the buffer.
+        const char *wide[] = { "abcdefghijklmn[0-9a-z]", "abcdefghijklmno[0-9]",
+                               "abcdefghijklmnop[0-9]", "x[0-9]{1,2}y[a-z]" };
+        const size_t wcap[][2] = { { 100, 64 }, { 3, 40 }, { 100, 300 } };
+        char big[300];
+        for (size_t p = 0; p < sizeof wide / sizeof *wide; p++) {
+            struct rxe *rxe = rxe_parse(wide[p], 0);
+            collect(rxe, want, sizeof want);
+            for (size_t c = 0; c < 2 * sizeof wcap / sizeof *wcap; c++) {
+                int rc, rounds = 0;
+                rxe_plan_vector_lanes = c % 2;
+                rxe_seek(rxe, zero);
+                got[0] = 0;
+                do {
+                    rc = rxe_render_batch(rxe, wcap[c/2][0], big, wcap[c/2][1],
+                                          offsets, &produced);
+                    for (size_t i = 0; i < produced; i++) {
+                        size_t len = offsets[i+1] - offsets[i];
+                        if (strlen(got) + len + 2 < sizeof got) {
+                            strncat(got, big + offsets[i], len);
+                            strcat(got, "/");
+                        }
+                    }
+                } while (rc == RXE_FOREACH_STOP && ++rounds < 10000);
+                sprintf(buf, "a batch walk of %s, %zu at a time in %zu bytes%s",
+                        wide[p], wcap[c/2][0], wcap[c/2][1],
+                        c % 2 ? "" : ", lanes by loop");
+                check(buf, want, got);
+                check_int("ends with the set", RXE_FOREACH_END, rc);
+            }
+            rxe_free(rxe);
+        }
+        rxe_plan_vector_lanes = 1;
+        // An endless set never ends; the next batch carries on from the last.
+        struct rxe *rxe = rxe_parse("[ab]*", 0);
+        rxe_render_batch(rxe, 4, chunk, sizeof chunk, offsets, &produced);
+        int rc = rxe_render_batch(rxe, 3, chunk, sizeof chunk, offsets,
+                                  &produced);
+        check_int("an endless set stops at the count", RXE_FOREACH_STOP, rc);
+        chunk[offsets[produced]] = 0;
+        check("and carries on from the batch before", "abbabb",
+              chunk + offsets[0]);
+        rxe_free(rxe);
+        rxe = rxe_parse("abcd|e", 0);
+        rc = rxe_render_batch(rxe, 2, chunk, 5, offsets, &produced);
+        check_int("a member the buffer can never hold", RXE_FOREACH_TOOBIG, rc);
+        check_int("is not taken", 0, (long)produced);
+        rc = rxe_render_batch(rxe, 2, chunk, 6, offsets, &produced);
+        check_int("but one byte more holds it", RXE_FOREACH_STOP, rc);
+        check_int("and only it", 1, (long)produced);
+        rxe_free(rxe);
+        mpz_clear(zero);
+    }
+
+    // Strides: an advance lands where a seek to the sum does, by plan and by
+    // tree walk, forwards and back, and the delta render after it agrees with
+    // a seek's whole one. A sum outside the set moves nothing.
+    {
+        const char *pat[] = { "[a-c][0-9]{2}", "(ab|c)[xy]{0,2}",
+                              "([a-c][0-9]){3}", "x(?~k:[a-e])[01]",
+                              "(a|bc)[0-9]-\\1", "a{0,4}b|[cd]{2}" };
+        const long stride[] = { 1, 7, 36, -5, -1 };
+        char got[64], want[64], delta[64];
+        mpz_t at;
+        mpz_init(at);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            for (int tree = 0; tree < 2; tree++) {
+                struct rxe *rxe = rxe_parse(pat[p], 0);
+                struct rxe *ref = rxe_parse(pat[p], 0);
+                if (tree) rxe_uncompile(rxe);
+                long n = (long)mpz_get_ui(rxe->nitems);
+                for (size_t k = 0; k < sizeof stride / sizeof *stride; k++) {
+                    long s = stride[k], i = s > 0 ? 0 : n - 1, bad = 0;
+                    mpz_set_si(at, i);
+                    rxe_seek(rxe, at);
+                    rxe_current(delta, sizeof delta - 1, rxe);
+                    for (;;) {
+                        mpz_set_si(at, i);
+                        rxe_seek(ref, at);
+                        rxe_current(want, sizeof want - 1, ref);
+                        rxe_current_delta(delta, sizeof delta - 1, rxe);
+                        if (strcmp(delta, want)) bad++;
+                        if (i + s < 0 || i + s >= n) break;
+                        if (rxe_advance(rxe, s)) { bad++; break; }
+                        i += s;
+                    }
+                    sprintf(buf, "a stride of %ld through %s by the %s", s,
+                            pat[p], tree ? "tree" : "plan");
+                    check_int(buf, 0, bad);
+                    check_int("and a step out of the set is refused", 1,
+                              rxe_advance(rxe, s));
+                    rxe_current(got, sizeof got - 1, rxe);
+                    check("leaving it where it was", want, got);
+                }
+                rxe_free(rxe);
+                rxe_free(ref);
+            }
+        }
+        // An endless set goes wherever the sum says.
+        struct rxe *rxe = rxe_parse("[ab]*c", 0);
+        mpz_set_ui(at, 3);
+        rxe_seek(rxe, at);
+        rxe_advance(rxe, 10);
+        rxe_current(got, sizeof got - 1, rxe);
+        mpz_set_ui(at, 13);
+        rxe_seek(rxe, at);
+        rxe_current(want, sizeof want - 1, rxe);
+        check("an endless set advances to the sum", want, got);
+        rxe_free(rxe);
+        // So does a cursor, over a shared plan.
+        rxe = rxe_parse("[a-z]{3}", 0);
+        struct rxe_cursor *cur = rxe_cursor_new(rxe);
+        mpz_set_ui(at, 100);
+        rxe_cursor_seek(cur, at);
+        rxe_cursor_advance(cur, 26 * 26 * 2 + 3);
+        rxe_cursor_current(got, sizeof got - 1, cur);
+        check("a cursor advances across wheels", "cdz", got);
+        check_int("and refuses a step before the start", 1,
+                  rxe_cursor_advance(cur, -100000));
+        check("with a reason", "index before the start of the set",
+              rxe_cursor_reason(cur));
+        rxe_cursor_free(cur);
+        rxe_free(rxe);
+        mpz_clear(at);
+    }
+
+    // A sorted list: each member is what a seek to its index renders, whether
+    // the neighbours share their high digits, repeat an index, or sit further
+    // apart than a long reaches; an index past the end stops the list there.
+    {
+        const char *pat[] = { "[a-c][0-9]{2}", "(ab|c)[xy]{0,2}",
+                              "[a-z0-9]{30}", "x|y[0-9]{3}" };
+        char want[4096], item[64], out[4096];
+        mpz_t ix[40], at;
+        mpz_init(at);
+        for (int i = 0; i < 40; i++) mpz_init(ix[i]);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *rxe = rxe_parse(pat[p], 0);
+            struct rxe *ref = rxe_parse(pat[p], 0);
+            if (exceeds_int(rxe)) {
+                rxe_free(rxe);
+                rxe_free(ref);
+                continue;
+            }
+            // Dense at the start, a repeat, then strides of a fifth of the set.
+            for (int i = 0; i < 40; i++) {
+                if (i < 20) mpz_set_ui(ix[i], i < 10 ? i : i - 1);
+                else {
+                    mpz_tdiv_q_ui(at, rxe->nitems, 25);
+                    mpz_mul_ui(ix[i], at, i - 19);
+                    mpz_add_ui(ix[i], ix[i], i);
+                }
+            }
+            mpz_set(ix[39], rxe->nitems);
+            int last = 40;
+            while (mpz_cmp(ix[last-1], rxe->nitems) >= 0) last--;
+            want[0] = 0;
+            for (int i = 0; i < last; i++) {
+                rxe_seek(ref, ix[i]);
+                rxe_current(item, sizeof item - 1, ref);
+                strcat(want, item);
+                strcat(want, "/");
+            }
+            for (int tree = 0; tree < 2; tree++) {
+                if (tree) rxe_uncompile(rxe);
+                struct catctx c = { out, sizeof out, 0, 0, "" };
+                out[0] = 0;
+                int rc = rxe_seek_many(rxe, (const mpz_t *)ix, 40, 63,
+                                       cat_sink, &c);
+                sprintf(buf, "a sorted seek through %s by the %s", pat[p],
+                        tree ? "tree" : "plan");
+                check(buf, want, out);
+                check_int("stops where the set does",
+                          last < 40 ? RXE_FOREACH_RANGE : RXE_FOREACH_END, rc);
+            }
+            rxe_free(rxe);
+            rxe_free(ref);
+        }
+        for (int i = 0; i < 40; i++) mpz_clear(ix[i]);
+        mpz_clear(at);
+    }
+
+    // A length window: exactly the members of a set whose length lies in it,
+    // checked against a whole walk filtered by length -- as sorted lists, the
+    // window coming out shortest first and a finite walk in place value --
+    // and, where the set is itself shortest first, each member against a seek
+    // to the index it was handed. A backreference cannot be counted by length
+    // and is filtered in the set's own order. The expression does not move.
+    {
+        const char *pat[] = { "[ab]{1,3}c?", "(x|yz)[0-2]{0,2}", "[a-c]{2}",
+                              "(a|bc)(x|yy)\\1", "[ab]+c?", "(a|bb)+" };
+        int win[][2] = { { 2, 3 }, { 1, 2 }, { 0, 5 }, { 4, 5 }, { 2, 3 },
+                         { 3, 4 } };
+        char out[8192], want[8192], all[8192], item[64], before[64];
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *rxe = rxe_parse(pat[p], 0);
+            int a = win[p][0], b = win[p][1];
+            mpz_t at, c;
+            mpz_init_set_ui(at, 0);
+            mpz_init_set_ui(c, 0);
+            if (rxe_is_infinite(rxe)) {
+                // Shortest first: nothing of length b or less comes after
+                // the first member longer than that.
+                all[0] = 0;
+                rxe_seek(rxe, at);
+                for (;;) {
+                    rxe_current(item, sizeof item - 1, rxe);
+                    if ((int)strlen(item) > b) break;
+                    strcat(all, item);
+                    strcat(all, "/");
+                    rxe_iterate(rxe);
+                }
+            } else {
+                collect(rxe, all, sizeof all);
+            }
+            want[0] = 0;
+            long n = 0;
+            for (char *q = strtok(all, "/"); q; q = strtok(NULL, "/"))
+                if ((int)strlen(q) >= a && (int)strlen(q) <= b) {
+                    strcat(want, q);
+                    strcat(want, "/");
+                    n++;
+                }
+            sort_members(want);
+
+            mpz_set_ui(at, 1);
+            rxe_seek(rxe, at);
+            rxe_current(before, sizeof before - 1, rxe);
+            struct catctx cc = { out, sizeof out, 0, 0, "" };
+            out[0] = 0;
+            int rc = rxe_foreach_lengths(rxe, a, b, 63, cat_sink, &cc);
+            sort_members(out);
+            sprintf(buf, "lengths %d to %d of %s", a, b, pat[p]);
+            check(buf, want, out);
+            check_int("the window ends", RXE_FOREACH_END, rc);
+            rxe_current(item, sizeof item - 1, rxe);
+            check("the expression stays where it was", before, item);
+
+            long counted = 0;
+            int countable = !rxe_length_count(rxe, a, c);
+            for (int L = a; countable && L <= b; L++) {
+                rxe_length_count(rxe, L, c);
+                counted += mpz_get_si(c);
+            }
+            check_int("lengths are counted unless there is a backreference",
+                      !strchr(pat[p], '\\'), countable);
+            if (countable) check_int("the counts sum to the window", n, counted);
+
+            if (rxe_is_shortlex(rxe)) {
+                struct seekcheck sc = { rxe_parse(pat[p], 0), 0 };
+                rxe_foreach_lengths(rxe, a, b, 63, seek_sink, &sc);
+                check_int("each index seeks to its member", 0, sc.wrong);
+                rxe_free(sc.ref);
+            }
+            mpz_clear(at);
+            mpz_clear(c);
+            rxe_free(rxe);
+        }
+        // A member past the sink's width stops the window; a window past
+        // every member is empty, not an error.
+        struct rxe *rxe = rxe_parse("[ab]{4}", 0);
+        struct catctx cc = { buf, sizeof buf, 0, 0, "" };
+        buf[0] = 0;
+        check_int("a member wider than maxlen", RXE_FOREACH_TOOBIG,
+                  rxe_foreach_lengths(rxe, 0, 9, 3, cat_sink, &cc));
+        check_int("a window past the set", RXE_FOREACH_END,
+                  rxe_foreach_lengths(rxe, 5, 9, 63, cat_sink, &cc));
+        check("nothing handed over", "", buf);
+        rxe_free(rxe);
+        rxe = rxe_parse("(a+)\\1", 0);
+        check_int("an endless set it cannot count", RXE_FOREACH_RANGE,
+                  rxe_foreach_lengths(rxe, 0, 9, 63, cat_sink, &cc));
+        rxe_free(rxe);
+    }
+
+    // Counts by length at long lengths: a repetition summed as a series
+    // rather than count by count, against sums worked out by hand -- the
+    // compositions of a length into ones and twos, with and without bounds on
+    // how many parts -- and the convolutions packed into one multiplication
+    // against done term by term, which must agree to the last digit.
+    {
+        const char *pat[] = { "(a|bb)*", "(a|bb){0,20}", "(a|bb){16,20}" };
+        int len[] = { 100, 30, 30 };
+        const char *want[] = { "573147844013817084101", "281403", "281402" };
+        char num[64];
+        mpz_t c, d;
+        mpz_init(c);
+        mpz_init(d);
+        for (int p = 0; p < 3; p++) {
+            struct rxe *rxe = rxe_parse(pat[p], 0);
+            rxe_count_at_length(c, rxe, len[p]);
+            sprintf(buf, "members of %s at length %d", pat[p], len[p]);
+            check(buf, want[p], mpz_get_str(num, 10, c));
+            rxe_free(rxe);
+        }
+        const char *many[] = { "(\\w+ )*", "[a-z]*-[0-9]*",
+                               "(ab|[c-f]{1,3})+x?", "(x|yy|zzz){2,50}[0-9]*" };
+        int saved = rxe_lens_kronecker_min, same = 1;
+        for (size_t p = 0; p < sizeof many / sizeof *many; p++) {
+            rxe_lens_kronecker_min = 1 << 30;
+            struct rxe *a = rxe_parse(many[p], 0);
+            rxe_lens_kronecker_min = 1;
+            struct rxe *b = rxe_parse(many[p], 0);
+            for (int L = 0; L <= 200; L += 13) {
+                rxe_lens_kronecker_min = 1 << 30;
+                rxe_count_at_length(c, a, L);
+                rxe_lens_kronecker_min = 1;
+                rxe_count_at_length(d, b, L);
+                same &= !mpz_cmp(c, d);
+            }
+            rxe_free(a);
+            rxe_free(b);
+        }
+        rxe_lens_kronecker_min = saved;
+        check_int("packed and term by term agree", 1, same);
+        mpz_clear(c);
+        mpz_clear(d);
+    }
+
+    // Identical subexpressions count once: the second copy of a group, and a
+    // (?1) written out from the first, read their length tables from it. Each
+    // keeps its own place, and a clone, which shares nothing, counts and
+    // seeks the same.
+    {
+        struct rxe *rxe = rxe_parse("([a-c]d|e)+-([a-c]d|e)+(?1)", 0);
+        struct rxe_node *first = rxe->head->head, *last = rxe->head->tail;
+        check_int("the copies are twinned", 1,
+                  first->next->next->rxe->twin == first->rxe &&
+                  last->rxe->twin != NULL);
+        struct rxe *clone = rxe_deep_clone(rxe);
+        check_int("a clone has no twins", 1,
+                  clone->head->tail->rxe->twin == NULL);
+        mpz_t c, d, at;
+        mpz_init(c);
+        mpz_init(d);
+        mpz_init(at);
+        int same = 1;
+        for (int L = 0; L <= 24; L++) {
+            rxe_count_at_length(c, rxe, L);
+            rxe_count_at_length(d, clone, L);
+            same &= !mpz_cmp(c, d);
+        }
+        check_int("shared and unshared tables agree", 1, same);
+        char a[64], b[64];
+        mpz_set_ui(at, 123456);
+        rxe_seek_shortlex(rxe, at);
+        rxe_seek_shortlex(clone, at);
+        rxe_current(a, sizeof a - 1, rxe);
+        rxe_current(b, sizeof b - 1, clone);
+        check("and seek to the same member", b, a);
+        mpz_clear(c);
+        mpz_clear(d);
+        mpz_clear(at);
+        rxe_free(clone);
+        rxe_free(rxe);
+    }
+
+    // An arena parse walks the set a heap parse does, from a fraction of the
+    // allocations, and so does a clone of it -- which outlives the original.
+    {
+        const char *pat = "([A-Z][a-z]{2,8}|(foo|bar)+)-[a-f0-9]{4}-(?1)";
+        unsigned long before = rxe_alloc_calls();
+        struct rxe *heap = rxe_parse(pat, 0);
+        unsigned long by_heap = rxe_alloc_calls() - before;
+        before = rxe_alloc_calls();
+        struct rxe *arena = rxe_parse(pat, RXE_ARENA);
+        unsigned long by_arena = rxe_alloc_calls() - before;
+        check_int("the arena needs fewer allocations", 1,
+                  by_arena * 2 < by_heap);
+        struct rxe *clone = rxe_deep_clone(arena);
+        rxe_free(arena);
+        mpz_t at;
+        mpz_init_set_ui(at, 987654);
+        rxe_seek(heap, at);
+        rxe_seek(clone, at);
+        int same = 1;
+        for (int i = 0; i < 40; i++) {
+            char a[64], b[64];
+            rxe_current(a, sizeof a - 1, heap);
+            rxe_current(b, sizeof b - 1, clone);
+            same &= !strcmp(a, b);
+            rxe_iterate(heap);
+            rxe_iterate(clone);
+        }
+        check_int("and its clone walks the same members", 1, same);
+        mpz_clear(at);
+        rxe_free(clone);
+        rxe_free(heap);
+    }
+
+    // An image brings back the set it was saved from, dictionary and all:
+    // loaded after the registry has changed its mind about the words, it
+    // still numbers the members as the original did, and a damaged one is
+    // refused rather than trusted.
+    {
+        const char *fruit[] = { "apple", "banana", "cherry" };
+        const char *other[] = { "fig" };
+        static unsigned char img[1024];
+        rxe_register_dict("fruit", fruit, 3);
+        struct rxe *rxe = rxe_parse("[:fruit:]{2}[0-9]", 0);
+        size_t need = rxe_save(rxe, NULL, 0);
+        check_int("an image has a size", 1, need > 0 && need <= sizeof img);
+        check_int("and is written whole", (long)need,
+                  (long)rxe_save(rxe, img, sizeof img));
+        rxe_free_dicts();
+        rxe_register_dict("fruit", other, 1);
+
+        struct rxe *back = rxe_load(img, need);
+        check_int("a saved expression loads", RXE_OK, rxe_error(back));
+        check_int("with the count it was saved with", 1,
+                  !mpz_cmp(rxe->nitems, back->nitems));
+        struct rxe *clone = rxe_deep_clone(back);
+        rxe_free(back);
+        char a[4096], b[4096];
+        collect(rxe, a, sizeof a);
+        collect(clone, b, sizeof b);
+        check("and its clone walks the same members", a, b);
+        rxe_free(clone);
+        rxe_free(rxe);
+        rxe_free_dicts();
+
+        // A save asks the registry what its words were called while another
+        // thread drops and replaces them.
+        pthread_t churn;
+        int wrong = 0, stop = 0;
+        static unsigned char raced[256];
+        rxe_register_dict("churn", fruit, 3);
+        pthread_create(&churn, NULL, dict_churn, &stop);
+        for (int i = 0; i < 2000; i++) {
+            struct rxe *c = rxe_parse("[:churn:]", 0);
+            size_t got = rxe_error(c) ? 0 : rxe_save(c, raced, sizeof raced);
+            if (got) {
+                struct rxe *r = rxe_load(raced, got);
+                wrong += rxe_error(r) || mpz_cmp(r->nitems, c->nitems);
+                rxe_free(r);
+            }
+            rxe_free(c);
+        }
+        __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+        pthread_join(churn, NULL);
+        check_int("a save racing the registry names its own words", 0, wrong);
+        rxe_free_dicts();
+
+        img[0] ^= 1;
+        back = rxe_load(img, need);
+        check_int("a damaged magic is refused", RXE_BAD_IMAGE, rxe_error(back));
+        rxe_free(back);
+        img[0] ^= 1;
+        back = rxe_load(img, need - 4);
+        check_int("so is a short image", RXE_BAD_IMAGE, rxe_error(back));
+        rxe_free(back);
+    }
+
+    // A set numbered off its automaton brings the automaton back with it,
+    // counts and all, rather than building it again: the same strings in the
+    // same order, distinct or in byte order, seek for seek. A move out of
+    // range refuses the image.
+    {
+        const char *pat[] = { "(a|ab|b)(b|)c{0,2}", "([ab]|a[ab]){1,3}",
+                              "x(0|00|1){2,4}" };
+        const int opt[] = { RXE_DISTINCT, RXE_BYTE_ORDER };
+        static unsigned char img[65536];
+        char a[8192], b[8192];
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++)
+            for (int o = 0; o < 2; o++) {
+                struct rxe *rxe = rxe_parse(pat[p], opt[o]);
+                size_t need = rxe_save(rxe, img, sizeof img);
+                struct rxe *back = rxe_load(img, need);
+                sprintf(buf, "an image of %s %s loads", pat[p],
+                        o ? "in byte order" : "distinct");
+                check_int(buf, RXE_OK, rxe_error(back));
+                check_int("with its automaton", 1, back->lex != NULL);
+                check_int("and its options", opt[o], back->options);
+                check_int("and its count", 1, !mpz_cmp(rxe->nitems, back->nitems));
+                collect(rxe, a, sizeof a);
+                collect(back, b, sizeof b);
+                check("and walks the same members", a, b);
+                mpz_t at5;
+                mpz_init_set_ui(at5, 5);
+                rxe_seek(rxe, at5);
+                rxe_seek(back, at5);
+                mpz_clear(at5);
+                check("and seeks to the same one", rxe_current(a, 64, rxe),
+                      rxe_current(b, 64, back));
+                // Past the header, the source and the count (under 256
+                // members: one byte), with no dictionaries: the state count,
+                // start and column count, the columns, then the moves.
+                size_t at = 20 + (strlen(pat[p]) + 4) / 4 * 4 + 8 + 4;
+                at += 12 + 256 * 4;
+                memcpy(img + at, "\xff\xff\xff\x7f", 4);
+                rxe_free(back);
+                back = rxe_load(img, need);
+                check_int("and a move out of range is refused", RXE_BAD_IMAGE,
+                          rxe_error(back));
+                rxe_free(back);
+                rxe_free(rxe);
+            }
+    }
+
+    // A repetition over a body whose count fits a machine word keeps its
+    // digits as words, one wider keeps bignums, and either walks the same.
+    // The body here is 2^63 strong, so a step of nearly as much must carry
+    // between words without overflowing them.
+    {
+        struct rxe *small = rxe_parse("[a-z0-9]{1,40}", 0);
+        struct rxe *wide = rxe_parse("([0-9a-f]{17}){2}", 0);
+        check_int("a small body's digits are words", 1,
+                  small->head->head->walk.rep_word != NULL &&
+                  small->head->head->walk.rep_digit == NULL);
+        check_int("a wide body's are bignums", 1,
+                  wide->head->head->walk.rep_word == NULL &&
+                  wide->head->head->walk.rep_digit != NULL);
+        rxe_free(small);
+        rxe_free(wide);
+
+        const char *pat = "([0-9a-f]{15}[0-7]){3}";
+        const long stride[] = { 0x7fffffffffffffffL, -0x7fffffffffffffffL - 1,
+                                0x4000000000000001L, -3 };
+        struct rxe *rxe = rxe_parse(pat, 0);
+        struct rxe *ref = rxe_parse(pat, 0);
+        rxe_uncompile(rxe);
+        check_int("and a word can hold 2^63", 1,
+                  rxe->head->head->walk.rep_word != NULL);
+        mpz_t at;
+        mpz_init(at);
+        mpz_ui_pow_ui(at, 2, 150);
+        rxe_seek(rxe, at);
+        int bad = 0;
+        for (int k = 0; k < 4 && !exceeds_int(rxe); k++)
+            for (int rep = 0; rep < 3; rep++) {
+                char got[64], want[64];
+                if (stride[k] < 0) mpz_sub_ui(at, at, 0UL - (unsigned long)stride[k]);
+                else mpz_add_ui(at, at, (unsigned long)stride[k]);
+                rxe_advance(rxe, stride[k]);
+                rxe_seek(ref, at);
+                rxe_current(got, sizeof got - 1, rxe);
+                rxe_current(want, sizeof want - 1, ref);
+                bad += !!strcmp(got, want);
+            }
+        check_int("word digits advance as a seek lands", 0, bad);
+        mpz_clear(at);
+        rxe_free(rxe);
+        rxe_free(ref);
+    }
+
+    // A wide index into a long run, or a long concatenation, is split in
+    // halves rather than divided a digit at a time. Rank shares none of that
+    // code, so it must find each member at the index the seek was given.
+    {
+        static char cat[8192], lcat[8192], item[8192];
+        strcpy(lcat, "(?L)");
+        for (int i = 0; i < 400; i++) strcat(cat, "[a-c](x|yz)[0-9]");
+        strcat(lcat, cat);
+        const char *pat[] = { "[a-z]{1,600}", "(?L)[a-z0-9]{200,600}",
+                              "([a-f][0-9]){40,300}", cat, lcat };
+        gmp_randstate_t rs;
+        gmp_randinit_default(rs);
+        gmp_randseed_ui(rs, 20);
+        mpz_t at, back;
+        mpz_init(at);
+        mpz_init(back);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *rxe = rxe_parse(pat[p], 0);
+            if (exceeds_int(rxe)) {
+                rxe_free(rxe);
+                continue;
+            }
+            int bad = 0;
+            for (int k = 0; k < 3; k++) {
+                mpz_urandomm(at, rs, rxe->nitems);
+                if (k == 0) mpz_sub_ui(at, rxe->nitems, 1);
+                if (rxe_seek(rxe, at)) { bad++; continue; }
+                rxe_current(item, sizeof item - 1, rxe);
+                bad += rxe_rank(rxe, item, back) || mpz_cmp(at, back);
+            }
+            sprintf(buf, "wide seeks into %.24s land where rank says", pat[p]);
+            check_int(buf, 0, bad);
+            mpz_add_ui(at, rxe->nitems, 0);
+            check_int("and the end is still past the end", 1, rxe_seek(rxe, at));
+            rxe_free(rxe);
+        }
+        mpz_clear(at);
+        mpz_clear(back);
+        gmp_randclear(rs);
+    }
+
+    // A filtered set is the members of the first pattern the second matches,
+    // counted, seeked and ranked without rendering the rest. Walking the
+    // whole first pattern and testing each member by hand must agree with it
+    // member for member, in either direction and excluded as well as kept.
+    {
+        const char *pat[] = { "[a-d]{1,3}(x|yz)?", "(?L)[a-d]{1,3}(x|yz)?" };
+        const char *flt[] = { "ab|ca", "^b", "d$" };
+        static char got[4096], want[4096];
+        char item[16];
+        mpz_t at, back;
+        mpz_init(at);
+        mpz_init(back);
+        for (int p = 0; p < 2; p++)
+            for (int f = 0; f < 3; f++)
+                for (int ex = 0; ex < 2; ex++) {
+                    struct rxe *all = rxe_parse(pat[p], 0);
+                    struct rxe *rxe = rxe_parse_filtered(pat[p], flt[f],
+                                                         ex ? RXE_FILTER_EXCLUDE : 0);
+                    long n = 0;
+                    want[0] = 0;
+                    mpz_set_ui(at, 0);
+                    rxe_seek(all, at);
+                    do {
+                        rxe_current(item, sizeof item - 1, all);
+                        size_t len = strlen(item);
+                        int match = f == 0 ? strstr(item, "ab") || strstr(item, "ca")
+                                  : f == 1 ? item[0] == 'b'
+                                  : len && item[len - 1] == 'd';
+                        if (match == !ex) {
+                            strcat(want, item);
+                            strcat(want, "/");
+                            n++;
+                        }
+                    } while (rxe_iterate(all) == 0);
+                    sprintf(buf, "%s filtered by %s%s", pat[p], flt[f],
+                            ex ? ", excluded" : "");
+                    check_int(buf, RXE_OK, rxe_error(rxe));
+                    check_int(buf, n, mpz_get_si(rxe->nitems));
+                    collect(rxe, got, sizeof got);
+                    check(buf, want, got);
+                    int bad = 0;
+                    for (long i = 0; i < n; i += 7) {
+                        mpz_set_si(at, i);
+                        if (rxe_seek(rxe, at)) { bad++; continue; }
+                        rxe_current(item, sizeof item - 1, rxe);
+                        bad += rxe_rank(rxe, item, back) || mpz_cmp(at, back);
+                    }
+                    check_int("and each seek is where rank puts it", 0, bad);
+                    mpz_set_si(at, n);
+                    check_int("and the end is past the end", 1, rxe_seek(rxe, at));
+                    rxe_free(rxe);
+                    rxe_free(all);
+                }
+
+        // A member the filter turns away has no rank, though the first
+        // pattern has it; a clone walks the same members as its original.
+        struct rxe *rxe = rxe_parse_filtered("[a-d]{1,3}", "ab", 0);
+        check_int("a member filtered out is not ranked", 1,
+                  rxe_rank(rxe, "cc", back));
+        collect(rxe, want, sizeof want);
+        check("the filtered set", "ab/aab/aba/abb/abc/abd/bab/cab/dab/", want);
+        struct rxe *copy = rxe_deep_clone(rxe);
+        collect(copy, got, sizeof got);
+        check("a clone of it", want, got);
+        rxe_free(copy);
+
+        // ...and so does a parallel walk, each member at its own index.
+        static char pgot[64][6];
+        struct par_tally tally[2] = { { pgot, 0, 0, -1 }, { pgot, 0, 0, -1 } };
+        void *ctx[2] = { &tally[0], &tally[1] };
+        mpz_set_ui(at, 0);
+        mpz_set_ui(back, 0);
+        check_int("a parallel walk of a filtered set ends", RXE_FOREACH_END,
+                  rxe_foreach_parallel(rxe, at, back, 8, par_sink, ctx, 2));
+        got[0] = 0;
+        for (long i = 0; i < tally[0].n + tally[1].n; i++) {
+            strcat(got, pgot[i]);
+            strcat(got, "/");
+        }
+        check("in the order of the plain walk", want, got);
+        rxe_free(rxe);
+
+        // A long repetition is counted exactly, not walked: the members of
+        // [a-z]{1,300} that begin with 'a' number the sum of 26^(n-1). A
+        // library built on a machine word refuses the set unfiltered, and so
+        // filtered too.
+        rxe = rxe_parse_filtered("[a-z]{1,300}", "^a", 0);
+        if (RXE_INT_BITS) {
+            check_int("a wide filtered set is refused", RXE_EXCEEDS_INT,
+                      rxe_error(rxe));
+        } else {
+            mpz_t want_n;
+            mpz_init(want_n);
+            for (int len = 1; len <= 300; len++) {
+                mpz_ui_pow_ui(at, 26, len - 1);
+                mpz_add(want_n, want_n, at);
+            }
+            check_int("a wide filtered count is exact", 0,
+                      mpz_cmp(want_n, rxe->nitems));
+            mpz_sub_ui(at, rxe->nitems, 1);
+            rxe_seek(rxe, at);
+            rxe_current(got, sizeof got - 1, rxe);
+            check_int("its last member is the longest", 300, strlen(got));
+            check_int("and passes the filter", 'a', got[0]);
+            mpz_clear(want_n);
+        }
+        rxe_free(rxe);
+
+        // What cannot be filtered is refused with a reason.
+        rxe = rxe_parse_filtered("[a-z]+", "a", 0);
+        check_int("an infinite set is not filtered", RXE_FILTER_SET, rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse_filtered("[a-z]{3}", "(a)\\1", 0);
+        check_int("nor filtered by a backreference", RXE_NOT_REGULAR, rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse_filtered("[a-z]{3}", "(a", 0);
+        check_int("a filter that does not parse", RXE_BAD_FILTER, rxe_error(rxe));
+        rxe_free(rxe);
+        mpz_clear(at);
+        mpz_clear(back);
+    }
+
+    // Under RXE_DISTINCT a set is its strings, each once, in byte order: the
+    // plain walk sorted with its repeats dropped. Seek and rank agree on every
+    // index, and the walks built on them -- a stride, a foreach, a clone --
+    // come out as the step does.
+    {
+        const char *pat[] = { "(a|a){6}", "(19|20)?[0-9]{1,2}|[0-9]{2}",
+                              "(a|ab|b){1,4}", "(?L)(x|[ab]{2,3}){1,2}",
+                              "(foo|bar|fo|o){1,3}", "(?i)[a-c]{1,2}x?" };
+        static char got[16384], want[16384];
+        char item[32];
+        mpz_t at, back, count;
+        mpz_init(at);
+        mpz_init(back);
+        mpz_init(count);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *all = rxe_parse(pat[p], 0);
+            struct rxe *rxe = rxe_parse(pat[p], RXE_DISTINCT);
+            collect(all, want, sizeof want);
+            sort_members(want);
+            uniq_members(want);
+            long n = 0;
+            for (char *c = want; *c; c++) n += *c == '/';
+            sprintf(buf, "%s, each string once", pat[p]);
+            check_int(buf, n, mpz_get_si(rxe->nitems));
+            collect(rxe, got, sizeof got);
+            check(buf, want, got);
+            int bad = 0;
+            for (long i = 0; i < n; i++) {
+                mpz_set_si(at, i);
+                if (rxe_seek(rxe, at)) { bad++; continue; }
+                rxe_current(item, sizeof item - 1, rxe);
+                bad += rxe_rank(rxe, item, back) || mpz_cmp(at, back);
+                rxe_rank_count(rxe, item, back);
+                bad += mpz_cmp_ui(back, 1) != 0;
+            }
+            check_int("and each seek is where rank puts it, once", 0, bad);
+            mpz_set_si(at, n);
+            check_int("and the end is past the end", 1, rxe_seek(rxe, at));
+
+            // A stride of three lands where a seek into a clone does.
+            struct rxe *ref = rxe_deep_clone(rxe);
+            mpz_set_ui(at, 0);
+            rxe_seek(rxe, at);
+            bad = 0;
+            for (long i = 3; i < n; i += 3) {
+                char moved[32];
+                if (rxe_advance(rxe, 3)) { bad++; break; }
+                rxe_current(moved, sizeof moved - 1, rxe);
+                mpz_set_si(at, i);
+                rxe_seek(ref, at);
+                rxe_current(item, sizeof item - 1, ref);
+                bad += !!strcmp(moved, item);
+            }
+            check_int("a stride lands where a seek does", 0, bad);
+            rxe_free(ref);
+
+            struct catctx c = { got, sizeof got, 0, 0, "" };
+            got[0] = 0;
+            mpz_set_ui(at, 0);
+            mpz_set_ui(count, 0);
+            rxe_foreach(rxe, at, count, 31, cat_sink, &c);
+            check("a foreach walks them in order", want, got);
+            rxe_free(rxe);
+            rxe_free(all);
+        }
+
+        // The empty string is a string, and comes first.
+        struct rxe *rxe = rxe_parse("(a|)(b|)|b", RXE_DISTINCT);
+        collect(rxe, got, sizeof got);
+        check("the empty member first", "/a/ab/b/", got);
+        check_int("a string not in the set has no rank", 1,
+                  rxe_rank(rxe, "ba", back));
+        rxe_free(rxe);
+
+        // What has no finite automaton is refused, with the reason.
+        rxe = rxe_parse("[a-z]+", RXE_DISTINCT);
+        check_int("an infinite set is not made distinct", RXE_DISTINCT_SET,
+                  rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse("(a|b)\\1", RXE_DISTINCT);
+        check_int("nor a backreference", RXE_NOT_REGULAR, rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse("[ab]{0,40}a[ab]{17}", RXE_DISTINCT);
+        check_int("nor an automaton past the cap", RXE_AUTOMATON_TOO_BIG,
+                  rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse_filtered("[ab]{3}", "a", RXE_DISTINCT);
+        check_int("nor filtered", RXE_FILTER_SET, rxe_error(rxe));
+        rxe_free(rxe);
+        mpz_clear(at);
+        mpz_clear(back);
+        mpz_clear(count);
+    }
+
+    // rxe_count_distinct counts what RXE_DISTINCT would number, without it;
+    // of a filtered set, the strings both patterns accept; and says why when
+    // it cannot.
+    {
+        struct { const char *pat; long want; } t[] = {
+            { "(a|a){22}", 1 }, { "(19|20)?[0-9]{2}|[0-9]{4}", 10100 },
+            { "(a|ab|b){1,4}", 87 }, { "[a-c]{0,3}|[a-c]{2}x?", 49 },
+            { "(foo|fo|o){2}", 9 }, { "", 1 },
+        };
+        mpz_t n;
+        mpz_init(n);
+        for (size_t i = 0; i < sizeof t / sizeof *t; i++) {
+            struct rxe *rxe = rxe_parse(t[i].pat, 0);
+            int st = rxe_count_distinct(rxe, n);
+            sprintf(buf, "distinct strings of %s", t[i].pat);
+            check_int(buf, RXE_OK, st);
+            check_int(buf, t[i].want, mpz_get_si(n));
+            rxe_free(rxe);
+        }
+        struct rxe *rxe = rxe_parse_filtered("(a|b|a){1,3}", "a", 0);
+        rxe_count_distinct(rxe, n);
+        check_int("distinct strings of a filtered set", 11, mpz_get_si(n));
+        rxe_free(rxe);
+        rxe = rxe_parse("[a-z]+", 0);
+        check_int("an endless set has endlessly many", RXE_INFINITE,
+                  rxe_count_distinct(rxe, n));
+        rxe_free(rxe);
+        rxe = rxe_parse("(a|b)\\1", 0);
+        check_int("a backreference is not counted", RXE_NOT_REGULAR,
+                  rxe_count_distinct(rxe, n));
+        rxe_free(rxe);
+        rxe = rxe_parse("[ab]{0,40}a[ab]{17}", 0);
+        check_int("nor an automaton past the cap", RXE_AUTOMATON_TOO_BIG,
+                  rxe_count_distinct(rxe, n));
+        rxe_free(rxe);
+        mpz_clear(n);
+    }
+
+    // rxe_estimate_distinct draws indices and ranks what it finds there. A
+    // seed gives the same draws, and so the same answer, at any thread count;
+    // the interval holds the exact count; a sample with no variety gets the
+    // rule-of-three interval rather than a point; and a backreference, which
+    // rxe_count_distinct refuses, is estimated like anything else.
+    {
+        gmp_randstate_t rs;
+        gmp_randinit_default(rs);
+        struct rxe_estimate e, e4;
+        mpz_t n;
+        mpz_init(n);
+        struct rxe *rxe = rxe_parse("(a|ab|b){1,8}", 0);
+        rxe_count_distinct(rxe, n);
+        double want = mpz_get_d(n) / mpz_get_d(rxe->nitems);
+        gmp_randseed_ui(rs, 7);
+        check_int("an estimate over one thread", RXE_OK,
+                  rxe_estimate_distinct(rxe, 2000, rs, 64, 1, &e));
+        gmp_randseed_ui(rs, 7);
+        check_int("and over four", RXE_OK,
+                  rxe_estimate_distinct(rxe, 2000, rs, 64, 4, &e4));
+        check_int("the same seed, the same estimate", 1,
+                  e.share == e4.share && e.repeated == e4.repeated);
+        check_int("the interval holds the exact share", 1,
+                  e.share_lo <= want && want <= e.share_hi);
+        check_int("and is not a point", 1, e.share_lo < e.share_hi);
+        check_int("every draw counted", 2000, (long)e.samples);
+        rxe_free(rxe);
+
+        rxe = rxe_parse("[a-z]{3}", 0);
+        rxe_estimate_distinct(rxe, 300, rs, 64, 2, &e);
+        check_int("a duplicate-free set repeats no draw", 0, (long)e.repeated);
+        check_int("and is estimated whole", 1, e.share == 1 && e.share_hi == 1);
+        check_int("to within the rule of three", 1, e.share_lo == 1 - 3.0 / 300);
+        rxe_free(rxe);
+
+        rxe = rxe_parse("(a|a)(b|b)\\1", 0);
+        check_int("a backreference is estimated", RXE_OK,
+                  rxe_estimate_distinct(rxe, 50, rs, 64, 1, &e));
+        check_int("every draw on its one string", 50, (long)e.repeated);
+        check_int("spelt four ways", 1, e.share == 0.25 &&
+                  e.share_lo <= 0.25 && 0.25 <= e.share_hi);
+        check_int("with too narrow a buffer it is not", RXE_TOO_BIG,
+                  rxe_estimate_distinct(rxe, 50, rs, 2, 1, &e));
+        rxe_free(rxe);
+
+        rxe = rxe_parse("[a-z]+", 0);
+        check_int("nor is an endless set", RXE_INFINITE,
+                  rxe_estimate_distinct(rxe, 50, rs, 64, 1, &e));
+        rxe_free(rxe);
+        mpz_clear(n);
+        gmp_randclear(rs);
+    }
+
+    // Under RXE_BYTE_ORDER a set keeps every spelling, its strings in byte
+    // order and each string's spellings side by side: the plain walk sorted.
+    // Rank puts a string at its first spelling, rank_count says how many
+    // follow, and rank_all emits them in a row.
+    {
+        const char *pat[] = { "(a|b|a){1,2}", "(a|a){6}", "(a|ab|b){1,4}",
+                              "(19|20)?[0-9]{1,2}", "(foo|bar|fo|o){1,3}",
+                              "(?i)[a-c]{1,2}x?" };
+        static char got[16384], want[16384];
+        char item[32];
+        mpz_t at, first, m;
+        mpz_init(at);
+        mpz_init(first);
+        mpz_init(m);
+        for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+            struct rxe *all = rxe_parse(pat[p], 0);
+            struct rxe *rxe = rxe_parse(pat[p], RXE_BYTE_ORDER);
+            collect(all, want, sizeof want);
+            sort_members(want);
+            sprintf(buf, "%s, in byte order", pat[p]);
+            check_int(buf, RXE_OK, rxe_error(rxe));
+            check_int(buf, mpz_get_si(all->nitems), mpz_get_si(rxe->nitems));
+            collect(rxe, got, sizeof got);
+            check(buf, want, got);
+            int bad = 0;
+            long n = mpz_get_si(rxe->nitems);
+            for (long i = 0; i < n; i++) {
+                mpz_set_si(at, i);
+                if (rxe_seek(rxe, at)) { bad++; continue; }
+                rxe_current(item, sizeof item - 1, rxe);
+                bad += rxe_rank(rxe, item, first) != 0 || mpz_cmp(first, at) > 0;
+                rxe_rank_count(rxe, item, m);
+                mpz_add(m, m, first);
+                bad += mpz_cmp(at, m) >= 0;
+                struct rankrun r = { .gaps = 0 };
+                mpz_init_set(r.next, first);
+                bad += rxe_rank_all(rxe, item, run_sink, &r) < 1 || r.gaps ||
+                       mpz_cmp(r.next, m);
+                mpz_clear(r.next);
+            }
+            check_int("each seek lies in its string's run of spellings", 0, bad);
+
+            struct rxe *twin = rxe_deep_clone(rxe);
+            collect(twin, got, sizeof got);
+            check("and a clone walks it the same", want, got);
+            rxe_free(twin);
+            rxe_free(rxe);
+            rxe_free(all);
+        }
+
+        // One string spelt four million ways is one run: rank finds its start
+        // without walking it.
+        struct rxe *rxe = rxe_parse("(a|a){22}", RXE_BYTE_ORDER);
+        check_int("a string spelt 2^22 ways is ranked", 0,
+                  rxe_rank(rxe, "aaaaaaaaaaaaaaaaaaaaaa", first));
+        check_int("at the start", 0, mpz_sgn(first));
+        rxe_rank_count(rxe, "aaaaaaaaaaaaaaaaaaaaaa", m);
+        check_int("with every spelling counted", 4194304, mpz_get_si(m));
+        rxe_free(rxe);
+
+        // A dictionary's repeated word is repeated in place.
+        const char *words[] = { "pear", "fig", "pear", "apple" };
+        rxe_register_dict("bytefruit", words, 4);
+        rxe = rxe_parse("[:bytefruit:]", RXE_BYTE_ORDER);
+        collect(rxe, got, sizeof got);
+        check("a dictionary in byte order", "apple/fig/pear/pear/", got);
+        rxe_free(rxe);
+        rxe_free_dicts();
+
+        rxe = rxe_parse("(a|b|a){1,2}", RXE_BYTE_ORDER | RXE_DISTINCT);
+        collect(rxe, got, sizeof got);
+        check("RXE_DISTINCT wins over byte order", "a/aa/ab/b/ba/bb/", got);
+        rxe_free(rxe);
+
+        rxe = rxe_parse("[a-z]+", RXE_BYTE_ORDER);
+        check_int("an infinite set is not put in byte order",
+                  RXE_BYTE_ORDER_SET, rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse("(a|b)\\1", RXE_BYTE_ORDER);
+        check_int("nor a backreference", RXE_NOT_REGULAR, rxe_error(rxe));
+        rxe_free(rxe);
+        rxe = rxe_parse_filtered("[ab]{3}", "a", RXE_BYTE_ORDER);
+        check_int("nor filtered", RXE_FILTER_SET, rxe_error(rxe));
+        rxe_free(rxe);
+        mpz_clear(at);
+        mpz_clear(first);
+        mpz_clear(m);
+    }
+
+    // A lazy count: a repetition too large to be worth counting at parse time
+    // is left as an estimate until something needs the count, and until then
+    // the set walks and seeks as it would have. Forced, the count is the one
+    // an ordinary parse works out, and the estimate was close to it. A word
+    // build refuses the set either way: no count would fit.
+    {
+        const char *pat = "([a-z]{1,40}){1,2000}";
+        struct rxe *eager = rxe_parse(pat, 0);
+        struct rxe *lazy = rxe_parse(pat, RXE_LAZY_SIZE);
+        if (RXE_INT_BITS) {
+            check_int("a deferred count is refused as well", RXE_EXCEEDS_INT,
+                      rxe_error(lazy));
+        } else {
+            char a[64], b[64];
+            mpz_t at;
+            long e;
+            check_int("the count is put off", 1, lazy->deferred > 0);
+            mpz_init_set_ui(at, 0);
+            rxe_seek(eager, at);
+            rxe_seek(lazy, at);
+            int same = 1;
+            for (int i = 0; i < 30; i++) {
+                rxe_current(a, sizeof a - 1, eager);
+                rxe_current(b, sizeof b - 1, lazy);
+                same &= !strcmp(a, b);
+                rxe_iterate(eager);
+                rxe_iterate(lazy);
+            }
+            check_int("it walks as it would have", 1, same);
+            mpz_ui_pow_ui(at, 26, 77);
+            rxe_seek(eager, at);
+            check_int("a seek short of the count", 0, rxe_seek(lazy, at));
+            rxe_current(a, sizeof a - 1, eager);
+            rxe_current(b, sizeof b - 1, lazy);
+            check("lands where it would have", a, b);
+            check_int("and leaves it put off", 1, lazy->deferred > 0);
+            double d = mpz_get_d_2exp(&e, eager->nitems);
+            double exact = e + log2(d);
+            check_int("the estimate is close", 1,
+                      fabs(rxe_log2_size(lazy) - exact) < 1e-6 * exact);
+            rxe_force_size(lazy);
+            check_int("forced, nothing is put off", 0, lazy->deferred);
+            check_int("and the count is exact", 0,
+                      mpz_cmp(eager->nitems, lazy->nitems));
+            mpz_add_ui(at, eager->nitems, 0);
+            check_int("so a seek past it is refused", 1, rxe_seek(lazy, at));
+            mpz_clear(at);
+        }
+        rxe_free(eager);
+        rxe_free(lazy);
+        struct rxe *rxe = rxe_parse("[ab]{3,5}", RXE_LAZY_SIZE);
+        check_int("a small count is not put off", 0, rxe->deferred);
+        check_int("its log is its count's", 1,
+                  fabs(rxe_log2_size(rxe) - log2(56)) < 1e-9);
+        rxe_free(rxe);
+        rxe = rxe_parse("[ab]+", RXE_LAZY_SIZE);
+        check_int("an endless set is infinitely large", 1,
+                  isinf(rxe_log2_size(rxe)) && rxe_log2_size(rxe) > 0);
+        rxe_free(rxe);
+
+        // Cursors made at once on several threads over one lazy parse: the
+        // first to need the counts settles them, and the rest wait for it.
+        rxe = rxe_parse("([a-z]{2}|q){1,40000}", RXE_LAZY_SIZE);
+        check_int("a wide count is put off", 1, rxe->deferred > 0);
+        struct lazy_walk w[4];
+        pthread_t tid[4];
+        for (int i = 0; i < 4; i++) {
+            w[i].rxe = rxe;
+            pthread_create(&tid[i], NULL, lazy_walker, &w[i]);
+        }
+        for (int i = 0; i < 4; i++) pthread_join(tid[i], NULL);
+        if (!exceeds_int(rxe)) {
+            check_int("cursors made together settle it", 0, rxe->deferred);
+            int agree = w[0].got[0] != 0;
+            for (int i = 1; i < 4; i++) agree &= !strcmp(w[0].got, w[i].got);
+            check_int("and all land on the one member", 1, agree);
+        }
+        rxe_free(rxe);
+    }
+
+    // The integer shim: exact under GMP; under a machine word, an operation
+    // that would wrap pins at the end of the range and raises the flag, and a
+    // finite set the word cannot count is refused when it is parsed. [A-Z]{13}
+    // is the largest run of capitals a 64-bit count holds.
+    {
+        rxe_int a, b, q, r;
+        mpz_t big;
+        ri_init_set_ui(a, 26);
+        ri_init(b);
+        ri_init(q);
+        ri_init(r);
+        mpz_init(big);
+        rxe_int_overflow = 0;
+        ri_pow_ui(b, a, 13);
+        ri_get_mpz(big, b);
+        check("26^13 fits every width", "2481152873203736576",
+              mpz_get_str(buf, 10, big));
+        check_int("and raises nothing", 0, rxe_int_overflow);
+        ri_tdiv_qr(q, r, b, a);
+        ri_mul(q, q, a);
+        check_int("26^13 / 26 * 26 comes back", 0, ri_cmp(q, b));
+        check_int("with nothing left over", 0, ri_sgn(r));
+        ri_pow_ui(b, a, 28);
+        ri_sub(r, a, b);
+        ri_get_mpz(big, b);
+        struct rxe *rxe = rxe_parse("[A-Z]{13}", 0);
+        check_int("[A-Z]{13} parses", RXE_OK, rxe->status);
+        rxe_free(rxe);
+        rxe = rxe_parse("[A-Z]{28}", 0);
+        if (RXE_INT_BITS) {
+            check_int("26^28 saturates", 1, rxe_int_overflow);
+            check_int("to the top of the word", (long)RXE_INT_BITS,
+                      (long)mpz_sizeinbase(big, 2));
+            check_int("26 - 26^28 stops at zero", 0, ri_sgn(r));
+            check_int("[A-Z]{28} is refused", RXE_EXCEEDS_INT, rxe->status);
+        } else {
+            check("26^28 is exact", "4.16e+39", (sprintf(buf, "%.2e",
+                  mpz_get_d(big)), buf));
+            check_int("without raising anything", 0, rxe_int_overflow);
+            check_int("[A-Z]{28} parses", RXE_OK, rxe->status);
+        }
+        rxe_free(rxe);
+        rxe = rxe_parse("[A-Z]{14}", 0);
+        check_int("[A-Z]{14} fits all but a 64-bit word",
+                  RXE_INT_BITS == 64 ? RXE_EXCEEDS_INT : RXE_OK, rxe->status);
+        rxe_free(rxe);
+        rxe = rxe_parse("[A-Z]*", 0);
+        check_int("an endless set is not refused", RXE_OK, rxe->status);
+        // But its index stops at the top of the word: the last index there
+        // seeks, and both the step past it and a seek past it are the end.
+        mpz_set_ui(big, 1);
+        mpz_mul_2exp(big, big, RXE_INT_BITS ? RXE_INT_BITS : 128);
+        mpz_sub_ui(big, big, 1);
+        check_int("the top of the word seeks", 0, rxe_seek(rxe, big));
+        check_int("and steps on under GMP alone", RXE_INT_BITS ? 1 : 0,
+                  rxe_iterate(rxe));
+        mpz_add_ui(big, big, 1);
+        check_int("as a seek past it does", RXE_INT_BITS ? 1 : 0,
+                  rxe_seek(rxe, big));
+        rxe_free(rxe);
+        rxe_int_overflow = 0;
+        ri_clear(a);
+        ri_clear(b);
+        ri_clear(q);
+        ri_clear(r);
+        mpz_clear(big);
+    }
+
     printf("api: %s\n", failures ? "FAILURES ABOVE" : "all checks passed");
     return failures ? 1 : 0;
 }
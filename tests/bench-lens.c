@@ -0,0 +1,151 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+// A speed comparison, not a test: counting by length with the convolutions
+// done term by term against done as one multiplication of packed integers
+// (see convolve() in lens.c). Each row counts a fresh parse of the set at one
+// length, which builds every table up to it, both ways; the last column is
+// how many times faster the packed one was. Where it passes 1 is where
+// LENS_KRONECKER_MIN should sit. A way that took longer than LIMIT seconds is
+// not run at the longer lengths.
+//
+// Then a second table, rendering: members per second of a few masks walked a
+// member at a time (rxe_current_delta and rxe_iterate), and in batches with a last
+// one-byte class laid as lanes both by the copying loop and by vector stores
+// (see lay_lanes() in plan.c). Where the build has no vector path the last
+// two columns are the same code. The library is built without optimisation
+// unless CFLAGS says otherwise, and intrinsics at -O0 are slower than the loop
+// they replace, so for numbers that mean anything:
+//
+//   make clean && make CFLAGS=-O2 bench-lens
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rxe.h"
+#include "lens.h"
+#include "plan.h"
+
+#define LIMIT 5.0
+#define BATCH 4096
+#define MEMBERS 20000000
+
+static double count_once(const char *pat, int L, int kmin)
+{
+    struct timespec t0, t1;
+    mpz_t c;
+    mpz_init(c);
+    rxe_lens_kronecker_min = kmin;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    struct rxe *rxe = rxe_parse(pat, 0);
+    rxe_count_at_length(c, rxe, L);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    rxe_free(rxe);
+    mpz_clear(c);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+// Best of a few, so that short runs are not all noise.
+static double best(const char *pat, int L, int kmin)
+{
+    double t = count_once(pat, L, kmin);
+    for (int i = 0; i < 4 && t < 0.5; i++) {
+        double u = count_once(pat, L, kmin);
+        if (u < t) t = u;
+    }
+    return t;
+}
+
+// Members per second over the first MEMBERS of 'pat', walked a member at a
+// time when 'lanes' is -1 (rxe_current_delta and rxe_iterate, the fastest way
+// a member at a time), else in batches with rxe_plan_vector_lanes set to
+// it. The checksum keeps the compiler from dropping the walk, and lets the
+// ways be checked against each other.
+static double render_rate(const char *pat, int lanes, unsigned long *sum)
+{
+    static char buf[BATCH * 32];
+    static size_t offsets[BATCH + 1];
+    struct timespec t0, t1;
+    struct rxe *rxe = rxe_parse(pat, 0);
+    unsigned long h = 0, done = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (lanes < 0) {
+        for (; done < MEMBERS; done++) {
+            const char *m = rxe_current_delta(buf, 64, rxe);
+            h = h * 31 + (unsigned char)m[strlen(m) - 1];
+            if (rxe_iterate(rxe)) break;
+        }
+    } else {
+        rxe_plan_vector_lanes = lanes;
+        while (done < MEMBERS) {
+            size_t got;
+            size_t n = MEMBERS - done < BATCH ? MEMBERS - done : BATCH;
+            int rc = rxe_render_batch(rxe, n, buf, sizeof buf, offsets, &got);
+            for (size_t i = 0; i < got; i++)
+                h = h * 31 + (unsigned char)buf[offsets[i + 1] - 1];
+            done += got;
+            if (rc != RXE_FOREACH_STOP) break;
+        }
+        rxe_plan_vector_lanes = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    rxe_free(rxe);
+    *sum = h;
+    return done / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+static void render_table(void)
+{
+    const char *pat[] = { "[a-z0-9]{6}", "[A-Za-z0-9]{8}", "pass[0-9]{4}[a-z]",
+                          "[a-f0-9]{16}", "[a-z]{2}-[0-9]{20}" };
+    printf("\nrendering, millions of members per second\n"
+           "  %-22s %10s %10s %10s %8s\n", "", "one-by-one", "lane loop",
+           "vector", "speedup");
+    for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+        unsigned long h0, h1, h2;
+        double a = render_rate(pat[p], -1, &h0);
+        double b = render_rate(pat[p], 0, &h1);
+        double c = render_rate(pat[p], 1, &h2);
+        printf("  %-22s %10.1f %10.1f %10.1f %8.2f%s\n", pat[p], a / 1e6,
+               b / 1e6, c / 1e6, c / b,
+               h0 == h1 && h1 == h2 ? "" : "  MISMATCH");
+    }
+}
+
+int main(void)
+{
+    const char *pat[] = { "(\\w+ )*", "[a-z]*-[0-9]*", "(ab|[c-f]{1,3})+" };
+    printf("counting by length, best of 5, seconds\n");
+    for (size_t p = 0; p < sizeof pat / sizeof *pat; p++) {
+        int slow = 0, fast = 0;
+        printf("\n%s\n  %6s %12s %12s %8s\n", pat[p], "L", "term-wise",
+               "packed", "speedup");
+        for (int L = 4; L <= 4096; L *= 2) {
+            double a = slow ? -1 : best(pat[p], L, INT_MAX);
+            double b = fast ? -1 : best(pat[p], L, 1);
+            if (a > LIMIT) slow = 1;
+            if (b > LIMIT) fast = 1;
+            printf("  %6d ", L);
+            if (a < 0) printf("%12s ", "-"); else printf("%12.6f ", a);
+            if (b < 0) printf("%12s ", "-"); else printf("%12.6f ", b);
+            if (a < 0 || b < 0) printf("%8s\n", "-");
+            else printf("%8.2f\n", a / b);
+        }
+    }
+    render_table();
+    return 0;
+}
@@ -12,6 +12,13 @@
 #   2. Threaded, how far does rxedup pull ahead? This is the thing rxenum cannot
 #      do. rxe_foreach shards on the index range, so -j hands each core a slice.
 #
+# And a third, on startup rather than throughput:
+#
+#   3. How long does a worker take to reach its first member, parsing a
+#      dictionary pattern itself against loading an image of it (--save,
+#      --load)? Under -u the parse builds an automaton, which the image
+#      carries, so a loaded worker skips it.
+#
 # Runs are sized to take about ten seconds single-threaded: below that, OS
 # scheduling noise swamps the numbers. REPS best-of runs guard what noise is
 # left. Set REPS, or point RXENUM/RXEDUP at other builds.
@@ -67,4 +74,24 @@ echo
 echo "[a-z]{5} -- thread scaling (distinct-heavy, ~2 GiB, serial merge)"
 for j in 1 "$NP"; do row "rxedup -j$j" "$RXEDUP -j$j -c 0 '[a-z]{5}'"; done
 
+# ---- 3. startup: parse against load ----------------------------------------
+# 3000 made-up words, one or more of them in a row. Each row takes the first
+# member and stops, so it times the parse or the load and nothing else.
+dict=$(mktemp -d)
+trap 'rm -rf "$dict"' EXIT
+awk 'BEGIN { srand(1); for (i = 0; i < 3000; i++) { w = "";
+     n = 3 + int(rand() * 10); for (j = 0; j < n; j++)
+     w = w sprintf("%c", 97 + int(rand() * 26)); print w } }' |
+    sort -u > "$dict/w.dict"
+for pat in '[:w:]{1,2}' '[:w:]{1,3}'; do
+    "$RXENUM" -D "$dict" --save "$dict/plain.img" "$pat"
+    "$RXENUM" -D "$dict" -u --save "$dict/u.img" "$pat"
+    echo
+    echo "$pat -- time to the first member"
+    row "parse"                  "$RXENUM -D $dict -c 1 '$pat'"
+    row "--load"                 "$RXENUM -c 1 --load $dict/plain.img"
+    row "parse -u"               "$RXENUM -D $dict -u -c 1 '$pat'"
+    row "--load, saved with -u"  "$RXENUM -c 1 --load $dict/u.img"
+done
+
 echo
@@ -761,6 +761,118 @@ check "caret marks the brace of a{2,1}" '     ^' \
 check "caret reaches inside a group" '         ^' \
       "$("$RXENUM" 'ab(cd[ef)' 2>&1 | sed -n 3p)"
 
+echo "== length windows, --lengths and --length-histogram =="
+# A window walks only the members of those lengths, shortest first, for a
+# finite set as for an infinite one; -n numbers them by their place in that
+# order over the whole set, and -c still limits the count.
+t_opts 'aa/ab/ba/bb/' --lengths 2-2 '[ab]{1,3}'
+t_opts '3 aa/4 ab/5 ba/' -n -c 3 --lengths 2-3 '[ab]+'
+t_opts '00000/00001/' -c 2 --lengths 5- '\d+'
+t_opts 'aax/abx/bax/bbx/' --lengths 3 '[ab]{2}(x|yz)'
+t_opts '' --lengths 5-9 '[ab]{2}'
+# A backreference cannot be counted by length, so a finite one is walked in
+# its own order and filtered, and an endless one is refused.
+t_opts '2 ayya/' -n --lengths 4 '(a|bc)(x|yy)\1'
+t_rc 1 --lengths 2-4 '(a+)\1'
+t_rc 1 --lengths 4-2 'a+'
+t_rc 1 --lengths 2-4 -f 3 '[ab]+'
+# The histogram: one "length count" row per length that has members.
+t_opts '1 3/2 9/3 27/' --length-histogram '[a-c]{1,3}'
+t_opts '1 1/2 2/3 3/4 5/5 8/' --length-histogram --lengths 0-5 '(a|bb)+'
+t_opts '3 1/4 1/5 1/6 1/' --length-histogram '(a|bc)(x|yy)\1'
+t_opts '20 1,048,576/' --length-histogram '[ab]{20}'
+t_rc 1 --length-histogram 'a+'
+
+echo "== counts put off until they are needed =="
+# A repetition far too large to count is walked from its first members and
+# seeked into without the count; the members are the ones a set small enough
+# to count eagerly has at the same indices.
+t_opts 'a/b/c/' -c 3 '([a-z]{1,10000}){1,3000}'
+t_opts 'aa/ab/ac/' -f 27 -c 3 '([a-z]{1,40}){1,2000}'
+t_opts "$("$RXENUM" -f 100000000000000000000 -c 2 '([a-z]{1,40}){1,20}' | tr '\n' '/')" \
+       -f 100000000000000000000 -c 2 '([a-z]{1,40}){1,2000}'
+check "the count, forced" '~ 10^113232' \
+      "$("$RXENUM" '([a-z]{1,40}){1,2000}' | grep '^~ 10')"
+
+echo "== expression images =="
+# An image carries its dictionaries: loaded with no -D, and after the word list
+# on disk has changed, it numbers the set exactly as it did when saved.
+mkdir -p "$tmp/img"
+printf 'apple\nbanana\ncherry\n' > "$tmp/img/fruit.dict"
+"$RXENUM" -D "$tmp/img" --save "$tmp/img/f.img" '[:fruit:]{2}-[0-9]{2}'
+printf 'fig\n' > "$tmp/img/fruit.dict"
+check "a loaded image counts as the saved one did" '900' \
+      "$("$RXENUM" -~ --load "$tmp/img/f.img" 2>&1 | head -1)"
+check "and seeks to the same members" 'cherryapple-42/cherryapple-43/' \
+      "$("$RXENUM" -z -f 642 -c 2 --load "$tmp/img/f.img" 2>&1 | tr '\n' '/')"
+"$RXENUM" --save "$tmp/img/s.img" -i '(a|bc)+x'
+t_opts "$("$RXENUM" -i -c 6 '(a|bc)+x' | tr '\n' '/')" -c 6 --load "$tmp/img/s.img"
+# A distinct set's image carries its automaton, and loads to the same walk.
+"$RXENUM" --save "$tmp/img/u.img" -u '(a|ab|b){1,4}'
+t_opts "$("$RXENUM" -u -f 3 -c 6 '(a|ab|b){1,4}' | tr '\n' '/')" -f 3 -c 6 --load "$tmp/img/u.img"
+printf 'RXEIMAGE\002\000\000\000' > "$tmp/img/bad.img"
+check "a damaged image is refused" "$tmp/img/bad.img: not an expression image, or a damaged one" \
+      "$("$RXENUM" --load "$tmp/img/bad.img" 2>&1)"
+t_rc 1 --load "$tmp/img/s.img" '(a|bc)+x'
+
+echo "== filtered sets =="
+# The members a second regex matches, numbered as a set of their own: the
+# count and the walk agree with grep over the whole set, and -f and -c count
+# kept members only.
+check "a filtered count" '7' "$("$RXENUM" -F 'b.?b' '[a-c]{3}' | head -1)"
+check "is grep's count" "$("$RXENUM" -e '[a-e]{1,4}' | grep -Ec 'b.?b|ca')" \
+      "$("$RXENUM" -F 'b.?b|ca' '[a-e]{1,4}' | head -1)"
+t_opts 'cc/cd/dc/dd/' -e -X '[ab]' '[a-d]{2}'
+t_opts 'aba/abb/' -F a -f 3 -c 2 '[ab]{3}'
+t_opts 'b/ba/bb/' -e -F '^b' '[ab]{1,2}'
+t_opts 'not regular: a backreference, choice or policy/' -F '(a)\1' '[ab]{2}'
+t_rc 1 -F a 'a+'
+t_rc 1 -F a -X b '[ab]{2}'
+t_rc 1 -F a --lengths 1-2 '[ab]{1,3}'
+
+echo "== distinct members =="
+# Each string once, in byte order: what sort -u makes of the plain walk, with
+# the count, a seek and the permuted walk all over the distinct strings.
+check "one string spelt four million ways" '1' "$("$RXENUM" -u '(a|a){22}' | head -1)"
+check "the years spelt twice, once" '10,100' \
+      "$("$RXENUM" -u '(19|20)?[0-9]{2}|[0-9]{4}' | head -1)"
+check "the distinct walk is sort -u" \
+      "$("$RXENUM" -e '(foo|bar|fo|o){1,3}' | LC_ALL=C sort -u | tr '\n' '/')" \
+      "$("$RXENUM" -u -e '(foo|bar|fo|o){1,3}' | tr '\n' '/')"
+t_opts 'aab/ab/aba/' -u -z -f 2 -c 3 '(a|ab|b){1,2}'
+check "a permuted distinct walk has no repeat" '' \
+      "$("$RXENUM" -u -k key '(a|ab|b){1,4}' | sort | uniq -d)"
+t_opts 'byte order/' -u -Q '(a|b)c'
+t_opts 'a duplicate-free set must be finite/' -u 'a+'
+t_opts 'automaton too large/' -u '[ab]{0,40}a[ab]{17}'
+t_rc 1 -u -F a '[ab]{2}'
+# -U adds the distinct count under the count, or the reason there is none.
+t_opts '4,194,304/~ 10^6.62266/=  2^22/distinct 1/' -U '(a|a){22}'
+check "the years counted once" 'distinct 10,100' \
+      "$("$RXENUM" -U '(19|20)?[0-9]{2}|[0-9]{4}' | tail -1)"
+check "a filtered set's distinct count" 'distinct 11' \
+      "$("$RXENUM" -U -F a '(a|b|a){1,3}' | tail -1)"
+t_opts 'infinite/distinct infinite/' -U 'a+'
+check "no distinct count for a backreference" \
+      'distinct unknown: not regular: a backreference, choice or policy' \
+      "$("$RXENUM" -U '(a|b)\1' | tail -1)"
+check "nor for an automaton past the cap" 'distinct unknown: automaton too large' \
+      "$("$RXENUM" -U '[ab]{0,40}a[ab]{17}' | tail -1)"
+t_rc 1 -U -e '[ab]{2}'
+
+echo "== byte order =="
+# Every spelling kept, sorted: what sort makes of the plain walk, each string's
+# repeats side by side, with the count and a seek over all of them.
+check "the byte-order walk is sort" \
+      "$("$RXENUM" -e '(foo|bar|fo|o){1,3}' | LC_ALL=C sort | tr '\n' '/')" \
+      "$("$RXENUM" -b -e '(foo|bar|fo|o){1,3}' | tr '\n' '/')"
+check "one string spelt four million ways, counted each way" '4,194,304' \
+      "$("$RXENUM" -b '(a|a){22}' | head -1)"
+t_opts 'aa/aa/aa/' -b -z -f 2 -c 3 '(a|b|a){1,2}'
+t_opts 'byte order/' -b -Q '(a|b)c'
+t_opts 'a set in byte order must be finite/' -b 'a+'
+t_rc 1 -b -F a '[ab]{2}'
+
 echo "== known divergences, still open =="
 
 printf '\n%d passed, %d failed' "$pass" "$fail"
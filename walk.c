@@ -0,0 +1,110 @@
+/*
+ * librxe - a library for enumerating sets described by regexes, version 1.1.0
+ *          (C) 2011 Marco "Kiko" Carnut <kiko at postcogito dot org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * http://www.gnu.org/licenses/gpl-2.0.html for details.
+ *
+ */
+
+/*
+ * walk -- the tree's walk code again, for a walk that is not the tree's.
+ *
+ * A cursor without a plan walks the shared tree with every field the walk
+ * writes kept in its own struct rxe_walk. The code that seeks, steps and
+ * renders is the tree's own, from the files included below, built a second
+ * time with RXE_CURSOR_WALK: RS, AS and NS then find each part's slot in the
+ * walk the call was handed, and whatever in those files is not walk code is
+ * left out of this build. Every function of it that has a namesake in the
+ * first build is renamed here, before any header declares it, so the two
+ * link side by side and each calls its own.
+ *
+ * Building it twice is what keeps the tree's walk where it was. Asking at every
+ * access whose walk it is -- or passing the walk down to every function that
+ * touches one -- costs the plain rxe_seek and rxe_iterate a tenth of their
+ * throughput, for callers that never made a cursor.
+ */
+
+#define RXE_CURSOR_WALK
+
+#define rxe_seek                   cw_rxe_seek
+#define rxe_iterate                cw_rxe_iterate
+#define rxe_advance                cw_rxe_advance
+#define rxe_current                cw_rxe_current
+#define rxe_current_delta          cw_rxe_current_delta
+#define rxe_alt_split              cw_rxe_alt_split
+#define rxe_node_tmp               cw_rxe_node_tmp
+#define rxe_repeat_reserve         cw_rxe_repeat_reserve
+#define rxe_repeat_digit           cw_rxe_repeat_digit
+#define rxe_repeat_set             cw_rxe_repeat_set
+#define rxe_repeat_set_ui          cw_rxe_repeat_set_ui
+#define rxe_repeat_bump            cw_rxe_repeat_bump
+#define rxe_repeat_seek            cw_rxe_repeat_seek
+#define rxe_repeat_iterate         cw_rxe_repeat_iterate
+#define rxe_repeat_advance         cw_rxe_repeat_advance
+#define rxe_repeat_memo            cw_rxe_repeat_memo
+#define rxe_comb_seek              cw_rxe_comb_seek
+#define rxe_comb_iterate           cw_rxe_comb_iterate
+#define rxe_policy_seek            cw_rxe_policy_seek
+#define rxe_policy_iterate         cw_rxe_policy_iterate
+#define rxe_shuffle_seek           cw_rxe_shuffle_seek
+#define rxe_shuffle_iterate        cw_rxe_shuffle_iterate
+#define rxe_lens_rxe               cw_rxe_lens_rxe
+#define rxe_lens_alt               cw_rxe_lens_alt
+#define rxe_count_at_length        cw_rxe_count_at_length
+#define rxe_seek_at_length         cw_rxe_seek_at_length
+#define rxe_repeat_seek_at_length  cw_rxe_repeat_seek_at_length
+#define rxe_seek_shortlex          cw_rxe_seek_shortlex
+#define rxe_step_shortlex          cw_rxe_step_shortlex
+
+// The walk the running call was handed. Only this file's build reads it.
+struct rxe_walk;
+static _Thread_local struct rxe_walk *rxe_walking;
+
+#include "rxe.c"
+#include "rxe_alt.c"
+#include "rxe_node.c"
+#include "repeat.c"
+#include "comb.c"
+#include "policy.c"
+#include "permute.c"
+#include "lens.c"
+
+int rxe_walk_seek(struct rxe_walk *walk, struct rxe *rxe, mpz_t pos)
+{
+    rxe_walking = walk;
+    return rxe_seek(rxe,pos);
+}
+
+int rxe_walk_iterate(struct rxe_walk *walk, struct rxe *rxe)
+{
+    rxe_walking = walk;
+    return rxe_iterate(rxe);
+}
+
+int rxe_walk_advance(struct rxe_walk *walk, struct rxe *rxe, long delta)
+{
+    rxe_walking = walk;
+    return rxe_advance(rxe,delta);
+}
+
+char *rxe_walk_current(struct rxe_walk *walk, char *str, int maxlen,
+                       struct rxe *rxe)
+{
+    rxe_walking = walk;
+    return rxe_current(str,maxlen,rxe);
+}
+
+char *rxe_walk_current_delta(struct rxe_walk *walk, char *str, int maxlen,
+                             struct rxe *rxe)
+{
+    rxe_walking = walk;
+    return rxe_current_delta(str,maxlen,rxe);
+}